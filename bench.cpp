@@ -0,0 +1,319 @@
+// resampler benchmark, sweeps filters, scale factors, image sizes, channel counts and resampling orders.
+// See unlicense.org text at the bottom of resampler.h
+// Example usage: bench.exe [-csv] [-quick] [-filter name] [-runs n] [-out file] [-filter_table]
+// The results are written as JSON (default) or CSV, one record per case and resampling order:
+//    mpix_per_sec - destination pixels produced per second
+//    ns_per_tap - time per multiply-add (taps counted like Resampler::Stats does)
+//    xy_ops/yx_ops - the constructor's cost estimates for both orders, auto_order - the order it picked
+//    construct_us - time to construct the Resampler, contributor lists included
+// The summary reports how often the constructor's pick was slower than the other order, and the average construction time.
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <chrono>
+
+#include "resampler.h"
+
+struct Bench_Case
+{
+   const char* pFilter;
+   int src_width, src_height;
+   int dst_width, dst_height;
+   int num_channels;
+};
+
+struct Bench_Result
+{
+   double seconds;
+   long long taps;
+};
+
+static long long count_taps(const Resampler::Contrib_List* pClist, int n)
+{
+   long long t = 0;
+   for (int i = 0; i < n; i++)
+      t += pClist[i].n;
+   return t;
+}
+
+// Best time of num_runs passes over the whole image, excluding construction (the contributor lists are cached anyway).
+static bool run_case(const Bench_Case& c, const std::vector<float>& src, bool delay_x_resample, int num_runs, Bench_Result& result)
+{
+   Resampler resampler(c.src_width, c.src_height, c.dst_width, c.dst_height, c.num_channels, Resampler::BOUNDARY_CLAMP, 0.0f, 1.0f, c.pFilter);
+   if ((resampler.status() != Resampler::STATUS_OKAY) || (!resampler.set_delay_x_resample(delay_x_resample)))
+      return false;
+
+   const long long x_taps = count_taps(resampler.get_clist_x(), c.dst_width);
+   const long long y_taps = count_taps(resampler.get_clist_y(), c.dst_height);
+   if (delay_x_resample)
+      result.taps = (y_taps * c.src_width + x_taps * c.dst_height) * c.num_channels;
+   else
+      result.taps = (x_taps * c.src_height + y_taps * c.dst_width) * c.num_channels;
+
+   const size_t src_pitch = (size_t)c.src_width * c.num_channels;
+   volatile float sink = 0.0f;
+
+   result.seconds = 1e+30;
+   for (int run = 0; run < num_runs; run++)
+   {
+      resampler.restart();
+
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      int dst_y = 0;
+      for (int src_y = 0; src_y < c.src_height; src_y++)
+      {
+         if (!resampler.put_line(&src[src_y * src_pitch]))
+            return false;
+
+         while (const float* pOutput = resampler.get_line())
+         {
+            sink = sink + pOutput[0];
+            dst_y++;
+         }
+      }
+
+      const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (dst_y != c.dst_height)
+         return false;
+
+      if (t < result.seconds)
+         result.seconds = t;
+   }
+
+   return true;
+}
+
+// Best time of num_runs constructions in microseconds, with the contributor list cache disabled so each one creates its lists.
+static double time_construction(const Bench_Case& c, int num_runs)
+{
+   Resampler::set_clist_cache_max_size(0);
+
+   double best = 1e+30;
+   for (int run = 0; run < num_runs; run++)
+   {
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      Resampler resampler(c.src_width, c.src_height, c.dst_width, c.dst_height, c.num_channels, Resampler::BOUNDARY_CLAMP, 0.0f, 1.0f, c.pFilter);
+
+      const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      if (t < best)
+         best = t;
+   }
+
+   Resampler::set_clist_cache_max_size(RESAMPLER_CLIST_CACHE_SIZE);
+
+   return best * 1e+6;
+}
+
+// The cost estimates of Resampler's constructor, see Resampler::init().
+static void calc_ops(const Bench_Case& c, long long& xy_ops, long long& yx_ops, bool& auto_delay_x_resample)
+{
+   Resampler resampler(c.src_width, c.src_height, c.dst_width, c.dst_height, c.num_channels, Resampler::BOUNDARY_CLAMP, 0.0f, 1.0f, c.pFilter);
+
+   const long long x_ops = count_taps(resampler.get_clist_x(), c.dst_width);
+   const long long y_ops = count_taps(resampler.get_clist_y(), c.dst_height);
+
+   xy_ops = x_ops * c.src_height + (4 * y_ops * c.dst_width) / 3;
+   yx_ops = (4 * y_ops * c.src_width) / 3 + x_ops * c.dst_height;
+
+   auto_delay_x_resample = resampler.get_delay_x_resample();
+}
+
+static void print_usage()
+{
+   printf("Usage: bench [-csv] [-quick] [-filter name] [-runs n] [-out file] [-filter_table]\n");
+   printf(" -csv: Write CSV instead of JSON\n");
+   printf(" -quick: Small images and a few filters only\n");
+   printf(" -filter: Only benchmark this filter\n");
+   printf(" -runs: Passes per case, the best time is reported (default 3)\n");
+   printf(" -out: Write the results to a file instead of stdout\n");
+   printf(" -filter_table: Sample the filters from tables, see Resampler::set_filter_table()\n");
+}
+
+int main(int arg_c, char** arg_v)
+{
+   bool csv = false, quick = false;
+   const char* pOnly_filter = NULL;
+   const char* pOut_filename = NULL;
+   int num_runs = 3;
+
+   for (int i = 1; i < arg_c; i++)
+   {
+      if (!strcmp(arg_v[i], "-csv"))
+         csv = true;
+      else if (!strcmp(arg_v[i], "-quick"))
+         quick = true;
+      else if ((!strcmp(arg_v[i], "-filter")) && (i + 1 < arg_c))
+         pOnly_filter = arg_v[++i];
+      else if ((!strcmp(arg_v[i], "-runs")) && (i + 1 < arg_c))
+         num_runs = atoi(arg_v[++i]);
+      else if ((!strcmp(arg_v[i], "-out")) && (i + 1 < arg_c))
+         pOut_filename = arg_v[++i];
+      else if (!strcmp(arg_v[i], "-filter_table"))
+         Resampler::set_filter_table(true);
+      else
+      {
+         print_usage();
+         return EXIT_FAILURE;
+      }
+   }
+
+   if (num_runs < 1)
+      num_runs = 1;
+
+   FILE* pFile = stdout;
+   if (pOut_filename)
+   {
+      pFile = fopen(pOut_filename, "w");
+      if (!pFile)
+      {
+         printf("Failed opening output file: %s\n", pOut_filename);
+         return EXIT_FAILURE;
+      }
+   }
+
+   static const int s_full_sizes[][2] = { { 256, 256 }, { 1024, 768 }, { 1920, 1080 } };
+   static const int s_quick_sizes[][2] = { { 256, 256 } };
+   static const float s_scales[] = { 0.125f, 0.25f, 0.5f, 0.75f, 1.5f, 2.0f, 4.0f };
+   static const int s_channels[] = { 1, 3, 4 };
+   static const char* s_quick_filters[] = { "box", "tent", "mitchell", "lanczos4" };
+
+   const int (*pSizes)[2] = quick ? s_quick_sizes : s_full_sizes;
+   const int num_sizes = quick ? 1 : (int)(sizeof(s_full_sizes) / sizeof(s_full_sizes[0]));
+
+   std::vector<const char*> filters;
+   for (int i = 0; i < Resampler::get_filter_num(); i++)
+   {
+      const char* pName = Resampler::get_filter_name(i);
+      if ((pOnly_filter) && (strcmp(pName, pOnly_filter)))
+         continue;
+
+      if ((quick) && (!pOnly_filter))
+      {
+         bool found = false;
+         for (size_t j = 0; j < sizeof(s_quick_filters) / sizeof(s_quick_filters[0]); j++)
+            found = found || (!strcmp(pName, s_quick_filters[j]));
+         if (!found)
+            continue;
+      }
+
+      filters.push_back(pName);
+   }
+
+   if (filters.empty())
+   {
+      printf("Unknown filter: %s\n", pOnly_filter);
+      return EXIT_FAILURE;
+   }
+
+   if (csv)
+      fprintf(pFile, "filter,src_width,src_height,dst_width,dst_height,channels,order,auto_order,ms,mpix_per_sec,taps,ns_per_tap,xy_ops,yx_ops,construct_us\n");
+   else
+      fprintf(pFile, "{\n  \"kernel\": \"%s\",\n  \"results\": [", Resampler::get_kernel_name());
+
+   int num_cases = 0, num_mispredicted = 0, num_records = 0;
+   double total_mispredicted_loss = 0.0, total_construct_us = 0.0;
+
+   for (size_t f = 0; f < filters.size(); f++)
+   {
+      for (int s = 0; s < num_sizes; s++)
+      {
+         // Deterministic noise, so each case does the same work every time.
+         const int max_channels = s_channels[sizeof(s_channels) / sizeof(s_channels[0]) - 1];
+         std::vector<float> src((size_t)pSizes[s][0] * pSizes[s][1] * max_channels);
+         unsigned int seed = 1;
+         for (size_t i = 0; i < src.size(); i++)
+         {
+            seed = seed * 1664525 + 1013904223;
+            src[i] = (seed >> 8) * (1.0f / 16777216.0f);
+         }
+
+         for (size_t r = 0; r < sizeof(s_scales) / sizeof(s_scales[0]); r++)
+         {
+            for (size_t ch = 0; ch < sizeof(s_channels) / sizeof(s_channels[0]); ch++)
+            {
+               Bench_Case c;
+               c.pFilter = filters[f];
+               c.src_width = pSizes[s][0];
+               c.src_height = pSizes[s][1];
+               c.dst_width = (int)(c.src_width * s_scales[r] + .5f);
+               c.dst_height = (int)(c.src_height * s_scales[r] + .5f);
+               c.num_channels = s_channels[ch];
+
+               if ((c.dst_width < 1) || (c.dst_height < 1) || (c.dst_width > RESAMPLER_MAX_DIMENSION) || (c.dst_height > RESAMPLER_MAX_DIMENSION))
+                  continue;
+
+               long long xy_ops, yx_ops;
+               bool auto_delay_x_resample;
+               calc_ops(c, xy_ops, yx_ops, auto_delay_x_resample);
+
+               const double construct_us = time_construction(c, num_runs);
+
+               Bench_Result results[2];
+               bool okay = true;
+               for (int order = 0; order < 2; order++)
+                  okay = okay && run_case(c, src, order == 1, num_runs, results[order]);
+
+               if (!okay)
+               {
+                  fprintf(stderr, "Failed: %s %ix%i -> %ix%i, %i channels\n", c.pFilter, c.src_width, c.src_height, c.dst_width, c.dst_height, c.num_channels);
+                  continue;
+               }
+
+               for (int order = 0; order < 2; order++)
+               {
+                  const Bench_Result& res = results[order];
+                  const double mpix_per_sec = ((double)c.dst_width * c.dst_height) / (res.seconds * 1e+6);
+                  const double ns_per_tap = (res.seconds * 1e+9) / (double)res.taps;
+                  const char* pOrder = order ? "yx" : "xy";
+                  const char* pAuto_order = auto_delay_x_resample ? "yx" : "xy";
+
+                  if (csv)
+                  {
+                     fprintf(pFile, "%s,%i,%i,%i,%i,%i,%s,%s,%.4f,%.3f,%lld,%.4f,%lld,%lld,%.1f\n",
+                        c.pFilter, c.src_width, c.src_height, c.dst_width, c.dst_height, c.num_channels,
+                        pOrder, pAuto_order, res.seconds * 1e+3, mpix_per_sec, res.taps, ns_per_tap, xy_ops, yx_ops, construct_us);
+                  }
+                  else
+                  {
+                     fprintf(pFile, "%s\n    { \"filter\": \"%s\", \"src_width\": %i, \"src_height\": %i, \"dst_width\": %i, \"dst_height\": %i, \"channels\": %i, "
+                        "\"order\": \"%s\", \"auto_order\": \"%s\", \"ms\": %.4f, \"mpix_per_sec\": %.3f, \"taps\": %lld, \"ns_per_tap\": %.4f, \"xy_ops\": %lld, \"yx_ops\": %lld, \"construct_us\": %.1f }",
+                        num_records ? "," : "", c.pFilter, c.src_width, c.src_height, c.dst_width, c.dst_height, c.num_channels,
+                        pOrder, pAuto_order, res.seconds * 1e+3, mpix_per_sec, res.taps, ns_per_tap, xy_ops, yx_ops, construct_us);
+                  }
+                  num_records++;
+               }
+
+               const Bench_Result& picked = results[auto_delay_x_resample ? 1 : 0];
+               const Bench_Result& other = results[auto_delay_x_resample ? 0 : 1];
+
+               num_cases++;
+               total_construct_us += construct_us;
+               if (picked.seconds > other.seconds)
+               {
+                  num_mispredicted++;
+                  total_mispredicted_loss += picked.seconds / other.seconds - 1.0;
+               }
+            }
+         }
+      }
+   }
+
+   const double avg_loss = num_mispredicted ? (100.0 * total_mispredicted_loss / num_mispredicted) : 0.0;
+   const double avg_construct_us = num_cases ? (total_construct_us / num_cases) : 0.0;
+
+   if (csv)
+      fprintf(stderr, "%i cases, auto order slower in %i (by %.1f%% on average), %.1f us per construction\n", num_cases, num_mispredicted, avg_loss, avg_construct_us);
+   else
+   {
+      fprintf(pFile, "\n  ],\n  \"summary\": { \"cases\": %i, \"auto_order_slower\": %i, \"avg_slowdown_percent\": %.2f, \"avg_construct_us\": %.1f }\n}\n",
+         num_cases, num_mispredicted, avg_loss, avg_construct_us);
+   }
+
+   if (pFile != stdout)
+      fclose(pFile);
+
+   return EXIT_SUCCESS;
+}
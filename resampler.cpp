@@ -14,8 +14,32 @@
 #include <cfloat>
 #include <cassert>
 #include <cstring>
+#include <cstdio>
+#include <chrono>
+#include <mutex>
+#include <type_traits>
+#include <limits>
 #include "resampler.h"
 
+#if RESAMPLER_USE_SIMD
+   #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+      #define RESAMPLER_SSE2 1
+      #define RESAMPLER_AVX2 1
+      #include <immintrin.h>
+      #ifdef _MSC_VER
+         #include <intrin.h>
+         #define RESAMPLER_TARGET_AVX2
+         #define RESAMPLER_TARGET_F16C
+      #else
+         #define RESAMPLER_TARGET_AVX2 __attribute__((target("avx2")))
+         #define RESAMPLER_TARGET_F16C __attribute__((target("avx2,f16c")))
+      #endif
+   #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      #define RESAMPLER_NEON 1
+      #include <arm_neon.h>
+   #endif
+#endif
+
 #define resampler_assert assert
 
 static inline int resampler_range_check(int v, int h) { (void)h; resampler_assert((v >= 0) && (v < h)); return v; }
@@ -40,10 +64,9 @@ static inline int resampler_range_check(int v, int h) { (void)h; resampler_asser
 
 #define M_PI 3.14159265358979323846
 
-#define RR(value) Resampler::RR(value)
-
 // Float to int cast with truncation.
-static constexpr int cast_to_int(Resample_Real i)
+template<typename T>
+static constexpr int cast_to_int(T i)
 {
    return (int)i;
 }
@@ -68,97 +91,105 @@ static constexpr int posmod(int x, int y)
 // There is no need to make the filter function particularly fast, because it's
 // only called during initializing to create the X and Y axis contributor tables.
 
-#define BOX_FILTER_SUPPORT RR(0.5)
-static constexpr Resample_Real box_filter(Resample_Real t)    /* pulse/Fourier window */
+#define BOX_FILTER_SUPPORT (0.5)
+template<typename T>
+static constexpr T box_filter(T t)    /* pulse/Fourier window */
 {
    // make_clist() calls the filter function with t inverted (pos = left, neg = right)
-   if ((t >= RR(-0.5)) && (t < RR(0.5)))
-      return RR(1.0);
+   if ((t >= T(-0.5)) && (t < T(0.5)))
+      return T(1.0);
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-#define TENT_FILTER_SUPPORT RR(1.0)
-static constexpr Resample_Real tent_filter(Resample_Real t)   /* box (*) box, bilinear/triangle */
+#define TENT_FILTER_SUPPORT (1.0)
+template<typename T>
+static constexpr T tent_filter(T t)   /* box (*) box, bilinear/triangle */
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(1.0))
-      return RR(1.0) - t;
+   if (t < T(1.0))
+      return T(1.0) - t;
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-#define BELL_SUPPORT RR(1.5)
-static constexpr Resample_Real bell_filter(Resample_Real t)    /* box (*) box (*) box */
+#define BELL_SUPPORT (1.5)
+template<typename T>
+static constexpr T bell_filter(T t)    /* box (*) box (*) box */
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(.5))
-      return (RR(.75) - (t * t));
+   if (t < T(.5))
+      return (T(.75) - (t * t));
 
-   if (t < RR(1.5))
+   if (t < T(1.5))
    {
-      t = (t - RR(1.5));
-      return (RR(.5) * (t * t));
+      t = (t - T(1.5));
+      return (T(.5) * (t * t));
    }
 
-   return RR(0.0);
+   return T(0.0);
 }
 
-#define B_SPLINE_SUPPORT RR(2.0)
-static constexpr Resample_Real B_spline_filter(Resample_Real t)  /* box (*) box (*) box (*) box */
+#define B_SPLINE_SUPPORT (2.0)
+template<typename T>
+static constexpr T B_spline_filter(T t)  /* box (*) box (*) box (*) box */
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(1.0))
+   if (t < T(1.0))
    {
-      Resample_Real tt = t * t;
-      return ((RR(.5) * tt * t) - tt + RR(2.0 / 3.0));
+      T tt = t * t;
+      return ((T(.5) * tt * t) - tt + T(2.0 / 3.0));
    }
-   else if (t < RR(2.0))
+   else if (t < T(2.0))
    {
-      t = RR(2.0) - t;
-      return (RR(1.0 / 6.0) * (t * t * t));
+      t = T(2.0) - t;
+      return (T(1.0 / 6.0) * (t * t * t));
    }
 
-   return RR(0.0);
+   return T(0.0);
 }
 
 // Dodgson, N., "Quadratic Interpolation for Image Resampling"
-#define QUADRATIC_SUPPORT RR(1.5)
-static constexpr Resample_Real quadratic(Resample_Real t, const Resample_Real R)
+#define QUADRATIC_SUPPORT (1.5)
+template<typename T>
+static constexpr T quadratic(T t, const T R)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
-   if (t < QUADRATIC_SUPPORT)
+   if (t < T(QUADRATIC_SUPPORT))
    {
-      Resample_Real tt = t * t;
-      if (t <= RR(.5))
-         return (RR(-2.0) * R) * tt + RR(.5) * (R + RR(1.0));
+      T tt = t * t;
+      if (t <= T(.5))
+         return (T(-2.0) * R) * tt + T(.5) * (R + T(1.0));
       else
-         return (R * tt) + (RR(-2.0) * R - RR(.5)) * t + RR(3.0 / 4.0) * (R + RR(1.0));
+         return (R * tt) + (T(-2.0) * R - T(.5)) * t + T(3.0 / 4.0) * (R + T(1.0));
    }
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-static constexpr Resample_Real quadratic_interp_filter(Resample_Real t)
+template<typename T>
+static constexpr T quadratic_interp_filter(T t)
 {
-   return quadratic(t, RR(1.0));
+   return quadratic(t, T(1.0));
 }
 
-static constexpr Resample_Real quadratic_approx_filter(Resample_Real t)
+template<typename T>
+static constexpr T quadratic_approx_filter(T t)
 {
-   return quadratic(t, RR(.5));
+   return quadratic(t, T(.5));
 }
 
-static constexpr Resample_Real quadratic_mix_filter(Resample_Real t)
+template<typename T>
+static constexpr T quadratic_mix_filter(T t)
 {
-   return quadratic(t, RR(.8));
+   return quadratic(t, T(.8));
 }
 
 // Mitchell, D. and A. Netravali, "Reconstruction Filters in Computer Graphics."
@@ -169,61 +200,66 @@ static constexpr Resample_Real quadratic_mix_filter(Resample_Real t)
 // (0, 0.5)		- Equivalent to the Catmull-Rom Spline
 // (0, C)		- The family of Cardinal Cubic Splines
 // (B, 0)		- Duff's tensioned B-Splines.
-static constexpr Resample_Real mitchell(Resample_Real t, const Resample_Real B, const Resample_Real C)
+template<typename T>
+static constexpr T mitchell(T t, const T B, const T C)
 {
-   Resample_Real tt = t * t;
+   T tt = t * t;
 
-   if(t < RR(0.0))
+   if(t < T(0.0))
       t = -t;
 
-   if(t < RR(1.0))
+   if(t < T(1.0))
    {
-      t = (((RR(12.0) - RR(9.0) * B - RR(6.0) * C) * (t * tt))
-         + ((RR(-18.0) + RR(12.0) * B + RR(6.0) * C) * tt)
-         + (RR(6.0) - RR(2.0) * B));
+      t = (((T(12.0) - T(9.0) * B - T(6.0) * C) * (t * tt))
+         + ((T(-18.0) + T(12.0) * B + T(6.0) * C) * tt)
+         + (T(6.0) - T(2.0) * B));
 
-      return t / RR(6.0);
+      return t / T(6.0);
    }
-   else if (t < RR(2.0))
+   else if (t < T(2.0))
    {
-      t = (((RR(-1.0) * B - RR(6.0) * C) * (t * tt))
-         + ((RR(6.0) * B + RR(30.0) * C) * tt)
-         + ((RR(-12.0) * B - RR(48.0) * C) * t)
-         + (RR(8.0) * B + RR(24.0) * C));
+      t = (((T(-1.0) * B - T(6.0) * C) * (t * tt))
+         + ((T(6.0) * B + T(30.0) * C) * tt)
+         + ((T(-12.0) * B - T(48.0) * C) * t)
+         + (T(8.0) * B + T(24.0) * C));
 
-      return t / RR(6.0);
+      return t / T(6.0);
    }
 
-   return RR(0.0);
+   return T(0.0);
 }
 
-#define MITCHELL_SUPPORT RR(2.0)
-constexpr static Resample_Real mitchell_filter(Resample_Real t)
+#define MITCHELL_SUPPORT (2.0)
+template<typename T>
+constexpr static T mitchell_filter(T t)
 {
-   return mitchell(t, RR(1.0 / 3.0), RR(1.0 / 3.0));
+   return mitchell(t, T(1.0 / 3.0), T(1.0 / 3.0));
 }
 
-#define CATMULL_ROM_SUPPORT RR(2.0)
-constexpr static Resample_Real catmull_rom_filter(Resample_Real t)
+#define CATMULL_ROM_SUPPORT (2.0)
+template<typename T>
+constexpr static T catmull_rom_filter(T t)
 {
-   return mitchell(t, RR(0.0), RR(.5));
+   return mitchell(t, T(0.0), T(.5));
 }
 
-constexpr static Resample_Real sinc(Resample_Real x)
+template<typename T>
+constexpr static T sinc(T x)
 {
-   x = (x * RR(M_PI));
+   x = (x * T(M_PI));
 
-   if ((x < RR(0.01)) && (x > RR(-0.01)))
-      return RR(1.0) + x*x*(RR(-1.0/6.0) + x*x*RR(1.0/120.0));
+   if ((x < T(0.01)) && (x > T(-0.01)))
+      return T(1.0) + x*x*(T(-1.0/6.0) + x*x*T(1.0/120.0));
 
    return std::sin(x) / x;
 }
 
-static Resample_Real clean(Resample_Real t)
+template<typename T>
+static T clean(T t)
 {
-   constexpr Resample_Real EPSILON = RR(.0000125);
+   constexpr T EPSILON = T(.0000125);
    if (std::fabs(t) < EPSILON)
-      return RR(0.0);
+      return T(0.0);
    return t;
 }
 
@@ -232,93 +268,101 @@ static Resample_Real clean(Resample_Real t)
 //	return .42f + .50f * cos(M_PI*x) + .08f * cos(2.0f*M_PI*x);
 //}
 
-static Resample_Real blackman_exact_window(Resample_Real x)
+template<typename T>
+static T blackman_exact_window(T x)
 {
-   return RR(0.42659071) + RR(0.49656062) * std::cos(RR(M_PI)*x) + RR(0.07684867) * std::cos(RR(2.0 * M_PI)*x);
+   return T(0.42659071) + T(0.49656062) * std::cos(T(M_PI)*x) + T(0.07684867) * std::cos(T(2.0 * M_PI)*x);
 }
 
-#define BLACKMAN_SUPPORT RR(3.0)
-static Resample_Real blackman_filter(Resample_Real t)
+#define BLACKMAN_SUPPORT (3.0)
+template<typename T>
+static T blackman_filter(T t)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(3.0))
+   if (t < T(3.0))
       //return clean(sinc(t) * blackman_window(t / 3.0f));
-      return clean(sinc(t) * blackman_exact_window(t / RR(3.0)));
+      return clean(sinc(t) * blackman_exact_window(t / T(3.0)));
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-#define GAUSSIAN_SUPPORT RR(1.25)
-static Resample_Real gaussian_filter(Resample_Real t) // with blackman window
+#define GAUSSIAN_SUPPORT (1.25)
+template<typename T>
+static T gaussian_filter(T t) // with blackman window
 {
    if (t < 0)
       t = -t;
-   if (t < GAUSSIAN_SUPPORT)
-      return clean(std::exp(RR(-2.0) * t * t) * std::sqrt(RR(2.0 / M_PI)) * blackman_exact_window(t / GAUSSIAN_SUPPORT));
+   if (t < T(GAUSSIAN_SUPPORT))
+      return clean(std::exp(T(-2.0) * t * t) * std::sqrt(T(2.0 / M_PI)) * blackman_exact_window(t / T(GAUSSIAN_SUPPORT)));
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
 // Windowed sinc -- see "Jimm Blinn's Corner: Dirty Pixels" pg. 26.
-#define LANCZOS3_SUPPORT RR(3.0)
-static Resample_Real lanczos3_filter(Resample_Real t)
+#define LANCZOS3_SUPPORT (3.0)
+template<typename T>
+static T lanczos3_filter(T t)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(3.0))
-      return clean(sinc(t) * sinc(t / RR(3.0)));
+   if (t < T(3.0))
+      return clean(sinc(t) * sinc(t / T(3.0)));
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-#define LANCZOS4_SUPPORT RR(4.0)
-static Resample_Real lanczos4_filter(Resample_Real t)
+#define LANCZOS4_SUPPORT (4.0)
+template<typename T>
+static T lanczos4_filter(T t)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(4.0))
-      return clean(sinc(t) * sinc(t / RR(4.0)));
+   if (t < T(4.0))
+      return clean(sinc(t) * sinc(t / T(4.0)));
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-#define LANCZOS6_SUPPORT RR(6.0)
-static Resample_Real lanczos6_filter(Resample_Real t)
+#define LANCZOS6_SUPPORT (6.0)
+template<typename T>
+static T lanczos6_filter(T t)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(6.0))
-      return clean(sinc(t) * sinc(t / RR(6.0)));
+   if (t < T(6.0))
+      return clean(sinc(t) * sinc(t / T(6.0)));
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-#define LANCZOS12_SUPPORT RR(12.0)
-static Resample_Real lanczos12_filter(Resample_Real t)
+#define LANCZOS12_SUPPORT (12.0)
+template<typename T>
+static T lanczos12_filter(T t)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < RR(12.0))
-      return clean(sinc(t) * sinc(t / RR(12.0)));
+   if (t < T(12.0))
+      return clean(sinc(t) * sinc(t / T(12.0)));
    else
-      return RR(0.0);
+      return T(0.0);
 }
 
-static constexpr Resample_Real bessel0(Resample_Real x)
+template<typename T>
+static constexpr T bessel0(T x)
 {
-   constexpr Resample_Real EPSILON_RATIO = RR(1E-16);
+   constexpr T EPSILON_RATIO = T(1E-16);
 
-   Resample_Real xh = RR(0.5) * x;
-   Resample_Real sum = RR(1.0);
-   Resample_Real pow = RR(1.0);
+   T xh = T(0.5) * x;
+   T sum = T(1.0);
+   T pow = T(1.0);
    int k = 0;
-   Resample_Real ds = RR(1.0);
+   T ds = T(1.0);
    while (ds > sum * EPSILON_RATIO) // FIXME: Shouldn't this stop after X iterations for max. safety?
    {
       ++k;
@@ -330,63 +374,78 @@ static constexpr Resample_Real bessel0(Resample_Real x)
    return sum;
 }
 
-//static const Resample_Real KAISER_ALPHA = 4.0;
-static Resample_Real kaiser(Resample_Real alpha, Resample_Real half_width, Resample_Real x)
+//static const T KAISER_ALPHA = 4.0;
+template<typename T>
+static T kaiser(T alpha, T half_width, T x)
 {
-   const Resample_Real ratio = (x / half_width);
-   return bessel0(alpha * std::sqrt(Resample_Real(1) - ratio * ratio)) / bessel0(alpha);
+   const T ratio = (x / half_width);
+   return bessel0(alpha * std::sqrt(T(1) - ratio * ratio)) / bessel0(alpha);
 }
 
-#define KAISER_SUPPORT RR(3)
-static Resample_Real kaiser_filter(Resample_Real t)
+#define KAISER_SUPPORT (3)
+template<typename T>
+static T kaiser_filter(T t)
 {
-   if (t < RR(0.0))
+   if (t < T(0.0))
       t = -t;
 
-   if (t < KAISER_SUPPORT)
+   if (t < T(KAISER_SUPPORT))
    {
       // db atten
-      const Resample_Real att = RR(40.0);
-      const Resample_Real alpha = (Resample_Real)(exp(log(RR(0.58417) * (att - RR(20.96))) * RR(0.4)) + RR(0.07886) * (att - RR(20.96)));
-      //const Resample_Real alpha = KAISER_ALPHA;
-      return clean(sinc(t) * kaiser(alpha, KAISER_SUPPORT, t));
+      const T att = T(40.0);
+      const T alpha = (T)(exp(log(T(0.58417) * (att - T(20.96))) * T(0.4)) + T(0.07886) * (att - T(20.96)));
+      //const T alpha = KAISER_ALPHA;
+      return clean(sinc(t) * kaiser(alpha, T(KAISER_SUPPORT), t));
    }
 
-   return RR(0.0);
+   return T(0.0);
 }
 
-// filters[] is a list of all the available filter functions.
-static struct
+template<typename T>
+struct Filter
 {
    char name[32];
-   Resample_Real (*func)(Resample_Real t);
-   Resample_Real support;
-} g_filters[] =
-{
-   { "box",		            box_filter,			         BOX_FILTER_SUPPORT },
-   { "tent",			      tent_filter,		         TENT_FILTER_SUPPORT },
-   { "bell",			      bell_filter,	            BELL_SUPPORT },
-   { "b-spline",	         B_spline_filter,	         B_SPLINE_SUPPORT },
-   { "mitchell",	         mitchell_filter,	         MITCHELL_SUPPORT },
-   { "lanczos3",	         lanczos3_filter,	         LANCZOS3_SUPPORT },
-   { "blackman",	         blackman_filter,	         BLACKMAN_SUPPORT },
-   { "lanczos4",	         lanczos4_filter,	         LANCZOS4_SUPPORT },
-   { "lanczos6",	         lanczos6_filter,	         LANCZOS6_SUPPORT },
-   { "lanczos12",          lanczos12_filter,          LANCZOS12_SUPPORT },
-   { "kaiser",		         kaiser_filter,		         KAISER_SUPPORT },
-   { "gaussian",	         gaussian_filter,	         GAUSSIAN_SUPPORT },
-   { "catmullrom",         catmull_rom_filter,        CATMULL_ROM_SUPPORT },
-   { "quadratic_interp",   quadratic_interp_filter,   QUADRATIC_SUPPORT },
-   { "quadratic_approx",   quadratic_approx_filter,   QUADRATIC_SUPPORT },
-   { "quadratic_mix",      quadratic_mix_filter,      QUADRATIC_SUPPORT },
+   T (*func)(T t);
+   T support;
+   bool tabulate; // expensive enough to be sampled from a table, see Resampler_Base::set_filter_table()
 };
 
-static const int NUM_FILTERS = sizeof(g_filters) / sizeof(g_filters[0]);
+static const int NUM_FILTERS = 16;
+
+// get_filters<T>() is a list of all the available filter functions, evaluated in T precision.
+template<typename T>
+static Filter<T>* get_filters()
+{
+   static Filter<T> s_filters[] =
+   {
+      { "box",		            box_filter<T>,			         T(BOX_FILTER_SUPPORT), false },
+      { "tent",			      tent_filter<T>,		         T(TENT_FILTER_SUPPORT), false },
+      { "bell",			      bell_filter<T>,	            T(BELL_SUPPORT), false },
+      { "b-spline",	         B_spline_filter<T>,	         T(B_SPLINE_SUPPORT), false },
+      { "mitchell",	         mitchell_filter<T>,	         T(MITCHELL_SUPPORT), false },
+      { "lanczos3",	         lanczos3_filter<T>,	         T(LANCZOS3_SUPPORT), true },
+      { "blackman",	         blackman_filter<T>,	         T(BLACKMAN_SUPPORT), true },
+      { "lanczos4",	         lanczos4_filter<T>,	         T(LANCZOS4_SUPPORT), true },
+      { "lanczos6",	         lanczos6_filter<T>,	         T(LANCZOS6_SUPPORT), true },
+      { "lanczos12",          lanczos12_filter<T>,          T(LANCZOS12_SUPPORT), true },
+      { "kaiser",		         kaiser_filter<T>,		         T(KAISER_SUPPORT), true },
+      { "gaussian",	         gaussian_filter<T>,	         T(GAUSSIAN_SUPPORT), true },
+      { "catmullrom",         catmull_rom_filter<T>,        T(CATMULL_ROM_SUPPORT), false },
+      { "quadratic_interp",   quadratic_interp_filter<T>,   T(QUADRATIC_SUPPORT), false },
+      { "quadratic_approx",   quadratic_approx_filter<T>,   T(QUADRATIC_SUPPORT), false },
+      { "quadratic_mix",      quadratic_mix_filter<T>,      T(QUADRATIC_SUPPORT), false },
+   };
+
+   static_assert(sizeof(s_filters) / sizeof(s_filters[0]) == NUM_FILTERS, "NUM_FILTERS must match the filter table");
+
+   return s_filters;
+}
 
 /* Ensure that the contributing source sample is
 * within bounds. If not, reflect, clamp, or wrap.
 */
-int Resampler::reflect(const int j, const int src_x, const Boundary_Op boundary_op)
+template<typename Real, typename Storage>
+int Resampler_T<Real, Storage>::reflect(const int j, const int src_x, const Boundary_Op boundary_op)
 {
    int n;
 
@@ -424,634 +483,3331 @@ int Resampler::reflect(const int j, const int src_x, const Boundary_Op boundary_
    return n;
 }
 
-// The make_clist() method generates, for all destination samples,
+// The center of destination sample i in DISCRETE source coordinates (pixel center = 0.0f) is
+// ((2i + 1) * src_x - dst_x) / (2 * dst_x) + src_ofs. It's split with integer math into base, a whole number of source
+// samples, and center, the phase (plus the fraction of src_ofs): all the destination samples with the same phase get
+// exactly the same weights, so a dst_x/src_x scale factor has dst_x / gcd(src_x, dst_x) different sets of
+// weights away from the edges (see make_contrib_table()). num_phases > 0 rounds the phase to a multiple of 1 / num_phases.
+template<typename Real>
+static inline void get_sample_center(int i, int src_x, int dst_x, Real src_ofs, int num_phases, Real& center, int& base)
+{
+   const long long den = 2LL * dst_x;
+   const long long num = (2LL * i + 1) * src_x - dst_x;
+
+   long long b = num / den, r = num % den;
+   if (r < 0)
+   {
+      r += den;
+      b--;
+   }
+
+   Real phase;
+   if (num_phases > 0)
+   {
+      long long q = (2 * r * num_phases + den) / (2 * den);
+      if (q >= num_phases)
+      {
+         q -= num_phases;
+         b++;
+      }
+      phase = (Real)q / (Real)num_phases;
+   }
+   else
+      phase = (Real)r / (Real)den;
+
+   const Real ofs_base = std::floor(src_ofs);
+
+   center = phase + (src_ofs - ofs_base);
+   base = (int)b + cast_to_int(ofs_base);
+}
+
+// Greatest common divisor of two positive integers.
+static int gcd(int a, int b)
+{
+   while (b)
+   {
+      const int t = a % b;
+      a = b;
+      b = t;
+   }
+   return a;
+}
+
+// Filters sampled from a table (see Resampler_Base::set_filter_table()) have a sample every 1 / FILTER_TABLE_RESOLUTION
+// over [0, support], and are linearly interpolated in between. All the filters are even functions, so the table only
+// covers half of each filter.
+#define FILTER_TABLE_RESOLUTION (4096)
+
+// Number of samples of the table of a filter.
+template<typename Real>
+static inline int get_filter_table_size(Real filter_support)
+{
+   return (int)std::ceil(filter_support * FILTER_TABLE_RESOLUTION) + 1;
+}
+
+template<typename Real>
+static inline Real sample_filter_table(const Real* Ptable, int table_size, Real t)
+{
+   if (t < Real(0.0))
+      t = -t;
+
+   const Real x = t * (Real)FILTER_TABLE_RESOLUTION;
+   if (!(x < (Real)(table_size - 1)))
+      return Real(0.0);
+
+   const int i = (int)x;
+   return Ptable[i] + (Ptable[i + 1] - Ptable[i]) * (x - (Real)i);
+}
+
+// The make_clist() method generates, for the window_size destination samples starting at window_ofs (out of dst_x),
 // the list of all source samples with non-zero weighted contributions.
-Resampler::Contrib_List* Resampler::make_clist(
-   int src_x, int dst_x, Boundary_Op boundary_op,
-   Resample_Real (*Pfilter)(Resample_Real),
-   Resample_Real filter_support,
-   Resample_Real filter_scale,
-   Resample_Real src_ofs)
+// Destination samples with the same phase have the same weights (see get_sample_center()), and the phases repeat
+// every dst_x / gcd(src_x, dst_x) destination samples, so the filter is only evaluated for the first period, once per
+// tap. Pfilter_table is the filter's table or NULL to call Pfilter.
+template<typename Real, typename Storage>
+typename Resampler_T<Real, Storage>::Contrib_List* Resampler_T<Real, Storage>::make_clist(
+   int src_x, int dst_x, int window_ofs, int window_size, Boundary_Op boundary_op,
+   Real (*Pfilter)(Real),
+   const Real* Pfilter_table,
+   Real filter_support,
+   Real filter_scale,
+   Real src_ofs,
+   int num_phases)
 {
    typedef struct
    {
-      // The center of the range in DISCRETE coordinates (pixel center = 0.0f).
-      Resample_Real center;
+      // The center of the range relative to source sample base, see get_sample_center().
+      Real center;
+      int base;
       int left, right;
    } Contrib_Bounds;
 
-   int i, j, k, n, left, right;
-   Resample_Real total_weight;
-   Resample_Real xscale, center, half_width, weight;
+   int i, j, k, n, left, right, base;
+   Real total_weight;
+   Real xscale, center, half_width, weight;
    Contrib_List* Pcontrib;
    Contrib* Pcpool;
    Contrib* Pcpool_next;
    Contrib_Bounds* Pcontrib_bounds;
 
-   if ((Pcontrib = (Contrib_List*)calloc(dst_x, sizeof(Contrib_List))) == NULL)
+   resampler_assert((window_ofs >= 0) && (window_size > 0) && (window_ofs + window_size <= dst_x));
+
+   if ((Pcontrib = (Contrib_List*)calloc(window_size, sizeof(Contrib_List))) == NULL)
       return NULL;
 
-   Pcontrib_bounds = (Contrib_Bounds*)calloc(dst_x, sizeof(Contrib_Bounds));
+   Pcontrib_bounds = (Contrib_Bounds*)calloc(window_size, sizeof(Contrib_Bounds));
    if (!Pcontrib_bounds)
    {
       free(Pcontrib);
       return (NULL);
    }
 
-   const Resample_Real oo_filter_scale = RR(1.0) / filter_scale;
+   const Real oo_filter_scale = RR(1.0) / filter_scale;
 
-   constexpr Resample_Real NUDGE = RR(0.5);
-   xscale = dst_x / (Resample_Real)src_x;
-
-   if (xscale < RR(1.0))
-   {
-      int total; (void)total;
+   xscale = dst_x / (Real)src_x;
 
-      /* Handle case when there are fewer destination
-      * samples than source samples (downsampling/minification).
-      */
+   // When downsampling (minification) the filter is stretched to cover 1 / xscale source samples.
+   const bool downsampling = (xscale < RR(1.0));
+   const Real tap_scale = downsampling ? xscale : RR(1.0);
 
-      // stretched half width of filter
-      half_width = (filter_support / xscale) * filter_scale;
+   // stretched half width of filter
+   half_width = downsampling ? ((filter_support / xscale) * filter_scale) : (filter_support * filter_scale);
 
-      // Find the range of source sample(s) that will contribute to each destination sample.
+   const int table_size = Pfilter_table ? get_filter_table_size(filter_support) : 0;
 
-      for (i = 0, n = 0; i < dst_x; i++)
-      {
-         // Convert from discrete to continuous coordinates, scale, then convert back to discrete.
-         center = ((Resample_Real)i + NUDGE) / xscale;
-         center -= NUDGE;
-         center += src_ofs;
+   // Number of contributors of all the destination samples.
+   size_t total = 0;
 
-         left   = cast_to_int(std::floor(center - half_width));
-         right  = cast_to_int(std::ceil(center + half_width));
+   // Find the range of source sample(s) that will contribute to each destination sample.
 
-         Pcontrib_bounds[i].center = center;
-         Pcontrib_bounds[i].left		= left;
-         Pcontrib_bounds[i].right	= right;
+   for (i = 0; i < window_size; i++)
+   {
+      get_sample_center(window_ofs + i, src_x, dst_x, src_ofs, num_phases, center, base);
 
-         n += (right - left + 1);
-      }
+      left   = base + cast_to_int(std::floor(center - half_width));
+      right  = base + cast_to_int(std::ceil(center + half_width));
 
-      /* Allocate memory for contributors. */
+      Pcontrib_bounds[i].center = center;
+      Pcontrib_bounds[i].base = base;
+      Pcontrib_bounds[i].left		= left;
+      Pcontrib_bounds[i].right	= right;
 
-      if ((n == 0) || ((Pcpool = (Contrib*)calloc(n, sizeof(Contrib))) == NULL))
+      // Contrib_List::n can't count this many contributors (RESAMPLER_LARGE_IMAGES can).
+      if (right - left + 1 > (long long)(std::numeric_limits<Resample_Index>::max)())
       {
          free(Pcontrib);
          free(Pcontrib_bounds);
          return NULL;
       }
-      total = n;
-
-      Pcpool_next = Pcpool;
-
-      /* Create the list of source samples which
-      * contribute to each destination sample.
-      */
-
-      for (i = 0; i < dst_x; i++)
-      {
-         int max_k = -1;
-         Resample_Real max_w = RR(-1e+20);
-
-         center = Pcontrib_bounds[i].center;
-         left   = Pcontrib_bounds[i].left;
-         right  = Pcontrib_bounds[i].right;
-
-         Pcontrib[i].n = 0;
-         Pcontrib[i].p = Pcpool_next;
-         Pcpool_next += (right - left + 1);
-         resampler_assert ((Pcpool_next - Pcpool) <= total);
-
-         total_weight = 0;
-
-         for (j = left; j <= right; j++)
-            total_weight += (*Pfilter)((center - (Resample_Real)j) * xscale * oo_filter_scale);
-         const Resample_Real norm = static_cast<Resample_Real>(RR(1.0) / total_weight);
-
-         total_weight = 0;
-
-#if RESAMPLER_DEBUG
-         printf("%i: ", i);
-#endif
-
-         for (j = left; j <= right; j++)
-         {
-            weight = (*Pfilter)((center - (Resample_Real)j) * xscale * oo_filter_scale) * norm;
-            if (weight == RR(0.0))
-               continue;
-
-            n = reflect(j, src_x, boundary_op);
-
-#if RESAMPLER_DEBUG
-            printf("%i(%f), ", n, weight);
-#endif
-
-            /* Increment the number of source
-            * samples which contribute to the
-            * current destination sample.
-            */
 
-            k = Pcontrib[i].n++;
+      total += (right - left + 1);
+   }
 
-            Pcontrib[i].p[k].pixel  = (unsigned short)(n);       /* store src sample number */
-            Pcontrib[i].p[k].weight = weight; /* store src sample weight */
+   // Normalized weights of each tap of the first period of the window, destination sample i's begin at
+   // Pperiod_weights[Pperiod_ofs[i]]. Windows shorter than a period are all computed.
+   const int period = min(dst_x / gcd(src_x, dst_x), window_size);
 
-            total_weight += weight;          /* total weight of all contributors */
+   size_t* Pperiod_ofs = (size_t*)malloc((period + 1) * sizeof(size_t));
+   if (!Pperiod_ofs)
+   {
+      free(Pcontrib);
+      free(Pcontrib_bounds);
+      return NULL;
+   }
 
-            if (weight > max_w)
-            {
-               max_w = weight;
-               max_k = k;
-            }
-         }
+   Pperiod_ofs[0] = 0;
+   for (i = 0; i < period; i++)
+      Pperiod_ofs[i + 1] = Pperiod_ofs[i] + (Pcontrib_bounds[i].right - Pcontrib_bounds[i].left + 1);
 
-#if RESAMPLER_DEBUG
-         printf("\n\n");
-#endif
+   Real* Pperiod_weights = (Real*)malloc(Pperiod_ofs[period] * sizeof(Real));
 
-         //resampler_assert(Pcontrib[i].n);
-         //resampler_assert(max_k != -1);
-         if ((max_k == -1) || (Pcontrib[i].n == 0))
-         {
-            free(Pcpool);
-            free(Pcontrib);
-            free(Pcontrib_bounds);
-            return NULL;
-         }
+   /* Allocate memory for contributors. */
 
-         if (total_weight != RR(1.0))
-            Pcontrib[i].p[max_k].weight += RR(1.0) - total_weight;
-      }
+   if ((total == 0) || (!Pperiod_weights) || ((Pcpool = (Contrib*)calloc(total, sizeof(Contrib))) == NULL))
+   {
+      free(Pperiod_weights);
+      free(Pperiod_ofs);
+      free(Pcontrib);
+      free(Pcontrib_bounds);
+      return NULL;
    }
-   else
+
+   for (i = 0; i < period; i++)
    {
-      /* Handle case when there are more
-      * destination samples than source
-      * samples (upsampling).
-      */
+      center = Pcontrib_bounds[i].center;
+      base   = Pcontrib_bounds[i].base;
+      left   = Pcontrib_bounds[i].left;
+      right  = Pcontrib_bounds[i].right;
 
-      half_width = filter_support * filter_scale;
+      Real* Pweights = Pperiod_weights + Pperiod_ofs[i];
 
-      // Find the source sample(s) that contribute to each destination sample.
+      total_weight = 0;
 
-      for (i = 0, n = 0; i < dst_x; i++)
+      for (j = left; j <= right; j++)
       {
-         // Convert from discrete to continuous coordinates, scale, then convert back to discrete.
-         center = ((Resample_Real)i + NUDGE) / xscale;
-         center -= NUDGE;
-         center += src_ofs;
-
-         left   = cast_to_int(std::floor(center - half_width));
-         right  = cast_to_int(std::ceil(center + half_width));
+         const Real t = (center - (Real)(j - base)) * tap_scale * oo_filter_scale;
+         weight = Pfilter_table ? sample_filter_table(Pfilter_table, table_size, t) : (*Pfilter)(t);
 
-         Pcontrib_bounds[i].center = center;
-         Pcontrib_bounds[i].left		= left;
-         Pcontrib_bounds[i].right	= right;
-
-         n += (right - left + 1);
+         Pweights[j - left] = weight;
+         total_weight += weight;
       }
 
-      /* Allocate memory for contributors. */
+      const Real norm = static_cast<Real>(RR(1.0) / total_weight);
 
-      int total = n;
-      if ((total == 0) || ((Pcpool = (Contrib*)calloc(total, sizeof(Contrib))) == NULL))
-      {
-         free(Pcontrib);
-         free(Pcontrib_bounds);
-         return NULL;
-      }
+      for (j = left; j <= right; j++)
+         Pweights[j - left] *= norm;
+   }
 
-      Pcpool_next = Pcpool;
+   Pcpool_next = Pcpool;
 
-      /* Create the list of source samples which
-      * contribute to each destination sample.
-      */
+   /* Create the list of source samples which
+   * contribute to each destination sample.
+   */
 
-      for (i = 0; i < dst_x; i++)
-      {
-         int max_k = -1;
-         Resample_Real max_w = RR(-1e+20);
+   for (i = 0; i < window_size; i++)
+   {
+      int max_k = -1;
+      Real max_w = RR(-1e+20);
 
-         center = Pcontrib_bounds[i].center;
-         left   = Pcontrib_bounds[i].left;
-         right  = Pcontrib_bounds[i].right;
+      left   = Pcontrib_bounds[i].left;
+      right  = Pcontrib_bounds[i].right;
 
-         Pcontrib[i].n = 0;
-         Pcontrib[i].p = Pcpool_next;
-         Pcpool_next += (right - left + 1);
-         resampler_assert((Pcpool_next - Pcpool) <= total);
+      const int phase_i = i % period;
+      resampler_assert((Pcontrib_bounds[i].center == Pcontrib_bounds[phase_i].center) && (right - left == Pcontrib_bounds[phase_i].right - Pcontrib_bounds[phase_i].left));
 
-         total_weight = 0;
-         for (j = left; j <= right; j++)
-            total_weight += (*Pfilter)((center - (Resample_Real)j) * oo_filter_scale);
+      const Real* Pweights = Pperiod_weights + Pperiod_ofs[phase_i];
 
-         const Resample_Real norm = static_cast<Resample_Real>(RR(1.0) / total_weight);
+      Pcontrib[i].n = 0;
+      Pcontrib[i].p = Pcpool_next;
+      Pcpool_next += (right - left + 1);
+      resampler_assert ((size_t)(Pcpool_next - Pcpool) <= total);
 
-         total_weight = 0;
+      total_weight = 0;
 
 #if RESAMPLER_DEBUG
-         printf("%i: ", i);
+      printf("%i: ", i);
 #endif
 
-         for (j = left; j <= right; j++)
-         {
-            weight = (*Pfilter)((center - (Resample_Real)j) * oo_filter_scale) * norm;
-            if (weight == RR(0.0))
-               continue;
+      for (j = left; j <= right; j++)
+      {
+         weight = Pweights[j - left];
+         if (weight == RR(0.0))
+            continue;
 
-            n = reflect(j, src_x, boundary_op);
+         n = ((unsigned int)j < (unsigned int)src_x) ? j : reflect(j, src_x, boundary_op);
 
 #if RESAMPLER_DEBUG
-            printf("%i(%f), ", n, weight);
+         printf("%i(%f), ", n, weight);
 #endif
 
-            /* Increment the number of source
-            * samples which contribute to the
-            * current destination sample.
-            */
+         /* Increment the number of source
+         * samples which contribute to the
+         * current destination sample.
+         */
 
-            k = Pcontrib[i].n++;
+         k = Pcontrib[i].n++;
 
-            Pcontrib[i].p[k].pixel  = (unsigned short)(n);       /* store src sample number */
-            Pcontrib[i].p[k].weight = weight; /* store src sample weight */
+         Pcontrib[i].p[k].pixel  = (Resample_Index)(n);       /* store src sample number */
+         Pcontrib[i].p[k].weight = weight; /* store src sample weight */
 
-            total_weight += weight;          /* total weight of all contributors */
+         total_weight += weight;          /* total weight of all contributors */
 
-            if (weight > max_w)
-            {
-               max_w = weight;
-               max_k = k;
-            }
+         if (weight > max_w)
+         {
+            max_w = weight;
+            max_k = k;
          }
+      }
 
 #if RESAMPLER_DEBUG
-         printf("\n\n");
+      printf("\n\n");
 #endif
 
-         //resampler_assert(Pcontrib[i].n);
-         //resampler_assert(max_k != -1);
-
-         if ((max_k == -1) || (Pcontrib[i].n == 0))
-         {
-            free(Pcpool);
-            free(Pcontrib);
-            free(Pcontrib_bounds);
-            return NULL;
-         }
-
-         if (total_weight != RR(1.0))
-            Pcontrib[i].p[max_k].weight += RR(1.0) - total_weight;
+      //resampler_assert(Pcontrib[i].n);
+      //resampler_assert(max_k != -1);
+      if ((max_k == -1) || (Pcontrib[i].n == 0))
+      {
+         free(Pcpool);
+         free(Pperiod_weights);
+         free(Pperiod_ofs);
+         free(Pcontrib);
+         free(Pcontrib_bounds);
+         return NULL;
       }
+
+      if (total_weight != RR(1.0))
+         Pcontrib[i].p[max_k].weight += RR(1.0) - total_weight;
    }
 
 #if RESAMPLER_DEBUG
    printf("*******\n");
 #endif
 
+   free(Pperiod_weights);
+   free(Pperiod_ofs);
    free(Pcontrib_bounds);
 
    return Pcontrib;
 }
 
-void Resampler::resample_x(Sample* Pdst, const Sample* Psrc)
+template<typename Real>
+static void free_clist(Resampler_Contrib_List<Real>* Pclist)
 {
-   resampler_assert(Pdst);
-   resampler_assert(Psrc);
-
-   int i, j;
-   Sample total;
-   Contrib_List *Pclist = m_Pclist_x;
-   Contrib *p;
-
-   for (i = m_resample_dst_x; i > 0; i--, Pclist++)
-   {
-#if RESAMPLER_DEBUG_OPS
-      total_ops += Pclist->n;
-#endif
-
-      for (j = Pclist->n, p = Pclist->p, total = 0; j > 0; j--, p++)
-         total += Psrc[p->pixel] * p->weight;
-
-      *Pdst++ = total;
-   }
+   free(Pclist->p);
+   free(Pclist);
 }
 
-void Resampler::scale_y_mov(Sample* Ptmp, const Sample* Psrc, Resample_Real weight, int dst_x)
+template<typename Real>
+static void free_cached_clist(void* Pclist)
 {
-   int i;
-
-#if RESAMPLER_DEBUG_OPS
-   total_ops += dst_x;
-#endif
+   free_clist(static_cast<Resampler_Contrib_List<Real>*>(Pclist));
+}
 
-   // Not += because temp buf wasn't cleared.
-   for (i = dst_x; i > 0; i--)
-      *Ptmp++ = *Psrc++ * weight;
+// Approximate memory used by a contributor list created by make_clist().
+template<typename Real>
+static size_t get_clist_size(const Resampler_Contrib_List<Real>* Pclist, int dst_x)
+{
+   size_t size = dst_x * sizeof(Resampler_Contrib_List<Real>);
+   for (int i = 0; i < dst_x; i++)
+      size += Pclist[i].n * sizeof(Resampler_Contrib<Real>);
+   return size;
 }
 
-void Resampler::scale_y_add(Sample* Ptmp, const Sample* Psrc, Resample_Real weight, int dst_x)
+// Contributor list cache. The entries are kept in a list, there are only ever a handful of different sizes in use.
+// Lists with float and double weights share the cache, real_size tells them apart (and frees them).
+struct Clist_Cache_Entry
 {
-#if RESAMPLER_DEBUG_OPS
-   total_ops += dst_x;
-#endif
+   Clist_Cache_Entry* Pnext;
+
+   void* Pclist;
+   void (*Pfree)(void* Pclist);
+
+   int real_size;
+   int src_x, dst_x;
+   int window_ofs, window_size;
+   Resampler_Base::Boundary_Op boundary_op;
+   int filter_index;
+   double filter_scale;
+   double src_ofs;
+   int num_phases;
+   bool filter_table;
+
+   size_t size;
+   int ref_count;
+   unsigned long long last_used;
+};
 
-   for (int i = dst_x; i > 0; i--)
-      (*Ptmp++) += *Psrc++ * weight;
-}
+static std::mutex g_clist_cache_mutex;
 
-void Resampler::clamp(Sample* Pdst, int n)
+static struct
 {
-   while (n > 0)
+   Clist_Cache_Entry* Pfirst;
+   size_t size;
+   size_t max_size;
+   unsigned long long hits, misses, evictions;
+   unsigned long long clock;
+   int num_phases; // phase quantization of new lists, see set_filter_phases()
+   bool filter_table; // new lists sample the filters from tables, see set_filter_table()
+} g_clist_cache = { NULL, 0, RESAMPLER_CLIST_CACHE_SIZE, 0, 0, 0, 0, 0, false };
+
+// All clist_cache_*() functions must be called with g_clist_cache_mutex held.
+static Clist_Cache_Entry* clist_cache_find(int real_size, int src_x, int dst_x, int window_ofs, int window_size, Resampler_Base::Boundary_Op boundary_op, int filter_index, double filter_scale, double src_ofs, int num_phases, bool filter_table)
+{
+   for (Clist_Cache_Entry* e = g_clist_cache.Pfirst; e; e = e->Pnext)
    {
-      *Pdst = clamp_sample(*Pdst);
-      ++Pdst;
-      n--;
+      if ((e->real_size == real_size) && (e->src_x == src_x) && (e->dst_x == dst_x) && (e->window_ofs == window_ofs) && (e->window_size == window_size) && (e->boundary_op == boundary_op) && (e->filter_index == filter_index) &&
+          (e->filter_scale == filter_scale) && (e->src_ofs == src_ofs) && (e->num_phases == num_phases) && (e->filter_table == filter_table))
+         return e;
    }
+   return NULL;
 }
 
-void Resampler::resample_y(Sample* Pdst)
+static Clist_Cache_Entry* clist_cache_find(const void* Pclist)
 {
-   int i, j;
-   Sample* Psrc;
-   Contrib_List* Pclist = &m_Pclist_y[m_cur_dst_y];
-
-   Sample* Ptmp = m_delay_x_resample ? m_Ptmp_buf : Pdst;
-   resampler_assert(Ptmp);
-
-   /* Process each contributor. */
+   for (Clist_Cache_Entry* e = g_clist_cache.Pfirst; e; e = e->Pnext)
+      if (e->Pclist == Pclist)
+         return e;
+   return NULL;
+}
 
-   for (i = 0; i < Pclist->n; i++)
+// Frees the least recently used unreferenced lists until the cache is no larger than max_size.
+static void clist_cache_trim(size_t max_size)
+{
+   while (g_clist_cache.size > max_size)
    {
-      /* locate the contributor's location in the scan
-      * buffer -- the contributor must always be found!
-      */
-
-      for (j = 0; j < MAX_SCAN_BUF_SIZE; j++)
-         if (m_Pscan_buf->scan_buf_y[j] == Pclist->p[i].pixel)
-            break;
+      Clist_Cache_Entry** Pprev_lru = NULL;
 
-      resampler_assert(j < MAX_SCAN_BUF_SIZE);
+      for (Clist_Cache_Entry** Pprev = &g_clist_cache.Pfirst; *Pprev; Pprev = &(*Pprev)->Pnext)
+         if (((*Pprev)->ref_count == 0) && ((!Pprev_lru) || ((*Pprev)->last_used < (*Pprev_lru)->last_used)))
+            Pprev_lru = Pprev;
 
-      Psrc = m_Pscan_buf->scan_buf_l[j];
+      if (!Pprev_lru)
+         break;
 
-      if (!i)
-         scale_y_mov(Ptmp, Psrc, Pclist->p[i].weight, m_intermediate_x);
-      else
-         scale_y_add(Ptmp, Psrc, Pclist->p[i].weight, m_intermediate_x);
+      Clist_Cache_Entry* e = *Pprev_lru;
+      *Pprev_lru = e->Pnext;
 
-      /* If this source line doesn't contribute to any
-      * more destination lines then mark the scanline buffer slot
-      * which holds this source line as free.
-      * (The max. number of slots used depends on the Y
-      * axis sampling factor and the scaled filter width.)
-      */
+      g_clist_cache.size -= e->size;
+      g_clist_cache.evictions++;
 
-      if (--m_Psrc_y_count[resampler_range_check(Pclist->p[i].pixel, m_resample_src_y)] == 0)
-      {
-         m_Psrc_y_flag[resampler_range_check(Pclist->p[i].pixel, m_resample_src_y)] = FALSE;
-         m_Pscan_buf->scan_buf_y[j] = -1;
-      }
+      e->Pfree(e->Pclist);
+      free(e);
    }
+}
 
-   /* Now generate the destination line */
+// The table of a filter in Real precision, or NULL if the filter isn't worth tabulating (or out of memory).
+// Built on first use and kept for the life of the process. Must be called with g_clist_cache_mutex held.
+template<typename Real>
+static const Real* get_filter_samples(int filter_index)
+{
+   static Real* s_tables[NUM_FILTERS];
 
-   if (m_delay_x_resample) // Was X resampling delayed until after Y resampling?
-   {
-      resampler_assert(Pdst != Ptmp);
-      resample_x(Pdst, Ptmp);
-   }
-   else
+   const Filter<Real>& filter = get_filters<Real>()[filter_index];
+   if (!filter.tabulate)
+      return NULL;
+
+   if (!s_tables[filter_index])
    {
-      resampler_assert(Pdst == Ptmp);
+      const int table_size = get_filter_table_size(filter.support);
+
+      Real* Ptable = (Real*)malloc(table_size * sizeof(Real));
+      if (!Ptable)
+         return NULL;
+
+      for (int i = 0; i < table_size; i++)
+         Ptable[i] = (*filter.func)((Real)i / (Real)FILTER_TABLE_RESOLUTION);
+
+      s_tables[filter_index] = Ptable;
    }
 
-   if (m_lo < m_hi)
-      clamp(Pdst, m_resample_dst_x);
+   return s_tables[filter_index];
 }
 
-bool Resampler::put_line(const Sample* Psrc)
+// Returns the cached list matching the parameters (creating and caching it if needed) and set cached to true,
+// or a private list if the cache is disabled or out of memory. The list has window_size entries, for the destination
+// samples window_ofs to window_ofs + window_size - 1 of dst_x.
+template<typename Real, typename Storage>
+typename Resampler_T<Real, Storage>::Contrib_List* Resampler_T<Real, Storage>::acquire_clist(
+   int src_x, int dst_x, int window_ofs, int window_size, Boundary_Op boundary_op,
+   int filter_index,
+   Real filter_scale,
+   Real src_ofs,
+   bool& cached)
 {
-   int i;
+   cached = false;
 
-   if (m_cur_src_y >= m_resample_src_y)
-      return false;
-
-   /* Does this source line contribute
-   * to any destination line? if not,
-   * exit now.
-   */
+   int num_phases;
+   bool filter_table;
+   const Real* Pfilter_table = NULL;
 
-   if (!m_Psrc_y_count[resampler_range_check(m_cur_src_y, m_resample_src_y)])
    {
-      m_cur_src_y++;
-      return true;
-   }
+      std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
 
-   /* Find an empty slot in the scanline buffer. (FIXME: Perf. is terrible here with extreme scaling ratios.) */
+      num_phases = g_clist_cache.num_phases;
+      filter_table = g_clist_cache.filter_table;
 
-   for (i = 0; i < MAX_SCAN_BUF_SIZE; i++)
-      if (m_Pscan_buf->scan_buf_y[i] == -1)
-         break;
+      if (Clist_Cache_Entry* e = clist_cache_find((int)sizeof(Real), src_x, dst_x, window_ofs, window_size, boundary_op, filter_index, filter_scale, src_ofs, num_phases, filter_table))
+      {
+         e->ref_count++;
+         e->last_used = ++g_clist_cache.clock;
+         g_clist_cache.hits++;
 
-   /* If the buffer is full, exit with an error. */
+         cached = true;
+         return static_cast<Contrib_List*>(e->Pclist);
+      }
 
-   if (i == MAX_SCAN_BUF_SIZE)
-   {
-      m_status = STATUS_SCAN_BUFFER_FULL;
-      return false;
+      if (g_clist_cache.max_size)
+         g_clist_cache.misses++;
+
+      if (filter_table)
+         Pfilter_table = get_filter_samples<Real>(filter_index);
    }
 
-   m_Psrc_y_flag[resampler_range_check(m_cur_src_y, m_resample_src_y)] = TRUE;
-   m_Pscan_buf->scan_buf_y[i]  = m_cur_src_y;
+   // Create the list without holding the lock, this is the expensive part.
+   const Filter<Real>& filter = get_filters<Real>()[filter_index];
+   Contrib_List* Pclist = make_clist(src_x, dst_x, window_ofs, window_size, boundary_op, filter.func, Pfilter_table, filter.support, filter_scale, src_ofs, num_phases);
+   if (!Pclist)
+      return NULL;
+
+   Clist_Cache_Entry* Pnew = (Clist_Cache_Entry*)malloc(sizeof(Clist_Cache_Entry));
+   if (!Pnew)
+      return Pclist;
 
-   /* Does this slot have any memory allocated to it? */
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
 
-   if (!m_Pscan_buf->scan_buf_l[i])
+   if (!g_clist_cache.max_size)
    {
-      if ((m_Pscan_buf->scan_buf_l[i] = (Sample*)malloc(m_intermediate_x * sizeof(Sample))) == NULL)
-      {
-         m_status = STATUS_OUT_OF_MEMORY;
-         return false;
-      }
+      free(Pnew);
+      return Pclist;
    }
 
-   // Resampling on the X axis first?
-   if (m_delay_x_resample)
+   // Another thread may have created the same list in the meantime.
+   if (Clist_Cache_Entry* e = clist_cache_find((int)sizeof(Real), src_x, dst_x, window_ofs, window_size, boundary_op, filter_index, filter_scale, src_ofs, num_phases, filter_table))
    {
-      resampler_assert(m_intermediate_x == m_resample_src_x);
+      free(Pnew);
+      free_clist(Pclist);
 
-      // Y-X resampling order
-      memcpy(m_Pscan_buf->scan_buf_l[i], Psrc, m_intermediate_x * sizeof(Sample));
-   }
-   else
-   {
-      resampler_assert(m_intermediate_x == m_resample_dst_x);
+      e->ref_count++;
+      e->last_used = ++g_clist_cache.clock;
 
-      // X-Y resampling order
-      resample_x(m_Pscan_buf->scan_buf_l[i], Psrc);
+      cached = true;
+      return static_cast<Contrib_List*>(e->Pclist);
    }
 
-   m_cur_src_y++;
-
-   return true;
+   Pnew->Pnext = g_clist_cache.Pfirst;
+   Pnew->Pclist = Pclist;
+   Pnew->Pfree = free_cached_clist<Real>;
+   Pnew->real_size = (int)sizeof(Real);
+   Pnew->src_x = src_x;
+   Pnew->dst_x = dst_x;
+   Pnew->window_ofs = window_ofs;
+   Pnew->window_size = window_size;
+   Pnew->boundary_op = boundary_op;
+   Pnew->filter_index = filter_index;
+   Pnew->filter_scale = filter_scale;
+   Pnew->src_ofs = src_ofs;
+   Pnew->num_phases = num_phases;
+   Pnew->filter_table = filter_table;
+   Pnew->size = get_clist_size(Pclist, window_size);
+   Pnew->ref_count = 1;
+   Pnew->last_used = ++g_clist_cache.clock;
+
+   g_clist_cache.Pfirst = Pnew;
+   g_clist_cache.size += Pnew->size;
+
+   clist_cache_trim(g_clist_cache.max_size);
+
+   cached = true;
+   return Pclist;
 }
 
-const Resampler::Sample* Resampler::get_line()
+// Adds a reference to a list if it belongs to the cache, returns false otherwise.
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::add_ref_clist(Contrib_List* Pclist)
 {
-   int i;
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
 
-   /* If all the destination lines have been
-   * generated, then always return NULL.
-   */
-
-   if (m_cur_dst_y == m_resample_dst_y)
-      return NULL;
+   Clist_Cache_Entry* e = clist_cache_find(Pclist);
+   if (!e)
+      return false;
 
-   /* Check to see if all the required
-   * contributors are present, if not,
-   * return NULL.
-   */
+   e->ref_count++;
+   return true;
+}
 
-   for (i = 0; i < m_Pclist_y[m_cur_dst_y].n; i++)
-      if (!m_Psrc_y_flag[resampler_range_check(m_Pclist_y[m_cur_dst_y].p[i].pixel, m_resample_src_y)])
-         return NULL;
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::release_clist(Contrib_List* Pclist)
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
 
-   resample_y(m_Pdst_buf);
+   Clist_Cache_Entry* e = clist_cache_find(Pclist);
+   resampler_assert(e && (e->ref_count > 0));
+   if (!e)
+      return;
 
-   m_cur_dst_y++;
+   e->ref_count--;
 
-   return m_Pdst_buf;
+   clist_cache_trim(g_clist_cache.max_size);
 }
 
-Resampler::~Resampler()
+void Resampler_Base::get_clist_cache_stats(Clist_Cache_Stats& stats)
 {
-   int i;
-
-#if RESAMPLER_DEBUG_OPS
-   printf("actual ops: %i\n", total_ops);
-#endif
-
-   free(m_Pdst_buf);
-   m_Pdst_buf = NULL;
-
-   if (m_Ptmp_buf)
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
+
+   stats.hits = g_clist_cache.hits;
+   stats.misses = g_clist_cache.misses;
+   stats.evictions = g_clist_cache.evictions;
+   stats.num_lists = 0;
+   stats.num_lists_in_use = 0;
+   for (Clist_Cache_Entry* e = g_clist_cache.Pfirst; e; e = e->Pnext)
    {
-      free(m_Ptmp_buf);
-      m_Ptmp_buf = NULL;
+      stats.num_lists++;
+      if (e->ref_count)
+         stats.num_lists_in_use++;
    }
+   stats.size = g_clist_cache.size;
+   stats.max_size = g_clist_cache.max_size;
+}
 
-   /* Don't deallocate a contibutor list
-   * if the user passed us one of their own.
-   */
+void Resampler_Base::set_clist_cache_max_size(size_t max_size)
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
 
-   if ((m_Pclist_x) && (!m_clist_x_forced))
-   {
-      free(m_Pclist_x->p);
-      free(m_Pclist_x);
-      m_Pclist_x = NULL;
-   }
+   g_clist_cache.max_size = max_size;
+   clist_cache_trim(max_size);
+}
 
-   if ((m_Pclist_y) && (!m_clist_y_forced))
-   {
-      free(m_Pclist_y->p);
-      free(m_Pclist_y);
-      m_Pclist_y = NULL;
-   }
+void Resampler_Base::flush_clist_cache()
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
 
-   free(m_Psrc_y_count);
-   m_Psrc_y_count = NULL;
+   clist_cache_trim(0);
+}
 
-   free(m_Psrc_y_flag);
-   m_Psrc_y_flag = NULL;
+void Resampler_Base::set_filter_phases(int num_phases)
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
+   g_clist_cache.num_phases = (num_phases > 0) ? num_phases : 0;
+}
+
+int Resampler_Base::get_filter_phases()
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
+   return g_clist_cache.num_phases;
+}
+
+void Resampler_Base::set_filter_table(bool enabled)
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
+   g_clist_cache.filter_table = enabled;
+}
+
+bool Resampler_Base::get_filter_table()
+{
+   std::lock_guard<std::mutex> lock(g_clist_cache_mutex);
+   return g_clist_cache.filter_table;
+}
+
+// Order profile, the faster resampling order of each shape seen (or loaded) so far.
+struct Order_Profile_Entry
+{
+   int src_x, src_y, dst_x, dst_y;
+   int num_channels;
+   int x_ops, y_ops;
+   int real_size, storage_size;
+   bool delay_x_resample;
+};
+
+static std::mutex g_order_mutex;
+
+static struct
+{
+   Resampler_Base::Order_Mode mode;
+   Order_Profile_Entry* Pentries;
+   int num_entries, max_entries;
+} g_order_profile = { Resampler_Base::ORDER_MODE_OPS, NULL, 0, 0 };
+
+// All order_profile_*() functions must be called with g_order_mutex held.
+static Order_Profile_Entry* order_profile_find(const Order_Profile_Entry& key)
+{
+   for (int i = 0; i < g_order_profile.num_entries; i++)
+   {
+      const Order_Profile_Entry& e = g_order_profile.Pentries[i];
+      if ((e.src_x == key.src_x) && (e.src_y == key.src_y) && (e.dst_x == key.dst_x) && (e.dst_y == key.dst_y) &&
+          (e.num_channels == key.num_channels) && (e.x_ops == key.x_ops) && (e.y_ops == key.y_ops) &&
+          (e.real_size == key.real_size) && (e.storage_size == key.storage_size))
+         return &g_order_profile.Pentries[i];
+   }
+   return NULL;
+}
+
+static bool order_profile_add(const Order_Profile_Entry& entry)
+{
+   if (Order_Profile_Entry* e = order_profile_find(entry))
+   {
+      e->delay_x_resample = entry.delay_x_resample;
+      return true;
+   }
+
+   if (g_order_profile.num_entries == g_order_profile.max_entries)
+   {
+      const int new_max = max(16, g_order_profile.max_entries * 2);
+      Order_Profile_Entry* Pentries = (Order_Profile_Entry*)realloc(g_order_profile.Pentries, new_max * sizeof(Order_Profile_Entry));
+      if (!Pentries)
+         return false;
+      g_order_profile.Pentries = Pentries;
+      g_order_profile.max_entries = new_max;
+   }
+
+   g_order_profile.Pentries[g_order_profile.num_entries++] = entry;
+   return true;
+}
+
+void Resampler_Base::set_order_mode(Order_Mode mode)
+{
+   std::lock_guard<std::mutex> lock(g_order_mutex);
+   g_order_profile.mode = mode;
+}
+
+Resampler_Base::Order_Mode Resampler_Base::get_order_mode()
+{
+   std::lock_guard<std::mutex> lock(g_order_mutex);
+   return g_order_profile.mode;
+}
+
+// One shape per line: src_x src_y dst_x dst_y channels x_ops y_ops real_size storage_size xy|yx
+bool Resampler_Base::load_order_profile(const char* Pfilename)
+{
+   FILE* pFile = fopen(Pfilename, "r");
+   if (!pFile)
+      return false;
+
+   std::lock_guard<std::mutex> lock(g_order_mutex);
+
+   bool okay = true;
+   char line[256];
+   while (fgets(line, sizeof(line), pFile))
+   {
+      if ((line[0] == '#') || (line[0] == '\n') || (line[0] == '\r'))
+         continue;
+
+      Order_Profile_Entry e;
+      char order[4];
+      if ((sscanf(line, "%i %i %i %i %i %i %i %i %i %3s", &e.src_x, &e.src_y, &e.dst_x, &e.dst_y, &e.num_channels,
+                  &e.x_ops, &e.y_ops, &e.real_size, &e.storage_size, order) != 10) ||
+          ((strcmp(order, "xy") != 0) && (strcmp(order, "yx") != 0)))
+      {
+         okay = false;
+         continue;
+      }
+
+      e.delay_x_resample = (strcmp(order, "yx") == 0);
+      if (!order_profile_add(e))
+         okay = false;
+   }
+
+   fclose(pFile);
+   return okay;
+}
+
+bool Resampler_Base::save_order_profile(const char* Pfilename)
+{
+   FILE* pFile = fopen(Pfilename, "w");
+   if (!pFile)
+      return false;
+
+   std::lock_guard<std::mutex> lock(g_order_mutex);
+
+   bool okay = fprintf(pFile, "# resampler order profile: src_x src_y dst_x dst_y channels x_ops y_ops real_size storage_size order\n") > 0;
+   for (int i = 0; (okay) && (i < g_order_profile.num_entries); i++)
+   {
+      const Order_Profile_Entry& e = g_order_profile.Pentries[i];
+      okay = fprintf(pFile, "%i %i %i %i %i %i %i %i %i %s\n", e.src_x, e.src_y, e.dst_x, e.dst_y, e.num_channels,
+                     e.x_ops, e.y_ops, e.real_size, e.storage_size, e.delay_x_resample ? "yx" : "xy") > 0;
+   }
+
+   if (fclose(pFile) != 0)
+      okay = false;
+
+   return okay;
+}
+
+void Resampler_Base::clear_order_profile()
+{
+   std::lock_guard<std::mutex> lock(g_order_mutex);
+
+   free(g_order_profile.Pentries);
+   g_order_profile.Pentries = NULL;
+   g_order_profile.num_entries = 0;
+   g_order_profile.max_entries = 0;
+}
+
+// Finds the longest run of destination samples sharing the same phase with equally spaced starts, see Contrib_Table.
+template<typename Real>
+static void find_table_ratio(Resampler_Contrib_Table<Real>* Ptable, int dst_x)
+{
+   int best_first = 0, best_end = 0, best_step = 0;
+   int run_first = 0;
+
+   for (int i = 1; i <= dst_x; i++)
+   {
+      const bool same = (i < dst_x) && (Ptable->phase[i] == Ptable->phase[run_first]) &&
+         ((i == run_first + 1) || (Ptable->start[i] - Ptable->start[i - 1] == Ptable->start[run_first + 1] - Ptable->start[run_first]));
+
+      if (same)
+         continue;
+
+      if (i - run_first > best_end - best_first)
+      {
+         best_first = run_first;
+         best_end = i;
+         best_step = (i - run_first > 1) ? (Ptable->start[run_first + 1] - Ptable->start[run_first]) : 0;
+      }
+
+      run_first = i;
+   }
+
+   // The SIMD kernels filter groups of 4 destination samples, aligned to the start of the scanline, differently from the
+   // rest. Trim the run to whole groups, so every sample is still summed the way the table kernels would sum it.
+   best_first = (best_first + 3) & ~3;
+   if (best_end < dst_x)
+      best_end &= ~3;
+
+   // Not worth it unless most of the scanline is covered.
+   if ((best_end - best_first < 8) || ((best_end - best_first) * 2 < dst_x))
+      return;
+
+   Ptable->ratio_first = best_first;
+   Ptable->ratio_end = best_end;
+   Ptable->ratio_step = best_step;
+}
+
+// FNV-1a hash of the bits of a table row.
+// size must be a multiple of 4, the row is hashed a 32-bit word at a time.
+static unsigned int hash_row(const void* p, size_t size)
+{
+   const unsigned char* Pbytes = static_cast<const unsigned char*>(p);
+   unsigned int h = 2166136261U;
+   for (size_t i = 0; i < size; i += 4)
+   {
+      unsigned int w;
+      memcpy(&w, Pbytes + i, 4);
+      h = (h ^ w) * 16777619U;
+   }
+   return h ^ (h >> 15);
+}
+
+// Converts a contributor list into a fixed width table: each destination sample gets the same number of taps
+// (rounded up to a multiple of 4 for the SIMD kernels) covering a contiguous run of source samples.
+// Contributors which were reflected/clamped onto the same source sample are merged.
+// Destination samples with bit identical weights share a phase, see get_sample_center().
+// Returns NULL if the padding would make the table much more expensive than the list it replaces.
+template<typename Real, typename Storage>
+typename Resampler_T<Real, Storage>::Contrib_Table* Resampler_T<Real, Storage>::make_contrib_table(const Contrib_List* Pclist, int src_x, int dst_x)
+{
+   int i, j, max_span = 0, total_taps = 0;
+
+   for (i = 0; i < dst_x; i++)
+   {
+      const Contrib_List& l = Pclist[i];
+      if (!l.n)
+         return NULL;
+
+      int lo = l.p[0].pixel, hi = l.p[0].pixel;
+      for (j = 1; j < l.n; j++)
+      {
+         lo = min(lo, (int)l.p[j].pixel);
+         hi = max(hi, (int)l.p[j].pixel);
+      }
+
+      max_span = max(max_span, hi - lo + 1);
+      total_taps += l.n;
+   }
+
+   const int taps = (max_span + 3) & ~3;
+
+   // start[i] + taps must stay within the source scanline, and the padding shouldn't more than double the work.
+   if ((taps > src_x) || ((double)taps * dst_x > 2.0 * total_taps + 4.0 * dst_x))
+      return NULL;
+
+   Contrib_Table* Ptable = (Contrib_Table*)calloc(1, sizeof(Contrib_Table));
+   if (!Ptable)
+      return NULL;
+
+   // Open addressing hash table of the phases found so far.
+   int hash_size = 16;
+   while (hash_size < dst_x * 2)
+      hash_size <<= 1;
+   int* Phash = (int*)malloc(hash_size * sizeof(int));
+
+   // The weights are allocated for the worst case (every destination sample has its own phase), and shrunk at the end.
+   Ptable->n = taps;
+   Ptable->start = (int*)malloc(dst_x * sizeof(int));
+   Ptable->phase = (int*)malloc(dst_x * sizeof(int));
+   Ptable->weight = (Real*)malloc((size_t)dst_x * taps * sizeof(Real));
+   if ((!Phash) || (!Ptable->start) || (!Ptable->phase) || (!Ptable->weight))
+   {
+      free(Phash);
+      free_contrib_table(Ptable);
+      return NULL;
+   }
+
+   for (i = 0; i < hash_size; i++)
+      Phash[i] = -1;
+
+   for (i = 0; i < dst_x; i++)
+   {
+      const Contrib_List& l = Pclist[i];
+
+      int lo = l.p[0].pixel;
+      for (j = 1; j < l.n; j++)
+         lo = min(lo, (int)l.p[j].pixel);
+
+      const int start = min(lo, src_x - taps);
+
+      // Build the weights in the next free row, it's only kept if they're a new phase.
+      Real* Pweight = Ptable->weight + (size_t)Ptable->num_phases * taps;
+      memset(Pweight, 0, taps * sizeof(Real));
+
+      for (j = 0; j < l.n; j++)
+         Pweight[resampler_range_check(l.p[j].pixel - start, taps)] += l.p[j].weight;
+
+      unsigned int h = hash_row(Pweight, taps * sizeof(Real)) & (hash_size - 1);
+      while ((Phash[h] >= 0) && (memcmp(Ptable->weight + (size_t)Phash[h] * taps, Pweight, taps * sizeof(Real))))
+         h = (h + 1) & (hash_size - 1);
+
+      if (Phash[h] < 0)
+         Phash[h] = Ptable->num_phases++;
+
+      Ptable->start[i] = start;
+      Ptable->phase[i] = Phash[h];
+   }
+
+   free(Phash);
+
+   Real* Pweight = (Real*)realloc(Ptable->weight, (size_t)Ptable->num_phases * taps * sizeof(Real));
+   if (Pweight)
+      Ptable->weight = Pweight;
+
+#if RESAMPLER_RATIO_X_KERNELS
+   find_table_ratio(Ptable, dst_x);
+#endif
+
+   return Ptable;
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::free_contrib_table(Contrib_Table* Ptable)
+{
+   if (Ptable)
+   {
+      free(Ptable->start);
+      free(Ptable->phase);
+      free(Ptable->weight);
+      free(Ptable);
+   }
+}
+
+// Vertical pass kernels. The SIMD versions perform exactly the same multiplies and adds
+// in the same order as the scalar versions (no FMA), so all kernels produce identical results.
+// The horizontal (Contrib_Table) kernels sum the taps of each destination sample in SIMD lanes, so
+// they only match the scalar versions up to float rounding.
+
+// IEEE 754 half <-> float conversions, round to nearest even. Denormals, infinities and NaN's are preserved
+// (float values too large for a half become infinity), matching the F16C instructions.
+static inline float half_to_float(unsigned short h)
+{
+   const unsigned int sign = (unsigned int)(h & 0x8000) << 16;
+   unsigned int exp = (h >> 10) & 0x1F;
+   unsigned int mant = h & 0x3FF;
+   unsigned int bits;
+
+   if (exp == 0x1F)
+      bits = sign | 0x7F800000 | (mant << 13) | (mant ? 0x400000 : 0); // NaN's come out quiet
+   else if (exp)
+      bits = sign | ((exp + 127 - 15) << 23) | (mant << 13);
+   else if (!mant)
+      bits = sign;
+   else
+   {
+      // Denormal, normalize it.
+      exp = 127 - 15 + 1;
+      while (!(mant & 0x400))
+      {
+         mant <<= 1;
+         exp--;
+      }
+      bits = sign | (exp << 23) | ((mant & 0x3FF) << 13);
+   }
+
+   float f;
+   memcpy(&f, &bits, sizeof(f));
+   return f;
+}
+
+static inline unsigned short float_to_half(float f)
+{
+   unsigned int x;
+   memcpy(&x, &f, sizeof(x));
+
+   const unsigned int sign = (x >> 16) & 0x8000;
+   x &= 0x7FFFFFFF;
+
+   if (x >= 0x7F800000)
+      return (unsigned short)(sign | 0x7C00 | ((x > 0x7F800000) ? (0x200 | ((x >> 13) & 0x3FF)) : 0));
+
+   // 65520.0 and above round to infinity.
+   if (x >= 0x477FF000)
+      return (unsigned short)(sign | 0x7C00);
+
+   const int exp = (int)(x >> 23);
+   unsigned int h, rem, half_way;
+
+   if (exp >= 127 - 14)
+   {
+      h = ((unsigned int)(exp - 127 + 15) << 10) | ((x >> 13) & 0x3FF);
+      rem = x & 0x1FFF;
+      half_way = 0x1000;
+   }
+   else if (exp >= 127 - 25)
+   {
+      // Denormal half.
+      const unsigned int mant = (x & 0x7FFFFF) | 0x800000;
+      const int shift = 126 - exp;
+      h = mant >> shift;
+      rem = mant & ((1U << shift) - 1);
+      half_way = 1U << (shift - 1);
+   }
+   else
+      return (unsigned short)sign;
+
+   // Rounding up may carry into the exponent, which is still the correctly rounded result.
+   if ((rem > half_way) || ((rem == half_way) && (h & 1)))
+      h++;
+
+   return (unsigned short)(sign | h);
+}
+
+// Scanline storage accessors, so the kernels can read and write buffered scanlines of any Scan_Sample type.
+template<typename T> static inline T load_sample(T s) { return s; }
+static inline float load_sample(Resample_Half s) { return half_to_float(s.bits); }
+
+template<typename T> static inline void store_sample(T& d, T s) { d = s; }
+static inline void store_sample(Resample_Half& d, float s) { d.bits = float_to_half(s); }
+
+template<typename S, typename T>
+static void store_samples_scalar(S* Pdst, const T* Psrc, int n)
+{
+   for (int i = 0; i < n; i++)
+      store_sample(Pdst[i], Psrc[i]);
+}
+
+// Output conversion to 8/16 bit unsigned normalized integers: [0, 1] maps to [0, max], rounded and clamped.
+template<typename D, typename T>
+static void store_unorm_scalar(D* Pdst, const T* Psrc, int n)
+{
+   const T scale = (T)(D)~0;
+   for (int i = 0; i < n; i++)
+   {
+      T f = Psrc[i];
+      // Written so NaN's become 0.
+      if (!(f > 0))
+         f = 0;
+      else if (f > 1)
+         f = 1;
+      Pdst[i] = (D)(f * scale + (T).5);
+   }
+}
+
+// Transfer function curves, see Resampler_Base::Transfer_Func.
+template<typename T>
+static T transfer_to_linear(Resampler_Base::Transfer_Func func, T gamma, T f)
+{
+   const T a = (f < 0) ? -f : f;
+   T l;
+
+   if (func == Resampler_Base::TRANSFER_SRGB)
+      l = (a <= T(.04045)) ? (a * T(1.0 / 12.92)) : std::pow((a + T(.055)) * T(1.0 / 1.055), T(2.4));
+   else if (func == Resampler_Base::TRANSFER_GAMMA)
+      l = std::pow(a, gamma);
+   else
+      l = a;
+
+   return (f < 0) ? -l : l;
+}
+
+template<typename T>
+static T linear_to_transfer(Resampler_Base::Transfer_Func func, T gamma, T l)
+{
+   const T a = (l < 0) ? -l : l;
+   T f;
+
+   if (func == Resampler_Base::TRANSFER_SRGB)
+      f = (a <= T(.0031308)) ? (a * T(12.92)) : (T(1.055) * std::pow(a, T(1.0 / 2.4)) - T(.055));
+   else if (func == Resampler_Base::TRANSFER_GAMMA)
+      f = std::pow(a, T(1) / gamma);
+   else
+      f = a;
+
+   return (l < 0) ? -f : f;
+}
+
+// Intervals of the table which gives the lowest 8-bit code of each range of linear samples, see encode_unorm8().
+static const int ENCODE_TABLE_SIZE = 4096;
+
+template<typename T, typename S>
+static void scale_y_mov_scalar(T* Ptmp, const S* Psrc, T weight, int n)
+{
+   // Not += because temp buf wasn't cleared.
+   for (int i = n; i > 0; i--)
+      *Ptmp++ = load_sample(*Psrc++) * weight;
+}
+
+template<typename T, typename S>
+static void scale_y_add_scalar(T* Ptmp, const S* Psrc, T weight, int n)
+{
+   for (int i = n; i > 0; i--)
+      (*Ptmp++) += load_sample(*Psrc++) * weight;
+}
+
+template<typename T>
+static void clamp_scalar(T* Pdst, int n, T lo, T hi)
+{
+   while (n > 0)
+   {
+      T f = *Pdst;
+      if (f < lo)
+         f = lo;
+      else if (f > hi)
+         f = hi;
+      *Pdst++ = f;
+      n--;
+   }
+}
+
+// Pdst[i] = sum(Psrc[k][i] * Pweight[k]) for i in [first, n), optionally clamped to [lo, hi].
+template<typename T, typename S>
+static void scale_y_fused_range(T* Pdst, const S* const* Psrc, const T* Pweight, int num_src, int first, int n, bool clamp, T lo, T hi)
+{
+   for (int i = first; i < n; i++)
+   {
+      T total = load_sample(Psrc[0][i]) * Pweight[0];
+      for (int k = 1; k < num_src; k++)
+         total += load_sample(Psrc[k][i]) * Pweight[k];
+
+      if (clamp)
+      {
+         if (total < lo)
+            total = lo;
+         else if (total > hi)
+            total = hi;
+      }
+
+      Pdst[i] = total;
+   }
+}
+
+template<typename T, typename S>
+static void scale_y_fused_scalar(T* Pdst, const S* const* Psrc, const T* Pweight, int num_src, int n, bool clamp, T lo, T hi)
+{
+   scale_y_fused_range(Pdst, Psrc, Pweight, num_src, 0, n, clamp, lo, hi);
+}
+
+// Filters one interleaved N channel scanline using a fixed width contributor table.
+template<typename T, int N>
+static void resample_x_table_scalar(T* Pdst, const T* Psrc, int src_pixel_stride, const int* Pstart, const int* Pphase, const T* Pweight, int taps, int dst_x)
+{
+   for (int i = 0; i < dst_x; i++)
+   {
+      const T* Pw = Pweight + (size_t)Pphase[i] * taps;
+      const T* Ps = Psrc + Pstart[i] * src_pixel_stride;
+      T total[N];
+      for (int c = 0; c < N; c++)
+         total[c] = 0;
+
+      for (int t = 0; t < taps; t++, Ps += src_pixel_stride)
+         for (int c = 0; c < N; c++)
+            total[c] += Ps[c] * Pw[t];
+
+      for (int c = 0; c < N; c++)
+         *Pdst++ = total[c];
+   }
+}
+
+static void resample_x_table_1_scalar(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   resample_x_table_scalar<float, 1>(Pdst, Psrc, 1, Pstart, Pphase, Pweight, taps, dst_x);
+}
+
+static void resample_x_table_2_scalar(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   resample_x_table_scalar<float, 2>(Pdst, Psrc, 2, Pstart, Pphase, Pweight, taps, dst_x);
+}
+
+static void resample_x_table_3_scalar(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   resample_x_table_scalar<float, 3>(Pdst, Psrc, 3, Pstart, Pphase, Pweight, taps, dst_x);
+}
+
+static void resample_x_table_4_scalar(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   resample_x_table_scalar<float, 4>(Pdst, Psrc, 4, Pstart, Pphase, Pweight, taps, dst_x);
+}
+
+#if RESAMPLER_SSE2
+// Note: max(lo, x)/min(hi, x) operand order matches clamp_scalar() (NaN's pass through).
+static void scale_y_mov_sse2(float* Ptmp, const float* Psrc, float weight, int n)
+{
+   const __m128 w = _mm_set1_ps(weight);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+   {
+      _mm_storeu_ps(Ptmp + i, _mm_mul_ps(_mm_loadu_ps(Psrc + i), w));
+      _mm_storeu_ps(Ptmp + i + 4, _mm_mul_ps(_mm_loadu_ps(Psrc + i + 4), w));
+   }
+   scale_y_mov_scalar(Ptmp + i, Psrc + i, weight, n - i);
+}
+
+static void scale_y_add_sse2(float* Ptmp, const float* Psrc, float weight, int n)
+{
+   const __m128 w = _mm_set1_ps(weight);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+   {
+      _mm_storeu_ps(Ptmp + i, _mm_add_ps(_mm_loadu_ps(Ptmp + i), _mm_mul_ps(_mm_loadu_ps(Psrc + i), w)));
+      _mm_storeu_ps(Ptmp + i + 4, _mm_add_ps(_mm_loadu_ps(Ptmp + i + 4), _mm_mul_ps(_mm_loadu_ps(Psrc + i + 4), w)));
+   }
+   scale_y_add_scalar(Ptmp + i, Psrc + i, weight, n - i);
+}
+
+static void clamp_sse2(float* Pdst, int n, float lo, float hi)
+{
+   const __m128 l = _mm_set1_ps(lo), h = _mm_set1_ps(hi);
+   int i = 0;
+   for ( ; i + 4 <= n; i += 4)
+      _mm_storeu_ps(Pdst + i, _mm_min_ps(h, _mm_max_ps(l, _mm_loadu_ps(Pdst + i))));
+   clamp_scalar(Pdst + i, n - i, lo, hi);
+}
+
+static void scale_y_fused_sse2(float* Pdst, const float* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi)
+{
+   const __m128 l = _mm_set1_ps(lo), h = _mm_set1_ps(hi);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+   {
+      __m128 w = _mm_set1_ps(Pweight[0]);
+      __m128 t0 = _mm_mul_ps(_mm_loadu_ps(Psrc[0] + i), w);
+      __m128 t1 = _mm_mul_ps(_mm_loadu_ps(Psrc[0] + i + 4), w);
+      for (int k = 1; k < num_src; k++)
+      {
+         w = _mm_set1_ps(Pweight[k]);
+         t0 = _mm_add_ps(t0, _mm_mul_ps(_mm_loadu_ps(Psrc[k] + i), w));
+         t1 = _mm_add_ps(t1, _mm_mul_ps(_mm_loadu_ps(Psrc[k] + i + 4), w));
+      }
+      if (clamp)
+      {
+         t0 = _mm_min_ps(h, _mm_max_ps(l, t0));
+         t1 = _mm_min_ps(h, _mm_max_ps(l, t1));
+      }
+      _mm_storeu_ps(Pdst + i, t0);
+      _mm_storeu_ps(Pdst + i + 4, t1);
+   }
+
+   scale_y_fused_range(Pdst, Psrc, Pweight, num_src, i, n, clamp, lo, hi);
+}
+// Single channel: 4 destination samples at a time, one dot product per lane group, then a transpose to sum them.
+// Contrib_Table tap counts are always a multiple of 4.
+static void resample_x_table_1_sse2(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   int i = 0;
+   for ( ; i + 4 <= dst_x; i += 4)
+   {
+      const float* Ps0 = Psrc + Pstart[i];
+      const float* Ps1 = Psrc + Pstart[i + 1];
+      const float* Ps2 = Psrc + Pstart[i + 2];
+      const float* Ps3 = Psrc + Pstart[i + 3];
+      const float* Pw0 = Pweight + (size_t)Pphase[i] * taps;
+      const float* Pw1 = Pweight + (size_t)Pphase[i + 1] * taps;
+      const float* Pw2 = Pweight + (size_t)Pphase[i + 2] * taps;
+      const float* Pw3 = Pweight + (size_t)Pphase[i + 3] * taps;
+
+      __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+      for (int t = 0; t < taps; t += 4)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Ps0 + t), _mm_loadu_ps(Pw0 + t)));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Ps1 + t), _mm_loadu_ps(Pw1 + t)));
+         a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(Ps2 + t), _mm_loadu_ps(Pw2 + t)));
+         a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(Ps3 + t), _mm_loadu_ps(Pw3 + t)));
+      }
+
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _mm_storeu_ps(Pdst + i, _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+   }
+
+   for ( ; i < dst_x; i++)
+   {
+      const float* Ps = Psrc + Pstart[i];
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+      __m128 a = _mm_setzero_ps();
+      for (int t = 0; t < taps; t += 4)
+         a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(Ps + t), _mm_loadu_ps(Pw + t)));
+
+      a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+      a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+      Pdst[i] = _mm_cvtss_f32(a);
+   }
+}
+
+// Two interleaved channels: two source pixels per vector.
+static void resample_x_table_2_sse2(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   for (int i = 0; i < dst_x; i++, Pdst += 2)
+   {
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+      const float* Ps = Psrc + Pstart[i] * 2;
+      __m128 a = _mm_setzero_ps();
+      for (int t = 0; t < taps; t += 2, Ps += 4)
+      {
+         const __m128 w = _mm_unpacklo_ps(_mm_set1_ps(Pw[t]), _mm_set1_ps(Pw[t + 1]));
+         a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(Ps), _mm_shuffle_ps(w, w, _MM_SHUFFLE(1, 1, 0, 0))));
+      }
+      a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+      _mm_storel_pi((__m64*)Pdst, a);
+   }
+}
+
+// Three interleaved channels: each source pixel is loaded as 4 samples with the extra lane ignored. The last
+// source pixel and last destination pixel of the scanline are handled separately to avoid reading or writing past them.
+static void resample_x_table_3_sse2(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   for (int i = 0; i < dst_x; i++, Pdst += 3)
+   {
+      if ((i == dst_x - 1) || (Pstart[i] + taps >= src_x))
+      {
+         resample_x_table_scalar<float, 3>(Pdst, Psrc, 3, Pstart + i, Pphase + i, Pweight, taps, 1);
+         continue;
+      }
+
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+
+      const float* Ps = Psrc + Pstart[i] * 3;
+      __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+      for (int t = 0; t < taps; t += 2, Ps += 6)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Ps), _mm_set1_ps(Pw[t])));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Ps + 3), _mm_set1_ps(Pw[t + 1])));
+      }
+      // Writes one sample into the next destination pixel, which is overwritten on the next iteration.
+      _mm_storeu_ps(Pdst, _mm_add_ps(a0, a1));
+   }
+}
+
+// Four interleaved channels: each source pixel fills one vector.
+static void resample_x_table_4_sse2(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   for (int i = 0; i < dst_x; i++, Pdst += 4)
+   {
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+      const float* Ps = Psrc + Pstart[i] * 4;
+      __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+      for (int t = 0; t < taps; t += 2, Ps += 8)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Ps), _mm_set1_ps(Pw[t])));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Ps + 4), _mm_set1_ps(Pw[t + 1])));
+      }
+      _mm_storeu_ps(Pdst, _mm_add_ps(a0, a1));
+   }
+}
+
+// Ratio kernels: like the table kernels, but all the destination samples share one set of weights (kept in registers)
+// and the source pointer advances by step pixels per destination sample. The taps are summed exactly like the
+// table kernels of the same instruction set do. taps is the table's tap count: a multiple of 4 up to 16.
+template<int TAPS>
+static void resample_x_ratio_1_sse2_taps(float* Pdst, const float* Psrc, int step, const float* Pweight, int dst_x)
+{
+   __m128 w[TAPS / 4];
+   for (int g = 0; g < TAPS / 4; g++)
+      w[g] = _mm_loadu_ps(Pweight + g * 4);
+
+   int i = 0;
+   for ( ; i + 4 <= dst_x; i += 4, Psrc += step * 4)
+   {
+      __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps(), a2 = _mm_setzero_ps(), a3 = _mm_setzero_ps();
+      for (int g = 0; g < TAPS / 4; g++)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Psrc + g * 4), w[g]));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Psrc + step + g * 4), w[g]));
+         a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(Psrc + step * 2 + g * 4), w[g]));
+         a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(Psrc + step * 3 + g * 4), w[g]));
+      }
+
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _mm_storeu_ps(Pdst + i, _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+   }
+
+   for ( ; i < dst_x; i++, Psrc += step)
+   {
+      __m128 a = _mm_setzero_ps();
+      for (int g = 0; g < TAPS / 4; g++)
+         a = _mm_add_ps(a, _mm_mul_ps(_mm_loadu_ps(Psrc + g * 4), w[g]));
+
+      a = _mm_add_ps(a, _mm_movehl_ps(a, a));
+      a = _mm_add_ss(a, _mm_shuffle_ps(a, a, 1));
+      Pdst[i] = _mm_cvtss_f32(a);
+   }
+}
+
+template<int TAPS>
+static void resample_x_ratio_4_sse2_taps(float* Pdst, const float* Psrc, int step, const float* Pweight, int dst_x)
+{
+   __m128 w[TAPS];
+   for (int t = 0; t < TAPS; t++)
+      w[t] = _mm_set1_ps(Pweight[t]);
+
+   for (int i = 0; i < dst_x; i++, Psrc += step * 4, Pdst += 4)
+   {
+      __m128 a0 = _mm_setzero_ps(), a1 = _mm_setzero_ps();
+      for (int t = 0; t < TAPS; t += 2)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Psrc + t * 4), w[t]));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Psrc + t * 4 + 4), w[t + 1]));
+      }
+      _mm_storeu_ps(Pdst, _mm_add_ps(a0, a1));
+   }
+}
+
+static bool resample_x_ratio_1_sse2(float* Pdst, const float* Psrc, int step, const float* Pweight, int taps, int dst_x)
+{
+   switch (taps)
+   {
+      case 4: resample_x_ratio_1_sse2_taps<4>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 8: resample_x_ratio_1_sse2_taps<8>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 12: resample_x_ratio_1_sse2_taps<12>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 16: resample_x_ratio_1_sse2_taps<16>(Pdst, Psrc, step, Pweight, dst_x); return true;
+   }
+   return false;
+}
+
+static bool resample_x_ratio_4_sse2(float* Pdst, const float* Psrc, int step, const float* Pweight, int taps, int dst_x)
+{
+   switch (taps)
+   {
+      case 4: resample_x_ratio_4_sse2_taps<4>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 8: resample_x_ratio_4_sse2_taps<8>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 12: resample_x_ratio_4_sse2_taps<12>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 16: resample_x_ratio_4_sse2_taps<16>(Pdst, Psrc, step, Pweight, dst_x); return true;
+   }
+   return false;
+}
+
+static void store_unorm8_sse2(unsigned char* Pdst, const float* Psrc, int n)
+{
+   const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f), scale = _mm_set1_ps(255.0f), half = _mm_set1_ps(.5f);
+   int i = 0;
+   for ( ; i + 16 <= n; i += 16)
+   {
+      __m128i v[4];
+      for (int k = 0; k < 4; k++)
+      {
+         // max(f, 0) returns 0 for NaN's, like store_unorm_scalar().
+         const __m128 f = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(Psrc + i + k * 4), zero), one);
+         v[k] = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(f, scale), half));
+      }
+      _mm_storeu_si128((__m128i*)(Pdst + i), _mm_packus_epi16(_mm_packs_epi32(v[0], v[1]), _mm_packs_epi32(v[2], v[3])));
+   }
+   store_unorm_scalar(Pdst + i, Psrc + i, n - i);
+}
+#endif // RESAMPLER_SSE2
+
+#if RESAMPLER_AVX2
+RESAMPLER_TARGET_AVX2 static void scale_y_mov_avx2(float* Ptmp, const float* Psrc, float weight, int n)
+{
+   const __m256 w = _mm256_set1_ps(weight);
+   int i = 0;
+   for ( ; i + 16 <= n; i += 16)
+   {
+      _mm256_storeu_ps(Ptmp + i, _mm256_mul_ps(_mm256_loadu_ps(Psrc + i), w));
+      _mm256_storeu_ps(Ptmp + i + 8, _mm256_mul_ps(_mm256_loadu_ps(Psrc + i + 8), w));
+   }
+   scale_y_mov_scalar(Ptmp + i, Psrc + i, weight, n - i);
+}
+
+RESAMPLER_TARGET_AVX2 static void scale_y_add_avx2(float* Ptmp, const float* Psrc, float weight, int n)
+{
+   const __m256 w = _mm256_set1_ps(weight);
+   int i = 0;
+   for ( ; i + 16 <= n; i += 16)
+   {
+      _mm256_storeu_ps(Ptmp + i, _mm256_add_ps(_mm256_loadu_ps(Ptmp + i), _mm256_mul_ps(_mm256_loadu_ps(Psrc + i), w)));
+      _mm256_storeu_ps(Ptmp + i + 8, _mm256_add_ps(_mm256_loadu_ps(Ptmp + i + 8), _mm256_mul_ps(_mm256_loadu_ps(Psrc + i + 8), w)));
+   }
+   scale_y_add_scalar(Ptmp + i, Psrc + i, weight, n - i);
+}
+
+RESAMPLER_TARGET_AVX2 static void clamp_avx2(float* Pdst, int n, float lo, float hi)
+{
+   const __m256 l = _mm256_set1_ps(lo), h = _mm256_set1_ps(hi);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+      _mm256_storeu_ps(Pdst + i, _mm256_min_ps(h, _mm256_max_ps(l, _mm256_loadu_ps(Pdst + i))));
+   clamp_scalar(Pdst + i, n - i, lo, hi);
+}
+
+RESAMPLER_TARGET_AVX2 static void scale_y_fused_avx2(float* Pdst, const float* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi)
+{
+   const __m256 l = _mm256_set1_ps(lo), h = _mm256_set1_ps(hi);
+   int i = 0;
+   for ( ; i + 16 <= n; i += 16)
+   {
+      __m256 w = _mm256_set1_ps(Pweight[0]);
+      __m256 t0 = _mm256_mul_ps(_mm256_loadu_ps(Psrc[0] + i), w);
+      __m256 t1 = _mm256_mul_ps(_mm256_loadu_ps(Psrc[0] + i + 8), w);
+      for (int k = 1; k < num_src; k++)
+      {
+         w = _mm256_set1_ps(Pweight[k]);
+         t0 = _mm256_add_ps(t0, _mm256_mul_ps(_mm256_loadu_ps(Psrc[k] + i), w));
+         t1 = _mm256_add_ps(t1, _mm256_mul_ps(_mm256_loadu_ps(Psrc[k] + i + 8), w));
+      }
+      if (clamp)
+      {
+         t0 = _mm256_min_ps(h, _mm256_max_ps(l, t0));
+         t1 = _mm256_min_ps(h, _mm256_max_ps(l, t1));
+      }
+      _mm256_storeu_ps(Pdst + i, t0);
+      _mm256_storeu_ps(Pdst + i + 8, t1);
+   }
+
+   scale_y_fused_range(Pdst, Psrc, Pweight, num_src, i, n, clamp, lo, hi);
+}
+
+RESAMPLER_TARGET_AVX2 static void resample_x_table_1_avx2(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   const int taps8 = taps & ~7;
+   int i = 0;
+   for ( ; i + 4 <= dst_x; i += 4)
+   {
+      const float* Ps0 = Psrc + Pstart[i];
+      const float* Ps1 = Psrc + Pstart[i + 1];
+      const float* Ps2 = Psrc + Pstart[i + 2];
+      const float* Ps3 = Psrc + Pstart[i + 3];
+      const float* Pw0 = Pweight + (size_t)Pphase[i] * taps;
+      const float* Pw1 = Pweight + (size_t)Pphase[i + 1] * taps;
+      const float* Pw2 = Pweight + (size_t)Pphase[i + 2] * taps;
+      const float* Pw3 = Pweight + (size_t)Pphase[i + 3] * taps;
+
+      __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps(), b2 = _mm256_setzero_ps(), b3 = _mm256_setzero_ps();
+      int t = 0;
+      for ( ; t < taps8; t += 8)
+      {
+         b0 = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_loadu_ps(Ps0 + t), _mm256_loadu_ps(Pw0 + t)));
+         b1 = _mm256_add_ps(b1, _mm256_mul_ps(_mm256_loadu_ps(Ps1 + t), _mm256_loadu_ps(Pw1 + t)));
+         b2 = _mm256_add_ps(b2, _mm256_mul_ps(_mm256_loadu_ps(Ps2 + t), _mm256_loadu_ps(Pw2 + t)));
+         b3 = _mm256_add_ps(b3, _mm256_mul_ps(_mm256_loadu_ps(Ps3 + t), _mm256_loadu_ps(Pw3 + t)));
+      }
+
+      __m128 a0 = _mm_add_ps(_mm256_castps256_ps128(b0), _mm256_extractf128_ps(b0, 1));
+      __m128 a1 = _mm_add_ps(_mm256_castps256_ps128(b1), _mm256_extractf128_ps(b1, 1));
+      __m128 a2 = _mm_add_ps(_mm256_castps256_ps128(b2), _mm256_extractf128_ps(b2, 1));
+      __m128 a3 = _mm_add_ps(_mm256_castps256_ps128(b3), _mm256_extractf128_ps(b3, 1));
+
+      if (t < taps)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Ps0 + t), _mm_loadu_ps(Pw0 + t)));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Ps1 + t), _mm_loadu_ps(Pw1 + t)));
+         a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(Ps2 + t), _mm_loadu_ps(Pw2 + t)));
+         a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(Ps3 + t), _mm_loadu_ps(Pw3 + t)));
+      }
+
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _mm_storeu_ps(Pdst + i, _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+   }
+
+   if (i < dst_x)
+      resample_x_table_1_sse2(Pdst + i, Psrc, src_x, Pstart + i, Pphase + i, Pweight, taps, dst_x - i);
+}
+
+// Four interleaved channels: two source pixels per vector.
+RESAMPLER_TARGET_AVX2 static void resample_x_table_4_avx2(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   for (int i = 0; i < dst_x; i++, Pdst += 4)
+   {
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+      const float* Ps = Psrc + Pstart[i] * 4;
+      __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+      for (int t = 0; t < taps; t += 4, Ps += 16)
+      {
+         const __m256 w0 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(Pw[t])), _mm_set1_ps(Pw[t + 1]), 1);
+         const __m256 w1 = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(Pw[t + 2])), _mm_set1_ps(Pw[t + 3]), 1);
+         a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(Ps), w0));
+         a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(Ps + 8), w1));
+      }
+      a0 = _mm256_add_ps(a0, a1);
+      _mm_storeu_ps(Pdst, _mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1)));
+   }
+}
+
+template<int TAPS>
+RESAMPLER_TARGET_AVX2 static void resample_x_ratio_1_avx2_taps(float* Pdst, const float* Psrc, int step, const float* Pweight, int dst_x)
+{
+   const int TAPS8 = TAPS & ~7;
+   __m256 w8[(TAPS / 8) ? (TAPS / 8) : 1];
+   for (int g = 0; g < TAPS / 8; g++)
+      w8[g] = _mm256_loadu_ps(Pweight + g * 8);
+   const __m128 w4 = (TAPS & 4) ? _mm_loadu_ps(Pweight + TAPS8) : _mm_setzero_ps();
+
+   int i = 0;
+   for ( ; i + 4 <= dst_x; i += 4, Psrc += step * 4)
+   {
+      const float* Ps0 = Psrc;
+      const float* Ps1 = Psrc + step;
+      const float* Ps2 = Psrc + step * 2;
+      const float* Ps3 = Psrc + step * 3;
+
+      __m256 b0 = _mm256_setzero_ps(), b1 = _mm256_setzero_ps(), b2 = _mm256_setzero_ps(), b3 = _mm256_setzero_ps();
+      for (int g = 0; g < TAPS / 8; g++)
+      {
+         b0 = _mm256_add_ps(b0, _mm256_mul_ps(_mm256_loadu_ps(Ps0 + g * 8), w8[g]));
+         b1 = _mm256_add_ps(b1, _mm256_mul_ps(_mm256_loadu_ps(Ps1 + g * 8), w8[g]));
+         b2 = _mm256_add_ps(b2, _mm256_mul_ps(_mm256_loadu_ps(Ps2 + g * 8), w8[g]));
+         b3 = _mm256_add_ps(b3, _mm256_mul_ps(_mm256_loadu_ps(Ps3 + g * 8), w8[g]));
+      }
+
+      __m128 a0 = _mm_add_ps(_mm256_castps256_ps128(b0), _mm256_extractf128_ps(b0, 1));
+      __m128 a1 = _mm_add_ps(_mm256_castps256_ps128(b1), _mm256_extractf128_ps(b1, 1));
+      __m128 a2 = _mm_add_ps(_mm256_castps256_ps128(b2), _mm256_extractf128_ps(b2, 1));
+      __m128 a3 = _mm_add_ps(_mm256_castps256_ps128(b3), _mm256_extractf128_ps(b3, 1));
+
+      if (TAPS & 4)
+      {
+         a0 = _mm_add_ps(a0, _mm_mul_ps(_mm_loadu_ps(Ps0 + TAPS8), w4));
+         a1 = _mm_add_ps(a1, _mm_mul_ps(_mm_loadu_ps(Ps1 + TAPS8), w4));
+         a2 = _mm_add_ps(a2, _mm_mul_ps(_mm_loadu_ps(Ps2 + TAPS8), w4));
+         a3 = _mm_add_ps(a3, _mm_mul_ps(_mm_loadu_ps(Ps3 + TAPS8), w4));
+      }
+
+      _MM_TRANSPOSE4_PS(a0, a1, a2, a3);
+      _mm_storeu_ps(Pdst + i, _mm_add_ps(_mm_add_ps(a0, a1), _mm_add_ps(a2, a3)));
+   }
+
+   if (i < dst_x)
+      resample_x_ratio_1_sse2_taps<TAPS>(Pdst + i, Psrc, step, Pweight, dst_x - i);
+}
+
+template<int TAPS>
+RESAMPLER_TARGET_AVX2 static void resample_x_ratio_4_avx2_taps(float* Pdst, const float* Psrc, int step, const float* Pweight, int dst_x)
+{
+   __m256 w[TAPS / 2];
+   for (int t = 0; t < TAPS; t += 2)
+      w[t / 2] = _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_set1_ps(Pweight[t])), _mm_set1_ps(Pweight[t + 1]), 1);
+
+   for (int i = 0; i < dst_x; i++, Psrc += step * 4, Pdst += 4)
+   {
+      __m256 a0 = _mm256_setzero_ps(), a1 = _mm256_setzero_ps();
+      for (int t = 0; t < TAPS; t += 4)
+      {
+         a0 = _mm256_add_ps(a0, _mm256_mul_ps(_mm256_loadu_ps(Psrc + t * 4), w[t / 2]));
+         a1 = _mm256_add_ps(a1, _mm256_mul_ps(_mm256_loadu_ps(Psrc + t * 4 + 8), w[t / 2 + 1]));
+      }
+      a0 = _mm256_add_ps(a0, a1);
+      _mm_storeu_ps(Pdst, _mm_add_ps(_mm256_castps256_ps128(a0), _mm256_extractf128_ps(a0, 1)));
+   }
+}
+
+RESAMPLER_TARGET_AVX2 static bool resample_x_ratio_1_avx2(float* Pdst, const float* Psrc, int step, const float* Pweight, int taps, int dst_x)
+{
+   switch (taps)
+   {
+      case 4: resample_x_ratio_1_avx2_taps<4>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 8: resample_x_ratio_1_avx2_taps<8>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 12: resample_x_ratio_1_avx2_taps<12>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 16: resample_x_ratio_1_avx2_taps<16>(Pdst, Psrc, step, Pweight, dst_x); return true;
+   }
+   return false;
+}
+
+RESAMPLER_TARGET_AVX2 static bool resample_x_ratio_4_avx2(float* Pdst, const float* Psrc, int step, const float* Pweight, int taps, int dst_x)
+{
+   switch (taps)
+   {
+      case 4: resample_x_ratio_4_avx2_taps<4>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 8: resample_x_ratio_4_avx2_taps<8>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 12: resample_x_ratio_4_avx2_taps<12>(Pdst, Psrc, step, Pweight, dst_x); return true;
+      case 16: resample_x_ratio_4_avx2_taps<16>(Pdst, Psrc, step, Pweight, dst_x); return true;
+   }
+   return false;
+}
+
+// Half float scanline kernels, the conversions are exact (half to float) or round to nearest even like float_to_half().
+RESAMPLER_TARGET_F16C static void scale_y_fused_half_f16c(float* Pdst, const Resample_Half* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi)
+{
+   const __m256 l = _mm256_set1_ps(lo), h = _mm256_set1_ps(hi);
+   int i = 0;
+   for ( ; i + 16 <= n; i += 16)
+   {
+      __m256 w = _mm256_set1_ps(Pweight[0]);
+      __m256 t0 = _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(Psrc[0] + i))), w);
+      __m256 t1 = _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(Psrc[0] + i + 8))), w);
+      for (int k = 1; k < num_src; k++)
+      {
+         w = _mm256_set1_ps(Pweight[k]);
+         t0 = _mm256_add_ps(t0, _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(Psrc[k] + i))), w));
+         t1 = _mm256_add_ps(t1, _mm256_mul_ps(_mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)(Psrc[k] + i + 8))), w));
+      }
+      if (clamp)
+      {
+         t0 = _mm256_min_ps(h, _mm256_max_ps(l, t0));
+         t1 = _mm256_min_ps(h, _mm256_max_ps(l, t1));
+      }
+      _mm256_storeu_ps(Pdst + i, t0);
+      _mm256_storeu_ps(Pdst + i + 8, t1);
+   }
+
+   scale_y_fused_range(Pdst, Psrc, Pweight, num_src, i, n, clamp, lo, hi);
+}
+
+RESAMPLER_TARGET_F16C static void store_half_f16c(Resample_Half* Pdst, const float* Psrc, int n)
+{
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+      _mm_storeu_si128((__m128i*)(Pdst + i), _mm256_cvtps_ph(_mm256_loadu_ps(Psrc + i), _MM_FROUND_TO_NEAREST_INT));
+   store_samples_scalar(Pdst + i, Psrc + i, n - i);
+}
+
+static bool cpu_has_avx2()
+{
+#ifdef _MSC_VER
+   int regs[4];
+   __cpuid(regs, 0);
+   if (regs[0] < 7)
+      return false;
+   __cpuid(regs, 1);
+   // OSXSAVE and AVX, then check the OS saves the YMM registers.
+   if ((regs[2] & ((1 << 27) | (1 << 28))) != ((1 << 27) | (1 << 28)))
+      return false;
+   if ((_xgetbv(0) & 6) != 6)
+      return false;
+   __cpuidex(regs, 7, 0);
+   return (regs[1] & (1 << 5)) != 0;
+#else
+   __builtin_cpu_init();
+   return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// Only called once AVX2 (and the OS's YMM support) has been detected.
+static bool cpu_has_f16c()
+{
+#ifdef _MSC_VER
+   int regs[4];
+   __cpuid(regs, 1);
+   return (regs[2] & (1 << 29)) != 0;
+#else
+   return __builtin_cpu_supports("f16c") != 0;
+#endif
+}
+#endif // RESAMPLER_AVX2
+
+#if RESAMPLER_NEON
+static void scale_y_mov_neon(float* Ptmp, const float* Psrc, float weight, int n)
+{
+   const float32x4_t w = vdupq_n_f32(weight);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+   {
+      vst1q_f32(Ptmp + i, vmulq_f32(vld1q_f32(Psrc + i), w));
+      vst1q_f32(Ptmp + i + 4, vmulq_f32(vld1q_f32(Psrc + i + 4), w));
+   }
+   scale_y_mov_scalar(Ptmp + i, Psrc + i, weight, n - i);
+}
+
+static void scale_y_add_neon(float* Ptmp, const float* Psrc, float weight, int n)
+{
+   const float32x4_t w = vdupq_n_f32(weight);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+   {
+      // vmulq + vaddq (not vmlaq/vfmaq) to keep results identical to the scalar path.
+      vst1q_f32(Ptmp + i, vaddq_f32(vld1q_f32(Ptmp + i), vmulq_f32(vld1q_f32(Psrc + i), w)));
+      vst1q_f32(Ptmp + i + 4, vaddq_f32(vld1q_f32(Ptmp + i + 4), vmulq_f32(vld1q_f32(Psrc + i + 4), w)));
+   }
+   scale_y_add_scalar(Ptmp + i, Psrc + i, weight, n - i);
+}
+
+static void clamp_neon(float* Pdst, int n, float lo, float hi)
+{
+   int i = 0;
+   for ( ; i + 4 <= n; i += 4)
+   {
+      // Select instead of vmaxq/vminq so NaN's pass through like clamp_scalar().
+      float32x4_t f = vld1q_f32(Pdst + i);
+      const float32x4_t l = vdupq_n_f32(lo), h = vdupq_n_f32(hi);
+      f = vbslq_f32(vcltq_f32(f, l), l, f);
+      f = vbslq_f32(vcgtq_f32(f, h), h, f);
+      vst1q_f32(Pdst + i, f);
+   }
+   clamp_scalar(Pdst + i, n - i, lo, hi);
+}
+
+static void scale_y_fused_neon(float* Pdst, const float* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi)
+{
+   const float32x4_t l = vdupq_n_f32(lo), h = vdupq_n_f32(hi);
+   int i = 0;
+   for ( ; i + 8 <= n; i += 8)
+   {
+      float32x4_t w = vdupq_n_f32(Pweight[0]);
+      float32x4_t t0 = vmulq_f32(vld1q_f32(Psrc[0] + i), w);
+      float32x4_t t1 = vmulq_f32(vld1q_f32(Psrc[0] + i + 4), w);
+      for (int k = 1; k < num_src; k++)
+      {
+         w = vdupq_n_f32(Pweight[k]);
+         t0 = vaddq_f32(t0, vmulq_f32(vld1q_f32(Psrc[k] + i), w));
+         t1 = vaddq_f32(t1, vmulq_f32(vld1q_f32(Psrc[k] + i + 4), w));
+      }
+      if (clamp)
+      {
+         t0 = vbslq_f32(vcltq_f32(t0, l), l, t0);
+         t0 = vbslq_f32(vcgtq_f32(t0, h), h, t0);
+         t1 = vbslq_f32(vcltq_f32(t1, l), l, t1);
+         t1 = vbslq_f32(vcgtq_f32(t1, h), h, t1);
+      }
+      vst1q_f32(Pdst + i, t0);
+      vst1q_f32(Pdst + i + 4, t1);
+   }
+
+   scale_y_fused_range(Pdst, Psrc, Pweight, num_src, i, n, clamp, lo, hi);
+}
+static void resample_x_table_1_neon(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   for (int i = 0; i < dst_x; i++)
+   {
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+      const float* Ps = Psrc + Pstart[i];
+      float32x4_t a = vdupq_n_f32(0.0f);
+      for (int t = 0; t < taps; t += 4)
+         a = vaddq_f32(a, vmulq_f32(vld1q_f32(Ps + t), vld1q_f32(Pw + t)));
+
+      float32x2_t h = vadd_f32(vget_low_f32(a), vget_high_f32(a));
+      Pdst[i] = vget_lane_f32(vpadd_f32(h, h), 0);
+   }
+}
+
+static void resample_x_table_4_neon(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   for (int i = 0; i < dst_x; i++, Pdst += 4)
+   {
+      const float* Pw = Pweight + (size_t)Pphase[i] * taps;
+      const float* Ps = Psrc + Pstart[i] * 4;
+      float32x4_t a0 = vdupq_n_f32(0.0f), a1 = vdupq_n_f32(0.0f);
+      for (int t = 0; t < taps; t += 2, Ps += 8)
+      {
+         a0 = vaddq_f32(a0, vmulq_f32(vld1q_f32(Ps), vdupq_n_f32(Pw[t])));
+         a1 = vaddq_f32(a1, vmulq_f32(vld1q_f32(Ps + 4), vdupq_n_f32(Pw[t + 1])));
+      }
+      vst1q_f32(Pdst, vaddq_f32(a0, a1));
+   }
+}
+#endif // RESAMPLER_NEON
+
+// The float kernels used by this process, selected once from the CPU's capabilities.
+struct Kernels
+{
+   const char* name;
+   void (*scale_y_mov)(float* Ptmp, const float* Psrc, float weight, int n);
+   void (*scale_y_add)(float* Ptmp, const float* Psrc, float weight, int n);
+   void (*clamp)(float* Pdst, int n, float lo, float hi);
+   void (*scale_y_fused)(float* Pdst, const float* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi);
+   void (*resample_x_table_1)(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x);
+   void (*resample_x_table_2)(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x);
+   void (*resample_x_table_3)(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x);
+   void (*resample_x_table_4)(float* Pdst, const float* Psrc, int src_x, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x);
+   void (*scale_y_fused_half)(float* Pdst, const Resample_Half* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi);
+   void (*store_half)(Resample_Half* Pdst, const float* Psrc, int n);
+   void (*store_unorm8)(unsigned char* Pdst, const float* Psrc, int n);
+   // NULL if there are no ratio kernels, return false for unsupported tap counts.
+   bool (*resample_x_ratio_1)(float* Pdst, const float* Psrc, int step, const float* Pweight, int taps, int dst_x);
+   bool (*resample_x_ratio_4)(float* Pdst, const float* Psrc, int step, const float* Pweight, int taps, int dst_x);
+};
+
+static const Kernels& get_kernels()
+{
+   // Function local static: initialized exactly once, even with multiple threads.
+   static const Kernels s_kernels = []()
+   {
+      Kernels k = { "scalar", scale_y_mov_scalar<float, float>, scale_y_add_scalar<float, float>, clamp_scalar<float>, scale_y_fused_scalar<float, float>, resample_x_table_1_scalar, resample_x_table_2_scalar, resample_x_table_3_scalar, resample_x_table_4_scalar,
+         scale_y_fused_scalar<float, Resample_Half>, store_samples_scalar<Resample_Half, float>, store_unorm_scalar<unsigned char, float>, NULL, NULL };
+#if RESAMPLER_SSE2
+      k.name = "sse2";
+      k.scale_y_mov = scale_y_mov_sse2;
+      k.scale_y_add = scale_y_add_sse2;
+      k.clamp = clamp_sse2;
+      k.scale_y_fused = scale_y_fused_sse2;
+      k.resample_x_table_1 = resample_x_table_1_sse2;
+      k.resample_x_table_2 = resample_x_table_2_sse2;
+      k.resample_x_table_3 = resample_x_table_3_sse2;
+      k.resample_x_table_4 = resample_x_table_4_sse2;
+      k.store_unorm8 = store_unorm8_sse2;
+      k.resample_x_ratio_1 = resample_x_ratio_1_sse2;
+      k.resample_x_ratio_4 = resample_x_ratio_4_sse2;
+#endif
+#if RESAMPLER_AVX2
+      if (cpu_has_avx2())
+      {
+         k.name = "avx2";
+         k.scale_y_mov = scale_y_mov_avx2;
+         k.scale_y_add = scale_y_add_avx2;
+         k.clamp = clamp_avx2;
+         k.scale_y_fused = scale_y_fused_avx2;
+         k.resample_x_table_1 = resample_x_table_1_avx2;
+         k.resample_x_table_4 = resample_x_table_4_avx2;
+         k.resample_x_ratio_1 = resample_x_ratio_1_avx2;
+         k.resample_x_ratio_4 = resample_x_ratio_4_avx2;
+
+         if (cpu_has_f16c())
+         {
+            k.scale_y_fused_half = scale_y_fused_half_f16c;
+            k.store_half = store_half_f16c;
+         }
+      }
+#endif
+#if RESAMPLER_NEON
+      k.name = "neon";
+      k.scale_y_mov = scale_y_mov_neon;
+      k.scale_y_add = scale_y_add_neon;
+      k.clamp = clamp_neon;
+      k.scale_y_fused = scale_y_fused_neon;
+      k.resample_x_table_1 = resample_x_table_1_neon;
+      k.resample_x_table_4 = resample_x_table_4_neon;
+#endif
+      return k;
+   }();
+   return s_kernels;
+}
+
+// Overloads select the dispatched kernels for float samples (and half float scanlines), and the scalar templates for anything else (double).
+static inline void do_scale_y_mov(float* Ptmp, const float* Psrc, float weight, int n) { get_kernels().scale_y_mov(Ptmp, Psrc, weight, n); }
+static inline void do_scale_y_add(float* Ptmp, const float* Psrc, float weight, int n) { get_kernels().scale_y_add(Ptmp, Psrc, weight, n); }
+static inline void do_clamp(float* Pdst, int n, float lo, float hi) { get_kernels().clamp(Pdst, n, lo, hi); }
+static inline void do_scale_y_fused(float* Pdst, const float* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi) { get_kernels().scale_y_fused(Pdst, Psrc, Pweight, num_src, n, clamp, lo, hi); }
+static inline void do_scale_y_fused(float* Pdst, const Resample_Half* const* Psrc, const float* Pweight, int num_src, int n, bool clamp, float lo, float hi) { get_kernels().scale_y_fused_half(Pdst, Psrc, Pweight, num_src, n, clamp, lo, hi); }
+static inline void do_store_samples(Resample_Half* Pdst, const float* Psrc, int n) { get_kernels().store_half(Pdst, Psrc, n); }
+
+template<typename T, typename S> static inline void do_scale_y_mov(T* Ptmp, const S* Psrc, T weight, int n) { scale_y_mov_scalar(Ptmp, Psrc, weight, n); }
+template<typename T, typename S> static inline void do_scale_y_add(T* Ptmp, const S* Psrc, T weight, int n) { scale_y_add_scalar(Ptmp, Psrc, weight, n); }
+template<typename T> static inline void do_clamp(T* Pdst, int n, T lo, T hi) { clamp_scalar(Pdst, n, lo, hi); }
+template<typename S, typename T> static inline void do_store_samples(S* Pdst, const T* Psrc, int n) { store_samples_scalar(Pdst, Psrc, n); }
+
+static inline void do_store_unorm(unsigned char* Pdst, const float* Psrc, int n) { get_kernels().store_unorm8(Pdst, Psrc, n); }
+template<typename D, typename T> static inline void do_store_unorm(D* Pdst, const T* Psrc, int n) { store_unorm_scalar(Pdst, Psrc, n); }
+
+template<typename D, typename T>
+static void store_unorm_strided(D* Pdst, int dst_pixel_stride, const T* Psrc, int num_pixels, int num_channels)
+{
+   for (int x = 0; x < num_pixels; x++, Pdst += dst_pixel_stride, Psrc += num_channels)
+      store_unorm_scalar(Pdst, Psrc, num_channels);
+}
+// Returns false if there's no table kernel for this sample type/channel count/stride combination.
+static inline bool do_resample_x_table(float* Pdst, const float* Psrc, int src_x, int num_channels, int src_pixel_stride, const int* Pstart, const int* Pphase, const float* Pweight, int taps, int dst_x)
+{
+   if (src_pixel_stride != num_channels)
+      return false;
+
+   switch (num_channels)
+   {
+      case 1: get_kernels().resample_x_table_1(Pdst, Psrc, src_x, Pstart, Pphase, Pweight, taps, dst_x); return true;
+      case 2: get_kernels().resample_x_table_2(Pdst, Psrc, src_x, Pstart, Pphase, Pweight, taps, dst_x); return true;
+      case 3: get_kernels().resample_x_table_3(Pdst, Psrc, src_x, Pstart, Pphase, Pweight, taps, dst_x); return true;
+      case 4: get_kernels().resample_x_table_4(Pdst, Psrc, src_x, Pstart, Pphase, Pweight, taps, dst_x); return true;
+   }
+   return false;
+}
+
+template<typename T> static inline bool do_resample_x_table(T*, const T*, int, int, int, const int*, const int*, const T*, int, int) { return false; }
+
+template<typename T, typename S> static inline void do_scale_y_fused(T* Pdst, const S* const* Psrc, const T* Pweight, int num_src, int n, bool clamp, T lo, T hi) { scale_y_fused_scalar(Pdst, Psrc, Pweight, num_src, n, clamp, lo, hi); }
+
+// Filters the ratio run of a table with the ratio kernels and the samples around it with the table kernels.
+// Returns false if there's no ratio kernel for this channel count/tap count.
+static inline bool do_resample_x_ratio(float* Pdst, const float* Psrc, int src_x, int num_channels, int src_pixel_stride, const Resampler_Contrib_Table<float>* Ptable, int dst_x)
+{
+   if (src_pixel_stride != num_channels)
+      return false;
+
+   const int first = Ptable->ratio_first, end = Ptable->ratio_end;
+   const float* Pweight = Ptable->weight + (size_t)Ptable->phase[first] * Ptable->n;
+   bool okay = false;
+
+   switch (num_channels)
+   {
+      case 1: okay = (get_kernels().resample_x_ratio_1) && (get_kernels().resample_x_ratio_1(Pdst + first, Psrc + Ptable->start[first], Ptable->ratio_step, Pweight, Ptable->n, end - first)); break;
+      case 4: okay = (get_kernels().resample_x_ratio_4) && (get_kernels().resample_x_ratio_4(Pdst + first * 4, Psrc + Ptable->start[first] * 4, Ptable->ratio_step, Pweight, Ptable->n, end - first)); break;
+   }
+   if (!okay)
+      return false;
+
+   // The edges.
+   if (first)
+      do_resample_x_table(Pdst, Psrc, src_x, num_channels, num_channels, Ptable->start, Ptable->phase, Ptable->weight, Ptable->n, first);
+   if (end < dst_x)
+      do_resample_x_table(Pdst + end * num_channels, Psrc, src_x, num_channels, num_channels, Ptable->start + end, Ptable->phase + end, Ptable->weight, Ptable->n, dst_x - end);
+
+   return true;
+}
+
+template<typename T> static inline bool do_resample_x_ratio(T*, const T*, int, int, int, const Resampler_Contrib_Table<T>*, int) { return false; }
+
+// Filters one interleaved scanline with N channels, walking each destination sample's contributor list once for all channels.
+template<typename Real, int N>
+static void resample_x_channels(Real* Pdst, const Real* Psrc, int src_pixel_stride, const Resampler_Contrib_List<Real>* Pclist, int dst_x)
+{
+   int i, j, c;
+   Real total[N];
+   const Resampler_Contrib<Real>* p;
+
+   for (i = dst_x; i > 0; i--, Pclist++)
+   {
+      for (c = 0; c < N; c++)
+         total[c] = 0;
+
+      for (j = Pclist->n, p = Pclist->p; j > 0; j--, p++)
+      {
+         const Real* Ps = Psrc + p->pixel * src_pixel_stride;
+         for (c = 0; c < N; c++)
+            total[c] += Ps[c] * p->weight;
+      }
+
+      for (c = 0; c < N; c++)
+         *Pdst++ = total[c];
+   }
+}
+
+static inline double get_pass_time()
+{
+   return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Calls the begin callback (if any) and returns the start time of the pass if pass timing is enabled.
+template<typename Real, typename Storage>
+inline double Resampler_T<Real, Storage>::begin_pass(Pass pass)
+{
+   if (m_trace.Pbegin)
+      m_trace.Pbegin(pass, m_trace.pUser);
+
+   return m_pass_timing ? get_pass_time() : 0.0;
+}
+
+template<typename Real, typename Storage>
+inline void Resampler_T<Real, Storage>::end_pass(Pass pass, double start_time)
+{
+   if (m_pass_timing)
+      ((pass == PASS_X) ? m_stats.x_seconds : m_stats.y_seconds) += get_pass_time() - start_time;
+
+   if (m_trace.Pend)
+      m_trace.Pend(pass, m_trace.pUser);
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::resample_x(Sample* Pdst, const Sample* Psrc, int src_pixel_stride)
+{
+   const double start_time = begin_pass(PASS_X);
+
+   m_stats.x_taps += m_x_taps_per_line;
+   filter_x(Pdst, Psrc, src_pixel_stride);
+
+   end_pass(PASS_X, start_time);
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::filter_x(Sample* Pdst, const Sample* Psrc, int src_pixel_stride)
+{
+   resampler_assert(Pdst);
+   resampler_assert(Psrc);
+
+#if RESAMPLER_RATIO_X_KERNELS
+   if ((m_Ptable_x) && (m_Ptable_x->ratio_end) && (do_resample_x_ratio(Pdst, Psrc, m_resample_src_x, m_num_channels, src_pixel_stride, m_Ptable_x, m_resample_dst_x)))
+      return;
+#endif
+
+   if ((m_Ptable_x) && (do_resample_x_table(Pdst, Psrc, m_resample_src_x, m_num_channels, src_pixel_stride, m_Ptable_x->start, m_Ptable_x->phase, m_Ptable_x->weight, m_Ptable_x->n, m_resample_dst_x)))
+      return;
+
+   switch (m_num_channels)
+   {
+      case 1:
+      {
+         int i, j;
+         Sample total;
+         Contrib_List *Pclist = m_Pclist_x;
+         Contrib *p;
+
+         if (src_pixel_stride == 1)
+         {
+            for (i = m_resample_dst_x; i > 0; i--, Pclist++)
+            {
+               for (j = Pclist->n, p = Pclist->p, total = 0; j > 0; j--, p++)
+                  total += Psrc[p->pixel] * p->weight;
+
+               *Pdst++ = total;
+            }
+         }
+         else
+            resample_x_channels<Real, 1>(Pdst, Psrc, src_pixel_stride, m_Pclist_x, m_resample_dst_x);
+         break;
+      }
+      case 2: resample_x_channels<Real, 2>(Pdst, Psrc, src_pixel_stride, m_Pclist_x, m_resample_dst_x); break;
+      case 3: resample_x_channels<Real, 3>(Pdst, Psrc, src_pixel_stride, m_Pclist_x, m_resample_dst_x); break;
+      case 4: resample_x_channels<Real, 4>(Pdst, Psrc, src_pixel_stride, m_Pclist_x, m_resample_dst_x); break;
+      default:
+      {
+         int i, j, c;
+         Sample total[RESAMPLER_MAX_CHANNELS];
+         Contrib_List *Pclist = m_Pclist_x;
+         Contrib *p;
+
+         for (i = m_resample_dst_x; i > 0; i--, Pclist++)
+         {
+            for (c = 0; c < m_num_channels; c++)
+               total[c] = 0;
+
+            for (j = Pclist->n, p = Pclist->p; j > 0; j--, p++)
+            {
+               const Sample* Ps = Psrc + p->pixel * src_pixel_stride;
+               for (c = 0; c < m_num_channels; c++)
+                  total[c] += Ps[c] * p->weight;
+            }
+
+            for (c = 0; c < m_num_channels; c++)
+               *Pdst++ = total[c];
+         }
+         break;
+      }
+   }
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::scale_y_mov(Sample* Ptmp, const Scan_Sample* Psrc, Real weight, int dst_x)
+{
+   do_scale_y_mov(Ptmp, Psrc, weight, dst_x);
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::scale_y_add(Sample* Ptmp, const Scan_Sample* Psrc, Real weight, int dst_x)
+{
+   do_scale_y_add(Ptmp, Psrc, weight, dst_x);
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::clamp(Sample* Pdst, int n)
+{
+   do_clamp(Pdst, n, m_lo, m_hi);
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::resample_y(Sample* Pdst)
+{
+   int i, j;
+   const Scan_Sample* Psrc;
+   Contrib_List* Pclist = &m_Pclist_y[m_cur_dst_y];
+
+   Sample* Ptmp = m_delay_x_resample ? m_Ptmp_buf : Pdst;
+   resampler_assert(Ptmp);
+
+   // In Y-X order only the columns of the source window are filtered, the X pass doesn't read the others.
+   const int first = m_delay_x_resample ? m_src_window.x * m_num_channels : 0;
+   const int num_samples = (m_delay_x_resample ? m_src_window.width : m_intermediate_x) * m_num_channels;
+
+   const double start_time = begin_pass(PASS_Y);
+
+   m_stats.y_taps += (unsigned long long)Pclist->n * num_samples;
+
+   /* Process each contributor. */
+
+   for (i = 0; i < Pclist->n; i++)
+   {
+      /* locate the contributor's location in the scan
+      * buffer -- the contributor must always be found!
+      */
+
+      j = m_Psrc_y_slot[resampler_range_check(Pclist->p[i].pixel, m_resample_src_y)];
+
+      resampler_assert((j >= 0) && (m_Pscan_buf->scan_buf_y[j] == Pclist->p[i].pixel));
+
+      Psrc = m_Pscan_buf->scan_buf_row[j] + first;
+
+#if RESAMPLER_FUSED_Y_PASS
+      m_Pscan_src[i] = Psrc;
+      m_Pscan_weight[i] = Pclist->p[i].weight;
+#else
+      if (!i)
+         scale_y_mov(Ptmp + first, Psrc, Pclist->p[i].weight, num_samples);
+      else
+         scale_y_add(Ptmp + first, Psrc, Pclist->p[i].weight, num_samples);
+#endif
+
+      /* If this source line doesn't contribute to any
+      * more destination lines then mark the scanline buffer slot
+      * which holds this source line as free.
+      * (The max. number of slots used depends on the Y
+      * axis sampling factor and the scaled filter width.)
+      * The slot's contents stay valid until the next put_line().
+      */
+
+      if (--m_Psrc_y_count[resampler_range_check(Pclist->p[i].pixel, m_resample_src_y)] == 0)
+      {
+         m_Psrc_y_slot[resampler_range_check(Pclist->p[i].pixel, m_resample_src_y)] = -1;
+         m_Pscan_buf->scan_buf_y[j] = -1;
+         m_Pscan_buf->free_slot[m_Pscan_buf->num_free++] = j;
+      }
+   }
+
+#if RESAMPLER_FUSED_Y_PASS
+   {
+      // When X resampling isn't delayed this is the final pass, so clamp while storing.
+      const bool clamp_now = (!m_delay_x_resample) && (m_lo < m_hi);
+
+      do_scale_y_fused(Ptmp + first, m_Pscan_src, m_Pscan_weight, Pclist->n, num_samples, clamp_now, m_lo, m_hi);
+   }
+#endif
+
+   /* Now generate the destination line */
+
+   if (m_delay_x_resample) // Was X resampling delayed until after Y resampling?
+   {
+      resampler_assert(Pdst != Ptmp);
+
+      end_pass(PASS_Y, start_time);
+
+      resample_x(Pdst, Ptmp, m_num_channels);
+
+      if (m_lo < m_hi)
+         clamp(Pdst, m_resample_dst_x * m_num_channels);
+   }
+   else
+   {
+      resampler_assert(Pdst == Ptmp);
+
+#if !RESAMPLER_FUSED_Y_PASS
+      if (m_lo < m_hi)
+         clamp(Pdst, m_resample_dst_x * m_num_channels);
+#endif
+
+      end_pass(PASS_Y, start_time);
+   }
+}
+
+// Returns the maximum number of source scanlines which are buffered at once, assuming the caller
+// retrieves all available destination scanlines after each put_line().
+template<typename Real, typename Storage>
+int Resampler_T<Real, Storage>::calc_scan_buf_size()
+{
+   // m_Psrc_y_slot is free for use as scratch space, init() refills it.
+   int* Pcount = m_Psrc_y_slot;
+   memcpy(Pcount, m_Psrc_y_count, m_resample_src_y * sizeof(int));
+
+   // last_y is the last source scanline of destination scanline dst_y, -1 until it's found. The scanlines it needs
+   // stay buffered until it's done, so it's done as soon as last_y has been added.
+   int i, j, dst_y = 0, cur = 0, max_size = 1, last_y = -1;
+   for (i = 0; i < m_resample_src_y; i++)
+   {
+      if (!Pcount[i])
+         continue;
+
+      ++cur;
+      if (cur > max_size)
+         max_size = cur;
+
+      while (dst_y < m_resample_dst_y)
+      {
+         const Contrib_List& l = m_Pclist_y[dst_y];
+         if (last_y < 0)
+         {
+            for (j = 0; j < l.n; j++)
+               last_y = max(last_y, (int)l.p[j].pixel);
+         }
+         if (last_y > i)
+            break;
+
+         last_y = -1;
+
+         for (j = 0; j < l.n; j++)
+         {
+            if (--Pcount[l.p[j].pixel] == 0)
+               cur--;
+         }
+
+         dst_y++;
+      }
+   }
+
+   return max_size;
+}
+
+// Makes Pbuf hold at least n elements, reallocating it only if it's smaller. The contents aren't preserved.
+template<typename T>
+static bool reserve_buf(T*& Pbuf, int& capacity, int n)
+{
+   if ((Pbuf) && (capacity >= n))
+      return true;
+
+   free(Pbuf);
+   Pbuf = (T*)malloc(n * sizeof(T));
+   capacity = Pbuf ? n : 0;
+
+   return Pbuf != NULL;
+}
+
+// Grows the scanline buffer to new_size slots (the new slots are unallocated and free).
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::resize_scan_buf(int new_size)
+{
+   Scan_Buf* Pbuf = m_Pscan_buf;
+   resampler_assert(new_size > Pbuf->size);
+
+   // The slot arrays are still long enough after a reset() to a smaller buffer.
+   if (new_size > Pbuf->capacity)
+   {
+      int* Pfree_slot = (int*)realloc(Pbuf->free_slot, new_size * sizeof(int));
+      if (!Pfree_slot)
+         return false;
+      Pbuf->free_slot = Pfree_slot;
+
+      int* Pscan_buf_y = (int*)realloc(Pbuf->scan_buf_y, new_size * sizeof(int));
+      if (!Pscan_buf_y)
+         return false;
+      Pbuf->scan_buf_y = Pscan_buf_y;
+
+      Scan_Sample** Pscan_buf_l = (Scan_Sample**)realloc(Pbuf->scan_buf_l, new_size * sizeof(Scan_Sample*));
+      if (!Pscan_buf_l)
+         return false;
+      Pbuf->scan_buf_l = Pscan_buf_l;
+
+      const Scan_Sample** Pscan_buf_row = (const Scan_Sample**)realloc(Pbuf->scan_buf_row, new_size * sizeof(const Scan_Sample*));
+      if (!Pscan_buf_row)
+         return false;
+      Pbuf->scan_buf_row = Pscan_buf_row;
+
+      Pbuf->capacity = new_size;
+   }
+
+   // Push the new slots so the lowest numbered slot is handed out first.
+   for (int i = new_size - 1; i >= Pbuf->size; i--)
+   {
+      Pbuf->scan_buf_y[i] = -1;
+      Pbuf->scan_buf_l[i] = NULL;
+      Pbuf->scan_buf_row[i] = NULL;
+      Pbuf->free_slot[Pbuf->num_free++] = i;
+   }
+
+   Pbuf->size = new_size;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::put_line(const Sample* Psrc)
+{
+   return add_line(Psrc, m_num_channels, false);
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::put_line(const Sample* Psrc, int src_pixel_stride)
+{
+   return add_line(Psrc, src_pixel_stride, false);
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::put_line_borrowed(const Sample* Psrc)
+{
+   return add_line(Psrc, m_num_channels, true);
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::put_line(const unsigned char* Psrc, int src_pixel_stride)
+{
+   return add_line(Psrc, src_pixel_stride, false);
+}
+
+template<typename Real, typename Storage>
+template<typename T>
+bool Resampler_T<Real, Storage>::add_line(const T* Psrc, int src_pixel_stride, bool borrow)
+{
+   int i;
+
+   resampler_assert(src_pixel_stride >= m_num_channels);
+
+   if (m_cur_src_y >= m_resample_src_y)
+      return false;
+
+   /* Does this source line contribute
+   * to any destination line? if not,
+   * exit now.
+   */
+
+   if (!m_Psrc_y_count[resampler_range_check(m_cur_src_y, m_resample_src_y)])
+   {
+      m_cur_src_y++;
+      return true;
+   }
+
+   // Samples which aren't linear Samples yet are decoded on their way into the first pass.
+   const bool decode = (!std::is_same<T, Sample>::value) || (input_stage());
+   const Sample* Psamples = (const Sample*)Psrc;
+
+   if (decode)
+   {
+      if ((!std::is_same<T, Sample>::value) && (!m_Pdecode_table) && (!build_decode_table()))
+         return false;
+
+      if (!reserve_buf(m_Pdecode_buf, m_capacity.decode_buf, m_resample_src_x * m_num_channels))
+      {
+         m_status = STATUS_OUT_OF_MEMORY;
+         return false;
+      }
+   }
+
+   if ((i = get_scan_slot()) < 0)
+      return false;
+
+   // In Y-X order a borrowed scanline which doesn't need any conversion is filtered straight out of the caller's memory.
+   if ((borrow) && (!decode) && (m_delay_x_resample) && (src_pixel_stride == m_num_channels) && (std::is_same<Sample, Scan_Sample>::value))
+   {
+      m_Pscan_buf->scan_buf_row[i] = (const Scan_Sample*)Psamples;
+      m_cur_src_y++;
+      return true;
+   }
+
+   if (!alloc_scan_slot_line(i))
+      return false;
+
+   // Resampling on the X axis first?
+   if (m_delay_x_resample)
+   {
+      resampler_assert(m_intermediate_x == m_resample_src_x);
+
+      // Y-X resampling order: only the source window's columns are stored, the Y pass doesn't read the others.
+      const int first = m_src_window.x * m_num_channels;
+      const int num_samples = m_src_window.width * m_num_channels;
+
+      if ((decode) && (std::is_same<Sample, Scan_Sample>::value))
+         decode_line((Sample*)m_Pscan_buf->scan_buf_l[i], Psrc, src_pixel_stride);
+      else if (decode)
+      {
+         decode_line(m_Pdecode_buf, Psrc, src_pixel_stride);
+         do_store_samples(m_Pscan_buf->scan_buf_l[i] + first, m_Pdecode_buf + first, num_samples);
+      }
+      else if ((src_pixel_stride == m_num_channels) && (std::is_same<Sample, Scan_Sample>::value))
+         memcpy(m_Pscan_buf->scan_buf_l[i] + first, Psamples + first, num_samples * sizeof(Sample));
+      else if (src_pixel_stride == m_num_channels)
+         do_store_samples(m_Pscan_buf->scan_buf_l[i] + first, Psamples + first, num_samples);
+      else
+      {
+         Scan_Sample* Pdst = m_Pscan_buf->scan_buf_l[i] + first;
+         Psamples += (size_t)m_src_window.x * src_pixel_stride;
+         for (int x = 0; x < m_src_window.width; x++, Psamples += src_pixel_stride)
+            for (int c = 0; c < m_num_channels; c++)
+               store_sample(*Pdst++, Psamples[c]);
+      }
+   }
+   else
+   {
+      resampler_assert(m_intermediate_x == m_resample_dst_x);
+
+      if (decode)
+      {
+         decode_line(m_Pdecode_buf, Psrc, src_pixel_stride);
+         Psamples = m_Pdecode_buf;
+         src_pixel_stride = m_num_channels;
+      }
+
+      // X-Y resampling order
+      if (std::is_same<Sample, Scan_Sample>::value)
+         resample_x((Sample*)m_Pscan_buf->scan_buf_l[i], Psamples, src_pixel_stride);
+      else
+      {
+         // Filter into the temp buffer, then convert to the scanline storage type.
+         resample_x(m_Ptmp_buf, Psamples, src_pixel_stride);
+         do_store_samples(m_Pscan_buf->scan_buf_l[i], m_Ptmp_buf, m_intermediate_x * m_num_channels);
+      }
+   }
+
+   m_Pscan_buf->scan_buf_row[i] = m_Pscan_buf->scan_buf_l[i];
+
+   m_cur_src_y++;
+
+   return true;
+}
+
+// Grabs an empty slot in the scanline buffer for the current source scanline, growing the buffer if the caller is holding
+// on to more lines than expected. -1 on out of memory.
+template<typename Real, typename Storage>
+int Resampler_T<Real, Storage>::get_scan_slot()
+{
+   if (!m_Pscan_buf->num_free)
+   {
+      if (!resize_scan_buf(m_Pscan_buf->size * 2))
+      {
+         m_status = STATUS_OUT_OF_MEMORY;
+         return -1;
+      }
+   }
+
+   const int i = m_Pscan_buf->free_slot[--m_Pscan_buf->num_free];
+
+   m_stats.scan_buf_high_water = max(m_stats.scan_buf_high_water, m_Pscan_buf->size - m_Pscan_buf->num_free);
+
+   m_Psrc_y_slot[resampler_range_check(m_cur_src_y, m_resample_src_y)] = i;
+   m_Pscan_buf->scan_buf_y[i] = m_cur_src_y;
+
+   return i;
+}
+
+// Makes sure slot i has memory allocated to it (the slots added by growing the buffer get theirs on first use).
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::alloc_scan_slot_line(int i)
+{
+   if (!m_Pscan_buf->scan_buf_l[i])
+   {
+      resampler_assert(i >= m_Pscan_buf->arena_size);
+
+      if ((m_Pscan_buf->scan_buf_l[i] = (Scan_Sample*)m_allocator.Palloc(m_intermediate_x * m_num_channels * sizeof(Scan_Sample), m_allocator.pUser)) == NULL)
+      {
+         m_status = STATUS_OUT_OF_MEMORY;
+         return false;
+      }
+   }
+
+   return true;
+}
+
+// X-Y order only: adds the current source scanline already decoded (see decode_line()) and resampled on the X axis
+// (dst_x packed samples) by a Resampler with the same X contributor lists, see Resampler_Batch and stream_pipelined().
+// Storing it is then just a copy.
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::put_line_x_filtered(const Sample* Psrc)
+{
+   resampler_assert(!m_delay_x_resample);
+
+   if (m_cur_src_y >= m_resample_src_y)
+      return false;
+
+   if (!m_Psrc_y_count[resampler_range_check(m_cur_src_y, m_resample_src_y)])
+   {
+      m_cur_src_y++;
+      return true;
+   }
+
+   const int i = get_scan_slot();
+   if ((i < 0) || (!alloc_scan_slot_line(i)))
+      return false;
+
+   if (std::is_same<Sample, Scan_Sample>::value)
+      memcpy(m_Pscan_buf->scan_buf_l[i], Psrc, m_intermediate_x * m_num_channels * sizeof(Sample));
+   else
+      do_store_samples(m_Pscan_buf->scan_buf_l[i], Psrc, m_intermediate_x * m_num_channels);
+
+   m_Pscan_buf->scan_buf_row[i] = m_Pscan_buf->scan_buf_l[i];
+
+   m_cur_src_y++;
+
+   return true;
+}
+
+// Multiplies the color channels of a pixel by its alpha.
+template<typename T>
+static inline void premultiply_pixel(T* Ppixel, int num_channels, int alpha_channel)
+{
+   const T a = Ppixel[alpha_channel];
+   for (int c = 0; c < num_channels; c++)
+      if (c != alpha_channel)
+         Ppixel[c] *= a;
+}
+
+// The factor which undoes premultiply_pixel().
+template<typename T>
+static inline T unpremultiply_scale(T a)
+{
+   return (a > 0) ? (T(1) / a) : T(0);
+}
+
+// Converts a source scanline to packed linear (and premultiplied) samples.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::decode_line(Sample* Pdst, const Sample* Psrc, int src_pixel_stride) const
+{
+   const Transfer& t = m_input_transfer;
+   const unsigned int linear_channel_mask = (t.func == TRANSFER_LINEAR) ? ~0U : t.linear_channel_mask;
+
+   for (int x = 0; x < m_resample_src_x; x++, Psrc += src_pixel_stride, Pdst += m_num_channels)
+   {
+      for (int c = 0; c < m_num_channels; c++)
+         Pdst[c] = (linear_channel_mask & (1U << c)) ? Psrc[c] : transfer_to_linear(t.func, t.gamma, Psrc[c]);
+
+      if (m_alpha_channel >= 0)
+         premultiply_pixel(Pdst, m_num_channels, m_alpha_channel);
+   }
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::decode_line(Sample* Pdst, const unsigned char* Psrc, int src_pixel_stride) const
+{
+   const Real* Ptables[RESAMPLER_MAX_CHANNELS];
+   for (int c = 0; c < m_num_channels; c++)
+   {
+      const bool linear = (m_input_transfer.func == TRANSFER_LINEAR) || (m_input_transfer.linear_channel_mask & (1U << c));
+      Ptables[c] = m_Pdecode_table + (linear ? 256 : 0);
+   }
+
+   for (int x = 0; x < m_resample_src_x; x++, Psrc += src_pixel_stride, Pdst += m_num_channels)
+   {
+      for (int c = 0; c < m_num_channels; c++)
+         Pdst[c] = Ptables[c][Psrc[c]];
+
+      if (m_alpha_channel >= 0)
+         premultiply_pixel(Pdst, m_num_channels, m_alpha_channel);
+   }
+}
+
+// Undoes the premultiplication and applies the output transfer function to a destination scanline in place.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::encode_line(Sample* Psamples) const
+{
+   const Transfer& t = m_output_transfer;
+   const unsigned int linear_channel_mask = (t.func == TRANSFER_LINEAR) ? ~0U : t.linear_channel_mask;
+
+   for (int x = 0; x < m_resample_dst_x; x++, Psamples += m_num_channels)
+   {
+      if (m_alpha_channel >= 0)
+      {
+         const Real scale = unpremultiply_scale(Psamples[m_alpha_channel]);
+         for (int c = 0; c < m_num_channels; c++)
+            if (c != m_alpha_channel)
+               Psamples[c] *= scale;
+      }
+
+      for (int c = 0; c < m_num_channels; c++)
+         if (!(linear_channel_mask & (1U << c)))
+            Psamples[c] = linear_to_transfer(t.func, t.gamma, Psamples[c]);
+   }
+}
+
+// Converts a linear destination scanline to 8-bit output transfer encoded samples. Code k is the result for the samples
+// in [threshold[k - 1], threshold[k]), so the start table gets each sample to its code (or just below it) with one lookup.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::encode_unorm8(unsigned char* Pdst, int dst_pixel_stride, const Sample* Psrc) const
+{
+   const Real* Pthreshold = m_Pencode_threshold;
+   const unsigned char* Pstart = m_Pencode_start;
+   const unsigned int linear_channel_mask = (m_output_transfer.func == TRANSFER_LINEAR) ? ~0U : m_output_transfer.linear_channel_mask;
+
+   for (int x = 0; x < m_resample_dst_x; x++, Pdst += dst_pixel_stride, Psrc += m_num_channels)
+   {
+      const Real scale = (m_alpha_channel >= 0) ? unpremultiply_scale(Psrc[m_alpha_channel]) : RR(1.0);
+
+      for (int c = 0; c < m_num_channels; c++)
+      {
+         Real f = (c != m_alpha_channel) ? (Psrc[c] * scale) : Psrc[c];
+         // Written so NaN's become 0.
+         if (!(f > 0))
+            f = 0;
+         else if (f > 1)
+            f = 1;
+
+         if (linear_channel_mask & (1U << c))
+            Pdst[c] = (unsigned char)(f * RR(255.0) + RR(.5));
+         else
+         {
+            int k = Pstart[(int)(f * ENCODE_TABLE_SIZE)];
+            while (f >= Pthreshold[k])
+               k++;
+            Pdst[c] = (unsigned char)k;
+         }
+      }
+   }
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::build_decode_table()
+{
+   if ((m_Pdecode_table = (Real*)malloc(512 * sizeof(Real))) == NULL)
+   {
+      m_status = STATUS_OUT_OF_MEMORY;
+      return false;
+   }
+
+   for (int i = 0; i < 256; i++)
+   {
+      const double f = i * (1.0 / 255.0);
+      m_Pdecode_table[i] = (Real)transfer_to_linear(m_input_transfer.func, (double)m_input_transfer.gamma, f);
+      m_Pdecode_table[256 + i] = (Real)f;
+   }
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::build_encode_table()
+{
+   if ((m_Pencode_threshold = (Real*)malloc(256 * sizeof(Real) + ENCODE_TABLE_SIZE + 1)) == NULL)
+   {
+      m_status = STATUS_OUT_OF_MEMORY;
+      return false;
+   }
+
+   m_Pencode_start = (unsigned char*)(m_Pencode_threshold + 256);
+
+   // The linear sample encoding to each code's upper half way point. The last one is never reached by clamped samples.
+   for (int k = 0; k < 255; k++)
+      m_Pencode_threshold[k] = (Real)transfer_to_linear(m_output_transfer.func, (double)m_output_transfer.gamma, (k + .5) / 255.0);
+   m_Pencode_threshold[255] = RR(2.0);
+
+   int k = 0;
+   for (int j = 0; j <= ENCODE_TABLE_SIZE; j++)
+   {
+      const Real f = (Real)j * RR(1.0 / ENCODE_TABLE_SIZE);
+      while (f >= m_Pencode_threshold[k])
+         k++;
+      m_Pencode_start[j] = (unsigned char)k;
+   }
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::set_input_transfer(Transfer_Func func, Real gamma, unsigned int linear_channel_mask)
+{
+   if (!(gamma > 0))
+      return false;
+
+   m_input_transfer.func = func;
+   m_input_transfer.gamma = gamma;
+   m_input_transfer.linear_channel_mask = linear_channel_mask;
+
+   // Rebuilt for the new function on first use.
+   free(m_Pdecode_table);
+   m_Pdecode_table = NULL;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::set_output_transfer(Transfer_Func func, Real gamma, unsigned int linear_channel_mask)
+{
+   if (!(gamma > 0))
+      return false;
+
+   m_output_transfer.func = func;
+   m_output_transfer.gamma = gamma;
+   m_output_transfer.linear_channel_mask = linear_channel_mask;
+
+   free(m_Pencode_threshold);
+   m_Pencode_threshold = NULL;
+   m_Pencode_start = NULL;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::set_premultiplied_alpha(int alpha_channel)
+{
+   if ((alpha_channel < -1) || (alpha_channel >= m_num_channels))
+      return false;
+
+   m_alpha_channel = alpha_channel;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::line_available() const
+{
+   int i;
+
+   /* If all the destination lines have been
+   * generated, then always return false.
+   */
+
+   if (m_cur_dst_y == m_resample_dst_y)
+      return false;
+
+   /* Check to see if all the required
+   * contributors are present, if not,
+   * return false.
+   */
+
+   for (i = 0; i < m_Pclist_y[m_cur_dst_y].n; i++)
+      if (m_Psrc_y_slot[resampler_range_check(m_Pclist_y[m_cur_dst_y].p[i].pixel, m_resample_src_y)] < 0)
+         return false;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+const typename Resampler_T<Real, Storage>::Sample* Resampler_T<Real, Storage>::get_line()
+{
+   if (!line_available())
+      return NULL;
+
+   resample_y(m_Pdst_buf);
+
+   if (output_stage())
+      encode_line(m_Pdst_buf);
+
+   m_cur_dst_y++;
+
+   return m_Pdst_buf;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::get_line_into(Sample* Pdst, int dst_pixel_stride)
+{
+   resampler_assert(dst_pixel_stride >= m_num_channels);
+
+   if (!line_available())
+      return false;
+
+   // Packed output is written by the last pass directly.
+   if (dst_pixel_stride == m_num_channels)
+   {
+      resample_y(Pdst);
+
+      if (output_stage())
+         encode_line(Pdst);
+   }
+   else
+   {
+      resample_y(m_Pdst_buf);
+
+      if (output_stage())
+         encode_line(m_Pdst_buf);
+
+      const Sample* Psrc = m_Pdst_buf;
+      for (int x = 0; x < m_resample_dst_x; x++, Pdst += dst_pixel_stride)
+         for (int c = 0; c < m_num_channels; c++)
+            Pdst[c] = *Psrc++;
+   }
+
+   m_cur_dst_y++;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::get_line_into(unsigned char* Pdst, int dst_pixel_stride)
+{
+   resampler_assert(dst_pixel_stride >= m_num_channels);
+
+   if ((m_output_transfer.func != TRANSFER_LINEAR) && (!m_Pencode_threshold) && (!build_encode_table()))
+      return false;
+
+   if (!line_available())
+      return false;
+
+   resample_y(m_Pdst_buf);
+
+   // The row is still in the cache, convert it right away.
+   if (output_stage())
+      encode_unorm8(Pdst, dst_pixel_stride, m_Pdst_buf);
+   else if (dst_pixel_stride == m_num_channels)
+      do_store_unorm(Pdst, m_Pdst_buf, m_resample_dst_x * m_num_channels);
+   else
+      store_unorm_strided(Pdst, dst_pixel_stride, m_Pdst_buf, m_resample_dst_x, m_num_channels);
+
+   m_cur_dst_y++;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::get_line_into(unsigned short* Pdst, int dst_pixel_stride)
+{
+   resampler_assert(dst_pixel_stride >= m_num_channels);
+
+   if (!line_available())
+      return false;
+
+   resample_y(m_Pdst_buf);
+
+   if (output_stage())
+      encode_line(m_Pdst_buf);
+
+   if (dst_pixel_stride == m_num_channels)
+      do_store_unorm(Pdst, m_Pdst_buf, m_resample_dst_x * m_num_channels);
+   else
+      store_unorm_strided(Pdst, dst_pixel_stride, m_Pdst_buf, m_resample_dst_x, m_num_channels);
+
+   m_cur_dst_y++;
+
+   return true;
+}
+
+template<typename Real, typename Storage>
+Resampler_T<Real, Storage>::~Resampler_T()
+{
+
+#if RESAMPLER_DEBUG_OPS
+   printf("actual ops: %llu\n", m_stats.x_taps + m_stats.y_taps);
+#endif
+
+   free_buffers();
+}
+
+/* Don't deallocate a contibutor list
+* if the user passed us one of their own.
+*/
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::drop_clist(Contrib_List* Pclist, bool cached, bool forced)
+{
+   if (!Pclist)
+      return;
+
+   if (cached)
+      release_clist(Pclist);
+   else if (!forced)
+      free_clist(Pclist);
+}
+
+// Frees everything the instance owns and leaves the pointers NULL.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::free_buffers()
+{
+   free(m_Pdst_buf);
+   m_Pdst_buf = NULL;
+
+   free(m_Ptmp_buf);
+   m_Ptmp_buf = NULL;
+
+   free(m_Pdecode_table);
+   m_Pdecode_table = NULL;
+
+   free(m_Pencode_threshold);
+   m_Pencode_threshold = NULL;
+   m_Pencode_start = NULL;
+
+   free(m_Pdecode_buf);
+   m_Pdecode_buf = NULL;
+
+   free_contrib_table(m_Ptable_x);
+   m_Ptable_x = NULL;
+
+   drop_clist(m_Pclist_x, m_clist_x_cached, m_clist_x_forced);
+   m_Pclist_x = NULL;
+
+   drop_clist(m_Pclist_y, m_clist_y_cached, m_clist_y_forced);
+   m_Pclist_y = NULL;
+
+   free(m_Pscan_src);
+   m_Pscan_src = NULL;
+
+   free(m_Pscan_weight);
+   m_Pscan_weight = NULL;
+
+   free(m_Psrc_y_count);
+   m_Psrc_y_count = NULL;
+
+   free(m_Psrc_y_slot);
+   m_Psrc_y_slot = NULL;
 
    if (m_Pscan_buf)
    {
-      for (i = 0; i < MAX_SCAN_BUF_SIZE; i++)
-         free(m_Pscan_buf->scan_buf_l[i]);
+      free_scan_buf_lines();
+      free_scan_buf_arena();
+
+      free(m_Pscan_buf->free_slot);
+      free(m_Pscan_buf->scan_buf_y);
+      free(m_Pscan_buf->scan_buf_l);
+      free(m_Pscan_buf->scan_buf_row);
+      free(m_Pscan_buf);
+      m_Pscan_buf = NULL;
+   }
+
+   memset(&m_capacity, 0, sizeof(m_capacity));
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::restart()
+{
+   if (STATUS_OKAY != m_status)
+      return;
+
+   m_cur_src_y = m_cur_dst_y = 0;
+
+   int i, j;
+   for (i = 0; i < m_resample_src_y; i++)
+   {
+      m_Psrc_y_count[i] = 0;
+      m_Psrc_y_slot[i] = -1;
+   }
+
+   for (i = 0; i < m_resample_dst_y; i++)
+   {
+      for (j = 0; j < m_Pclist_y[i].n; j++)
+         m_Psrc_y_count[resampler_range_check(m_Pclist_y[i].p[j].pixel, m_resample_src_y)]++;
+   }
+
+   for (i = 0; i < m_Pscan_buf->size; i++)
+   {
+      m_Pscan_buf->scan_buf_y[i] = -1;
+      m_Pscan_buf->free_slot[i] = m_Pscan_buf->size - 1 - i;
+   }
+
+   m_Pscan_buf->num_free = m_Pscan_buf->size;
+}
+
+static void* default_alloc(size_t size, void* pUser)
+{
+   (void)pUser;
+   return malloc(size);
+}
+
+static void default_free(void* p, void* pUser)
+{
+   (void)pUser;
+   free(p);
+}
+
+// Points the first arena_size (= size) slots into the arena, which is only reallocated if it's too small for them.
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::alloc_scan_buf_lines()
+{
+   Scan_Buf* Pbuf = m_Pscan_buf;
+   resampler_assert(!Pbuf->arena_size);
+
+   const size_t align = 64;
+   const size_t arena_size = (size_t)Pbuf->size * m_scan_buf_pitch * sizeof(Scan_Sample) + align;
+   if (arena_size > Pbuf->arena_capacity)
+   {
+      free_scan_buf_arena();
 
-      free(m_Pscan_buf);
-      m_Pscan_buf = NULL;
+      Pbuf->Parena = m_allocator.Palloc(arena_size, m_allocator.pUser);
+      if (!Pbuf->Parena)
+         return false;
+
+      Pbuf->arena_capacity = arena_size;
    }
+
+   Scan_Sample* Pline = (Scan_Sample*)(((size_t)Pbuf->Parena + align - 1) & ~(align - 1));
+   for (int i = 0; i < Pbuf->size; i++, Pline += m_scan_buf_pitch)
+      Pbuf->scan_buf_l[i] = Pline;
+
+   Pbuf->arena_size = Pbuf->size;
+
+   return true;
 }
 
-void Resampler::restart()
+// Frees the lines of the slots added by growing the buffer and detaches all the slots, the arena is kept.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::free_scan_buf_lines()
 {
-   if (STATUS_OKAY != m_status)
-      return;
+   Scan_Buf* Pbuf = m_Pscan_buf;
 
-   m_cur_src_y = m_cur_dst_y = 0;
-
-   int i, j;
-   for (i = 0; i < m_resample_src_y; i++)
+   for (int i = 0; i < Pbuf->size; i++)
    {
-      m_Psrc_y_count[i] = 0;
-      m_Psrc_y_flag[i] = FALSE;
+      if ((i >= Pbuf->arena_size) && (Pbuf->scan_buf_l[i]))
+         m_allocator.Pfree(Pbuf->scan_buf_l[i], m_allocator.pUser);
+
+      Pbuf->scan_buf_l[i] = NULL;
    }
 
-   for (i = 0; i < m_resample_dst_y; i++)
+   Pbuf->arena_size = 0;
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::free_scan_buf_arena()
+{
+   Scan_Buf* Pbuf = m_Pscan_buf;
+
+   if (Pbuf->Parena)
    {
-      for (j = 0; j < m_Pclist_y[i].n; j++)
-         m_Psrc_y_count[resampler_range_check(m_Pclist_y[i].p[j].pixel, m_resample_src_y)]++;
+      m_allocator.Pfree(Pbuf->Parena, m_allocator.pUser);
+      Pbuf->Parena = NULL;
    }
 
-   for (i = 0; i < MAX_SCAN_BUF_SIZE; i++)
+   Pbuf->arena_capacity = 0;
+}
+
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::set_allocator(const Allocator* Pallocator)
+{
+   if ((STATUS_OKAY != m_status) || (m_cur_src_y) || (m_Pscan_buf->num_free != m_Pscan_buf->size))
+      return false;
+
+   free_scan_buf_lines();
+   free_scan_buf_arena();
+
+   if (Pallocator)
+      m_allocator = *Pallocator;
+   else
    {
-      m_Pscan_buf->scan_buf_y[i] = -1;
+      m_allocator.Palloc = default_alloc;
+      m_allocator.Pfree = default_free;
+      m_allocator.pUser = NULL;
+   }
 
-      free(m_Pscan_buf->scan_buf_l[i]);
-      m_Pscan_buf->scan_buf_l[i] = NULL;
+   if (!alloc_scan_buf_lines())
+   {
+      m_status = STATUS_OUT_OF_MEMORY;
+      return false;
    }
+
+   return true;
 }
 
-Resampler::Resampler(int src_x, int src_y,
-                     int dst_x, int dst_y,
-                     Boundary_Op boundary_op,
-                     Resample_Real sample_low, Resample_Real sample_high,
-                     const char* Pfilter_name,
-                     Contrib_List* Pclist_x,
-                     Contrib_List* Pclist_y,
-                     Resample_Real filter_x_scale,
-                     Resample_Real filter_y_scale,
-                     Resample_Real src_x_ofs,
-                     Resample_Real src_y_ofs)
+template<typename Real, typename Storage>
+Resampler_T<Real, Storage>::Resampler_T(int src_x, int src_y,
+                                        int dst_x, int dst_y,
+                                        Boundary_Op boundary_op,
+                                        Real sample_low, Real sample_high,
+                                        const char* Pfilter_name,
+                                        Contrib_List* Pclist_x,
+                                        Contrib_List* Pclist_y,
+                                        Real filter_x_scale,
+                                        Real filter_y_scale,
+                                        Real src_x_ofs,
+                                        Real src_y_ofs)
 {
-   int i, j;
-   Resample_Real support, (*func)(Resample_Real);
+   init_members();
+   init(src_x, src_y, dst_x, dst_y, 1, boundary_op, sample_low, sample_high, Pfilter_name, Pclist_x, Pclist_y, filter_x_scale, filter_y_scale, src_x_ofs, src_y_ofs, NULL);
+}
 
-   resampler_assert(src_x > 0);
-   resampler_assert(src_y > 0);
-   resampler_assert(dst_x > 0);
-   resampler_assert(dst_y > 0);
+template<typename Real, typename Storage>
+Resampler_T<Real, Storage>::Resampler_T(int src_x, int src_y,
+                                        int dst_x, int dst_y,
+                                        int num_channels,
+                                        Boundary_Op boundary_op,
+                                        Real sample_low, Real sample_high,
+                                        const char* Pfilter_name,
+                                        Contrib_List* Pclist_x,
+                                        Contrib_List* Pclist_y,
+                                        Real filter_x_scale,
+                                        Real filter_y_scale,
+                                        Real src_x_ofs,
+                                        Real src_y_ofs,
+                                        const Window* Pdst_window)
+{
+   init_members();
+   init(src_x, src_y, dst_x, dst_y, num_channels, boundary_op, sample_low, sample_high, Pfilter_name, Pclist_x, Pclist_y, filter_x_scale, filter_y_scale, src_x_ofs, src_y_ofs, Pdst_window);
+}
 
-#if RESAMPLER_DEBUG_OPS
-   total_ops = 0;
-#endif
+template<typename Real, typename Storage>
+Resampler_T<Real, Storage>::Resampler_T(Resampler_T&& o)
+{
+   move_from(o);
+}
 
-   m_lo = sample_low;
-   m_hi = sample_high;
+template<typename Real, typename Storage>
+Resampler_T<Real, Storage>& Resampler_T<Real, Storage>::operator= (Resampler_T&& o)
+{
+   if (this != &o)
+   {
+      free_buffers();
+      move_from(o);
+   }
+
+   return *this;
+}
+
+template<typename Real, typename Storage>
+typename Resampler_T<Real, Storage>::Status Resampler_T<Real, Storage>::reset(int src_x, int src_y,
+                                                                             int dst_x, int dst_y,
+                                                                             int num_channels,
+                                                                             Boundary_Op boundary_op,
+                                                                             Real sample_low, Real sample_high,
+                                                                             const char* Pfilter_name,
+                                                                             Contrib_List* Pclist_x,
+                                                                             Contrib_List* Pclist_y,
+                                                                             Real filter_x_scale,
+                                                                             Real filter_y_scale,
+                                                                             Real src_x_ofs,
+                                                                             Real src_y_ofs,
+                                                                             const Window* Pdst_window)
+{
+   init(src_x, src_y, dst_x, dst_y, num_channels, boundary_op, sample_low, sample_high, Pfilter_name, Pclist_x, Pclist_y, filter_x_scale, filter_y_scale, src_x_ofs, src_y_ofs, Pdst_window);
+
+   return m_status;
+}
+
+// Puts the instance in the state of a moved from Resampler: no buffers, no contributor lists and default settings.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::init_members()
+{
+   memset(&m_stats, 0, sizeof(m_stats));
+   m_x_taps_per_line = 0;
+   m_pass_timing = false;
+   m_trace.Pbegin = NULL;
+   m_trace.Pend = NULL;
+   m_trace.pUser = NULL;
 
-   m_delay_x_resample = false;
    m_intermediate_x = 0;
+   m_num_channels = 0;
+   m_resample_src_x = 0;
+   m_resample_src_y = 0;
+   m_resample_dst_x = 0;
+   m_resample_dst_y = 0;
+   m_boundary_op = BOUNDARY_CLAMP;
+   memset(&m_src_window, 0, sizeof(m_src_window));
+
+   memset(&m_capacity, 0, sizeof(m_capacity));
+   m_delay_x_resample = false;
    m_Pdst_buf = NULL;
    m_Ptmp_buf = NULL;
+   m_input_transfer.func = TRANSFER_LINEAR;
+   m_input_transfer.gamma = RR(1.0);
+   m_input_transfer.linear_channel_mask = 0;
+   m_output_transfer = m_input_transfer;
+   m_alpha_channel = -1;
+   m_Pdecode_table = NULL;
+   m_Pencode_threshold = NULL;
+   m_Pencode_start = NULL;
+   m_Pdecode_buf = NULL;
    m_clist_x_forced = false;
+   m_clist_x_cached = false;
    m_Pclist_x = NULL;
+   m_Ptable_x = NULL;
    m_clist_y_forced = false;
+   m_clist_y_cached = false;
    m_Pclist_y = NULL;
+   m_Pscan_src = NULL;
+   m_Pscan_weight = NULL;
    m_Psrc_y_count = NULL;
-   m_Psrc_y_flag = NULL;
+   m_Psrc_y_slot = NULL;
    m_Pscan_buf = NULL;
+   m_scan_buf_pitch = 0;
+   m_allocator.Palloc = default_alloc;
+   m_allocator.Pfree = default_free;
+   m_allocator.pUser = NULL;
+   m_cur_src_y = m_cur_dst_y = 0;
+   m_status = STATUS_OUT_OF_MEMORY;
+
+   m_lo = RR(0.0);
+   m_hi = RR(0.0);
+}
+
+// Takes over the state of o, then leaves o like init_members() does.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::move_from(Resampler_T& o)
+{
+   m_stats = o.m_stats;
+   m_x_taps_per_line = o.m_x_taps_per_line;
+   m_pass_timing = o.m_pass_timing;
+   m_trace = o.m_trace;
+
+   m_intermediate_x = o.m_intermediate_x;
+   m_num_channels = o.m_num_channels;
+   m_resample_src_x = o.m_resample_src_x;
+   m_resample_src_y = o.m_resample_src_y;
+   m_resample_dst_x = o.m_resample_dst_x;
+   m_resample_dst_y = o.m_resample_dst_y;
+   m_boundary_op = o.m_boundary_op;
+   m_src_window = o.m_src_window;
+
+   m_capacity = o.m_capacity;
+   m_delay_x_resample = o.m_delay_x_resample;
+   m_Pdst_buf = o.m_Pdst_buf;
+   m_Ptmp_buf = o.m_Ptmp_buf;
+   m_input_transfer = o.m_input_transfer;
+   m_output_transfer = o.m_output_transfer;
+   m_alpha_channel = o.m_alpha_channel;
+   m_Pdecode_table = o.m_Pdecode_table;
+   m_Pencode_threshold = o.m_Pencode_threshold;
+   m_Pencode_start = o.m_Pencode_start;
+   m_Pdecode_buf = o.m_Pdecode_buf;
+   m_clist_x_forced = o.m_clist_x_forced;
+   m_clist_x_cached = o.m_clist_x_cached;
+   m_Pclist_x = o.m_Pclist_x;
+   m_Ptable_x = o.m_Ptable_x;
+   m_clist_y_forced = o.m_clist_y_forced;
+   m_clist_y_cached = o.m_clist_y_cached;
+   m_Pclist_y = o.m_Pclist_y;
+   m_Pscan_src = o.m_Pscan_src;
+   m_Pscan_weight = o.m_Pscan_weight;
+   m_Psrc_y_count = o.m_Psrc_y_count;
+   m_Psrc_y_slot = o.m_Psrc_y_slot;
+   m_Pscan_buf = o.m_Pscan_buf;
+   m_scan_buf_pitch = o.m_scan_buf_pitch;
+   m_allocator = o.m_allocator;
+   m_cur_src_y = o.m_cur_src_y;
+   m_cur_dst_y = o.m_cur_dst_y;
+   m_status = o.m_status;
+
+   m_lo = o.m_lo;
+   m_hi = o.m_hi;
+
+   o.init_members();
+}
+
+// Sets the instance up for the given parameters, keeping the buffers it already has when they're large enough.
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::init(int src_x, int src_y,
+                                      int dst_x, int dst_y,
+                                      int num_channels,
+                                      Boundary_Op boundary_op,
+                                      Real sample_low, Real sample_high,
+                                      const char* Pfilter_name,
+                                      Contrib_List* Pclist_x,
+                                      Contrib_List* Pclist_y,
+                                      Real filter_x_scale,
+                                      Real filter_y_scale,
+                                      Real src_x_ofs,
+                                      Real src_y_ofs,
+                                      const Window* Pdst_window)
+{
+   int i, j;
+
+   resampler_assert(src_x > 0);
+   resampler_assert(src_y > 0);
+   resampler_assert(dst_x > 0);
+   resampler_assert(dst_y > 0);
+   resampler_assert((max(src_x, src_y) <= RESAMPLER_MAX_DIMENSION) && (max(dst_x, dst_y) <= RESAMPLER_MAX_DIMENSION));
+   resampler_assert((num_channels > 0) && (num_channels <= RESAMPLER_MAX_CHANNELS));
+
+   // The whole output unless a window of it was asked for.
+   Window dst_window = { 0, 0, dst_x, dst_y };
+   if (Pdst_window)
+   {
+      dst_window = *Pdst_window;
+      resampler_assert((dst_window.x >= 0) && (dst_window.width > 0) && (dst_window.x + dst_window.width <= dst_x));
+      resampler_assert((dst_window.y >= 0) && (dst_window.height > 0) && (dst_window.y + dst_window.height <= dst_y));
+   }
+
+   memset(&m_stats, 0, sizeof(m_stats));
+   m_x_taps_per_line = 0;
+
+   m_lo = sample_low;
+   m_hi = sample_high;
+
    m_status = STATUS_OKAY;
 
    m_resample_src_x = src_x;
    m_resample_src_y = src_y;
-   m_resample_dst_x = dst_x;
-   m_resample_dst_y = dst_y;
+   m_resample_dst_x = dst_window.width;
+   m_resample_dst_y = dst_window.height;
+
+   m_num_channels = num_channels;
 
    m_boundary_op = boundary_op;
 
-   if ((m_Pdst_buf = (Sample*)malloc(m_resample_dst_x * sizeof(Sample))) == NULL)
+   if (m_alpha_channel >= m_num_channels)
+      m_alpha_channel = -1;
+
+   m_cur_src_y = m_cur_dst_y = 0;
+
+   // Drop the buffered scanlines (a new instance has no scanline buffer yet).
+   if (m_Pscan_buf)
+   {
+      free_scan_buf_lines();
+      m_Pscan_buf->size = 0;
+      m_Pscan_buf->num_free = 0;
+   }
+
+   if (!reserve_buf(m_Pdst_buf, m_capacity.dst_buf, m_resample_dst_x * m_num_channels))
    {
       m_status = STATUS_OUT_OF_MEMORY;
       return;
@@ -1062,137 +3818,399 @@ Resampler::Resampler(int src_x, int src_y,
    if (Pfilter_name == NULL)
       Pfilter_name = RESAMPLER_DEFAULT_FILTER;
 
-   for (i = 0; i < NUM_FILTERS; i++)
-      if (strcmp(Pfilter_name, g_filters[i].name) == 0)
+   int filter_index;
+   for (filter_index = 0; filter_index < NUM_FILTERS; filter_index++)
+      if (strcmp(Pfilter_name, get_filters<Real>()[filter_index].name) == 0)
          break;
 
-   if (i == NUM_FILTERS)
-   {
-      m_status = STATUS_BAD_FILTER_NAME;
-      return;
-   }
+   /* Get contributor lists from the cache, unless the user supplied custom lists.
+   * The previous lists are only released afterwards, so the cache can hand back the same ones.
+   */
+
+   Contrib_List* Pprev_clist_x = m_Pclist_x;
+   Contrib_List* Pprev_clist_y = m_Pclist_y;
+   const bool prev_clist_x_cached = m_clist_x_cached, prev_clist_x_forced = m_clist_x_forced;
+   const bool prev_clist_y_cached = m_clist_y_cached, prev_clist_y_forced = m_clist_y_forced;
 
-   func = g_filters[i].func;
-   support = g_filters[i].support;
+   m_Pclist_x = m_Pclist_y = NULL;
+   m_clist_x_cached = m_clist_x_forced = false;
+   m_clist_y_cached = m_clist_y_forced = false;
 
-   /* Create contributor lists, unless the user supplied custom lists. */
+   const double clist_start_time = get_pass_time();
 
-   if (!Pclist_x)
+   if (filter_index < NUM_FILTERS)
    {
-      m_Pclist_x = make_clist(m_resample_src_x, m_resample_dst_x, m_boundary_op, func, support, filter_x_scale, src_x_ofs);
-      if (!m_Pclist_x)
+      if (!Pclist_x)
+         m_Pclist_x = acquire_clist(m_resample_src_x, dst_x, dst_window.x, m_resample_dst_x, m_boundary_op, filter_index, filter_x_scale, src_x_ofs, m_clist_x_cached);
+      else
       {
-         m_status = STATUS_OUT_OF_MEMORY;
-         return;
+         m_Pclist_x = Pclist_x;
+         m_clist_x_cached = add_ref_clist(Pclist_x);
+         m_clist_x_forced = !m_clist_x_cached;
       }
-   }
-   else
-   {
-      m_Pclist_x = Pclist_x;
-      m_clist_x_forced = true;
-   }
 
-   if (!Pclist_y)
-   {
-      m_Pclist_y = make_clist(m_resample_src_y, m_resample_dst_y, m_boundary_op, func, support, filter_y_scale, src_y_ofs);
-      if (!m_Pclist_y)
+      if (!Pclist_y)
+         m_Pclist_y = acquire_clist(m_resample_src_y, dst_y, dst_window.y, m_resample_dst_y, m_boundary_op, filter_index, filter_y_scale, src_y_ofs, m_clist_y_cached);
+      else
       {
-         m_status = STATUS_OUT_OF_MEMORY;
-         return;
+         m_Pclist_y = Pclist_y;
+         m_clist_y_cached = add_ref_clist(Pclist_y);
+         m_clist_y_forced = !m_clist_y_cached;
       }
    }
-   else
+
+   // The X table only depends on the X list, and cached lists never change.
+   if ((m_Ptable_x) && ((!m_Pclist_x) || (m_Pclist_x != Pprev_clist_x) || (!m_clist_x_cached) || (!prev_clist_x_cached)))
+   {
+      free_contrib_table(m_Ptable_x);
+      m_Ptable_x = NULL;
+   }
+
+   drop_clist(Pprev_clist_x, prev_clist_x_cached, prev_clist_x_forced);
+   drop_clist(Pprev_clist_y, prev_clist_y_cached, prev_clist_y_forced);
+
+   if (filter_index == NUM_FILTERS)
    {
-      m_Pclist_y = Pclist_y;
-      m_clist_y_forced = true;
+      m_status = STATUS_BAD_FILTER_NAME;
+      return;
    }
 
-   if ((m_Psrc_y_count = (int*)calloc(m_resample_src_y, sizeof(int))) == NULL)
+   if ((!m_Pclist_x) || (!m_Pclist_y))
    {
       m_status = STATUS_OUT_OF_MEMORY;
       return;
    }
 
-   if ((m_Psrc_y_flag = (unsigned char*)calloc(m_resample_src_y, sizeof(unsigned char))) == NULL)
+#if RESAMPLER_PADDED_X_TABLES
+   // Optional, resample_x() falls back to the contributor list if this fails.
+   if (!m_Ptable_x)
+      m_Ptable_x = make_contrib_table(m_Pclist_x, m_resample_src_x, m_resample_dst_x);
+#endif
+
+   m_stats.clist_seconds = get_pass_time() - clist_start_time;
+
+   // The source columns the X pass reads: its contributors, and the padding of the table's taps.
+   int src_first_x = m_resample_src_x, src_end_x = 0;
+   for (i = 0; i < m_resample_dst_x; i++)
+   {
+      for (j = 0; j < m_Pclist_x[i].n; j++)
+      {
+         src_first_x = min(src_first_x, (int)m_Pclist_x[i].p[j].pixel);
+         src_end_x = max(src_end_x, (int)m_Pclist_x[i].p[j].pixel + 1);
+      }
+
+      if (m_Ptable_x)
+      {
+         src_first_x = min(src_first_x, m_Ptable_x->start[i]);
+         src_end_x = max(src_end_x, m_Ptable_x->start[i] + m_Ptable_x->n);
+      }
+   }
+
+   if ((!reserve_buf(m_Psrc_y_count, m_capacity.src_y_count, m_resample_src_y)) ||
+       (!reserve_buf(m_Psrc_y_slot, m_capacity.src_y_slot, m_resample_src_y)))
    {
       m_status = STATUS_OUT_OF_MEMORY;
       return;
    }
 
+   memset(m_Psrc_y_count, 0, m_resample_src_y * sizeof(int));
+
    /* Count how many times each source line
    * contributes to a destination line.
    */
 
+   int max_y_contribs = 0, src_first_y = m_resample_src_y, src_end_y = 0;
    for (i = 0; i < m_resample_dst_y; i++)
+   {
       for (j = 0; j < m_Pclist_y[i].n; j++)
-         m_Psrc_y_count[resampler_range_check(m_Pclist_y[i].p[j].pixel, m_resample_src_y)]++;
+      {
+         const int y = resampler_range_check(m_Pclist_y[i].p[j].pixel, m_resample_src_y);
+         m_Psrc_y_count[y]++;
 
-   if ((m_Pscan_buf = (Scan_Buf*)malloc(sizeof(Scan_Buf))) == NULL)
+         src_first_y = min(src_first_y, y);
+         src_end_y = max(src_end_y, y + 1);
+      }
+
+      max_y_contribs = max(max_y_contribs, (int)m_Pclist_y[i].n);
+   }
+
+   m_src_window.x = src_first_x;
+   m_src_window.y = src_first_y;
+   m_src_window.width = max(src_end_x - src_first_x, 0);
+   m_src_window.height = max(src_end_y - src_first_y, 0);
+
+   if ((!reserve_buf(m_Pscan_src, m_capacity.scan_src, max_y_contribs)) ||
+       (!reserve_buf(m_Pscan_weight, m_capacity.scan_weight, max_y_contribs)))
    {
       m_status = STATUS_OUT_OF_MEMORY;
       return;
    }
 
-   for (i = 0; i < MAX_SCAN_BUF_SIZE; i++)
+   if ((!m_Pscan_buf) && ((m_Pscan_buf = (Scan_Buf*)calloc(1, sizeof(Scan_Buf))) == NULL))
    {
-      m_Pscan_buf->scan_buf_y[i] = -1;
-      m_Pscan_buf->scan_buf_l[i] = NULL;
+      m_status = STATUS_OUT_OF_MEMORY;
+      return;
    }
 
-   m_cur_src_y = m_cur_dst_y = 0;
+   if (!resize_scan_buf(calc_scan_buf_size()))
    {
-      // Determine which axis to resample first by comparing the number of multiplies required
-      // for each possibility.
-      int x_ops = count_ops(m_Pclist_x, m_resample_dst_x);
-      int y_ops = count_ops(m_Pclist_y, m_resample_dst_y);
+      m_status = STATUS_OUT_OF_MEMORY;
+      return;
+   }
+
+   for (i = 0; i < m_resample_src_y; i++)
+      m_Psrc_y_slot[i] = -1;
+
+   bool delay_x_resample;
+
+   // Determine which axis to resample first by comparing the number of multiplies required
+   // for each possibility.
+   const int x_ops = count_ops(m_Pclist_x, m_resample_dst_x);
+   const int y_ops = count_ops(m_Pclist_y, m_resample_dst_y);
 
+   m_x_taps_per_line = (unsigned long long)x_ops * m_num_channels;
+   {
       // Hack 10/2000: Weight Y axis ops a little more than X axis ops.
       // (Y axis ops use more cache resources.)
-      int xy_ops = x_ops * m_resample_src_y +
-         (4 * y_ops * m_resample_dst_x)/3;
+      // Only the source window is filtered: the rows it spans in X-Y order, its columns in Y-X order.
+      const long long xy_ops = (long long)x_ops * m_src_window.height +
+         (4LL * y_ops * m_resample_dst_x)/3;
 
-      int yx_ops = (4 * y_ops * m_resample_src_x)/3 +
-         x_ops * m_resample_dst_y;
+      const long long yx_ops = (4LL * y_ops * m_src_window.width)/3 +
+         (long long)x_ops * m_resample_dst_y;
 
 #if RESAMPLER_DEBUG_OPS
       printf("src: %i %i\n", m_resample_src_x, m_resample_src_y);
       printf("dst: %i %i\n", m_resample_dst_x, m_resample_dst_y);
       printf("x_ops: %i\n", x_ops);
       printf("y_ops: %i\n", y_ops);
-      printf("xy_ops: %i\n", xy_ops);
-      printf("yx_ops: %i\n", yx_ops);
+      printf("xy_ops: %lld\n", xy_ops);
+      printf("yx_ops: %lld\n", yx_ops);
 #endif
 
       // Now check which resample order is better. In case of a tie, choose the order
       // which buffers the least amount of data.
-      if ((xy_ops > yx_ops) ||
-         ((xy_ops == yx_ops) && (m_resample_src_x < m_resample_dst_x))
-         )
+      delay_x_resample = (xy_ops > yx_ops) ||
+         ((xy_ops == yx_ops) && (m_resample_src_x < m_resample_dst_x));
+
+#if RESAMPLER_DEBUG_OPS
+      printf("delaying: %i\n", delay_x_resample);
+#endif
+   }
+
+   Order_Profile_Entry shape;
+   shape.src_x = m_resample_src_x;
+   shape.src_y = m_resample_src_y;
+   shape.dst_x = m_resample_dst_x;
+   shape.dst_y = m_resample_dst_y;
+   shape.num_channels = m_num_channels;
+   shape.x_ops = x_ops;
+   shape.y_ops = y_ops;
+   shape.real_size = (int)sizeof(Real);
+   shape.storage_size = (int)sizeof(Scan_Sample);
+
+   Order_Mode order_mode;
+   bool in_profile = false;
+   {
+      std::lock_guard<std::mutex> lock(g_order_mutex);
+
+      order_mode = g_order_profile.mode;
+      if (order_mode == ORDER_MODE_XY)
+         delay_x_resample = false;
+      else if (order_mode == ORDER_MODE_YX)
+         delay_x_resample = true;
+      else if ((order_mode != ORDER_MODE_OPS) && (!Pclist_x) && (!Pclist_y))
       {
-         m_delay_x_resample = true;
-         m_intermediate_x = m_resample_src_x;
+         if (const Order_Profile_Entry* e = order_profile_find(shape))
+         {
+            delay_x_resample = e->delay_x_resample;
+            in_profile = true;
+         }
       }
-      else
+   }
+
+   if (!set_delay_x_resample(delay_x_resample))
+   {
+      m_status = STATUS_OUT_OF_MEMORY;
+      return;
+   }
+
+   if ((order_mode == ORDER_MODE_CALIBRATE) && (!in_profile) && (!Pclist_x) && (!Pclist_y))
+   {
+      // Keep the op count based order if timing fails.
+      bool faster_delay_x_resample;
+      if (!time_orders(faster_delay_x_resample))
+         return;
+
+      shape.delay_x_resample = faster_delay_x_resample;
       {
-         m_delay_x_resample = false;
-         m_intermediate_x = m_resample_dst_x;
+         std::lock_guard<std::mutex> lock(g_order_mutex);
+         order_profile_add(shape);
       }
-#if RESAMPLER_DEBUG_OPS
-      printf("delaying: %i\n", m_delay_x_resample);
-#endif
+
+      if (!set_delay_x_resample(faster_delay_x_resample))
+         return;
    }
+}
 
-   if (m_delay_x_resample)
+// Times both resampling orders on this instance, by producing the first RESAMPLER_ORDER_CALIBRATION_LINES destination
+// scanlines from constant source scanlines (best of two runs each). Leaves the instance restarted.
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::time_orders(bool& delay_x_resample)
+{
+   Sample* Psrc = (Sample*)malloc(m_resample_src_x * m_num_channels * sizeof(Sample));
+   if (!Psrc)
+      return false;
+
+   for (int i = 0; i < m_resample_src_x * m_num_channels; i++)
+      Psrc[i] = RR(.5);
+
+   const int num_lines = min(m_resample_dst_y, RESAMPLER_ORDER_CALIBRATION_LINES);
+   double best_time[2] = { 1e+30, 1e+30 };
+
+   for (int run = 0; run < 4; run++)
+   {
+      const int order = run & 1;
+      if (!set_delay_x_resample(order != 0))
+      {
+         free(Psrc);
+         return false;
+      }
+
+      const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+      int lines = 0;
+      while (lines < num_lines)
+      {
+         if (!put_line(Psrc))
+         {
+            free(Psrc);
+            return false;
+         }
+
+         while ((lines < num_lines) && (get_line()))
+            lines++;
+      }
+
+      const double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+      best_time[order] = min(best_time[order], t);
+
+      restart();
+   }
+
+   free(Psrc);
+
+   delay_x_resample = best_time[1] < best_time[0];
+   return true;
+}
+
+// Selects the resampling order and (re)allocates the buffers which depend on it.
+template<typename Real, typename Storage>
+bool Resampler_T<Real, Storage>::set_delay_x_resample(bool delay_x_resample)
+{
+   if ((STATUS_OKAY != m_status) || (!m_Pscan_buf) || (m_cur_src_y) || (m_Pscan_buf->num_free != m_Pscan_buf->size))
+      return false;
+
+   free_scan_buf_lines();
+
+   m_delay_x_resample = delay_x_resample;
+   m_intermediate_x = m_delay_x_resample ? m_resample_src_x : m_resample_dst_x;
+
+   // X-Y order only needs the temp buffer to convert the X filtered scanlines to the storage type.
+   if ((m_delay_x_resample) || (!std::is_same<Sample, Scan_Sample>::value))
    {
-      if ((m_Ptmp_buf = (Sample*)malloc(m_intermediate_x * sizeof(Sample))) == NULL)
+      if (!reserve_buf(m_Ptmp_buf, m_capacity.tmp_buf, m_intermediate_x * m_num_channels))
       {
          m_status = STATUS_OUT_OF_MEMORY;
-         return;
+         return false;
       }
    }
+
+   m_scan_buf_pitch = (m_intermediate_x * m_num_channels + (64 / sizeof(Scan_Sample)) - 1) & ~((int)(64 / sizeof(Scan_Sample)) - 1);
+
+   if (!alloc_scan_buf_lines())
+   {
+      m_status = STATUS_OUT_OF_MEMORY;
+      return false;
+   }
+
+   return true;
+}
+
+// Sums the sizes of the buffers this instance allocated, the way they were allocated.
+template<typename Real, typename Storage>
+size_t Resampler_T<Real, Storage>::get_memory_size() const
+{
+   size_t size = sizeof(*this);
+
+   size += (size_t)m_capacity.dst_buf * sizeof(Sample);
+   size += (size_t)m_capacity.tmp_buf * sizeof(Sample);
+   size += (size_t)m_capacity.decode_buf * sizeof(Sample);
+   if (m_Pdecode_table)
+      size += 512 * sizeof(Real);
+   if (m_Pencode_threshold)
+      size += 256 * sizeof(Real) + ENCODE_TABLE_SIZE + 1;
+
+   // Private contributor lists, the others belong to the cache or to the caller.
+   if ((m_Pclist_x) && (!m_clist_x_cached) && (!m_clist_x_forced))
+      size += get_clist_size(m_Pclist_x, m_resample_dst_x);
+   if ((m_Pclist_y) && (!m_clist_y_cached) && (!m_clist_y_forced))
+      size += get_clist_size(m_Pclist_y, m_resample_dst_y);
+
+   if (m_Ptable_x)
+      size += sizeof(Contrib_Table) + 2 * m_resample_dst_x * sizeof(int) + (size_t)m_Ptable_x->num_phases * m_Ptable_x->n * sizeof(Real);
+
+   size += (size_t)(m_capacity.src_y_count + m_capacity.src_y_slot) * sizeof(int);
+   size += (size_t)m_capacity.scan_src * sizeof(const Scan_Sample*) + (size_t)m_capacity.scan_weight * sizeof(Real);
+
+   if (const Scan_Buf* Pbuf = m_Pscan_buf)
+   {
+      size += sizeof(Scan_Buf) + Pbuf->capacity * (2 * sizeof(int) + sizeof(Scan_Sample*) + sizeof(const Scan_Sample*));
+      size += Pbuf->arena_capacity;
+
+      const size_t slot_line_size = (size_t)m_intermediate_x * m_num_channels * sizeof(Scan_Sample);
+      for (int i = Pbuf->arena_size; i < Pbuf->size; i++)
+         if (Pbuf->scan_buf_l[i])
+            size += slot_line_size;
+   }
+
+   return size;
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::get_stats(Stats& stats) const
+{
+   stats = m_stats;
+   stats.delay_x_resample = m_delay_x_resample;
+   stats.scan_buf_size = m_Pscan_buf ? m_Pscan_buf->size : 0;
+   stats.memory_size = get_memory_size();
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::reset_stats()
+{
+   m_stats.x_taps = 0;
+   m_stats.y_taps = 0;
+   m_stats.x_seconds = 0.0;
+   m_stats.y_seconds = 0.0;
+   m_stats.scan_buf_high_water = m_Pscan_buf ? (m_Pscan_buf->size - m_Pscan_buf->num_free) : 0;
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::set_trace_callbacks(const Trace_Callbacks* Pcallbacks)
+{
+   if (Pcallbacks)
+      m_trace = *Pcallbacks;
+   else
+   {
+      m_trace.Pbegin = NULL;
+      m_trace.Pend = NULL;
+      m_trace.pUser = NULL;
+   }
 }
 
-void Resampler::get_clists(Contrib_List** ptr_clist_x, Contrib_List** ptr_clist_y)
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::get_clists(Contrib_List** ptr_clist_x, Contrib_List** ptr_clist_y)
 {
    if (ptr_clist_x)
       *ptr_clist_x = m_Pclist_x;
@@ -1201,16 +4219,34 @@ void Resampler::get_clists(Contrib_List** ptr_clist_x, Contrib_List** ptr_clist_
       *ptr_clist_y = m_Pclist_y;
 }
 
-int Resampler::get_filter_num()
+int Resampler_Base::get_filter_num()
 {
    return NUM_FILTERS;
 }
 
-char* Resampler::get_filter_name(int filter_num)
+char* Resampler_Base::get_filter_name(int filter_num)
 {
    if ((filter_num < 0) || (filter_num >= NUM_FILTERS))
       return NULL;
    else
-      return g_filters[filter_num].name;
+      return get_filters<Resample_Real>()[filter_num].name;
+}
+
+const char* Resampler_Base::get_kernel_name()
+{
+   return get_kernels().name;
+}
+
+unsigned int Resampler_Base::get_alpha_channel_mask(int num_channels)
+{
+   if (num_channels == 2)
+      return 1U << 1;
+   else if (num_channels == 4)
+      return 1U << 3;
+   else
+      return 0;
 }
 
+template class Resampler_T<float>;
+template class Resampler_T<double>;
+template class Resampler_T<float, Resample_Half>;
@@ -3,37 +3,158 @@
 #ifndef __RESAMPLER_H__
 #define __RESAMPLER_H__
 
+#include <cstddef>
+
 #define RESAMPLER_DEBUG_OPS 0
+
+// Set to 1 to use SSE2/AVX2/NEON kernels for the vertical pass (float samples only, selected at runtime).
+#define RESAMPLER_USE_SIMD 1
+
+// Set to 1 to accumulate all the Y axis contributors of each destination scanline in a single pass,
+// with the output clamp folded into the final store. Results are identical to the unfused path.
+#define RESAMPLER_FUSED_Y_PASS 1
+
+// Set to 1 to filter the X axis with fixed width contributor tables (see Contrib_Table) when their padding overhead is low.
+// Results can differ from the Contrib_List path by float rounding, because the taps are summed in a different order.
+#define RESAMPLER_PADDED_X_TABLES 1
+
+// Set to 1 to filter the X axis of integer ratio downsamples, where all the destination samples away from the edges
+// have the same weights, with SIMD kernels which keep the weights in registers (see Contrib_Table). Identical results.
+#define RESAMPLER_RATIO_X_KERNELS 1
 #define RESAMPLER_DEFAULT_FILTER "lanczos4"
 
-#define RESAMPLER_MAX_DIMENSION 16384
+// Set to 1 for images wider or taller than 16384 pixels (gigapixel scans, satellite strips): the contributor lists then
+// use 32-bit source sample indices and counts (see Resample_Index). The scanline buffer already grows as needed and all
+// the image/pitch offsets are computed in size_t. The default keeps the 16-bit Contrib types, which also limit each
+// destination sample to 65535 contributors (more fail with STATUS_OUT_OF_MEMORY).
+#define RESAMPLER_LARGE_IMAGES 0
+
+#if RESAMPLER_LARGE_IMAGES
+   #define RESAMPLER_MAX_DIMENSION (1 << 24)
+#else
+   #define RESAMPLER_MAX_DIMENSION 16384
+#endif
+
+// Set to 1 to build the OpenCL backend of resampler_opencl.cpp (see Resampler_OpenCL), which then needs the OpenCL 1.2
+// headers and library. With 0 Resampler_OpenCL reports STATUS_NO_DEVICE.
+#define RESAMPLER_OPENCL 0
 
-// float or double
+// Default memory cap of the contributor list cache in bytes (see set_clist_cache_max_size()), 0 disables the cache.
+#define RESAMPLER_CLIST_CACHE_SIZE (16 * 1024 * 1024)
+
+// Number of destination scanlines each resampling order produces when ORDER_MODE_CALIBRATE times a new shape.
+#define RESAMPLER_ORDER_CALIBRATION_LINES 16
+
+// Maximum number of interleaved channels a single Resampler can process.
+#define RESAMPLER_MAX_CHANNELS 8
+
+// float or double: the Real type of the Resampler typedef below.
 typedef float Resample_Real;
 
-class Resampler
+// Source sample index/contributor count of the contributor lists.
+#if RESAMPLER_LARGE_IMAGES
+typedef int Resample_Index;
+#else
+typedef unsigned short Resample_Index;
+#endif
+
+// IEEE 754 half precision float. Only used as a storage type for buffered scanlines, see Resampler_T.
+struct Resample_Half
+{
+   unsigned short bits;
+};
+
+class Resampler_Thread_Pool;
+class Resampler_OpenCL;
+struct Resampler_Row_Source;
+struct Resampler_Row_Sink;
+
+// Types and functions shared by all Resampler_T instantiations.
+class Resampler_Base
 {
 public:
-   typedef Resample_Real Sample;
-   static constexpr Resample_Real RR(double d) { return Resample_Real(d); }
+   enum Boundary_Op
+   {
+      BOUNDARY_WRAP = 0,
+      BOUNDARY_REFLECT = 1,
+      BOUNDARY_CLAMP = 2
+   };
 
-   struct Contrib
+   // Memory allocator for the scanline buffers, so they can be placed in hugepage or NUMA local memory.
+   struct Allocator
    {
-      Resample_Real weight;
-      unsigned short pixel;
+      void* (*Palloc)(size_t size, void* pUser);
+      void (*Pfree)(void* p, void* pUser);
+      void* pUser;
    };
 
-   struct Contrib_List
+   // Counters of the process wide contributor list cache.
+   struct Clist_Cache_Stats
    {
-      unsigned short n;
-      Contrib* p;
+      unsigned long long hits;      // lists found in the cache
+      unsigned long long misses;    // lists which had to be created
+      unsigned long long evictions; // unused lists freed to stay under the memory cap
+      int num_lists;                // lists currently cached
+      int num_lists_in_use;         // cached lists referenced by at least one Resampler
+      size_t size;                  // memory used by the cached lists, in bytes
+      size_t max_size;
    };
 
-   enum Boundary_Op
+   // Counters of a Resampler, see Resampler_T::get_stats(). Taps are multiply-adds of one sample (so a pass over an RGBA
+   // scanline counts 4 per contributor of each destination pixel), counted like the constructor's cost estimates.
+   struct Stats
    {
-      BOUNDARY_WRAP = 0,
-      BOUNDARY_REFLECT = 1,
-      BOUNDARY_CLAMP = 2
+      unsigned long long x_taps;    // done by the X pass
+      unsigned long long y_taps;    // done by the Y pass
+      bool delay_x_resample;        // resampling order: Y-X if true, X-Y if false
+      int scan_buf_size;            // slots in the scanline buffer
+      int scan_buf_high_water;      // most source scanlines buffered at once
+      size_t memory_size;           // heap memory held by the Resampler, in bytes: shared contributor lists aren't included
+      double clist_seconds;         // spent by the constructor or reset() getting (or creating) the contributor lists and tables
+      double x_seconds, y_seconds;  // spent in the X and Y passes, only measured while pass timing is enabled
+   };
+
+   // A filtering pass over one scanline: the X pass filters a scanline horizontally, the Y pass produces a
+   // destination scanline from the buffered scanlines (in Y-X order its X pass follows the Y pass).
+   enum Pass
+   {
+      PASS_X = 0,
+      PASS_Y = 1
+   };
+
+   // Optional hooks called around each pass, see Resampler_T::set_trace_callbacks(). Either one may be NULL.
+   struct Trace_Callbacks
+   {
+      void (*Pbegin)(Pass pass, void* pUser);
+      void (*Pend)(Pass pass, void* pUser);
+      void* pUser;
+   };
+
+   // A rectangle of pixels: the part of the output a Resampler produces (see the multichannel constructor), or the part
+   // of the source it reads (see Resampler_T::get_src_window()).
+   struct Window
+   {
+      int x, y;
+      int width, height;
+   };
+
+   // How the constructors pick the resampling order (X-Y or Y-X, see set_delay_x_resample()).
+   enum Order_Mode
+   {
+      ORDER_MODE_OPS = 0,        // fewest multiplies, with Y axis multiplies weighted by 4/3 (the default)
+      ORDER_MODE_PROFILE = 1,    // the order recorded in the order profile, ORDER_MODE_OPS for shapes it doesn't have
+      ORDER_MODE_CALIBRATE = 2,  // like ORDER_MODE_PROFILE, but shapes missing from the profile are timed in both orders and added to it
+      ORDER_MODE_XY = 3,         // always filter X first
+      ORDER_MODE_YX = 4          // always filter Y first
+   };
+
+   // Transfer functions of the samples going into and coming out of a Resampler, see set_input_transfer().
+   // Filtering is always done on linear samples. Negative samples are mapped like their absolute values, with the sign kept.
+   enum Transfer_Func
+   {
+      TRANSFER_LINEAR = 0,
+      TRANSFER_SRGB = 1,         // the sRGB curve (IEC 61966-2-1)
+      TRANSFER_GAMMA = 2         // a power curve: linear = encoded ^ gamma
    };
 
    enum Status
@@ -41,61 +162,338 @@ public:
       STATUS_OKAY = 0,
       STATUS_OUT_OF_MEMORY = 1,
       STATUS_BAD_FILTER_NAME = 2,
-      STATUS_SCAN_BUFFER_FULL = 3
+      STATUS_SCAN_BUFFER_FULL = 3,
+      STATUS_IO_ERROR = 4,         // a stream()'s source or sink failed
+      STATUS_NO_DEVICE = 5,        // Resampler_OpenCL found no OpenCL device (or RESAMPLER_OPENCL is 0)
+      STATUS_DEVICE_ERROR = 6      // an OpenCL call failed: out of device memory, kernel build error, etc.
    };
 
+   // Contributor lists which aren't supplied by the caller are shared through a process wide, thread safe cache keyed
+   // by the source/destination size, output window, filter, filter scale, source offset, boundary op and weight type, so
+   // resampling many images to the same sizes only evaluates the filter once. Unused lists are kept until the cache exceeds
+   // its memory cap.
+   static void get_clist_cache_stats(Clist_Cache_Stats& stats);
+
+   // Lists in use are never freed, so the cache can temporarily exceed max_size. 0 frees all unused lists
+   // and disables caching (new Resamplers create private lists).
+   static void set_clist_cache_max_size(size_t max_size);
+
+   // Frees all the cached lists not in use by a Resampler.
+   static void flush_clist_cache();
+
+   // Phase quantization of the contributor lists created from now on (it's part of the cache key). By default each
+   // destination sample is filtered at its exact position, so a dst_x/src_x scale factor has as many different sets
+   // of weights as the reduced ratio's numerator. num_phases > 0 rounds the positions to a multiple of
+   // 1 / num_phases of a source sample, which caps the number of sets of weights of arbitrary scale factors
+   // (see Contrib_Table) at the price of a small position error. 0 disables it.
+   static void set_filter_phases(int num_phases);
+   static int get_filter_phases();
+
+   // Whether the contributor lists created from now on sample the windowed sinc, kaiser and gaussian filters from a
+   // table (it's part of the cache key) instead of evaluating them, which makes creating them several times faster.
+   // The tables are linearly interpolated between 4096 samples per unit, the weights then differ from the exact
+   // ones by up to about 1e-5 (where the filters round tiny values to 0, elsewhere by about 1e-7). Disabled by default.
+   static void set_filter_table(bool enabled);
+   static bool get_filter_table();
+
+   // Process wide resampling order mode, see Order_Mode. Resamplers constructed with caller supplied contributor lists
+   // don't use the profile (resample_image()'s strips use the order of the whole image).
+   static void set_order_mode(Order_Mode mode);
+   static Order_Mode get_order_mode();
+
+   // The order profile records the faster order of each shape: source/destination size, channel count, contributor
+   // list sizes (these depend on the filter and filter scale) and sample/storage types. It's kept in memory and can be
+   // persisted per machine, so the calibration only has to run once. Loading merges into the current profile.
+   // Both return false if the file can't be opened/written, or contains malformed lines.
+   static bool load_order_profile(const char* Pfilename);
+   static bool save_order_profile(const char* Pfilename);
+   static void clear_order_profile();
+
+   // Filter accessors.
+   static int get_filter_num();
+   static char* get_filter_name(int filter_num);
+
+   // Name of the SIMD kernels selected for this CPU ("scalar", "sse2", "avx2" or "neon").
+   static const char* get_kernel_name();
+
+   // Channel mask of the alpha channel of gray/alpha (2 channels) and RGBA (4 channels) pixels, 0 for other channel counts.
+   static unsigned int get_alpha_channel_mask(int num_channels);
+};
+
+// The contributor types only depend on the weight type, so resamplers with different scanline storage types can share lists.
+template<typename Real>
+struct Resampler_Contrib
+{
+   Real weight;
+   Resample_Index pixel;
+};
+
+template<typename Real>
+struct Resampler_Contrib_List
+{
+   Resample_Index n;
+   Resampler_Contrib<Real>* p;
+};
+
+// Fixed width polyphase contributor table: every destination sample has exactly n taps (padded with zero weights),
+// which read n consecutive source samples beginning at source sample start[i], weighted by the weights of phase[i].
+// Each different set of weights is only stored once, so the weights of rational scale factors fit in the L1 cache.
+// Destination samples [ratio_first, ratio_end) all have the phase of sample ratio_first, and their starts are
+// ratio_step source samples apart (integer scale factors, away from the edges). ratio_end is 0 if there's no such run.
+template<typename Real>
+struct Resampler_Contrib_Table
+{
+   int n;
+   int num_phases;
+   int* start;
+   int* phase;
+   Real* weight; // n weights per phase
+
+   int ratio_first, ratio_end;
+   int ratio_step;
+};
+
+// Real - Type of the samples passed to put_line() and returned by get_line(), of the filter weights and of the
+//    accumulators: float or double.
+// Storage - Type of the buffered scanlines: Real, or Resample_Half (with float) to halve the size of the scanline buffer,
+//    at half float precision. Scanlines are still filtered and accumulated in Real.
+// Explicitly instantiated in resampler.cpp for <float>, <double> and <float, Resample_Half>, see the typedefs below.
+template<typename Real, typename Storage = Real>
+class Resampler_T : public Resampler_Base
+{
+public:
+   typedef Real Sample;
+   typedef Storage Scan_Sample;
+   static constexpr Real RR(double d) { return Real(d); }
+
+   typedef Resampler_Contrib<Real> Contrib;
+   typedef Resampler_Contrib_List<Real> Contrib_List;
+   typedef Resampler_Contrib_Table<Real> Contrib_Table;
+
    // src_x/src_y - Input dimensions
    // dst_x/dst_y - Output dimensions
    // boundary_op - How to sample pixels near the image boundaries
    // sample_low/sample_high - Clamp output samples to specified range, or disable clamping if sample_low >= sample_high
-   // Pclist_x/Pclist_y - Optional pointers to contributor lists from another instance of a Resampler
+   // Pclist_x/Pclist_y - Optional pointers to contributor lists from another instance of a Resampler.
+   //    Lists which came from the contributor list cache are reference counted, so they stay valid after the other
+   //    instance is destroyed. Any other lists must outlive this instance.
    // src_x_ofs/src_y_ofs - Offset input image by specified amount (fractional values okay)
-   Resampler(
+   Resampler_T(
+      int src_x, int src_y,
+      int dst_x, int dst_y,
+      Boundary_Op boundary_op = BOUNDARY_CLAMP,
+      Real sample_low = RR(0.0), Real sample_high = RR(0.0),
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Contrib_List* Pclist_x = NULL,
+      Contrib_List* Pclist_y = NULL,
+      Real filter_x_scale = RR(1.0),
+      Real filter_y_scale = RR(1.0),
+      Real src_x_ofs = RR(0.0),
+      Real src_y_ofs = RR(0.0));
+
+   // Multichannel version: each scanline holds num_channels interleaved samples per pixel (RGBA, RGB, RA, etc.),
+   // all channels are filtered in a single pass sharing the same contributor lists.
+   // num_channels - Number of channels to process, 1 to RESAMPLER_MAX_CHANNELS
+   // Pdst_window - Optional window of the dst_x * dst_y output to produce (crop while resizing): get_line() then returns
+   //    Pdst_window->height scanlines of Pdst_window->width pixels, the same as the window's part of the whole output.
+   //    The contributor lists only cover the window, and the source rows and columns outside its filter support are
+   //    never filtered, so the cost scales with the window. Caller supplied contributor lists must then be the
+   //    window's (from a Resampler with the same window). NULL produces the whole output.
+   Resampler_T(
       int src_x, int src_y,
       int dst_x, int dst_y,
+      int num_channels,
       Boundary_Op boundary_op = BOUNDARY_CLAMP,
-      Resample_Real sample_low = RR(0.0), Resample_Real sample_high = RR(0.0),
+      Real sample_low = RR(0.0), Real sample_high = RR(0.0),
       const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
       Contrib_List* Pclist_x = NULL,
       Contrib_List* Pclist_y = NULL,
-      Resample_Real filter_x_scale = RR(1.0),
-      Resample_Real filter_y_scale = RR(1.0),
-      Resample_Real src_x_ofs = RR(0.0),
-      Resample_Real src_y_ofs = RR(0.0));
+      Real filter_x_scale = RR(1.0),
+      Real filter_y_scale = RR(1.0),
+      Real src_x_ofs = RR(0.0),
+      Real src_y_ofs = RR(0.0),
+      const Window* Pdst_window = NULL);
+
+   // Takes over the buffers, contributor lists and settings of o. o is left without any buffers: it can still be
+   // destroyed or reset(), status() returns STATUS_OUT_OF_MEMORY until then.
+   Resampler_T(Resampler_T&& o);
+   Resampler_T& operator= (Resampler_T&& o);
 
-   ~Resampler();
+   ~Resampler_T();
 
-   // Reinits resampler so it can handle another frame.
+   // Reinits resampler so it can handle another frame. The scanline buffers are kept for reuse.
    void restart();
 
+   // Reconfigures the resampler for another image, as if it was constructed again with these parameters (the buffered
+   // scanlines are dropped), but without freeing the buffers it already has: they're only reallocated if they're too
+   // small. The X contributor table is kept if the X contributor list comes out of the cache unchanged.
+   // The allocator, transfer functions, pass timing and trace callbacks are kept, the premultiplied alpha channel too
+   // unless it's >= num_channels. The stats start over. Returns status().
+   Status reset(
+      int src_x, int src_y,
+      int dst_x, int dst_y,
+      int num_channels,
+      Boundary_Op boundary_op = BOUNDARY_CLAMP,
+      Real sample_low = RR(0.0), Real sample_high = RR(0.0),
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Contrib_List* Pclist_x = NULL,
+      Contrib_List* Pclist_y = NULL,
+      Real filter_x_scale = RR(1.0),
+      Real filter_y_scale = RR(1.0),
+      Real src_x_ofs = RR(0.0),
+      Real src_y_ofs = RR(0.0),
+      const Window* Pdst_window = NULL);
+
+   // Switches the allocator used for the scanline buffers (NULL selects malloc/free) and reallocates them.
+   // Only possible while no scanlines are buffered: right after construction or restart().
+   // Returns false if scanlines are buffered or on out of memory.
+   bool set_allocator(const Allocator* Pallocator);
+
    // false on out of memory.
+   // Psrc must point to src_x pixels of num_channels interleaved samples.
    bool put_line(const Sample* Psrc);
 
+   // src_pixel_stride - Number of samples between two consecutive source pixels (must be >= num_channels),
+   // so channels can be read directly out of rows containing additional (unprocessed) channels.
+   bool put_line(const Sample* Psrc, int src_pixel_stride);
+
+   // Like put_line(), but the resampler may keep a pointer to Psrc instead of copying it. The scanline must stay valid
+   // and unchanged until get_line() has returned every destination scanline it contributes to (or until restart()).
+   // Saves a copy of each source scanline in Y-X order when no storage type conversion is needed, otherwise it's a put_line().
+   bool put_line_borrowed(const Sample* Psrc);
+
+   // 8-bit version: samples in [0, 255] map to [0, 1] before the input transfer function (see set_input_transfer()).
+   // They're decoded with a table, in Y-X order straight into the scanline buffer.
+   bool put_line(const unsigned char* Psrc, int src_pixel_stride);
+
    // NULL if no scanlines are currently available (give the resampler more scanlines!)
+   // The returned scanline contains dst_x pixels of num_channels interleaved samples.
    const Sample* get_line();
 
+   // Like get_line(), but the destination scanline is written to Pdst, with dst_pixel_stride samples between consecutive
+   // pixels (>= num_channels). Packed scanlines are written by the last filtering pass directly, without an extra copy.
+   // Returns false if no scanline is currently available.
+   bool get_line_into(Sample* Pdst, int dst_pixel_stride);
+
+   // Converting versions: samples in [0, 1] are scaled to [0, 255] or [0, 65535], rounded and clamped.
+   bool get_line_into(unsigned char* Pdst, int dst_pixel_stride);
+   bool get_line_into(unsigned short* Pdst, int dst_pixel_stride);
+
+   // The transfer function of the samples passed to put_line(): they're converted to linear samples on their way into
+   // the first pass. gamma is the exponent of TRANSFER_GAMMA, ignored otherwise. The channels set in linear_channel_mask
+   // (bit c for channel c, usually alpha: see get_alpha_channel_mask()) are passed through unchanged.
+   // Returns false if gamma isn't positive.
+   bool set_input_transfer(Transfer_Func func, Real gamma = RR(1.0), unsigned int linear_channel_mask = 0);
+
+   // The transfer function of the samples returned by get_line() and get_line_into(): the filtered (and clamped) linear
+   // samples are encoded as soon as the last pass has produced them. The 8-bit get_line_into() encodes with tables,
+   // which give the same results as encoding and then rounding each sample (up to float rounding).
+   bool set_output_transfer(Transfer_Func func, Real gamma = RR(1.0), unsigned int linear_channel_mask = 0);
+
+   // Premultiplied alpha mode: the other channels are multiplied by channel alpha_channel (after the input transfer
+   // function) on their way into the first pass, and divided by the filtered alpha (before the output transfer function)
+   // as the last pass produces them, so transparent pixels don't bleed their colors. Pixels with a filtered alpha <= 0
+   // come out as 0. -1 disables it (the default). Returns false if alpha_channel isn't -1 or a valid channel.
+   bool set_premultiplied_alpha(int alpha_channel);
+   int get_premultiplied_alpha() const { return m_alpha_channel; }
+
    Status status() const { return m_status; }
 
+   int get_num_channels() const { return m_num_channels; }
+
+   // true if scanlines are filtered in Y first (Y-X order), false for X-Y order.
+   // The constructor picks the order which needs the fewest multiplies.
+   bool get_delay_x_resample() const { return m_delay_x_resample; }
+
+   // Forces the resampling order. Both orders produce the same image up to float rounding.
+   // Only possible while no scanlines are buffered: right after construction or restart().
+   // Returns false if scanlines are buffered or on out of memory.
+   bool set_delay_x_resample(bool delay_x_resample);
+
+   // The counters accumulate over all the scanlines since construction or the last reset_stats() (restart() keeps them).
+   // While stream_pipelined() runs the X pass counters are updated by its X thread, read them once it has returned.
+   void get_stats(Stats& stats) const;
+
+   // Zeroes the tap counters and pass times, and lowers the high-water mark to the scanlines currently buffered.
+   // clist_seconds is kept.
+   void reset_stats();
+
+   // Measures the time of each pass, into x_seconds and y_seconds. Disabled by default, it reads the clock twice per scanline
+   // and pass.
+   void set_pass_timing(bool enabled) { m_pass_timing = enabled; }
+   bool get_pass_timing() const { return m_pass_timing; }
+
+   // Calls Pbegin before and Pend after each pass, with the pass. In Y-X order the X pass of a destination scanline
+   // comes after the end of its Y pass. stream_pipelined() calls them for the X passes on its X thread.
+   // NULL removes the callbacks.
+   void set_trace_callbacks(const Trace_Callbacks* Pcallbacks);
+
    // Returned contributor lists can be shared with another Resampler.
    void get_clists(Contrib_List** ptr_clist_x, Contrib_List** ptr_clist_y);
    Contrib_List* get_clist_x() const {	return m_Pclist_x; }
    Contrib_List* get_clist_y() const {	return m_Pclist_y; }
 
-   // Filter accessors.
-   static int get_filter_num();
-   static char* get_filter_name(int filter_num);
+   // The source pixels the output depends on. put_line() returns right away for the scanlines above and below it, so the
+   // caller can skip reading them (but still has to call put_line() for them). The columns left and right of it are
+   // never read.
+   const Window& get_src_window() const { return m_src_window; }
+
+   // Resamples a whole image by splitting the output into horizontal strips and processing them in parallel,
+   // with each strip reading only the source scanlines its Y contributors need. All strips share one set of
+   // contributor lists and the resampling order of the whole image, so the output is bit-identical to feeding the
+   // image through a single multichannel Resampler. Implemented in resampler_image.cpp.
+   // src_pitch/dst_pitch - Number of samples between the starts of consecutive scanlines
+   // Ppool - Thread pool to run the strips on, or NULL to use a temporary pool with one thread per core
+   static Status resample_image(
+      const Sample* Psrc, int src_x, int src_y, size_t src_pitch,
+      Sample* Pdst, int dst_x, int dst_y, size_t dst_pitch,
+      int num_channels,
+      Boundary_Op boundary_op = BOUNDARY_CLAMP,
+      Real sample_low = RR(0.0), Real sample_high = RR(0.0),
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Resampler_Thread_Pool* Ppool = NULL,
+      Real filter_x_scale = RR(1.0),
+      Real filter_y_scale = RR(1.0),
+      Real src_x_ofs = RR(0.0),
+      Real src_y_ofs = RR(0.0));
+
+   // Restarts the resampler, then pulls every scanline of src through it and pushes each destination scanline to dst
+   // as soon as it's complete, so only one 8-bit source scanline, the Y filter window and one 8-bit destination scanline
+   // are ever in memory: images larger than RAM can be resized file to file. See resampler_stream.h for the file
+   // sources and sinks, implemented in resampler_stream.cpp. Float sinks receive get_line()'s samples instead of 8-bit ones.
+   // src must be src_x * src_y with at least num_channels channels (the extra ones are skipped), dst must be
+   // dst_x * dst_y with num_channels channels.
+   Status stream(const Resampler_Row_Source& src, const Resampler_Row_Sink& dst);
+
+   // Like stream(), but pipelined across 4 threads connected by bounded lock-free row queues of queue_rows scanlines:
+   // one reads src, one decodes each scanline and resamples it on the X axis, the calling thread resamples on the Y axis
+   // and one writes to dst. Each image then takes about as long as its slowest stage instead of the sum of all of them,
+   // given a core per stage. The pipeline always resamples on the X axis first, whichever order the resampler picked
+   // (it's restored afterwards). Implemented in resampler_stream.cpp.
+   Status stream_pipelined(const Resampler_Row_Source& src, const Resampler_Row_Sink& dst, int queue_rows = 16);
 
 private:
-   Resampler();
-   Resampler(const Resampler& o);
-   Resampler& operator= (const Resampler& o);
+   template<typename T> friend class Resampler_Int;
+   friend class Resampler_OpenCL;
+   template<typename R, typename S> friend class Resampler_Batch;
+   template<typename R, typename S> friend class Resampler_Pyramid;
 
-#ifdef RESAMPLER_DEBUG_OPS
-   int total_ops;
-#endif
+   Resampler_T();
+   Resampler_T(const Resampler_T& o);
+   Resampler_T& operator= (const Resampler_T& o);
+
+   Stats m_stats;
+
+   // Taps of the X pass of one scanline.
+   unsigned long long m_x_taps_per_line;
+
+   bool m_pass_timing;
+   Trace_Callbacks m_trace;
 
    int m_intermediate_x;
 
+   int m_num_channels;
+
    int m_resample_src_x;
    int m_resample_src_y;
    int m_resample_dst_x;
@@ -103,29 +501,77 @@ private:
 
    Boundary_Op m_boundary_op;
 
+   // See get_src_window(). In Y-X order the Y pass only filters the window's columns.
+   Window m_src_window;
+
+   // Allocated lengths of the buffers reset() reuses, in elements.
+   struct Capacity
+   {
+      int dst_buf;
+      int tmp_buf;
+      int decode_buf;
+      int src_y_count;
+      int src_y_slot;
+      int scan_src;
+      int scan_weight;
+   };
+
+   Capacity m_capacity;
+
    Sample* m_Pdst_buf;
+
+   // Y filtered scanline in Y-X order. In X-Y order it receives the X filtered scanline when it must be converted
+   // to a different Scan_Sample type, otherwise it's not allocated (or left over from Y-X order).
    Sample* m_Ptmp_buf;
 
    Contrib_List* m_Pclist_x;
    Contrib_List* m_Pclist_y;
 
+   // Optional fixed width version of m_Pclist_x used by resample_x().
+   Contrib_Table* m_Ptable_x;
+
    bool m_clist_x_forced;
    bool m_clist_y_forced;
 
+   // Set if the list is referenced in the contributor list cache (and must be released instead of freed).
+   bool m_clist_x_cached;
+   bool m_clist_y_cached;
+
    bool m_delay_x_resample;
 
+   // Per destination scanline Y contributor row pointers and weights, sized to the largest Y contributor list.
+   const Scan_Sample** m_Pscan_src;
+   Real* m_Pscan_weight;
+
    int* m_Psrc_y_count;
-   unsigned char* m_Psrc_y_flag;
 
-   // The maximum number of scanlines that can be buffered at one time.
-   enum { MAX_SCAN_BUF_SIZE = RESAMPLER_MAX_DIMENSION };
+   // Scan buffer slot holding each source scanline, or -1 if the scanline isn't buffered.
+   int* m_Psrc_y_slot;
 
+   // The scanline buffer. Its initial size is the maximum number of source scanlines which must be buffered at once
+   // (when get_line() is called until it returns NULL after each put_line()), it grows if the caller buffers more.
+   // The first arena_size slots point into a single arena, slots added by growing the buffer are allocated one by one.
+   // The arena and the slot arrays only ever grow, so set_delay_x_resample() and reset() can reuse them.
    struct Scan_Buf
    {
-      int scan_buf_y[MAX_SCAN_BUF_SIZE];
-      Sample* scan_buf_l[MAX_SCAN_BUF_SIZE];
+      int size;
+      int capacity;        // allocated length of the slot arrays
+      int num_free;
+      int* free_slot;      // stack of unused slot indices
+      int* scan_buf_y;     // source scanline held by each slot, or -1
+      Scan_Sample** scan_buf_l;
+      const Scan_Sample** scan_buf_row; // scanline each used slot refers to: its scan_buf_l line or a borrowed caller scanline
+
+      int arena_size;
+      void* Parena;
+      size_t arena_capacity; // allocated bytes
    };
 
+   Allocator m_allocator;
+
+   // Scan_Samples between the starts of consecutive scanlines in the arena (rounded up to a 64 byte multiple).
+   int m_scan_buf_pitch;
+
    Scan_Buf* m_Pscan_buf;
 
    int m_cur_src_y;
@@ -133,20 +579,110 @@ private:
 
    Status m_status;
 
-   void resample_x(Sample* Pdst, const Sample* Psrc);
-   void scale_y_mov(Sample* Ptmp, const Sample* Psrc, Resample_Real weight, int dst_x);
-   void scale_y_add(Sample* Ptmp, const Sample* Psrc, Resample_Real weight, int dst_x);
+   struct Transfer
+   {
+      Transfer_Func func;
+      Real gamma;
+      unsigned int linear_channel_mask;
+   };
+
+   Transfer m_input_transfer;
+   Transfer m_output_transfer;
+
+   // Premultiplied alpha channel, or -1.
+   int m_alpha_channel;
+
+   // 8-bit input table: the 256 input transfer decoded values, followed by the 256 linear ones. Built on first use.
+   Real* m_Pdecode_table;
+
+   // 8-bit output tables of the output transfer function, built on first use (see encode_unorm8()):
+   // the linear samples rounding to each code's upper half way point, and the lowest code of each table interval.
+   Real* m_Pencode_threshold;
+   unsigned char* m_Pencode_start;
+
+   // Source scanline converted to linear samples, when it can't be decoded straight into the scanline buffer.
+   Sample* m_Pdecode_buf;
+
+   void init(
+      int src_x, int src_y,
+      int dst_x, int dst_y,
+      int num_channels,
+      Boundary_Op boundary_op,
+      Real sample_low, Real sample_high,
+      const char* Pfilter_name,
+      Contrib_List* Pclist_x,
+      Contrib_List* Pclist_y,
+      Real filter_x_scale,
+      Real filter_y_scale,
+      Real src_x_ofs,
+      Real src_y_ofs,
+      const Window* Pdst_window);
+
+   void init_members();
+   void move_from(Resampler_T& o);
+   void free_buffers();
+   static void drop_clist(Contrib_List* Pclist, bool cached, bool forced);
+
+   double begin_pass(Pass pass);
+   void end_pass(Pass pass, double start_time);
+   void resample_x(Sample* Pdst, const Sample* Psrc, int src_pixel_stride);
+   void filter_x(Sample* Pdst, const Sample* Psrc, int src_pixel_stride);
+   void scale_y_mov(Sample* Ptmp, const Scan_Sample* Psrc, Real weight, int dst_x);
+   void scale_y_add(Sample* Ptmp, const Scan_Sample* Psrc, Real weight, int dst_x);
    void clamp(Sample* Pdst, int n);
    void resample_y(Sample* Pdst);
 
-   int reflect(const int j, const int src_x, const Boundary_Op boundary_op);
-
-   Contrib_List* make_clist(
-      int src_x, int dst_x, Boundary_Op boundary_op,
-      Resample_Real (*Pfilter)(Resample_Real),
-      Resample_Real filter_support,
-      Resample_Real filter_scale,
-      Resample_Real src_ofs);
+   template<typename T> bool add_line(const T* Psrc, int src_pixel_stride, bool borrow);
+   bool put_line_x_filtered(const Sample* Psrc);
+   struct Pipeline;
+   static void pipeline_read_stage(Pipeline* Pp);
+   static void pipeline_x_stage(Pipeline* Pp);
+   static void pipeline_write_stage(Pipeline* Pp);
+   int get_scan_slot();
+   bool alloc_scan_slot_line(int i);
+   void decode_line(Sample* Pdst, const Sample* Psrc, int src_pixel_stride) const;
+   void decode_line(Sample* Pdst, const unsigned char* Psrc, int src_pixel_stride) const;
+   void encode_line(Sample* Psamples) const;
+   void encode_unorm8(unsigned char* Pdst, int dst_pixel_stride, const Sample* Psrc) const;
+   bool input_stage() const { return (m_input_transfer.func != TRANSFER_LINEAR) || (m_alpha_channel >= 0); }
+   bool output_stage() const { return (m_output_transfer.func != TRANSFER_LINEAR) || (m_alpha_channel >= 0); }
+   bool build_decode_table();
+   bool build_encode_table();
+   bool line_available() const;
+
+   int calc_scan_buf_size();
+   size_t get_memory_size() const;
+   bool resize_scan_buf(int new_size);
+   bool alloc_scan_buf_lines();
+   void free_scan_buf_lines();
+   void free_scan_buf_arena();
+
+   bool time_orders(bool& delay_x_resample);
+
+   static void resample_image_strip(int strip_index, void* pData);
+
+   static int reflect(const int j, const int src_x, const Boundary_Op boundary_op);
+
+   static Contrib_List* make_clist(
+      int src_x, int dst_x, int window_ofs, int window_size, Boundary_Op boundary_op,
+      Real (*Pfilter)(Real),
+      const Real* Pfilter_table,
+      Real filter_support,
+      Real filter_scale,
+      Real src_ofs,
+      int num_phases);
+
+   static Contrib_List* acquire_clist(
+      int src_x, int dst_x, int window_ofs, int window_size, Boundary_Op boundary_op,
+      int filter_index,
+      Real filter_scale,
+      Real src_ofs,
+      bool& cached);
+   static bool add_ref_clist(Contrib_List* Pclist);
+   static void release_clist(Contrib_List* Pclist);
+
+   static Contrib_Table* make_contrib_table(const Contrib_List* Pclist, int src_x, int dst_x);
+   static void free_contrib_table(Contrib_Table* Ptable);
 
    inline int count_ops(Contrib_List* Pclist, int k)
    {
@@ -156,10 +692,10 @@ private:
       return (t);
    }
 
-   Resample_Real m_lo;
-   Resample_Real m_hi;
+   Real m_lo;
+   Real m_hi;
 
-   inline Resample_Real clamp_sample(Resample_Real f) const
+   inline Real clamp_sample(Real f) const
    {
       if (f < m_lo)
          f = m_lo;
@@ -169,6 +705,12 @@ private:
    }
 };
 
+typedef Resampler_T<Resample_Real> Resampler;
+typedef Resampler_T<double> Resampler_Double;
+
+// float samples, with the buffered scanlines stored as half floats.
+typedef Resampler_T<float, Resample_Half> Resampler_Half;
+
 #endif // __RESAMPLER_H__
 
 // This is free and unencumbered software released into the public domain.
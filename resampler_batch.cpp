@@ -0,0 +1,234 @@
+// resampler_batch.cpp, Resampling one source image to many output sizes in a single pass.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cassert>
+#include "resampler_batch.h"
+#include "resampler_threads.h"
+
+#define resampler_assert assert
+
+template<typename Real, typename Storage>
+struct Resampler_Batch<Real, Storage>::Job
+{
+   const Real* Psrc;
+   size_t src_pitch;
+   int src_y;
+   int num_channels;
+
+   const Target* Ptargets;
+   Target_Resampler** Presamplers;
+
+   // The targets of group g are Pgroup_targets[Pgroup_first[g]] to Pgroup_targets[Pgroup_first[g + 1] - 1].
+   int num_groups;
+   int* Pgroup_first;
+   int* Pgroup_targets;
+
+   // X filtered scanline of each group sharing its X pass, NULL for the other groups.
+   Real** Pgroup_x_line;
+
+   Resampler_Base::Status* Pstatus;
+};
+
+// Feeds source scanline y to one group's targets and writes out every destination scanline they complete.
+template<typename Real, typename Storage>
+bool Resampler_Batch<Real, Storage>::put_group_line(Job& job, int group, int y)
+{
+   const Real* Psrc = job.Psrc + y * job.src_pitch;
+   const int first = job.Pgroup_first[group], end = job.Pgroup_first[group + 1];
+
+   if (Real* Px_line = job.Pgroup_x_line[group])
+   {
+      // X filter the scanline once if any of the group's targets still needs it.
+      bool needed = false;
+      for (int i = first; (i < end) && (!needed); i++)
+      {
+         const Target_Resampler& r = *job.Presamplers[job.Pgroup_targets[i]];
+         needed = (r.m_cur_src_y < r.m_resample_src_y) && (r.m_Psrc_y_count[r.m_cur_src_y] != 0);
+      }
+
+      if (needed)
+         job.Presamplers[job.Pgroup_targets[first]]->resample_x(Px_line, Psrc, job.num_channels);
+   }
+
+   for (int i = first; i < end; i++)
+   {
+      const int t = job.Pgroup_targets[i];
+      const Target& target = job.Ptargets[t];
+      Target_Resampler& resampler = *job.Presamplers[t];
+
+      // The source image outlives the targets, so its scanlines never have to be copied.
+      const bool okay = job.Pgroup_x_line[group] ? resampler.put_line_x_filtered(job.Pgroup_x_line[group]) : resampler.put_line_borrowed(Psrc);
+      if (!okay)
+      {
+         job.Pstatus[group] = (resampler.status() != Resampler_Base::STATUS_OKAY) ? resampler.status() : Resampler_Base::STATUS_OUT_OF_MEMORY;
+         return false;
+      }
+
+      for ( ; ; )
+      {
+         Real* Pdst = target.Pdst + resampler.m_cur_dst_y * target.pitch;
+         if (!resampler.get_line_into(Pdst, job.num_channels))
+            break;
+      }
+   }
+
+   return true;
+}
+
+// Thread pool task filtering one group of targets.
+template<typename Real, typename Storage>
+void Resampler_Batch<Real, Storage>::resample_group(int group, void* pData)
+{
+   Job& job = *static_cast<Job*>(pData);
+
+   for (int y = 0; y < job.src_y; y++)
+      if (!put_group_line(job, group, y))
+         return;
+}
+
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_Batch<Real, Storage>::resample_batch(
+   const Sample* Psrc, int src_x, int src_y, size_t src_pitch,
+   int num_channels,
+   const Target* Ptargets, int num_targets,
+   Resampler_Base::Boundary_Op boundary_op,
+   Real sample_low, Real sample_high,
+   Resampler_Thread_Pool* Ppool)
+{
+   resampler_assert(src_pitch >= (size_t)src_x * num_channels);
+
+   if (num_targets <= 0)
+      return Resampler_Base::STATUS_OKAY;
+
+   Job job;
+   job.Psrc = Psrc;
+   job.src_pitch = src_pitch;
+   job.src_y = src_y;
+   job.num_channels = num_channels;
+   job.Ptargets = Ptargets;
+   job.num_groups = 0;
+
+   job.Presamplers = (Target_Resampler**)calloc(num_targets, sizeof(Target_Resampler*));
+   job.Pgroup_first = (int*)malloc((num_targets + 1) * sizeof(int));
+   job.Pgroup_targets = (int*)malloc(num_targets * sizeof(int));
+   job.Pgroup_x_line = (Real**)calloc(num_targets, sizeof(Real*));
+   job.Pstatus = (Resampler_Base::Status*)malloc(num_targets * sizeof(Resampler_Base::Status));
+
+   Resampler_Base::Status status = Resampler_Base::STATUS_OKAY;
+
+   if ((!job.Presamplers) || (!job.Pgroup_first) || (!job.Pgroup_targets) || (!job.Pgroup_x_line) || (!job.Pstatus))
+      status = Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+   for (int t = 0; (t < num_targets) && (status == Resampler_Base::STATUS_OKAY); t++)
+   {
+      const Target& target = Ptargets[t];
+      resampler_assert(target.pitch >= (size_t)target.dst_x * num_channels);
+
+      job.Presamplers[t] = new Target_Resampler(src_x, src_y, target.dst_x, target.dst_y, num_channels,
+         boundary_op, sample_low, sample_high, target.Pfilter_name, NULL, NULL, target.filter_scale, target.filter_scale);
+
+      status = job.Presamplers[t]->status();
+   }
+
+   // Group the targets by X contributor lists.
+   if (status == Resampler_Base::STATUS_OKAY)
+   {
+      int num_grouped = 0;
+      for (int t = 0; t < num_targets; t++)
+      {
+         bool grouped = false;
+         for (int i = 0; (i < num_grouped) && (!grouped); i++)
+            grouped = (job.Pgroup_targets[i] == t);
+         if (grouped)
+            continue;
+
+         job.Pgroup_first[job.num_groups++] = num_grouped;
+         for (int u = t; u < num_targets; u++)
+            if (job.Presamplers[u]->m_Pclist_x == job.Presamplers[t]->m_Pclist_x)
+               job.Pgroup_targets[num_grouped++] = u;
+      }
+      job.Pgroup_first[job.num_groups] = num_grouped;
+   }
+
+   // Share the X pass of a group if that's cheaper than resampling each target in the order its Resampler picked,
+   // with the op estimates of Resampler_T::init().
+   for (int g = 0; (g < job.num_groups) && (status == Resampler_Base::STATUS_OKAY); g++)
+   {
+      const int first = job.Pgroup_first[g], end = job.Pgroup_first[g + 1];
+      if (end - first < 2)
+         continue;
+
+      Target_Resampler& leader = *job.Presamplers[job.Pgroup_targets[first]];
+      const int group_dst_x = leader.m_resample_dst_x;
+      const long long x_ops = leader.count_ops(leader.m_Pclist_x, group_dst_x);
+
+      long long shared_ops = x_ops * src_y, separate_ops = 0;
+      for (int i = first; i < end; i++)
+      {
+         Target_Resampler& r = *job.Presamplers[job.Pgroup_targets[i]];
+         const long long y_ops = r.count_ops(r.m_Pclist_y, r.m_resample_dst_y);
+
+         shared_ops += (4LL * y_ops * group_dst_x) / 3;
+         separate_ops += r.m_delay_x_resample ? ((4LL * y_ops * src_x) / 3 + x_ops * r.m_resample_dst_y) : (x_ops * src_y + (4LL * y_ops * group_dst_x) / 3);
+      }
+
+      // Sharing needs the samples as they are passed in, without an input transfer function.
+      if ((shared_ops >= separate_ops) || (leader.input_stage()))
+         continue;
+
+      for (int i = first; (i < end) && (status == Resampler_Base::STATUS_OKAY); i++)
+      {
+         Target_Resampler& r = *job.Presamplers[job.Pgroup_targets[i]];
+         if ((r.m_delay_x_resample) && (!r.set_delay_x_resample(false)))
+            status = Resampler_Base::STATUS_OUT_OF_MEMORY;
+      }
+
+      if ((status == Resampler_Base::STATUS_OKAY) && ((job.Pgroup_x_line[g] = (Real*)malloc((size_t)group_dst_x * num_channels * sizeof(Real))) == NULL))
+         status = Resampler_Base::STATUS_OUT_OF_MEMORY;
+   }
+
+   if (status == Resampler_Base::STATUS_OKAY)
+   {
+      for (int g = 0; g < job.num_groups; g++)
+         job.Pstatus[g] = Resampler_Base::STATUS_OKAY;
+
+      if ((Ppool) && (Ppool->get_num_threads() > 1) && (job.num_groups > 1))
+         Ppool->run(job.num_groups, resample_group, &job);
+      else
+      {
+         // Each source scanline goes through every target while it's in the cache.
+         bool okay = true;
+         for (int y = 0; (y < src_y) && (okay); y++)
+            for (int g = 0; (g < job.num_groups) && (okay); g++)
+               okay = put_group_line(job, g, y);
+      }
+
+      for (int g = 0; g < job.num_groups; g++)
+         if (job.Pstatus[g] != Resampler_Base::STATUS_OKAY)
+            status = job.Pstatus[g];
+   }
+
+   if (job.Presamplers)
+   {
+      for (int t = 0; t < num_targets; t++)
+         delete job.Presamplers[t];
+      free(job.Presamplers);
+   }
+
+   if (job.Pgroup_x_line)
+   {
+      for (int g = 0; g < job.num_groups; g++)
+         free(job.Pgroup_x_line[g]);
+      free(job.Pgroup_x_line);
+   }
+
+   free(job.Pgroup_first);
+   free(job.Pgroup_targets);
+   free(job.Pstatus);
+
+   return status;
+}
+
+template class Resampler_Batch<float>;
+template class Resampler_Batch<double>;
+template class Resampler_Batch<float, Resample_Half>;
@@ -0,0 +1,50 @@
+// resampler_batch.h, Resampling one source image to many output sizes in a single pass.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_BATCH_H__
+#define __RESAMPLER_BATCH_H__
+
+#include "resampler.h"
+
+// Resamples a source image to several targets at once: each source scanline is passed to every target's Resampler
+// while it's still in the cache, and no target copies it (Y-X order targets filter straight out of the source image).
+// Targets with the same X contributor lists (same width, filter and filter scale: the contributor list cache hands
+// them the same lists) form a group. When the op counts favor it a group runs in X-Y order, with every source scanline
+// resampled on the X axis once for the whole group and only copied into each target's scanline buffer.
+// The output of each target is bit-identical to a single Resampler_T using the same resampling order.
+// Explicitly instantiated in resampler_batch.cpp for the same types as Resampler_T.
+template<typename Real, typename Storage = Real>
+class Resampler_Batch
+{
+public:
+   typedef Resampler_T<Real, Storage> Target_Resampler;
+   typedef Real Sample;
+
+   // An output image.
+   struct Target
+   {
+      Sample* Pdst;
+      int dst_x, dst_y;
+      size_t pitch; // Number of samples between the starts of consecutive scanlines
+      const char* Pfilter_name;
+      Real filter_scale;
+   };
+
+   // Ppool - Optional thread pool: each group of targets is then filtered by its own task (which all read the same
+   //    source scanlines). NULL filters all the targets on the calling thread, scanline by scanline.
+   // The other parameters are the same as Resampler_T::resample_image()'s.
+   static Resampler_Base::Status resample_batch(
+      const Sample* Psrc, int src_x, int src_y, size_t src_pitch,
+      int num_channels,
+      const Target* Ptargets, int num_targets,
+      Resampler_Base::Boundary_Op boundary_op = Resampler_Base::BOUNDARY_CLAMP,
+      Real sample_low = Target_Resampler::RR(0.0), Real sample_high = Target_Resampler::RR(0.0),
+      Resampler_Thread_Pool* Ppool = NULL);
+
+private:
+   struct Job;
+
+   static bool put_group_line(Job& job, int group, int y);
+   static void resample_group(int group, void* pData);
+};
+
+#endif // __RESAMPLER_BATCH_H__
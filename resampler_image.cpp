@@ -0,0 +1,186 @@
+// resampler_image.cpp, Multithreaded whole image resampling on top of the streaming Resampler.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cassert>
+#include "resampler.h"
+#include "resampler_threads.h"
+
+#define resampler_assert assert
+
+template<typename Real, typename Storage>
+struct Resample_Image_Job
+{
+   const Resampler_T<Real, Storage>* Pmaster;
+
+   const Real* Psrc;
+   int src_x, src_y;
+   size_t src_pitch;
+
+   Real* Pdst;
+   int dst_x, dst_y;
+   size_t dst_pitch;
+
+   int num_channels;
+   Resampler_Base::Boundary_Op boundary_op;
+   Real sample_low, sample_high;
+   const char* Pfilter_name;
+   Real filter_x_scale, filter_y_scale;
+   Real src_x_ofs, src_y_ofs;
+
+   int num_strips;
+   Resampler_Base::Status* Pstatus;
+};
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::resample_image_strip(int strip_index, void* pData)
+{
+   const Resample_Image_Job<Real, Storage>& job = *static_cast<const Resample_Image_Job<Real, Storage>*>(pData);
+   const Resampler_T& master = *job.Pmaster;
+
+   const int first_dst_y = (int)(((long long)job.dst_y * strip_index) / job.num_strips);
+   const int end_dst_y = (int)(((long long)job.dst_y * (strip_index + 1)) / job.num_strips);
+   if (first_dst_y == end_dst_y)
+   {
+      job.Pstatus[strip_index] = STATUS_OKAY;
+      return;
+   }
+
+   // The range of source scanlines this strip's destination scanlines depend on.
+   int first_src_y = job.src_y, last_src_y = -1;
+   for (int y = first_dst_y; y < end_dst_y; y++)
+   {
+      const Contrib_List& l = master.m_Pclist_y[y];
+      for (int i = 0; i < l.n; i++)
+      {
+         if (l.p[i].pixel < first_src_y)
+            first_src_y = l.p[i].pixel;
+         if (l.p[i].pixel > last_src_y)
+            last_src_y = l.p[i].pixel;
+      }
+   }
+
+   // A Resampler which only produces this strip: its Y contributor lists are a window into the master's.
+   Resampler_T strip(job.src_x, job.src_y, job.dst_x, end_dst_y - first_dst_y, job.num_channels,
+      job.boundary_op, job.sample_low, job.sample_high, job.Pfilter_name,
+      master.m_Pclist_x, master.m_Pclist_y + first_dst_y,
+      job.filter_x_scale, job.filter_y_scale, job.src_x_ofs, job.src_y_ofs);
+
+   if (strip.status() != STATUS_OKAY)
+   {
+      job.Pstatus[strip_index] = strip.status();
+      return;
+   }
+
+   // Use the order picked for the whole image, the strip's own op counts could pick the other one
+   // (which would change the rounding of the results).
+   if (strip.m_delay_x_resample != master.m_delay_x_resample)
+   {
+      if (!strip.set_delay_x_resample(master.m_delay_x_resample))
+      {
+         job.Pstatus[strip_index] = STATUS_OUT_OF_MEMORY;
+         return;
+      }
+   }
+
+   // None of the scanlines before first_src_y contribute to this strip.
+   strip.m_cur_src_y = first_src_y;
+
+   for (int y = first_src_y; y <= last_src_y; y++)
+   {
+      // The source image outlives the strip, so it never has to be copied.
+      if (!strip.put_line_borrowed(job.Psrc + y * job.src_pitch))
+      {
+         job.Pstatus[strip_index] = (strip.status() != STATUS_OKAY) ? strip.status() : STATUS_OUT_OF_MEMORY;
+         return;
+      }
+
+      // The strip's scanlines are written straight into the destination image.
+      for ( ; ; )
+      {
+         Sample* Pdst_line = job.Pdst + (first_dst_y + strip.m_cur_dst_y) * job.dst_pitch;
+         if (!strip.get_line_into(Pdst_line, job.num_channels))
+            break;
+      }
+   }
+
+   resampler_assert(strip.m_cur_dst_y == end_dst_y - first_dst_y);
+
+   job.Pstatus[strip_index] = STATUS_OKAY;
+}
+
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_T<Real, Storage>::resample_image(
+   const Sample* Psrc, int src_x, int src_y, size_t src_pitch,
+   Sample* Pdst, int dst_x, int dst_y, size_t dst_pitch,
+   int num_channels,
+   Boundary_Op boundary_op,
+   Real sample_low, Real sample_high,
+   const char* Pfilter_name,
+   Resampler_Thread_Pool* Ppool,
+   Real filter_x_scale,
+   Real filter_y_scale,
+   Real src_x_ofs,
+   Real src_y_ofs)
+{
+   resampler_assert(src_pitch >= (size_t)src_x * num_channels);
+   resampler_assert(dst_pitch >= (size_t)dst_x * num_channels);
+
+   // The master instance creates the contributor lists and picks the resampling order, it never sees any scanlines.
+   Resampler_T master(src_x, src_y, dst_x, dst_y, num_channels, boundary_op, sample_low, sample_high, Pfilter_name,
+      NULL, NULL, filter_x_scale, filter_y_scale, src_x_ofs, src_y_ofs);
+   if (master.status() != STATUS_OKAY)
+      return master.status();
+
+   Resampler_Thread_Pool* Ptemp_pool = NULL;
+   if (!Ppool)
+      Ppool = Ptemp_pool = new Resampler_Thread_Pool();
+
+   // One strip per thread: each strip filters the source scanlines overlapping its neighbors' again,
+   // so fewer, taller strips keep the redundant work down.
+   const int num_strips = (Ppool->get_num_threads() < dst_y) ? Ppool->get_num_threads() : dst_y;
+
+   Status* Pstatus = (Status*)malloc(num_strips * sizeof(Status));
+   if (!Pstatus)
+   {
+      delete Ptemp_pool;
+      return STATUS_OUT_OF_MEMORY;
+   }
+
+   Resample_Image_Job<Real, Storage> job;
+   job.Pmaster = &master;
+   job.Psrc = Psrc;
+   job.src_x = src_x;
+   job.src_y = src_y;
+   job.src_pitch = src_pitch;
+   job.Pdst = Pdst;
+   job.dst_x = dst_x;
+   job.dst_y = dst_y;
+   job.dst_pitch = dst_pitch;
+   job.num_channels = num_channels;
+   job.boundary_op = boundary_op;
+   job.sample_low = sample_low;
+   job.sample_high = sample_high;
+   job.Pfilter_name = Pfilter_name;
+   job.filter_x_scale = filter_x_scale;
+   job.filter_y_scale = filter_y_scale;
+   job.src_x_ofs = src_x_ofs;
+   job.src_y_ofs = src_y_ofs;
+   job.num_strips = num_strips;
+   job.Pstatus = Pstatus;
+
+   Ppool->run(num_strips, resample_image_strip, &job);
+
+   Status status = STATUS_OKAY;
+   for (int i = 0; i < num_strips; i++)
+      if (Pstatus[i] != STATUS_OKAY)
+         status = Pstatus[i];
+
+   free(Pstatus);
+   delete Ptemp_pool;
+
+   return status;
+}
+
+template Resampler_Base::Status Resampler_T<float>::resample_image(const float*, int, int, size_t, float*, int, int, size_t, int, Boundary_Op, float, float, const char*, Resampler_Thread_Pool*, float, float, float, float);
+template Resampler_Base::Status Resampler_T<double>::resample_image(const double*, int, int, size_t, double*, int, int, size_t, int, Boundary_Op, double, double, const char*, Resampler_Thread_Pool*, double, double, double, double);
+template Resampler_Base::Status Resampler_T<float, Resample_Half>::resample_image(const float*, int, int, size_t, float*, int, int, size_t, int, Boundary_Op, float, float, const char*, Resampler_Thread_Pool*, float, float, float, float);
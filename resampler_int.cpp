@@ -0,0 +1,816 @@
+// resampler_int.cpp, Fixed point version of the separable filtering image rescaler for 8 and 16 bit samples.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include <limits>
+#include "resampler_int.h"
+
+#if RESAMPLER_USE_SIMD
+   #if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+      #define RESAMPLER_INT_SSE2 1
+      #include <emmintrin.h>
+   #elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+      #define RESAMPLER_INT_NEON 1
+      #include <arm_neon.h>
+   #endif
+#endif
+
+#define resampler_assert assert
+
+template<typename D, typename S>
+static inline D clamp_to(S v)
+{
+   if (v < (S)std::numeric_limits<D>::min())
+      return std::numeric_limits<D>::min();
+   else if (v > (S)std::numeric_limits<D>::max())
+      return std::numeric_limits<D>::max();
+   return (D)v;
+}
+
+template<typename W>
+static inline W quantize_weight(Resample_Real weight, int weight_bits)
+{
+   const double w = (double)weight * ((long long)1 << weight_bits);
+   return clamp_to<W>((w < 0) ? (w - .5) : (w + .5));
+}
+
+// Adds the rounding error of n quantized weights to the largest one, so they sum to exactly 1 << weight_bits.
+template<typename W>
+static void normalize_weights(W* Pweight, int n, int weight_bits)
+{
+   long long sum = 0;
+   int max_j = 0;
+   for (int j = 0; j < n; j++)
+   {
+      sum += Pweight[j];
+      if (Pweight[j] > Pweight[max_j])
+         max_j = j;
+   }
+
+   Pweight[max_j] = clamp_to<W>(Pweight[max_j] + (((long long)1 << weight_bits) - sum));
+}
+
+// X pass: N is the number of channels, or 0 for any number of channels.
+// L is the private contributor list type of Resampler_Int<T>.
+template<int N, typename T, typename L>
+static void resample_x_int(typename Resampler_Int_Traits<T>::Intermediate* Pdst, const T* Psrc, const L* Pclist, int dst_x, int num_channels)
+{
+   typedef typename Resampler_Int_Traits<T>::Intermediate Intermediate;
+   typedef typename Resampler_Int_Traits<T>::Accum Accum;
+
+   const int shift = Resampler_Int_Traits<T>::WEIGHT_BITS - Resampler_Int_Traits<T>::FRAC_BITS;
+   const Accum round = (Accum)1 << (shift - 1);
+   const int nc = N ? N : num_channels;
+
+   for (int i = 0; i < dst_x; i++, Pclist++)
+   {
+      Accum total[N ? N : RESAMPLER_MAX_CHANNELS];
+      for (int c = 0; c < nc; c++)
+         total[c] = round;
+
+      for (int j = 0; j < Pclist->n; j++)
+      {
+         const T* Ps = Psrc + Pclist->pixel[j];
+         const Accum weight = Pclist->weight[j];
+         for (int c = 0; c < nc; c++)
+            total[c] += Ps[c] * weight;
+      }
+
+      for (int c = 0; c < nc; c++)
+         *Pdst++ = clamp_to<Intermediate>(total[c] >> shift);
+   }
+}
+
+// X pass over a fixed width table, for destination samples [first, end).
+template<int N, typename T, typename W>
+static void resample_x_int_table_range(typename Resampler_Int_Traits<T>::Intermediate* Pdst, const T* Psrc, const int* Pstart, const W* Pweight, int taps, int first, int end, int num_channels)
+{
+   typedef typename Resampler_Int_Traits<T>::Intermediate Intermediate;
+   typedef typename Resampler_Int_Traits<T>::Accum Accum;
+
+   const int shift = Resampler_Int_Traits<T>::WEIGHT_BITS - Resampler_Int_Traits<T>::FRAC_BITS;
+   const Accum round = (Accum)1 << (shift - 1);
+   const int nc = N ? N : num_channels;
+
+   for (int i = first; i < end; i++)
+   {
+      const T* Ps = Psrc + Pstart[i] * nc;
+      const W* Pw = Pweight + (size_t)i * taps;
+
+      Accum total[N ? N : RESAMPLER_MAX_CHANNELS];
+      for (int c = 0; c < nc; c++)
+         total[c] = round;
+
+      for (int t = 0; t < taps; t++, Ps += nc)
+      {
+         const Accum weight = Pw[t];
+         for (int c = 0; c < nc; c++)
+            total[c] += Ps[c] * weight;
+      }
+
+      for (int c = 0; c < nc; c++)
+         Pdst[i * nc + c] = clamp_to<Intermediate>(total[c] >> shift);
+   }
+}
+
+// Y pass: sums num_src weighted intermediate scanlines over samples [first, n), then rounds and clamps them to the output type.
+template<typename T, typename I, typename W, typename A>
+static void resample_y_int_range(T* Pdst, const I* const* Psrc, const W* Pweight, int num_src, int first, int n, A* Paccum)
+{
+   const int shift = Resampler_Int_Traits<T>::WEIGHT_BITS + Resampler_Int_Traits<T>::FRAC_BITS;
+   const A round = (A)1 << (shift - 1);
+
+   int x, j;
+
+   for (x = first; x < n; x++)
+      Paccum[x] = round;
+
+   for (j = 0; j < num_src; j++)
+   {
+      const I* Ps = Psrc[j];
+      const A weight = Pweight[j];
+      for (x = first; x < n; x++)
+         Paccum[x] += Ps[x] * weight;
+   }
+
+   for (x = first; x < n; x++)
+      Pdst[x] = clamp_to<T>(Paccum[x] >> shift);
+}
+
+#if RESAMPLER_INT_SSE2
+// 8 samples per iteration: pairs of scanlines are interleaved so _mm_madd_epi16 applies two weights at once.
+static void resample_y_u8_sse2(unsigned char* Pdst, const short* const* Psrc, const short* Pweight, int num_src, int n, int* Paccum)
+{
+   const int shift = Resampler_Int_Traits<unsigned char>::WEIGHT_BITS + Resampler_Int_Traits<unsigned char>::FRAC_BITS;
+   const __m128i round = _mm_set1_epi32(1 << (shift - 1));
+   const __m128i zero = _mm_setzero_si128();
+
+   int x = 0;
+   for ( ; x + 8 <= n; x += 8)
+   {
+      __m128i lo = round, hi = round;
+
+      int j = 0;
+      for ( ; j + 2 <= num_src; j += 2)
+      {
+         const __m128i w = _mm_set1_epi32((unsigned short)Pweight[j] | ((unsigned int)(unsigned short)Pweight[j + 1] << 16));
+         const __m128i a = _mm_loadu_si128((const __m128i*)(Psrc[j] + x));
+         const __m128i b = _mm_loadu_si128((const __m128i*)(Psrc[j + 1] + x));
+         lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), w));
+         hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), w));
+      }
+
+      if (j < num_src)
+      {
+         const __m128i w = _mm_set1_epi32((unsigned short)Pweight[j]);
+         const __m128i a = _mm_loadu_si128((const __m128i*)(Psrc[j] + x));
+         lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, zero), w));
+         hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, zero), w));
+      }
+
+      lo = _mm_srai_epi32(lo, shift);
+      hi = _mm_srai_epi32(hi, shift);
+
+      const __m128i r = _mm_packs_epi32(lo, hi);
+      _mm_storel_epi64((__m128i*)(Pdst + x), _mm_packus_epi16(r, r));
+   }
+
+   resample_y_int_range(Pdst, Psrc, Pweight, num_src, x, n, Paccum);
+}
+
+// 8-bit X pass kernels. The table's tap count is a multiple of 4, and start + taps never exceeds the source width.
+static const int U8_X_SHIFT = Resampler_Int_Traits<unsigned char>::WEIGHT_BITS - Resampler_Int_Traits<unsigned char>::FRAC_BITS;
+
+static void resample_x_u8_table_1_sse2(short* Pdst, const unsigned char* Psrc, int src_x, const int* Pstart, const short* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   const __m128i zero = _mm_setzero_si128();
+
+   for (int i = 0; i < dst_x; i++, Pweight += taps)
+   {
+      const unsigned char* Ps = Psrc + Pstart[i];
+      __m128i acc = zero;
+
+      int t = 0;
+      for ( ; t + 8 <= taps; t += 8)
+      {
+         const __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(Ps + t)), zero);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(s, _mm_loadu_si128((const __m128i*)(Pweight + t))));
+      }
+
+      if (t < taps)
+      {
+         int v;
+         memcpy(&v, Ps + t, sizeof(v));
+         const __m128i s = _mm_unpacklo_epi8(_mm_cvtsi32_si128(v), zero);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(s, _mm_loadl_epi64((const __m128i*)(Pweight + t))));
+      }
+
+      acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(1, 0, 3, 2)));
+      acc = _mm_add_epi32(acc, _mm_shuffle_epi32(acc, _MM_SHUFFLE(2, 3, 0, 1)));
+      Pdst[i] = clamp_to<short>((_mm_cvtsi128_si32(acc) + (1 << (U8_X_SHIFT - 1))) >> U8_X_SHIFT);
+   }
+}
+
+static void resample_x_u8_table_2_sse2(short* Pdst, const unsigned char* Psrc, int src_x, const int* Pstart, const short* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   const __m128i round = _mm_set1_epi32(1 << (U8_X_SHIFT - 1));
+   const __m128i zero = _mm_setzero_si128();
+
+   for (int i = 0; i < dst_x; i++, Pweight += taps, Pdst += 2)
+   {
+      const unsigned char* Ps = Psrc + Pstart[i] * 2;
+      __m128i acc = zero;
+
+      // 4 pixels per iteration, reordered to c0 c0 c1 c1 pairs, with weights w0 w1 w0 w1 w2 w3 w2 w3.
+      for (int t = 0; t < taps; t += 4, Ps += 8)
+      {
+         __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)Ps), zero);
+         s = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 1, 2, 0)), _MM_SHUFFLE(3, 1, 2, 0));
+
+         const __m128i w = _mm_loadl_epi64((const __m128i*)(Pweight + t));
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(s, _mm_unpacklo_epi32(w, w)));
+      }
+
+      acc = _mm_add_epi32(acc, _mm_srli_si128(acc, 8));
+      acc = _mm_srai_epi32(_mm_add_epi32(acc, round), U8_X_SHIFT);
+
+      const int r = _mm_cvtsi128_si32(_mm_packs_epi32(acc, acc));
+      memcpy(Pdst, &r, sizeof(r));
+   }
+}
+
+static void resample_x_u8_table_3_sse2(short* Pdst, const unsigned char* Psrc, int src_x, const int* Pstart, const short* Pweight, int taps, int dst_x)
+{
+   const __m128i round = _mm_set1_epi32(1 << (U8_X_SHIFT - 1));
+   const __m128i zero = _mm_setzero_si128();
+
+   for (int i = 0; i < dst_x; i++)
+   {
+      // Each pair of pixels is read with an 8 byte load, which must not run past the end of the scanline.
+      if ((i == dst_x - 1) || (Pstart[i] + taps >= src_x))
+      {
+         resample_x_int_table_range<3>(Pdst, Psrc, Pstart, Pweight, taps, i, i + 1, 3);
+         continue;
+      }
+
+      const unsigned char* Ps = Psrc + Pstart[i] * 3;
+      const short* Pw = Pweight + (size_t)i * taps;
+      __m128i acc = round;
+
+      // s holds c0 c1 c2 of two pixels, interleaving it with itself shifted by one pixel gives c0 c0 c1 c1 c2 c2 pairs.
+      for (int t = 0; t < taps; t += 4, Ps += 12)
+      {
+         const __m128i w = _mm_loadl_epi64((const __m128i*)(Pw + t));
+
+         __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)Ps), zero);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(s, _mm_srli_si128(s, 6)), _mm_shuffle_epi32(w, _MM_SHUFFLE(0, 0, 0, 0))));
+
+         s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(Ps + 6)), zero);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(s, _mm_srli_si128(s, 6)), _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 1, 1))));
+      }
+
+      // Writes one sample into the next destination pixel, which is overwritten on the next iteration.
+      acc = _mm_srai_epi32(acc, U8_X_SHIFT);
+      _mm_storel_epi64((__m128i*)(Pdst + i * 3), _mm_packs_epi32(acc, acc));
+   }
+}
+
+static void resample_x_u8_table_4_sse2(short* Pdst, const unsigned char* Psrc, int src_x, const int* Pstart, const short* Pweight, int taps, int dst_x)
+{
+   (void)src_x;
+   const __m128i round = _mm_set1_epi32(1 << (U8_X_SHIFT - 1));
+   const __m128i zero = _mm_setzero_si128();
+
+   for (int i = 0; i < dst_x; i++, Pweight += taps, Pdst += 4)
+   {
+      const unsigned char* Ps = Psrc + Pstart[i] * 4;
+      __m128i acc = round;
+
+      for (int t = 0; t < taps; t += 4, Ps += 16)
+      {
+         const __m128i w = _mm_loadl_epi64((const __m128i*)(Pweight + t));
+
+         __m128i s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)Ps), zero);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(s, _mm_srli_si128(s, 8)), _mm_shuffle_epi32(w, _MM_SHUFFLE(0, 0, 0, 0))));
+
+         s = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(Ps + 8)), zero);
+         acc = _mm_add_epi32(acc, _mm_madd_epi16(_mm_unpacklo_epi16(s, _mm_srli_si128(s, 8)), _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 1, 1))));
+      }
+
+      acc = _mm_srai_epi32(acc, U8_X_SHIFT);
+      _mm_storel_epi64((__m128i*)Pdst, _mm_packs_epi32(acc, acc));
+   }
+}
+#elif RESAMPLER_INT_NEON
+static void resample_y_u8_neon(unsigned char* Pdst, const short* const* Psrc, const short* Pweight, int num_src, int n, int* Paccum)
+{
+   const int shift = Resampler_Int_Traits<unsigned char>::WEIGHT_BITS + Resampler_Int_Traits<unsigned char>::FRAC_BITS;
+   const int32x4_t round = vdupq_n_s32(1 << (shift - 1));
+
+   int x = 0;
+   for ( ; x + 8 <= n; x += 8)
+   {
+      int32x4_t lo = round, hi = round;
+
+      for (int j = 0; j < num_src; j++)
+      {
+         const int16x8_t a = vld1q_s16(Psrc[j] + x);
+         lo = vmlal_n_s16(lo, vget_low_s16(a), Pweight[j]);
+         hi = vmlal_n_s16(hi, vget_high_s16(a), Pweight[j]);
+      }
+
+      const int16x8_t r = vcombine_s16(vqmovn_s32(vshrq_n_s32(lo, shift)), vqmovn_s32(vshrq_n_s32(hi, shift)));
+      vst1_u8(Pdst + x, vqmovun_s16(r));
+   }
+
+   resample_y_int_range(Pdst, Psrc, Pweight, num_src, x, n, Paccum);
+}
+#endif
+
+// The SIMD kernels compute exactly what the scalar version does.
+static inline void do_resample_y_int(unsigned char* Pdst, const short* const* Psrc, const short* Pweight, int num_src, int n, int* Paccum)
+{
+#if RESAMPLER_INT_SSE2
+   resample_y_u8_sse2(Pdst, Psrc, Pweight, num_src, n, Paccum);
+#elif RESAMPLER_INT_NEON
+   resample_y_u8_neon(Pdst, Psrc, Pweight, num_src, n, Paccum);
+#else
+   resample_y_int_range(Pdst, Psrc, Pweight, num_src, 0, n, Paccum);
+#endif
+}
+
+template<typename T, typename I, typename W, typename A>
+static inline void do_resample_y_int(T* Pdst, const I* const* Psrc, const W* Pweight, int num_src, int n, A* Paccum)
+{
+   resample_y_int_range(Pdst, Psrc, Pweight, num_src, 0, n, Paccum);
+}
+
+// Returns false if there's no SIMD kernel for the sample type and channel count.
+static inline bool do_resample_x_int_table(short* Pdst, const unsigned char* Psrc, int src_x, int num_channels, const int* Pstart, const short* Pweight, int taps, int dst_x)
+{
+#if RESAMPLER_INT_SSE2
+   switch (num_channels)
+   {
+      case 1: resample_x_u8_table_1_sse2(Pdst, Psrc, src_x, Pstart, Pweight, taps, dst_x); return true;
+      case 2: resample_x_u8_table_2_sse2(Pdst, Psrc, src_x, Pstart, Pweight, taps, dst_x); return true;
+      case 3: resample_x_u8_table_3_sse2(Pdst, Psrc, src_x, Pstart, Pweight, taps, dst_x); return true;
+      case 4: resample_x_u8_table_4_sse2(Pdst, Psrc, src_x, Pstart, Pweight, taps, dst_x); return true;
+   }
+#else
+   (void)Pdst; (void)Psrc; (void)src_x; (void)num_channels; (void)Pstart; (void)Pweight; (void)taps; (void)dst_x;
+#endif
+   return false;
+}
+
+template<typename T, typename I, typename W>
+static inline bool do_resample_x_int_table(I*, const T*, int, int, const int*, const W*, int, int) { return false; }
+
+// Quantizes the weights of a contributor list, the rounding error of each list is added to its largest weight
+// so the weights always sum to exactly 1 << WEIGHT_BITS. Source sample indices are multiplied by pixel_scale.
+template<typename T>
+typename Resampler_Int<T>::Int_Contrib_List* Resampler_Int<T>::quantize_clist(const Resampler::Contrib_List* Pclist, int dst_x, int pixel_scale)
+{
+   int i, j;
+   size_t total = 0;
+   for (i = 0; i < dst_x; i++)
+      total += Pclist[i].n;
+
+   Int_Contrib_List* Plist = (Int_Contrib_List*)calloc(dst_x, sizeof(Int_Contrib_List));
+   if (!Plist)
+      return NULL;
+
+   int* Ppixel = (int*)malloc(total * sizeof(int));
+   Weight* Pweight = (Weight*)malloc(total * sizeof(Weight));
+   if ((!Ppixel) || (!Pweight))
+   {
+      free(Ppixel);
+      free(Pweight);
+      free(Plist);
+      return NULL;
+   }
+
+   for (i = 0; i < dst_x; i++)
+   {
+      const Resampler::Contrib_List& src = Pclist[i];
+      Int_Contrib_List& dst = Plist[i];
+
+      dst.n = src.n;
+      dst.pixel = Ppixel;
+      dst.weight = Pweight;
+      Ppixel += src.n;
+      Pweight += src.n;
+
+      for (j = 0; j < src.n; j++)
+      {
+         dst.pixel[j] = src.p[j].pixel * pixel_scale;
+         dst.weight[j] = quantize_weight<Weight>(src.p[j].weight, WEIGHT_BITS);
+      }
+
+      normalize_weights(dst.weight, dst.n, WEIGHT_BITS);
+   }
+
+   return Plist;
+}
+
+template<typename T>
+void Resampler_Int<T>::free_clist(Int_Contrib_List* Pclist)
+{
+   if (!Pclist)
+      return;
+
+   // The first list points to the start of the pools.
+   free(Pclist->pixel);
+   free(Pclist->weight);
+   free(Pclist);
+}
+
+template<typename T>
+typename Resampler_Int<T>::Int_Contrib_Table* Resampler_Int<T>::quantize_table(const Resampler::Contrib_Table* Ptable, int dst_x)
+{
+   Int_Contrib_Table* Pint_table = (Int_Contrib_Table*)calloc(1, sizeof(Int_Contrib_Table));
+   if (!Pint_table)
+      return NULL;
+
+   Pint_table->n = Ptable->n;
+   Pint_table->start = (int*)malloc(dst_x * sizeof(int));
+   Pint_table->weight = (Weight*)malloc((size_t)dst_x * Ptable->n * sizeof(Weight));
+   if ((!Pint_table->start) || (!Pint_table->weight))
+   {
+      free_table(Pint_table);
+      return NULL;
+   }
+
+   memcpy(Pint_table->start, Ptable->start, dst_x * sizeof(int));
+
+   // Each phase is quantized once, by its first destination sample, and copied to the others.
+   int* Pfirst = (int*)malloc(Ptable->num_phases * sizeof(int));
+   if (!Pfirst)
+   {
+      free_table(Pint_table);
+      return NULL;
+   }
+
+   for (int p = 0; p < Ptable->num_phases; p++)
+      Pfirst[p] = -1;
+
+   for (int i = 0; i < dst_x; i++)
+   {
+      const int phase = Ptable->phase[i];
+      Weight* Pweight = Pint_table->weight + (size_t)i * Ptable->n;
+
+      if (Pfirst[phase] >= 0)
+      {
+         memcpy(Pweight, Pint_table->weight + (size_t)Pfirst[phase] * Ptable->n, Ptable->n * sizeof(Weight));
+         continue;
+      }
+
+      Pfirst[phase] = i;
+
+      for (int t = 0; t < Ptable->n; t++)
+         Pweight[t] = quantize_weight<Weight>(Ptable->weight[(size_t)phase * Ptable->n + t], WEIGHT_BITS);
+
+      normalize_weights(Pweight, Ptable->n, WEIGHT_BITS);
+   }
+
+   free(Pfirst);
+
+   return Pint_table;
+}
+
+template<typename T>
+void Resampler_Int<T>::free_table(Int_Contrib_Table* Ptable)
+{
+   if (!Ptable)
+      return;
+
+   free(Ptable->start);
+   free(Ptable->weight);
+   free(Ptable);
+}
+
+template<typename T>
+Resampler_Int<T>::Resampler_Int(int src_x, int src_y,
+                                int dst_x, int dst_y,
+                                int num_channels,
+                                Resampler::Boundary_Op boundary_op,
+                                const char* Pfilter_name,
+                                Resample_Real filter_x_scale,
+                                Resample_Real filter_y_scale,
+                                Resample_Real src_x_ofs,
+                                Resample_Real src_y_ofs) :
+   m_num_channels(num_channels),
+   m_resample_src_x(src_x),
+   m_resample_src_y(src_y),
+   m_resample_dst_x(dst_x),
+   m_resample_dst_y(dst_y),
+   m_Pclist_x(NULL),
+   m_Pclist_y(NULL),
+   m_Ptable_x(NULL),
+   m_Pdst_buf(NULL),
+   m_Pscan_src(NULL),
+   m_Paccum(NULL),
+   m_Psrc_y_count(NULL),
+   m_Psrc_y_slot(NULL),
+   m_scan_buf_size(0),
+   m_scan_buf_num_free(0),
+   m_Pscan_buf_free(NULL),
+   m_Pscan_buf_l(NULL),
+   m_cur_src_y(0),
+   m_cur_dst_y(0),
+   m_status(Resampler::STATUS_OKAY)
+{
+   int i, j;
+
+   resampler_assert(src_x > 0);
+   resampler_assert(src_y > 0);
+   resampler_assert(dst_x > 0);
+   resampler_assert(dst_y > 0);
+   resampler_assert((num_channels > 0) && (num_channels <= RESAMPLER_MAX_CHANNELS));
+
+   if (Pfilter_name == NULL)
+      Pfilter_name = RESAMPLER_DEFAULT_FILTER;
+
+   int filter_index;
+   for (filter_index = 0; filter_index < Resampler::get_filter_num(); filter_index++)
+      if (strcmp(Pfilter_name, Resampler::get_filter_name(filter_index)) == 0)
+         break;
+
+   if (filter_index == Resampler::get_filter_num())
+   {
+      m_status = Resampler::STATUS_BAD_FILTER_NAME;
+      return;
+   }
+
+   // Quantize the same contributor lists the floating point Resampler uses.
+   for (int axis = 0; axis < 2; axis++)
+   {
+      bool cached;
+      Resampler::Contrib_List* Pclist = axis ?
+         Resampler::acquire_clist(src_y, dst_y, 0, dst_y, boundary_op, filter_index, filter_y_scale, src_y_ofs, cached) :
+         Resampler::acquire_clist(src_x, dst_x, 0, dst_x, boundary_op, filter_index, filter_x_scale, src_x_ofs, cached);
+      if (!Pclist)
+      {
+         m_status = Resampler::STATUS_OUT_OF_MEMORY;
+         return;
+      }
+
+      Int_Contrib_List* Pint_clist = axis ? quantize_clist(Pclist, dst_y, 1) : quantize_clist(Pclist, dst_x, num_channels);
+
+#if RESAMPLER_PADDED_X_TABLES
+      // Optional, resample_x() falls back to the contributor list if this fails.
+      if (!axis)
+      {
+         Resampler::Contrib_Table* Ptable = Resampler::make_contrib_table(Pclist, src_x, dst_x);
+         if (Ptable)
+         {
+            m_Ptable_x = quantize_table(Ptable, dst_x);
+            Resampler::free_contrib_table(Ptable);
+         }
+      }
+#endif
+
+      if (cached)
+         Resampler::release_clist(Pclist);
+      else
+      {
+         free(Pclist->p);
+         free(Pclist);
+      }
+
+      if (!Pint_clist)
+      {
+         m_status = Resampler::STATUS_OUT_OF_MEMORY;
+         return;
+      }
+
+      (axis ? m_Pclist_y : m_Pclist_x) = Pint_clist;
+   }
+
+   if ((m_Pdst_buf = (Sample*)malloc(dst_x * num_channels * sizeof(Sample))) == NULL)
+   {
+      m_status = Resampler::STATUS_OUT_OF_MEMORY;
+      return;
+   }
+
+   if ((m_Paccum = (Accum*)malloc(dst_x * num_channels * sizeof(Accum))) == NULL)
+   {
+      m_status = Resampler::STATUS_OUT_OF_MEMORY;
+      return;
+   }
+
+   if (((m_Psrc_y_count = (int*)calloc(src_y, sizeof(int))) == NULL) ||
+       ((m_Psrc_y_slot = (int*)malloc(src_y * sizeof(int))) == NULL))
+   {
+      m_status = Resampler::STATUS_OUT_OF_MEMORY;
+      return;
+   }
+
+   for (i = 0; i < src_y; i++)
+      m_Psrc_y_slot[i] = -1;
+
+   int max_y_contribs = 0;
+   for (i = 0; i < dst_y; i++)
+   {
+      for (j = 0; j < m_Pclist_y[i].n; j++)
+         m_Psrc_y_count[m_Pclist_y[i].pixel[j]]++;
+
+      if (m_Pclist_y[i].n > max_y_contribs)
+         max_y_contribs = m_Pclist_y[i].n;
+   }
+
+   if ((m_Pscan_src = (const Intermediate**)malloc(max_y_contribs * sizeof(const Intermediate*))) == NULL)
+   {
+      m_status = Resampler::STATUS_OUT_OF_MEMORY;
+      return;
+   }
+}
+
+template<typename T>
+Resampler_Int<T>::~Resampler_Int()
+{
+   free_clist(m_Pclist_x);
+   free_clist(m_Pclist_y);
+   free_table(m_Ptable_x);
+
+   free(m_Pdst_buf);
+   free(m_Pscan_src);
+   free(m_Paccum);
+   free(m_Psrc_y_count);
+   free(m_Psrc_y_slot);
+
+   for (int i = 0; i < m_scan_buf_size; i++)
+      free(m_Pscan_buf_l[i]);
+   free(m_Pscan_buf_l);
+   free(m_Pscan_buf_free);
+}
+
+template<typename T>
+void Resampler_Int<T>::restart()
+{
+   if (Resampler::STATUS_OKAY != m_status)
+      return;
+
+   m_cur_src_y = m_cur_dst_y = 0;
+
+   int i, j;
+   for (i = 0; i < m_resample_src_y; i++)
+   {
+      m_Psrc_y_count[i] = 0;
+      m_Psrc_y_slot[i] = -1;
+   }
+
+   for (i = 0; i < m_resample_dst_y; i++)
+      for (j = 0; j < m_Pclist_y[i].n; j++)
+         m_Psrc_y_count[m_Pclist_y[i].pixel[j]]++;
+
+   for (i = 0; i < m_scan_buf_size; i++)
+      m_Pscan_buf_free[i] = m_scan_buf_size - 1 - i;
+
+   m_scan_buf_num_free = m_scan_buf_size;
+}
+
+// Doubles the number of scanline slots, the new slots are all free.
+template<typename T>
+bool Resampler_Int<T>::grow_scan_buf()
+{
+   const int new_size = m_scan_buf_size ? (m_scan_buf_size * 2) : 16;
+
+   int* Pnew_free = (int*)realloc(m_Pscan_buf_free, new_size * sizeof(int));
+   if (!Pnew_free)
+      return false;
+   m_Pscan_buf_free = Pnew_free;
+
+   Intermediate** Pnew_l = (Intermediate**)realloc(m_Pscan_buf_l, new_size * sizeof(Intermediate*));
+   if (!Pnew_l)
+      return false;
+   m_Pscan_buf_l = Pnew_l;
+
+   for (int i = new_size - 1; i >= m_scan_buf_size; i--)
+   {
+      m_Pscan_buf_l[i] = NULL;
+      m_Pscan_buf_free[m_scan_buf_num_free++] = i;
+   }
+
+   m_scan_buf_size = new_size;
+   return true;
+}
+
+template<typename T>
+void Resampler_Int<T>::resample_x(Intermediate* Pdst, const Sample* Psrc)
+{
+   if ((m_Ptable_x) && (m_num_channels <= 4))
+   {
+      const int* Pstart = m_Ptable_x->start;
+      const Weight* Pweight = m_Ptable_x->weight;
+      const int taps = m_Ptable_x->n;
+
+      if (do_resample_x_int_table(Pdst, Psrc, m_resample_src_x, m_num_channels, Pstart, Pweight, taps, m_resample_dst_x))
+         return;
+
+      switch (m_num_channels)
+      {
+         case 1: resample_x_int_table_range<1>(Pdst, Psrc, Pstart, Pweight, taps, 0, m_resample_dst_x, 1); break;
+         case 2: resample_x_int_table_range<2>(Pdst, Psrc, Pstart, Pweight, taps, 0, m_resample_dst_x, 2); break;
+         case 3: resample_x_int_table_range<3>(Pdst, Psrc, Pstart, Pweight, taps, 0, m_resample_dst_x, 3); break;
+         default: resample_x_int_table_range<4>(Pdst, Psrc, Pstart, Pweight, taps, 0, m_resample_dst_x, 4); break;
+      }
+      return;
+   }
+
+   switch (m_num_channels)
+   {
+      case 1: resample_x_int<1>(Pdst, Psrc, m_Pclist_x, m_resample_dst_x, 1); break;
+      case 2: resample_x_int<2>(Pdst, Psrc, m_Pclist_x, m_resample_dst_x, 2); break;
+      case 3: resample_x_int<3>(Pdst, Psrc, m_Pclist_x, m_resample_dst_x, 3); break;
+      case 4: resample_x_int<4>(Pdst, Psrc, m_Pclist_x, m_resample_dst_x, 4); break;
+      default: resample_x_int<0>(Pdst, Psrc, m_Pclist_x, m_resample_dst_x, m_num_channels); break;
+   }
+}
+
+template<typename T>
+void Resampler_Int<T>::resample_y(Sample* Pdst)
+{
+   const Int_Contrib_List& clist = m_Pclist_y[m_cur_dst_y];
+
+   for (int i = 0; i < clist.n; i++)
+   {
+      const int src_y = clist.pixel[i];
+      const int slot = m_Psrc_y_slot[src_y];
+      resampler_assert(slot >= 0);
+
+      m_Pscan_src[i] = m_Pscan_buf_l[slot];
+
+      // Free the slot once the scanline isn't needed anymore, it's only reused by a later put_line().
+      if (--m_Psrc_y_count[src_y] == 0)
+      {
+         m_Psrc_y_slot[src_y] = -1;
+         m_Pscan_buf_free[m_scan_buf_num_free++] = slot;
+      }
+   }
+
+   do_resample_y_int(Pdst, m_Pscan_src, clist.weight, clist.n, m_resample_dst_x * m_num_channels, m_Paccum);
+}
+
+template<typename T>
+bool Resampler_Int<T>::put_line(const Sample* Psrc)
+{
+   if (m_cur_src_y >= m_resample_src_y)
+      return false;
+
+   // Skip source lines which don't contribute to any destination line.
+   if (!m_Psrc_y_count[m_cur_src_y])
+   {
+      m_cur_src_y++;
+      return true;
+   }
+
+   if ((!m_scan_buf_num_free) && (!grow_scan_buf()))
+   {
+      m_status = Resampler::STATUS_OUT_OF_MEMORY;
+      return false;
+   }
+
+   const int slot = m_Pscan_buf_free[--m_scan_buf_num_free];
+
+   if (!m_Pscan_buf_l[slot])
+   {
+      if ((m_Pscan_buf_l[slot] = (Intermediate*)malloc(m_resample_dst_x * m_num_channels * sizeof(Intermediate))) == NULL)
+      {
+         m_scan_buf_num_free++;
+         m_status = Resampler::STATUS_OUT_OF_MEMORY;
+         return false;
+      }
+   }
+
+   m_Psrc_y_slot[m_cur_src_y] = slot;
+
+   resample_x(m_Pscan_buf_l[slot], Psrc);
+
+   m_cur_src_y++;
+
+   return true;
+}
+
+template<typename T>
+const typename Resampler_Int<T>::Sample* Resampler_Int<T>::get_line()
+{
+   if (m_cur_dst_y == m_resample_dst_y)
+      return NULL;
+
+   const Int_Contrib_List& clist = m_Pclist_y[m_cur_dst_y];
+   for (int i = 0; i < clist.n; i++)
+      if (m_Psrc_y_slot[clist.pixel[i]] < 0)
+         return NULL;
+
+   resample_y(m_Pdst_buf);
+
+   m_cur_dst_y++;
+
+   return m_Pdst_buf;
+}
+
+template class Resampler_Int<unsigned char>;
+template class Resampler_Int<unsigned short>;
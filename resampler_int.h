@@ -0,0 +1,143 @@
+// resampler_int.h, Fixed point version of the separable filtering image rescaler for 8 and 16 bit samples.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_INT_H__
+#define __RESAMPLER_INT_H__
+
+#include "resampler.h"
+
+template<typename T> struct Resampler_Int_Traits;
+
+// 8-bit samples: int16 weights, int16 intermediate scanlines (FRAC_BITS fractional bits) and int32 accumulators.
+template<> struct Resampler_Int_Traits<unsigned char>
+{
+   typedef short Weight;
+   typedef short Intermediate;
+   typedef int Accum;
+   enum { WEIGHT_BITS = 14, FRAC_BITS = 6 };
+};
+
+// 16-bit samples: int32 weights, int32 intermediate scanlines and int64 accumulators. The extra weight precision
+// keeps large downsampling factors (thousands of taps with tiny weights) accurate to 16 bits.
+template<> struct Resampler_Int_Traits<unsigned short>
+{
+   typedef int Weight;
+   typedef int Intermediate;
+   typedef long long Accum;
+   enum { WEIGHT_BITS = 24, FRAC_BITS = 8 };
+};
+
+// Resamples images of unsigned char or unsigned short samples without converting them to floating point.
+// The contributor lists are the ones Resampler uses (shared through its contributor list cache), with the weights
+// quantized to WEIGHT_BITS fractional bits so that each list sums to exactly 1.0: constant areas stay constant.
+// Scanlines are always filtered in X first, then in Y. Output samples are rounded and clamped to the sample type's range.
+// There's no gamma correction, so it's meant for data where filtering the stored values is good enough (thumbnails etc.).
+template<typename T>
+class Resampler_Int
+{
+public:
+   typedef T Sample;
+   typedef typename Resampler_Int_Traits<T>::Weight Weight;
+   typedef typename Resampler_Int_Traits<T>::Intermediate Intermediate;
+   typedef typename Resampler_Int_Traits<T>::Accum Accum;
+
+   enum { WEIGHT_BITS = Resampler_Int_Traits<T>::WEIGHT_BITS };
+
+   // The parameters are the same as Resampler's multichannel constructor.
+   Resampler_Int(
+      int src_x, int src_y,
+      int dst_x, int dst_y,
+      int num_channels = 1,
+      Resampler::Boundary_Op boundary_op = Resampler::BOUNDARY_CLAMP,
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Resample_Real filter_x_scale = Resampler::RR(1.0),
+      Resample_Real filter_y_scale = Resampler::RR(1.0),
+      Resample_Real src_x_ofs = Resampler::RR(0.0),
+      Resample_Real src_y_ofs = Resampler::RR(0.0));
+
+   ~Resampler_Int();
+
+   // Reinits resampler so it can handle another frame.
+   void restart();
+
+   // false on out of memory.
+   // Psrc must point to src_x pixels of num_channels interleaved samples.
+   bool put_line(const Sample* Psrc);
+
+   // NULL if no scanlines are currently available (give the resampler more scanlines!)
+   // The returned scanline contains dst_x pixels of num_channels interleaved samples.
+   const Sample* get_line();
+
+   Resampler::Status status() const { return m_status; }
+
+   int get_num_channels() const { return m_num_channels; }
+
+private:
+   Resampler_Int(const Resampler_Int& o);
+   Resampler_Int& operator= (const Resampler_Int& o);
+
+   // A contributor list with fixed point weights.
+   struct Int_Contrib_List
+   {
+      int n;
+      int* pixel;    // source sample offsets for X, source scanlines for Y
+      Weight* weight;
+   };
+
+   // Fixed width X contributor table with fixed point weights, built from the table Resampler would use.
+   struct Int_Contrib_Table
+   {
+      int n;
+      int* start;
+      Weight* weight; // n weights per destination sample
+   };
+
+   int m_num_channels;
+
+   int m_resample_src_x;
+   int m_resample_src_y;
+   int m_resample_dst_x;
+   int m_resample_dst_y;
+
+   Int_Contrib_List* m_Pclist_x;
+   Int_Contrib_List* m_Pclist_y;
+
+   // Optional fixed width version of m_Pclist_x used by resample_x().
+   Int_Contrib_Table* m_Ptable_x;
+
+   Sample* m_Pdst_buf;
+
+   // Per destination scanline Y contributor rows, sized to the largest Y contributor list.
+   const Intermediate** m_Pscan_src;
+
+   // Y accumulators used by the scalar vertical pass, dst_x * num_channels.
+   Accum* m_Paccum;
+
+   int* m_Psrc_y_count;
+   int* m_Psrc_y_slot;
+
+   // Horizontally filtered scanlines which are still needed, they're allocated on demand and kept until destruction.
+   int m_scan_buf_size;
+   int m_scan_buf_num_free;
+   int* m_Pscan_buf_free;
+   Intermediate** m_Pscan_buf_l;
+
+   int m_cur_src_y;
+   int m_cur_dst_y;
+
+   Resampler::Status m_status;
+
+   static Int_Contrib_List* quantize_clist(const Resampler::Contrib_List* Pclist, int dst_x, int pixel_scale);
+   static void free_clist(Int_Contrib_List* Pclist);
+   static Int_Contrib_Table* quantize_table(const Resampler::Contrib_Table* Ptable, int dst_x);
+   static void free_table(Int_Contrib_Table* Ptable);
+
+   bool grow_scan_buf();
+
+   void resample_x(Intermediate* Pdst, const Sample* Psrc);
+   void resample_y(Sample* Pdst);
+};
+
+typedef Resampler_Int<unsigned char> Resampler_U8;
+typedef Resampler_Int<unsigned short> Resampler_U16;
+
+#endif // __RESAMPLER_INT_H__
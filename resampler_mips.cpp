@@ -0,0 +1,258 @@
+// resampler_mips.cpp, Mipmap chain generation on top of the streaming Resampler.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cassert>
+#include "resampler_mips.h"
+#include "resampler_threads.h"
+
+#define resampler_assert assert
+
+template<typename Real, typename Storage>
+struct Resampler_Mips_Job
+{
+   typedef typename Resampler_Mips<Real, Storage>::Level Level;
+   typedef typename Resampler_Mips<Real, Storage>::Level_Resampler Level_Resampler;
+
+   const Real* Psrc;
+   size_t src_pitch;
+   int src_x, src_y;
+   int num_channels;
+
+   const Level* Plevels;
+   int num_levels;
+
+   // Resampler of each level, reading the previous level (or the source image).
+   Level_Resampler** Presamplers;
+
+   // Scanlines of each level written so far. Guarded by mutex when the levels run on a thread pool.
+   int* Pnum_lines;
+
+   std::mutex mutex;
+   std::condition_variable cond;
+   bool failed;
+
+   Resampler_Base::Status* Pstatus;
+};
+
+// Source scanline y of level's Resampler.
+template<typename Real, typename Storage>
+static const Real* get_level_src_line(const Resampler_Mips_Job<Real, Storage>& job, int level, int y)
+{
+   if (!level)
+      return job.Psrc + y * job.src_pitch;
+
+   return job.Plevels[level - 1].Pdst + y * job.Plevels[level - 1].pitch;
+}
+
+// Feeds a scanline to level's Resampler and cascades every scanline it completes through the following levels,
+// while they're still in the cache.
+template<typename Real, typename Storage>
+static bool cascade_line(Resampler_Mips_Job<Real, Storage>& job, int level, const Real* Psrc)
+{
+   typename Resampler_Mips_Job<Real, Storage>::Level_Resampler& resampler = *job.Presamplers[level];
+
+   // The scanlines of the source and of the completed levels stay put, so they never have to be copied.
+   if (!resampler.put_line_borrowed(Psrc))
+      return false;
+
+   for ( ; ; )
+   {
+      Real* Pdst = job.Plevels[level].Pdst + job.Pnum_lines[level] * job.Plevels[level].pitch;
+      if (!resampler.get_line_into(Pdst, job.num_channels))
+         break;
+
+      job.Pnum_lines[level]++;
+
+      if ((level + 1 < job.num_levels) && (!cascade_line(job, level + 1, Pdst)))
+         return false;
+   }
+
+   return true;
+}
+
+// Thread pool task filtering one level. Tasks are started in level order, so the task a level waits for is always running.
+template<typename Real, typename Storage>
+static void generate_level(int level, void* pData)
+{
+   Resampler_Mips_Job<Real, Storage>& job = *static_cast<Resampler_Mips_Job<Real, Storage>*>(pData);
+   typename Resampler_Mips_Job<Real, Storage>::Level_Resampler& resampler = *job.Presamplers[level];
+
+   int level_src_x, level_src_y;
+   Resampler_Mips<Real, Storage>::get_level_size(job.src_x, job.src_y, level, level_src_x, level_src_y);
+
+   int num_lines = 0;
+   int num_src_lines = level ? 0 : level_src_y;
+
+   for (int y = 0; y < level_src_y; y++)
+   {
+      // Wait for the previous level to complete this scanline.
+      if (y >= num_src_lines)
+      {
+         std::unique_lock<std::mutex> lock(job.mutex);
+         while ((!job.failed) && (job.Pnum_lines[level - 1] <= y))
+            job.cond.wait(lock);
+
+         if (job.failed)
+         {
+            job.Pstatus[level] = Resampler_Base::STATUS_OKAY;
+            return;
+         }
+
+         num_src_lines = job.Pnum_lines[level - 1];
+      }
+
+      if (!resampler.put_line_borrowed(get_level_src_line(job, level, y)))
+         break;
+
+      const int first_line = num_lines;
+      while (resampler.get_line_into(job.Plevels[level].Pdst + num_lines * job.Plevels[level].pitch, job.num_channels))
+         num_lines++;
+
+      if (num_lines != first_line)
+      {
+         {
+            std::lock_guard<std::mutex> lock(job.mutex);
+            job.Pnum_lines[level] = num_lines;
+         }
+         job.cond.notify_all();
+      }
+   }
+
+   int level_x, level_y;
+   Resampler_Mips<Real, Storage>::get_level_size(job.src_x, job.src_y, level + 1, level_x, level_y);
+
+   if (num_lines == level_y)
+      job.Pstatus[level] = Resampler_Base::STATUS_OKAY;
+   else
+   {
+      job.Pstatus[level] = (resampler.status() != Resampler_Base::STATUS_OKAY) ? resampler.status() : Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+      // Release the following levels.
+      {
+         std::lock_guard<std::mutex> lock(job.mutex);
+         job.failed = true;
+      }
+      job.cond.notify_all();
+   }
+}
+
+template<typename Real, typename Storage>
+int Resampler_Mips<Real, Storage>::get_num_levels(int src_x, int src_y)
+{
+   int num_levels = 0;
+   while ((src_x > 1) || (src_y > 1))
+   {
+      src_x = (src_x > 1) ? (src_x >> 1) : 1;
+      src_y = (src_y > 1) ? (src_y >> 1) : 1;
+      num_levels++;
+   }
+   return num_levels;
+}
+
+template<typename Real, typename Storage>
+void Resampler_Mips<Real, Storage>::get_level_size(int src_x, int src_y, int level, int& level_x, int& level_y)
+{
+   level_x = src_x;
+   level_y = src_y;
+   for (int i = 0; i < level; i++)
+   {
+      level_x = (level_x > 1) ? (level_x >> 1) : 1;
+      level_y = (level_y > 1) ? (level_y >> 1) : 1;
+   }
+}
+
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_Mips<Real, Storage>::generate_mips(
+   const Sample* Psrc, int src_x, int src_y, size_t src_pitch,
+   int num_channels,
+   const Level* Plevels, int num_levels,
+   Resampler_Base::Boundary_Op boundary_op,
+   Real sample_low, Real sample_high,
+   const char* Pfilter_name,
+   Resampler_Thread_Pool* Ppool,
+   Real filter_scale)
+{
+   resampler_assert(src_pitch >= (size_t)src_x * num_channels);
+   resampler_assert(num_levels <= get_num_levels(src_x, src_y));
+
+   if (num_levels <= 0)
+      return Resampler_Base::STATUS_OKAY;
+
+   Resampler_Mips_Job<Real, Storage> job;
+   job.Psrc = Psrc;
+   job.src_pitch = src_pitch;
+   job.src_x = src_x;
+   job.src_y = src_y;
+   job.num_channels = num_channels;
+   job.Plevels = Plevels;
+   job.num_levels = num_levels;
+   job.failed = false;
+
+   job.Presamplers = (Level_Resampler**)calloc(num_levels, sizeof(Level_Resampler*));
+   job.Pnum_lines = (int*)calloc(num_levels, sizeof(int));
+   job.Pstatus = (Resampler_Base::Status*)malloc(num_levels * sizeof(Resampler_Base::Status));
+
+   Resampler_Base::Status status = Resampler_Base::STATUS_OKAY;
+
+   if ((!job.Presamplers) || (!job.Pnum_lines) || (!job.Pstatus))
+      status = Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+   // All the levels are set up front, the streaming needs every one of them at once.
+   for (int level = 0; (level < num_levels) && (status == Resampler_Base::STATUS_OKAY); level++)
+   {
+      int level_src_x, level_src_y, level_x, level_y;
+      get_level_size(src_x, src_y, level, level_src_x, level_src_y);
+      get_level_size(src_x, src_y, level + 1, level_x, level_y);
+
+      resampler_assert(Plevels[level].pitch >= (size_t)level_x * num_channels);
+
+      job.Presamplers[level] = new Level_Resampler(level_src_x, level_src_y, level_x, level_y, num_channels,
+         boundary_op, sample_low, sample_high, Pfilter_name, NULL, NULL, filter_scale, filter_scale);
+
+      status = job.Presamplers[level]->status();
+   }
+
+   if (status == Resampler_Base::STATUS_OKAY)
+   {
+      if ((Ppool) && (Ppool->get_num_threads() > 1) && (num_levels > 1))
+      {
+         Ppool->run(num_levels, generate_level<Real, Storage>, &job);
+
+         for (int level = 0; level < num_levels; level++)
+            if (job.Pstatus[level] != Resampler_Base::STATUS_OKAY)
+               status = job.Pstatus[level];
+      }
+      else
+      {
+         for (int y = 0; y < src_y; y++)
+         {
+            if (!cascade_line(job, 0, Psrc + y * src_pitch))
+            {
+               for (int level = 0; level < num_levels; level++)
+                  if (job.Presamplers[level]->status() != Resampler_Base::STATUS_OKAY)
+                     status = job.Presamplers[level]->status();
+
+               if (status == Resampler_Base::STATUS_OKAY)
+                  status = Resampler_Base::STATUS_OUT_OF_MEMORY;
+               break;
+            }
+         }
+      }
+   }
+
+   if (job.Presamplers)
+   {
+      for (int level = 0; level < num_levels; level++)
+         delete job.Presamplers[level];
+      free(job.Presamplers);
+   }
+
+   free(job.Pnum_lines);
+   free(job.Pstatus);
+
+   return status;
+}
+
+template class Resampler_Mips<float>;
+template class Resampler_Mips<double>;
+template class Resampler_Mips<float, Resample_Half>;
@@ -0,0 +1,49 @@
+// resampler_mips.h, Mipmap chain generation on top of the streaming Resampler.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_MIPS_H__
+#define __RESAMPLER_MIPS_H__
+
+#include "resampler.h"
+
+// Generates mip chains in a single pass over the source image: every scanline a level's Resampler produces is written
+// to the level's image and immediately passed on to the next level's Resampler, which reads it in place. No level is
+// read back from memory after it has been completed, and only the scanlines still needed by the next level's filter
+// are buffered. Each level is a 2:1 reduction of the previous one (rounded down, to at least 1 pixel).
+// The contributor lists come from the contributor list cache, so chains of same sized images (and the X and Y axes of
+// square levels) share them. Explicitly instantiated in resampler_mips.cpp for the same types as Resampler_T.
+template<typename Real, typename Storage = Real>
+class Resampler_Mips
+{
+public:
+   typedef Resampler_T<Real, Storage> Level_Resampler;
+   typedef Real Sample;
+
+   // Destination of a mip level.
+   struct Level
+   {
+      Sample* Pdst;
+      size_t pitch; // Number of samples between the starts of consecutive scanlines
+   };
+
+   // Number of mip levels below a src_x * src_y image, down to 1x1.
+   static int get_num_levels(int src_x, int src_y);
+
+   // Dimensions of mip level level (0 is the image itself).
+   static void get_level_size(int src_x, int src_y, int level, int& level_x, int& level_y);
+
+   // Plevels[i] receives mip level i + 1, num_levels must be <= get_num_levels().
+   // Ppool - Optional thread pool: each level is then filtered by its own task, working on the scanlines of the
+   //    previous level as they're completed. NULL filters all the levels on the calling thread.
+   // The other parameters are the same as Resampler_T::resample_image()'s.
+   static Resampler_Base::Status generate_mips(
+      const Sample* Psrc, int src_x, int src_y, size_t src_pitch,
+      int num_channels,
+      const Level* Plevels, int num_levels,
+      Resampler_Base::Boundary_Op boundary_op = Resampler_Base::BOUNDARY_CLAMP,
+      Real sample_low = Level_Resampler::RR(0.0), Real sample_high = Level_Resampler::RR(0.0),
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Resampler_Thread_Pool* Ppool = NULL,
+      Real filter_scale = Level_Resampler::RR(1.0));
+};
+
+#endif // __RESAMPLER_MIPS_H__
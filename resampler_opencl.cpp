@@ -0,0 +1,491 @@
+// resampler_opencl.cpp, OpenCL backend running both separable filter passes on a GPU.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cstring>
+#include <cassert>
+#include "resampler_opencl.h"
+
+#if RESAMPLER_OPENCL
+   #define CL_TARGET_OPENCL_VERSION 120
+   #ifdef __APPLE__
+      #include <OpenCL/opencl.h>
+   #else
+      #include <CL/cl.h>
+   #endif
+#endif
+
+#define resampler_assert assert
+
+#if RESAMPLER_OPENCL
+
+// One work item per destination sample (global id 0: sample of the scanline, 1: scanline, 2: image of the group).
+// The contributors of destination sample i of an axis are Ppixel[Pstart[i]] to Ppixel[Pstart[i + 1] - 1], the source
+// pixels for X and the source scanlines for Y, in the order of the Contrib_List.
+static const char g_kernel_source[] =
+   "__kernel void resample_x(__global const float* Psrc, int src_row_size, __global float* Pdst,\n"
+   "   __global const int* Pstart, __global const int* Ppixel, __global const float* Pweight, int num_channels)\n"
+   "{\n"
+   "   const int i = get_global_id(0);\n"
+   "   const size_t row = get_global_id(2) * get_global_size(1) + get_global_id(1);\n"
+   "   const int x = i / num_channels;\n"
+   "   __global const float* Ps = Psrc + row * src_row_size + (i - x * num_channels);\n"
+   "   float sum = 0.0f;\n"
+   "   for (int j = Pstart[x]; j < Pstart[x + 1]; j++)\n"
+   "      sum += Pweight[j] * Ps[Ppixel[j] * num_channels];\n"
+   "   Pdst[row * get_global_size(0) + i] = sum;\n"
+   "}\n"
+   "\n"
+   "__kernel void resample_y(__global const float* Psrc, int src_y, __global float* Pdst,\n"
+   "   __global const int* Pstart, __global const int* Ppixel, __global const float* Pweight, int clamp, float lo, float hi)\n"
+   "{\n"
+   "   const int i = get_global_id(0), y = get_global_id(1);\n"
+   "   const size_t row_size = get_global_size(0);\n"
+   "   __global const float* Ps = Psrc + get_global_id(2) * src_y * row_size + i;\n"
+   "   float sum = 0.0f;\n"
+   "   for (int j = Pstart[y]; j < Pstart[y + 1]; j++)\n"
+   "      sum += Pweight[j] * Ps[Ppixel[j] * row_size];\n"
+   "   if (clamp)\n"
+   "      sum = fmin(fmax(sum, lo), hi);\n"
+   "   Pdst[(get_global_id(2) * get_global_size(1) + y) * row_size + i] = sum;\n"
+   "}\n";
+
+// The contributor lists of one axis on the device.
+struct Device_Clist
+{
+   // Cached list the buffers were made from (holding a reference to it), NULL if the list wasn't cached.
+   Resampler::Contrib_List* Pclist;
+
+   cl_mem start;
+   cl_mem pixel;
+   cl_mem weight;
+};
+
+struct Resampler_OpenCL::Device
+{
+   cl_context context;
+   cl_command_queue queue;
+   cl_program program;
+   cl_kernel kernel_x;
+   cl_kernel kernel_y;
+
+   cl_ulong max_alloc_size;
+   cl_ulong global_mem_size;
+
+   Device_Clist clist[2]; // X, Y
+
+   // Source, X filtered and destination images of a group, kept while they're large enough.
+   cl_mem src, tmp, dst;
+   size_t src_size, tmp_size, dst_size;
+};
+
+static void release_mem(cl_mem& mem)
+{
+   if (mem)
+   {
+      clReleaseMemObject(mem);
+      mem = NULL;
+   }
+}
+
+// Finds device device_index, counting the GPUs of all platforms first, then their other devices.
+static bool find_device(int device_index, cl_device_id& device)
+{
+   cl_platform_id platforms[16];
+   cl_uint num_platforms = 0;
+   if ((clGetPlatformIDs(16, platforms, &num_platforms) != CL_SUCCESS) || (!num_platforms))
+      return false;
+
+   if (num_platforms > 16)
+      num_platforms = 16;
+
+   const cl_device_type types[2] = { CL_DEVICE_TYPE_GPU, CL_DEVICE_TYPE_CPU | CL_DEVICE_TYPE_ACCELERATOR };
+
+   for (int t = 0; t < 2; t++)
+   {
+      for (cl_uint p = 0; p < num_platforms; p++)
+      {
+         cl_device_id devices[16];
+         cl_uint num_devices = 0;
+         if ((clGetDeviceIDs(platforms[p], types[t], 16, devices, &num_devices) != CL_SUCCESS) || (!num_devices))
+            continue;
+
+         if (num_devices > 16)
+            num_devices = 16;
+
+         if (device_index < (int)num_devices)
+         {
+            device = devices[device_index];
+            return true;
+         }
+
+         device_index -= num_devices;
+      }
+   }
+
+   return false;
+}
+
+Resampler_OpenCL::Resampler_OpenCL(int device_index) :
+   m_Pdevice(NULL),
+   m_status(Resampler::STATUS_NO_DEVICE)
+{
+   m_device_name[0] = '\0';
+
+   cl_device_id device;
+   if ((device_index < 0) || (!find_device(device_index, device)))
+      return;
+
+   if ((m_Pdevice = (Device*)calloc(1, sizeof(Device))) == NULL)
+   {
+      m_status = Resampler::STATUS_OUT_OF_MEMORY;
+      return;
+   }
+
+   m_status = Resampler::STATUS_DEVICE_ERROR;
+
+   if ((clGetDeviceInfo(device, CL_DEVICE_NAME, sizeof(m_device_name), m_device_name, NULL) != CL_SUCCESS) ||
+       (clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &m_Pdevice->max_alloc_size, NULL) != CL_SUCCESS) ||
+       (clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &m_Pdevice->global_mem_size, NULL) != CL_SUCCESS))
+   {
+      m_device_name[0] = '\0';
+      return;
+   }
+
+   m_device_name[sizeof(m_device_name) - 1] = '\0';
+
+   cl_int err;
+   if ((m_Pdevice->context = clCreateContext(NULL, 1, &device, NULL, NULL, &err)) == NULL)
+      return;
+
+   if ((m_Pdevice->queue = clCreateCommandQueue(m_Pdevice->context, device, 0, &err)) == NULL)
+      return;
+
+   const char* Psource = g_kernel_source;
+   if ((m_Pdevice->program = clCreateProgramWithSource(m_Pdevice->context, 1, &Psource, NULL, &err)) == NULL)
+      return;
+
+   if (clBuildProgram(m_Pdevice->program, 1, &device, "", NULL, NULL) != CL_SUCCESS)
+      return;
+
+   if (((m_Pdevice->kernel_x = clCreateKernel(m_Pdevice->program, "resample_x", &err)) == NULL) ||
+       ((m_Pdevice->kernel_y = clCreateKernel(m_Pdevice->program, "resample_y", &err)) == NULL))
+      return;
+
+   m_status = Resampler::STATUS_OKAY;
+}
+
+Resampler_OpenCL::~Resampler_OpenCL()
+{
+   if (!m_Pdevice)
+      return;
+
+   free_clist(0);
+   free_clist(1);
+
+   release_mem(m_Pdevice->src);
+   release_mem(m_Pdevice->tmp);
+   release_mem(m_Pdevice->dst);
+
+   if (m_Pdevice->kernel_x)
+      clReleaseKernel(m_Pdevice->kernel_x);
+   if (m_Pdevice->kernel_y)
+      clReleaseKernel(m_Pdevice->kernel_y);
+   if (m_Pdevice->program)
+      clReleaseProgram(m_Pdevice->program);
+   if (m_Pdevice->queue)
+      clReleaseCommandQueue(m_Pdevice->queue);
+   if (m_Pdevice->context)
+      clReleaseContext(m_Pdevice->context);
+
+   free(m_Pdevice);
+}
+
+void Resampler_OpenCL::free_clist(int axis)
+{
+   Device_Clist& c = m_Pdevice->clist[axis];
+
+   release_mem(c.start);
+   release_mem(c.pixel);
+   release_mem(c.weight);
+
+   if (c.Pclist)
+   {
+      Resampler::release_clist(c.Pclist);
+      c.Pclist = NULL;
+   }
+}
+
+// Makes Pclist (dst_n destination samples, from Resampler::acquire_clist()) the device contributor list of axis,
+// uploading it unless the device already has it. Takes over the list.
+Resampler_Base::Status Resampler_OpenCL::set_clist(int axis, Resampler::Contrib_List* Pclist, bool cached, int dst_n)
+{
+   Device_Clist& c = m_Pdevice->clist[axis];
+
+   // Cached lists never change.
+   if ((cached) && (Pclist == c.Pclist))
+   {
+      Resampler::release_clist(Pclist);
+      return Resampler::STATUS_OKAY;
+   }
+
+   free_clist(axis);
+
+   int i, j, total = 0;
+   for (i = 0; i < dst_n; i++)
+      total += Pclist[i].n;
+
+   int* Pstart = (int*)malloc((dst_n + 1) * sizeof(int));
+   int* Ppixel = (int*)malloc((total ? total : 1) * sizeof(int));
+   float* Pweight = (float*)malloc((total ? total : 1) * sizeof(float));
+
+   Resampler_Base::Status status = Resampler::STATUS_OKAY;
+
+   if ((!Pstart) || (!Ppixel) || (!Pweight))
+      status = Resampler::STATUS_OUT_OF_MEMORY;
+   else
+   {
+      int k = 0;
+      for (i = 0; i < dst_n; i++)
+      {
+         Pstart[i] = k;
+         for (j = 0; j < Pclist[i].n; j++, k++)
+         {
+            Ppixel[k] = Pclist[i].p[j].pixel;
+            Pweight[k] = Pclist[i].p[j].weight;
+         }
+      }
+      Pstart[dst_n] = k;
+
+      cl_int err;
+      const cl_mem_flags flags = CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR;
+      if (((c.start = clCreateBuffer(m_Pdevice->context, flags, (dst_n + 1) * sizeof(int), Pstart, &err)) == NULL) ||
+          ((c.pixel = clCreateBuffer(m_Pdevice->context, flags, (total ? total : 1) * sizeof(int), Ppixel, &err)) == NULL) ||
+          ((c.weight = clCreateBuffer(m_Pdevice->context, flags, (total ? total : 1) * sizeof(float), Pweight, &err)) == NULL))
+         status = Resampler::STATUS_DEVICE_ERROR;
+   }
+
+   free(Pstart);
+   free(Ppixel);
+   free(Pweight);
+
+   if ((cached) && (status == Resampler::STATUS_OKAY))
+      c.Pclist = Pclist;
+   else if (cached)
+      Resampler::release_clist(Pclist);
+   else
+   {
+      free(Pclist->p);
+      free(Pclist);
+   }
+
+   if (status != Resampler::STATUS_OKAY)
+      free_clist(axis);
+
+   return status;
+}
+
+// Makes the group image buffers at least the given sizes (in bytes).
+bool Resampler_OpenCL::reserve_image_buffers(size_t src_size, size_t tmp_size, size_t dst_size)
+{
+   Device& d = *m_Pdevice;
+   cl_int err;
+
+   if (src_size > d.src_size)
+   {
+      release_mem(d.src);
+      d.src_size = 0;
+      if ((d.src = clCreateBuffer(d.context, CL_MEM_READ_ONLY, src_size, NULL, &err)) == NULL)
+         return false;
+      d.src_size = src_size;
+   }
+
+   if (tmp_size > d.tmp_size)
+   {
+      release_mem(d.tmp);
+      d.tmp_size = 0;
+      if ((d.tmp = clCreateBuffer(d.context, CL_MEM_READ_WRITE, tmp_size, NULL, &err)) == NULL)
+         return false;
+      d.tmp_size = tmp_size;
+   }
+
+   if (dst_size > d.dst_size)
+   {
+      release_mem(d.dst);
+      d.dst_size = 0;
+      if ((d.dst = clCreateBuffer(d.context, CL_MEM_WRITE_ONLY, dst_size, NULL, &err)) == NULL)
+         return false;
+      d.dst_size = dst_size;
+   }
+
+   return true;
+}
+
+Resampler_Base::Status Resampler_OpenCL::resample_batch(
+   const Image* Pimages, int num_images,
+   int src_x, int src_y,
+   int dst_x, int dst_y,
+   int num_channels,
+   Resampler_Base::Boundary_Op boundary_op,
+   Sample sample_low, Sample sample_high,
+   const char* Pfilter_name,
+   Sample filter_x_scale,
+   Sample filter_y_scale,
+   Sample src_x_ofs,
+   Sample src_y_ofs)
+{
+   resampler_assert((src_x > 0) && (src_y > 0) && (dst_x > 0) && (dst_y > 0));
+   resampler_assert((num_channels > 0) && (num_channels <= RESAMPLER_MAX_CHANNELS));
+
+   if (m_status != Resampler::STATUS_OKAY)
+      return m_status;
+
+   if (num_images <= 0)
+      return Resampler::STATUS_OKAY;
+
+   if (Pfilter_name == NULL)
+      Pfilter_name = RESAMPLER_DEFAULT_FILTER;
+
+   int filter_index;
+   for (filter_index = 0; filter_index < Resampler::get_filter_num(); filter_index++)
+      if (strcmp(Pfilter_name, Resampler::get_filter_name(filter_index)) == 0)
+         break;
+
+   if (filter_index == Resampler::get_filter_num())
+      return Resampler::STATUS_BAD_FILTER_NAME;
+
+   // The same contributor lists as Resampler's, uploaded unless the device already has them.
+   for (int axis = 0; axis < 2; axis++)
+   {
+      bool cached;
+      Resampler::Contrib_List* Pclist = axis ?
+         Resampler::acquire_clist(src_y, dst_y, 0, dst_y, boundary_op, filter_index, filter_y_scale, src_y_ofs, cached) :
+         Resampler::acquire_clist(src_x, dst_x, 0, dst_x, boundary_op, filter_index, filter_x_scale, src_x_ofs, cached);
+      if (!Pclist)
+         return Resampler::STATUS_OUT_OF_MEMORY;
+
+      const Resampler::Status status = set_clist(axis, Pclist, cached, axis ? dst_y : dst_x);
+      if (status != Resampler::STATUS_OKAY)
+         return status;
+   }
+
+   Device& d = *m_Pdevice;
+
+   const size_t src_row_size = (size_t)src_x * num_channels * sizeof(Sample);
+   const size_t dst_row_size = (size_t)dst_x * num_channels * sizeof(Sample);
+   const size_t src_size = src_row_size * src_y;
+   const size_t tmp_size = dst_row_size * src_y;
+   const size_t dst_size = dst_row_size * dst_y;
+
+   // As many images per group as the largest allocation allows, using at most half of the device memory.
+   size_t largest_size = src_size;
+   if (tmp_size > largest_size)
+      largest_size = tmp_size;
+   if (dst_size > largest_size)
+      largest_size = dst_size;
+
+   size_t group_size = (size_t)num_images;
+   if (group_size > d.max_alloc_size / largest_size)
+      group_size = (size_t)(d.max_alloc_size / largest_size);
+   if (group_size > d.global_mem_size / 2 / (src_size + tmp_size + dst_size))
+      group_size = (size_t)(d.global_mem_size / 2 / (src_size + tmp_size + dst_size));
+   if (group_size < 1)
+      group_size = 1;
+
+   if (!reserve_image_buffers(group_size * src_size, group_size * tmp_size, group_size * dst_size))
+      return Resampler::STATUS_DEVICE_ERROR;
+
+   const cl_int src_samples = src_x * num_channels;
+   const cl_int src_rows = src_y;
+   const cl_int channels = num_channels;
+   const cl_int clamp = (sample_low < sample_high) ? 1 : 0;
+
+   bool okay = true;
+   okay = okay && (clSetKernelArg(d.kernel_x, 0, sizeof(cl_mem), &d.src) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_x, 1, sizeof(cl_int), &src_samples) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_x, 2, sizeof(cl_mem), &d.tmp) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_x, 3, sizeof(cl_mem), &d.clist[0].start) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_x, 4, sizeof(cl_mem), &d.clist[0].pixel) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_x, 5, sizeof(cl_mem), &d.clist[0].weight) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_x, 6, sizeof(cl_int), &channels) == CL_SUCCESS);
+
+   okay = okay && (clSetKernelArg(d.kernel_y, 0, sizeof(cl_mem), &d.tmp) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 1, sizeof(cl_int), &src_rows) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 2, sizeof(cl_mem), &d.dst) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 3, sizeof(cl_mem), &d.clist[1].start) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 4, sizeof(cl_mem), &d.clist[1].pixel) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 5, sizeof(cl_mem), &d.clist[1].weight) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 6, sizeof(cl_int), &clamp) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 7, sizeof(cl_float), &sample_low) == CL_SUCCESS);
+   okay = okay && (clSetKernelArg(d.kernel_y, 8, sizeof(cl_float), &sample_high) == CL_SUCCESS);
+
+   for (int first = 0; (first < num_images) && (okay); first += (int)group_size)
+   {
+      const int n = ((size_t)(num_images - first) < group_size) ? (num_images - first) : (int)group_size;
+      const size_t zero_origin[3] = { 0, 0, 0 };
+
+      // The copies only have to be complete by the clFinish() below.
+      for (int i = 0; (i < n) && (okay); i++)
+      {
+         const Image& image = Pimages[first + i];
+         resampler_assert((image.src_pitch >= (size_t)src_x * num_channels) && (image.dst_pitch >= (size_t)dst_x * num_channels));
+
+         const size_t origin[3] = { i * src_size, 0, 0 };
+         const size_t region[3] = { src_row_size, (size_t)src_y, 1 };
+         okay = clEnqueueWriteBufferRect(d.queue, d.src, CL_FALSE, origin, zero_origin, region,
+            src_row_size, 0, image.src_pitch * sizeof(Sample), 0, image.Psrc, 0, NULL, NULL) == CL_SUCCESS;
+      }
+
+      const size_t x_global_size[3] = { (size_t)dst_x * num_channels, (size_t)src_y, (size_t)n };
+      const size_t y_global_size[3] = { (size_t)dst_x * num_channels, (size_t)dst_y, (size_t)n };
+
+      okay = okay && (clEnqueueNDRangeKernel(d.queue, d.kernel_x, 3, NULL, x_global_size, NULL, 0, NULL, NULL) == CL_SUCCESS);
+      okay = okay && (clEnqueueNDRangeKernel(d.queue, d.kernel_y, 3, NULL, y_global_size, NULL, 0, NULL, NULL) == CL_SUCCESS);
+
+      for (int i = 0; (i < n) && (okay); i++)
+      {
+         const Image& image = Pimages[first + i];
+
+         const size_t origin[3] = { i * dst_size, 0, 0 };
+         const size_t region[3] = { dst_row_size, (size_t)dst_y, 1 };
+         okay = clEnqueueReadBufferRect(d.queue, d.dst, CL_FALSE, origin, zero_origin, region,
+            dst_row_size, 0, image.dst_pitch * sizeof(Sample), 0, image.Pdst, 0, NULL, NULL) == CL_SUCCESS;
+      }
+
+      // Always wait, the queued copies still refer to the caller's images.
+      okay = (clFinish(d.queue) == CL_SUCCESS) && (okay);
+   }
+
+   return okay ? Resampler::STATUS_OKAY : Resampler::STATUS_DEVICE_ERROR;
+}
+
+#else // !RESAMPLER_OPENCL
+
+Resampler_OpenCL::Resampler_OpenCL(int device_index) :
+   m_Pdevice(NULL),
+   m_status(Resampler::STATUS_NO_DEVICE)
+{
+   (void)device_index;
+   m_device_name[0] = '\0';
+}
+
+Resampler_OpenCL::~Resampler_OpenCL()
+{
+}
+
+Resampler_Base::Status Resampler_OpenCL::resample_batch(
+   const Image*, int,
+   int, int,
+   int, int,
+   int,
+   Resampler_Base::Boundary_Op,
+   Sample, Sample,
+   const char*,
+   Sample,
+   Sample,
+   Sample,
+   Sample)
+{
+   return m_status;
+}
+
+#endif // RESAMPLER_OPENCL
@@ -0,0 +1,73 @@
+// resampler_opencl.h, OpenCL backend running both separable filter passes on a GPU.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_OPENCL_H__
+#define __RESAMPLER_OPENCL_H__
+
+#include "resampler.h"
+
+// Resamples batches of same sized float images on an OpenCL device. The contributor lists are the ones Resampler uses
+// (from its contributor list cache, so the filters and boundary ops are the same as the CPU path's); they're uploaded
+// to the device once and kept there for as long as the following batches use the same lists. Each image is filtered
+// in X first, then in Y, by one work item per destination sample, with the same contributors as Resampler in X-Y
+// order: the output matches Resampler's up to float rounding (the taps may be summed in a different order).
+// Only built with RESAMPLER_OPENCL set to 1, the status is STATUS_NO_DEVICE otherwise.
+// An instance must only be used by one thread at a time.
+class Resampler_OpenCL
+{
+public:
+   typedef float Sample;
+
+   // An image of a batch.
+   struct Image
+   {
+      const Sample* Psrc;
+      size_t src_pitch; // Number of samples between the starts of consecutive source scanlines
+      Sample* Pdst;
+      size_t dst_pitch;
+   };
+
+   // device_index - Index of the device to use among the OpenCL devices of all platforms, GPUs first.
+   explicit Resampler_OpenCL(int device_index = 0);
+   ~Resampler_OpenCL();
+
+   // STATUS_NO_DEVICE if there's no such device, STATUS_DEVICE_ERROR if it couldn't be set up.
+   Resampler_Base::Status status() const { return m_status; }
+
+   // Empty if there's no device.
+   const char* get_device_name() const { return m_device_name; }
+
+   // Resamples num_images src_x * src_y images of num_channels interleaved samples to dst_x * dst_y. The images are
+   // uploaded and filtered in groups sized to the device's memory. The other parameters are the same as Resampler's
+   // multichannel constructor. Returns STATUS_DEVICE_ERROR if an OpenCL call fails, the destination images are then
+   // undefined.
+   Resampler_Base::Status resample_batch(
+      const Image* Pimages, int num_images,
+      int src_x, int src_y,
+      int dst_x, int dst_y,
+      int num_channels,
+      Resampler_Base::Boundary_Op boundary_op = Resampler_Base::BOUNDARY_CLAMP,
+      Sample sample_low = 0.0f, Sample sample_high = 0.0f,
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Sample filter_x_scale = 1.0f,
+      Sample filter_y_scale = 1.0f,
+      Sample src_x_ofs = 0.0f,
+      Sample src_y_ofs = 0.0f);
+
+private:
+   Resampler_OpenCL(const Resampler_OpenCL& o);
+   Resampler_OpenCL& operator= (const Resampler_OpenCL& o);
+
+   // OpenCL objects, defined in resampler_opencl.cpp so this header doesn't need the OpenCL headers.
+   struct Device;
+   Device* m_Pdevice;
+
+   Resampler_Base::Status m_status;
+
+   char m_device_name[256];
+
+   Resampler_Base::Status set_clist(int axis, Resampler::Contrib_List* Pclist, bool cached, int dst_n);
+   void free_clist(int axis);
+   bool reserve_image_buffers(size_t src_size, size_t tmp_size, size_t dst_size);
+};
+
+#endif // __RESAMPLER_OPENCL_H__
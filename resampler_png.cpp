@@ -0,0 +1,560 @@
+// resampler_png.cpp, Streaming PNG sink for resampler_stream.h.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include "resampler_stream.h"
+
+#define resampler_assert assert
+
+// Deflate constants, see RFC 1951.
+enum
+{
+   DEFLATE_WINDOW_SIZE = 32768,
+   DEFLATE_MIN_MATCH = 3,
+   DEFLATE_MAX_MATCH = 258,
+   DEFLATE_MAX_STORED = 65535,
+
+   DEFLATE_HASH_BITS = 15,
+   DEFLATE_HASH_SIZE = 1 << DEFLATE_HASH_BITS,
+
+   // Compressed data is written as an IDAT chunk whenever this much of it has accumulated.
+   PNG_IDAT_SIZE = 65536
+};
+
+static const unsigned short g_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const unsigned char g_length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const unsigned short g_dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const unsigned char g_dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+// State of a PNG sink.
+struct Png_Sink
+{
+   FILE* Pfile;
+   int width, height;
+   int num_channels;
+   int cur_y;
+   int level;
+   bool failed;
+
+   // The previous (unfiltered) scanline, and the filtered scanline with its filter type byte. Adaptive filtering
+   // keeps a second filtered scanline.
+   unsigned char* Pprev_row;
+   unsigned char* Pfiltered_row[2];
+
+   unsigned int crc_table[256];
+   unsigned int adler_a, adler_b;
+
+   // Deflate: the window holds up to 2 * DEFLATE_WINDOW_SIZE bytes of filtered data. Bytes before window_pos are coded,
+   // the ones from window_pos to window_end still wait for more data (matches need DEFLATE_MIN_MATCH bytes).
+   // hash_head[] and hash_prev[] hold window positions, -1 when empty.
+   unsigned char* Pwindow;
+   int window_pos, window_end;
+   int* Phash_head;
+   int* Phash_prev;
+   int max_chain;
+
+   // Fixed Huffman codes, bit reversed to be written LSB first.
+   unsigned short lit_codes[288];
+   unsigned char lit_lengths[288];
+   unsigned char dist_codes[30];
+
+   unsigned int bit_buf;
+   int bit_count;
+
+   // Compressed data not yet written out. Chunks are written just before bytes are added past PNG_IDAT_SIZE, so
+   // the buffer has room for the few bytes a single code can add.
+   unsigned char* Pout;
+   int out_size;
+};
+
+static unsigned int reverse_bits(unsigned int code, int len)
+{
+   unsigned int r = 0;
+   for (int i = 0; i < len; i++, code >>= 1)
+      r = (r << 1) | (code & 1);
+   return r;
+}
+
+static void init_png_tables(Png_Sink* Pp)
+{
+   for (unsigned int n = 0; n < 256; n++)
+   {
+      unsigned int c = n;
+      for (int k = 0; k < 8; k++)
+         c = (c & 1) ? (0xEDB88320U ^ (c >> 1)) : (c >> 1);
+      Pp->crc_table[n] = c;
+   }
+
+   for (int i = 0; i < 288; i++)
+   {
+      unsigned int code;
+      int len;
+      if (i < 144)      { code = 0x30 + i;          len = 8; }
+      else if (i < 256) { code = 0x190 + (i - 144); len = 9; }
+      else if (i < 280) { code = i - 256;           len = 7; }
+      else              { code = 0xC0 + (i - 280);  len = 8; }
+
+      Pp->lit_codes[i] = (unsigned short)reverse_bits(code, len);
+      Pp->lit_lengths[i] = (unsigned char)len;
+   }
+
+   for (int i = 0; i < 30; i++)
+      Pp->dist_codes[i] = (unsigned char)reverse_bits(i, 5);
+}
+
+static unsigned int update_crc(const Png_Sink* Pp, unsigned int crc, const unsigned char* Pbuf, size_t len)
+{
+   for (size_t i = 0; i < len; i++)
+      crc = Pp->crc_table[(crc ^ Pbuf[i]) & 0xFF] ^ (crc >> 8);
+   return crc;
+}
+
+static void put_be32(unsigned char* Pdst, unsigned int v)
+{
+   Pdst[0] = (unsigned char)(v >> 24);
+   Pdst[1] = (unsigned char)(v >> 16);
+   Pdst[2] = (unsigned char)(v >> 8);
+   Pdst[3] = (unsigned char)v;
+}
+
+static bool write_png_chunk(Png_Sink* Pp, const char* Ptype, const unsigned char* Pdata, size_t len)
+{
+   unsigned char h[8];
+   put_be32(h, (unsigned int)len);
+   memcpy(h + 4, Ptype, 4);
+
+   unsigned char crc[4];
+   put_be32(crc, ~update_crc(Pp, update_crc(Pp, 0xFFFFFFFFU, h + 4, 4), Pdata, len));
+
+   return (fwrite(h, 1, 8, Pp->Pfile) == 8) && (!len || fwrite(Pdata, 1, len, Pp->Pfile) == len) && (fwrite(crc, 1, 4, Pp->Pfile) == 4);
+}
+
+static void flush_idat(Png_Sink* Pp)
+{
+   if ((Pp->out_size) && (!Pp->failed))
+      Pp->failed = !write_png_chunk(Pp, "IDAT", Pp->Pout, Pp->out_size);
+   Pp->out_size = 0;
+}
+
+static inline void put_byte(Png_Sink* Pp, unsigned char b)
+{
+   if (Pp->out_size == PNG_IDAT_SIZE)
+      flush_idat(Pp);
+   Pp->Pout[Pp->out_size++] = b;
+}
+
+static inline void put_bits(Png_Sink* Pp, unsigned int bits, int len)
+{
+   Pp->bit_buf |= bits << Pp->bit_count;
+   Pp->bit_count += len;
+   while (Pp->bit_count >= 8)
+   {
+      put_byte(Pp, (unsigned char)Pp->bit_buf);
+      Pp->bit_buf >>= 8;
+      Pp->bit_count -= 8;
+   }
+}
+
+static void align_bits(Png_Sink* Pp)
+{
+   if (Pp->bit_count)
+      put_bits(Pp, 0, 8 - Pp->bit_count);
+}
+
+static inline void put_literal(Png_Sink* Pp, int c)
+{
+   put_bits(Pp, Pp->lit_codes[c], Pp->lit_lengths[c]);
+}
+
+static void put_match(Png_Sink* Pp, int len, int dist)
+{
+   int l = 28;
+   while (g_length_base[l] > len)
+      l--;
+   put_literal(Pp, 257 + l);
+   put_bits(Pp, len - g_length_base[l], g_length_extra[l]);
+
+   int d = 29;
+   while (g_dist_base[d] > dist)
+      d--;
+   put_bits(Pp, Pp->dist_codes[d], 5);
+   put_bits(Pp, dist - g_dist_base[d], g_dist_extra[d]);
+}
+
+static inline unsigned int hash3(const unsigned char* p)
+{
+   return ((p[0] << 10) ^ (p[1] << 5) ^ p[2]) & (DEFLATE_HASH_SIZE - 1);
+}
+
+static inline void insert_hash(Png_Sink* Pp, int pos)
+{
+   const unsigned int h = hash3(Pp->Pwindow + pos);
+   Pp->Phash_prev[pos & (DEFLATE_WINDOW_SIZE - 1)] = Pp->Phash_head[h];
+   Pp->Phash_head[h] = pos;
+}
+
+// Codes the window's pending bytes, all of them when finishing.
+static void deflate_window(Png_Sink* Pp, bool finish)
+{
+   const unsigned char* Pw = Pp->Pwindow;
+   int pos = Pp->window_pos;
+   const int end = Pp->window_end;
+
+   while (end - pos >= DEFLATE_MIN_MATCH)
+   {
+      const int max_len = ((end - pos) < DEFLATE_MAX_MATCH) ? (end - pos) : DEFLATE_MAX_MATCH;
+      int best_len = 0, best_dist = 0;
+
+      int cand = Pp->Phash_head[hash3(Pw + pos)];
+      for (int chain = Pp->max_chain; (cand >= 0) && (pos - cand <= DEFLATE_WINDOW_SIZE) && (chain > 0); chain--)
+      {
+         // Check the byte which would make the match longer than the best one first.
+         if (Pw[cand + best_len] == Pw[pos + best_len])
+         {
+            int len = 0;
+            while ((len < max_len) && (Pw[cand + len] == Pw[pos + len]))
+               len++;
+
+            if (len > best_len)
+            {
+               best_len = len;
+               best_dist = pos - cand;
+               if (len == max_len)
+                  break;
+            }
+         }
+
+         cand = Pp->Phash_prev[cand & (DEFLATE_WINDOW_SIZE - 1)];
+      }
+
+      if (best_len >= DEFLATE_MIN_MATCH)
+      {
+         put_match(Pp, best_len, best_dist);
+
+         // The fastest level only indexes the start of each match.
+         insert_hash(Pp, pos);
+         const int match_end = pos + best_len;
+         for (pos++; pos < match_end; pos++)
+            if ((Pp->max_chain > 1) && (end - pos >= DEFLATE_MIN_MATCH))
+               insert_hash(Pp, pos);
+      }
+      else
+      {
+         put_literal(Pp, Pw[pos]);
+         insert_hash(Pp, pos);
+         pos++;
+      }
+   }
+
+   if (finish)
+   {
+      for ( ; pos < end; pos++)
+         put_literal(Pp, Pw[pos]);
+   }
+
+   Pp->window_pos = pos;
+}
+
+// Drops the older half of the window.
+static void slide_window(Png_Sink* Pp)
+{
+   memmove(Pp->Pwindow, Pp->Pwindow + DEFLATE_WINDOW_SIZE, Pp->window_end - DEFLATE_WINDOW_SIZE);
+   Pp->window_pos -= DEFLATE_WINDOW_SIZE;
+   Pp->window_end -= DEFLATE_WINDOW_SIZE;
+
+   for (int i = 0; i < DEFLATE_HASH_SIZE; i++)
+      Pp->Phash_head[i] = (Pp->Phash_head[i] >= DEFLATE_WINDOW_SIZE) ? (Pp->Phash_head[i] - DEFLATE_WINDOW_SIZE) : -1;
+   for (int i = 0; i < DEFLATE_WINDOW_SIZE; i++)
+      Pp->Phash_prev[i] = (Pp->Phash_prev[i] >= DEFLATE_WINDOW_SIZE) ? (Pp->Phash_prev[i] - DEFLATE_WINDOW_SIZE) : -1;
+}
+
+static void update_adler(Png_Sink* Pp, const unsigned char* Psrc, size_t len)
+{
+   unsigned int a = Pp->adler_a, b = Pp->adler_b;
+   while (len)
+   {
+      // 5552 bytes can't overflow the sums before they're reduced.
+      size_t n = (len < 5552) ? len : 5552;
+      len -= n;
+      while (n--)
+      {
+         a += *Psrc++;
+         b += a;
+      }
+      a %= 65521;
+      b %= 65521;
+   }
+   Pp->adler_a = a;
+   Pp->adler_b = b;
+}
+
+// Adds filtered scanline bytes to the zlib stream.
+static void deflate_data(Png_Sink* Pp, const unsigned char* Psrc, size_t len)
+{
+   update_adler(Pp, Psrc, len);
+
+   if (!Pp->level)
+   {
+      // Non-final stored blocks; finish_deflate() ends the stream with an empty final block.
+      while (len)
+      {
+         const size_t n = (len < (size_t)DEFLATE_MAX_STORED) ? len : (size_t)DEFLATE_MAX_STORED;
+         put_bits(Pp, 0, 3);
+         align_bits(Pp);
+         put_bits(Pp, (unsigned int)n, 16);
+         put_bits(Pp, (unsigned int)n ^ 0xFFFF, 16);
+         for (size_t i = 0; i < n; i++)
+            put_byte(Pp, Psrc[i]);
+         Psrc += n;
+         len -= n;
+      }
+      return;
+   }
+
+   while (len)
+   {
+      if (Pp->window_end == 2 * DEFLATE_WINDOW_SIZE)
+         slide_window(Pp);
+
+      size_t n = 2 * DEFLATE_WINDOW_SIZE - Pp->window_end;
+      if (n > len)
+         n = len;
+
+      memcpy(Pp->Pwindow + Pp->window_end, Psrc, n);
+      Pp->window_end += (int)n;
+      Psrc += n;
+      len -= n;
+
+      deflate_window(Pp, false);
+   }
+}
+
+static void finish_deflate(Png_Sink* Pp)
+{
+   if (Pp->level)
+   {
+      deflate_window(Pp, true);
+
+      // End of the (non-final) fixed Huffman block started by open_png_sink().
+      put_literal(Pp, 256);
+   }
+
+   // Empty final fixed Huffman block.
+   put_bits(Pp, 3, 3);
+   put_literal(Pp, 256);
+   align_bits(Pp);
+
+   put_byte(Pp, (unsigned char)(Pp->adler_b >> 8));
+   put_byte(Pp, (unsigned char)Pp->adler_b);
+   put_byte(Pp, (unsigned char)(Pp->adler_a >> 8));
+   put_byte(Pp, (unsigned char)Pp->adler_a);
+}
+
+static inline int paeth(int a, int b, int c)
+{
+   const int p = a + b - c;
+   const int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+   if ((pa <= pb) && (pa <= pc))
+      return a;
+   return (pb <= pc) ? b : c;
+}
+
+// Filters Psrc with filter type 0 (none) to 4 (Paeth) into Pdst, including the filter type byte.
+static void filter_png_row(unsigned char* Pdst, const unsigned char* Psrc, const unsigned char* Pprev, int row_size, int bpp, int filter)
+{
+   Pdst[0] = (unsigned char)filter;
+   Pdst++;
+
+   for (int i = 0; i < row_size; i++)
+   {
+      const int a = (i >= bpp) ? Psrc[i - bpp] : 0;
+      const int b = Pprev[i];
+      const int c = (i >= bpp) ? Pprev[i - bpp] : 0;
+      int pred;
+      switch (filter)
+      {
+         case 0: pred = 0; break;
+         case 1: pred = a; break;
+         case 2: pred = b; break;
+         case 3: pred = (a + b) >> 1; break;
+         default: pred = paeth(a, b, c); break;
+      }
+      Pdst[i] = (unsigned char)(Psrc[i] - pred);
+   }
+}
+
+// Sum of the filtered bytes as signed values, the usual estimate of how well a filtered scanline compresses.
+static unsigned int filtered_row_cost(const unsigned char* Pfiltered, int row_size)
+{
+   unsigned int cost = 0;
+   for (int i = 1; i <= row_size; i++)
+      cost += (Pfiltered[i] < 128) ? Pfiltered[i] : (256 - Pfiltered[i]);
+   return cost;
+}
+
+static bool write_png_row(const unsigned char* Psrc, void* pUser)
+{
+   Png_Sink* Pp = static_cast<Png_Sink*>(pUser);
+   if ((Pp->cur_y >= Pp->height) || (Pp->failed))
+      return false;
+
+   const int row_size = Pp->width * Pp->num_channels;
+   const int bpp = Pp->num_channels;
+
+   const unsigned char* Pfiltered;
+   if (!Pp->level)
+   {
+      filter_png_row(Pp->Pfiltered_row[0], Psrc, Pp->Pprev_row, row_size, bpp, 0);
+      Pfiltered = Pp->Pfiltered_row[0];
+   }
+   else if (Pp->level <= 5)
+   {
+      filter_png_row(Pp->Pfiltered_row[0], Psrc, Pp->Pprev_row, row_size, bpp, 4);
+      Pfiltered = Pp->Pfiltered_row[0];
+   }
+   else
+   {
+      // Keep the cheapest filtered scanline in Pfiltered_row[best], try the others in the other buffer.
+      int best = 0;
+      unsigned int best_cost = 0;
+      for (int filter = 0; filter < 5; filter++)
+      {
+         unsigned char* Pdst = Pp->Pfiltered_row[filter ? (best ^ 1) : 0];
+         filter_png_row(Pdst, Psrc, Pp->Pprev_row, row_size, bpp, filter);
+
+         const unsigned int cost = filtered_row_cost(Pdst, row_size);
+         if ((!filter) || (cost < best_cost))
+         {
+            best = filter ? (best ^ 1) : 0;
+            best_cost = cost;
+         }
+      }
+      Pfiltered = Pp->Pfiltered_row[best];
+   }
+
+   deflate_data(Pp, Pfiltered, row_size + 1);
+   memcpy(Pp->Pprev_row, Psrc, row_size);
+
+   Pp->cur_y++;
+   return !Pp->failed;
+}
+
+static void free_png_sink(Png_Sink* Pp)
+{
+   if (Pp->Pfile)
+      fclose(Pp->Pfile);
+   free(Pp->Pprev_row);
+   free(Pp->Pfiltered_row[0]);
+   free(Pp->Pfiltered_row[1]);
+   free(Pp->Pwindow);
+   free(Pp->Phash_head);
+   free(Pp->Phash_prev);
+   free(Pp->Pout);
+   free(Pp);
+}
+
+static bool close_png_sink(void* pUser)
+{
+   Png_Sink* Pp = static_cast<Png_Sink*>(pUser);
+
+   // A sink which didn't receive every scanline leaves a truncated file behind.
+   bool okay = (Pp->cur_y == Pp->height);
+   if (okay)
+   {
+      finish_deflate(Pp);
+      flush_idat(Pp);
+      okay = (!Pp->failed) && (write_png_chunk(Pp, "IEND", NULL, 0));
+   }
+
+   okay = (!ferror(Pp->Pfile)) && okay;
+   okay = (!fclose(Pp->Pfile)) && okay;
+   Pp->Pfile = NULL;
+
+   free_png_sink(Pp);
+   return okay;
+}
+
+bool resampler_open_png_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels, int level)
+{
+   memset(&dst, 0, sizeof(dst));
+
+   if ((width < 1) || (height < 1) || (num_channels < 1) || (num_channels > 4) || (level < 0) || (level > 9) ||
+       ((size_t)width * num_channels >= 0x7FFFFFFF))
+      return false;
+
+   Png_Sink* Pp = (Png_Sink*)calloc(1, sizeof(Png_Sink));
+   if (!Pp)
+      return false;
+
+   Pp->width = width;
+   Pp->height = height;
+   Pp->num_channels = num_channels;
+   Pp->level = level;
+   Pp->max_chain = level ? (1 << (level - 1)) : 0;
+   Pp->adler_a = 1;
+
+   const size_t row_size = (size_t)width * num_channels;
+   Pp->Pprev_row = (unsigned char*)calloc(row_size, 1);
+   Pp->Pfiltered_row[0] = (unsigned char*)malloc(row_size + 1);
+   Pp->Pfiltered_row[1] = (unsigned char*)malloc(row_size + 1);
+   Pp->Pout = (unsigned char*)malloc(PNG_IDAT_SIZE);
+   bool okay = (Pp->Pprev_row) && (Pp->Pfiltered_row[0]) && (Pp->Pfiltered_row[1]) && (Pp->Pout);
+
+   if ((okay) && (level))
+   {
+      Pp->Pwindow = (unsigned char*)malloc(2 * DEFLATE_WINDOW_SIZE);
+      Pp->Phash_head = (int*)malloc(DEFLATE_HASH_SIZE * sizeof(int));
+      Pp->Phash_prev = (int*)malloc(DEFLATE_WINDOW_SIZE * sizeof(int));
+      okay = (Pp->Pwindow) && (Pp->Phash_head) && (Pp->Phash_prev);
+      if (okay)
+      {
+         memset(Pp->Phash_head, 0xFF, DEFLATE_HASH_SIZE * sizeof(int));
+         memset(Pp->Phash_prev, 0xFF, DEFLATE_WINDOW_SIZE * sizeof(int));
+      }
+   }
+
+   if ((okay) && ((Pp->Pfile = fopen(Pfilename, "wb")) == NULL))
+      okay = false;
+
+   if (okay)
+   {
+      init_png_tables(Pp);
+
+      // 8-bit gray, gray + alpha, RGB, RGBA.
+      static const unsigned char s_color_types[4] = { 0, 4, 2, 6 };
+
+      unsigned char ihdr[13];
+      put_be32(ihdr, width);
+      put_be32(ihdr + 4, height);
+      ihdr[8] = 8;
+      ihdr[9] = s_color_types[num_channels - 1];
+      ihdr[10] = 0;
+      ihdr[11] = 0;
+      ihdr[12] = 0;
+
+      static const unsigned char s_signature[8] = { 137, 'P', 'N', 'G', '\r', '\n', 26, '\n' };
+      okay = (fwrite(s_signature, 1, 8, Pp->Pfile) == 8) && (write_png_chunk(Pp, "IHDR", ihdr, sizeof(ihdr)));
+   }
+
+   if (!okay)
+   {
+      free_png_sink(Pp);
+      return false;
+   }
+
+   // zlib header (32K window, fastest compression), then the fixed Huffman block all the matches go to.
+   put_byte(Pp, 0x78);
+   put_byte(Pp, 0x01);
+   if (level)
+      put_bits(Pp, 2, 3);
+
+   dst.width = width;
+   dst.height = height;
+   dst.num_channels = num_channels;
+   dst.Pwrite_row = write_png_row;
+   dst.Pclose = close_png_sink;
+   dst.pUser = Pp;
+   return true;
+}
@@ -0,0 +1,464 @@
+// resampler_pyramid.cpp, Tiled multi-resolution pyramids (Deep Zoom, XYZ tiles) streamed out of a single pass over the source.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include <cassert>
+#include "resampler_pyramid.h"
+#include "resampler_threads.h"
+
+#define resampler_assert assert
+
+// A level of the pyramid. Its scanlines are kept in a ring of num_slots bands, rows of tiles of tile_size full width
+// scanlines each: a band's slot is only reused once its tiles have been written and the next level has filtered it.
+template<typename Real, typename Storage>
+struct Resampler_Pyramid<Real, Storage>::Level
+{
+   Job* Pjob;
+   int level;
+
+   int width, height;
+   int num_cols, num_bands;
+
+   int num_slots;
+   size_t pitch;
+   Real* Pslots;
+
+   // Resampler of each tile column, windowed to the column and reading the previous level. NULL for level 0, which is
+   // read from the source.
+   Level_Resampler** Presamplers;
+
+   // Scanlines completed once each band of the previous level has been filtered.
+   int* Pstep_rows;
+
+   // A step reads the next band of the source (level 0), or filters the next band of the previous level with every
+   // column's Resampler. The fields below are guarded by the job's mutex.
+   int next_step;
+   int step_tasks;      // tasks of the running step left, 0 if none is running
+   int step_rows_end;   // scanlines completed once the running step is done
+   int num_rows;        // scanlines completed
+
+   int next_emit;       // next band whose tiles are written, the bands before it are written
+   int emit_tasks;      // tile writing tasks of band next_emit left, 0 if none are running
+
+   int num_consumed;    // bands filtered by the next level
+
+   int get_band_end(int band) const
+   {
+      return (band + 1 < num_bands) ? (band + 1) * Pjob->tile_size : height;
+   }
+
+   Real* get_row(int y) const
+   {
+      const int tile_size = Pjob->tile_size;
+      return Pslots + ((size_t)((y / tile_size) % num_slots) * tile_size + (y % tile_size)) * pitch;
+   }
+};
+
+template<typename Real, typename Storage>
+struct Resampler_Pyramid<Real, Storage>::Job
+{
+   const Resampler_Row_Source* Psrc;
+   const Tile_Sink* Pdst;
+
+   int tile_size;
+   int num_channels;
+
+   Level* Plevels;
+   int num_levels;
+
+   Resampler_Work_Pool* Ppool;
+
+   // 8-bit source scanline, and the sample of each 8-bit value.
+   unsigned char* Psrc_row;
+   Real byte_to_sample[256];
+
+   std::mutex mutex;
+   std::atomic<bool> failed;
+   Resampler_Base::Status status; // of the first failure, guarded by mutex
+
+   void fail(Resampler_Base::Status s)
+   {
+      std::lock_guard<std::mutex> lock(mutex);
+      if (!failed)
+      {
+         status = s;
+         failed = true;
+      }
+   }
+
+   // Whether band of level has been written and filtered by the next level, so its slot can be reused.
+   bool is_band_released(int level, int band) const
+   {
+      return (band < Plevels[level].next_emit) && ((level + 1 == num_levels) || (band < Plevels[level].num_consumed));
+   }
+};
+
+// Spawns the tasks which have become ready. Must be called with the job's mutex held.
+template<typename Real, typename Storage>
+void Resampler_Pyramid<Real, Storage>::schedule(Job& job)
+{
+   if (job.failed)
+      return;
+
+   for (int level = 0; level < job.num_levels; level++)
+   {
+      Level& l = job.Plevels[level];
+
+      // Write the next row of tiles as soon as its scanlines are complete.
+      if ((!l.emit_tasks) && (l.next_emit < l.num_bands) && (l.num_rows >= l.get_band_end(l.next_emit)))
+      {
+         l.emit_tasks = l.num_cols;
+         for (int col = 0; col < l.num_cols; col++)
+            job.Ppool->spawn(write_tile, &l, col);
+      }
+
+      if (l.step_tasks)
+         continue;
+
+      int rows_end;
+      if (!level)
+      {
+         if (l.next_step >= l.num_bands)
+            continue;
+
+         rows_end = l.get_band_end(l.next_step);
+      }
+      else
+      {
+         // The previous level's band must be complete.
+         const Level& prev = job.Plevels[level - 1];
+         if ((l.next_step >= prev.num_bands) || (prev.num_rows < prev.get_band_end(l.next_step)))
+            continue;
+
+         rows_end = l.Pstep_rows[l.next_step];
+      }
+
+      // The slots the step writes to must have been released by the bands they held before (which are released in order).
+      if (rows_end > l.num_rows)
+      {
+         const int last_band = (rows_end - 1) / job.tile_size;
+         if ((last_band >= l.num_slots) && (!job.is_band_released(level, last_band - l.num_slots)))
+            continue;
+      }
+
+      l.step_rows_end = rows_end;
+      l.step_tasks = level ? l.num_cols : 1;
+      for (int col = 0; col < l.step_tasks; col++)
+         job.Ppool->spawn(run_step, &l, col);
+   }
+}
+
+// Reads the next band of the source into level 0.
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_Pyramid<Real, Storage>::read_band(Job& job, Level& l)
+{
+   const Resampler_Row_Source& src = *job.Psrc;
+   const int num_samples = l.width * job.num_channels;
+
+   for (int y = l.next_step * job.tile_size; y < l.step_rows_end; y++)
+   {
+      if (!src.Pread_row(job.Psrc_row, src.pUser))
+         return Resampler_Base::STATUS_IO_ERROR;
+
+      Real* Pdst = l.get_row(y);
+      for (int i = 0; i < num_samples; i++)
+         Pdst[i] = job.byte_to_sample[job.Psrc_row[i]];
+   }
+
+   return Resampler_Base::STATUS_OKAY;
+}
+
+// Filters the next band of the previous level with the Resampler of tile column col, into the column's part of the
+// level's scanlines.
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_Pyramid<Real, Storage>::filter_band(Job& job, Level& l, int col)
+{
+   const Level& prev = job.Plevels[l.level - 1];
+   Level_Resampler& resampler = *l.Presamplers[col];
+
+   const size_t col_ofs = (size_t)col * job.tile_size * job.num_channels;
+   const int src_end = prev.get_band_end(l.next_step);
+
+   int y = l.num_rows;
+   for (int src_y = l.next_step * job.tile_size; src_y < src_end; src_y++)
+   {
+      if (!resampler.put_line(prev.get_row(src_y)))
+         return (resampler.status() != Resampler_Base::STATUS_OKAY) ? resampler.status() : Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+      while (resampler.get_line_into(l.get_row(y) + col_ofs, job.num_channels))
+         y++;
+   }
+
+   resampler_assert(y == l.step_rows_end);
+
+   return Resampler_Base::STATUS_OKAY;
+}
+
+template<typename Real, typename Storage>
+void Resampler_Pyramid<Real, Storage>::run_step(void* pData, int col)
+{
+   Level& l = *static_cast<Level*>(pData);
+   Job& job = *l.Pjob;
+
+   if (!job.failed)
+   {
+      const Resampler_Base::Status status = l.level ? filter_band(job, l, col) : read_band(job, l);
+      if (status != Resampler_Base::STATUS_OKAY)
+         job.fail(status);
+   }
+
+   std::lock_guard<std::mutex> lock(job.mutex);
+
+   if (--l.step_tasks == 0)
+   {
+      l.num_rows = l.step_rows_end;
+      if (l.level)
+         job.Plevels[l.level - 1].num_consumed = l.next_step + 1;
+      l.next_step++;
+   }
+
+   schedule(job);
+}
+
+template<typename Real, typename Storage>
+void Resampler_Pyramid<Real, Storage>::write_tile(void* pData, int col)
+{
+   Level& l = *static_cast<Level*>(pData);
+   Job& job = *l.Pjob;
+
+   if (!job.failed)
+   {
+      Tile tile;
+      tile.level = l.level;
+      tile.col = col;
+      tile.row = l.next_emit;
+      tile.x = col * job.tile_size;
+      tile.y = l.next_emit * job.tile_size;
+      tile.width = (tile.x + job.tile_size <= l.width) ? job.tile_size : (l.width - tile.x);
+      tile.height = l.get_band_end(l.next_emit) - tile.y;
+      tile.Psamples = l.get_row(tile.y) + (size_t)tile.x * job.num_channels;
+      tile.pitch = l.pitch;
+
+      if (!job.Pdst->Pwrite_tile(tile, job.Pdst->pUser))
+         job.fail(Resampler_Base::STATUS_IO_ERROR);
+   }
+
+   std::lock_guard<std::mutex> lock(job.mutex);
+
+   if (--l.emit_tasks == 0)
+      l.next_emit++;
+
+   schedule(job);
+}
+
+template<typename Real, typename Storage>
+int Resampler_Pyramid<Real, Storage>::get_num_levels(int src_x, int src_y)
+{
+   int num_levels = 1;
+   while ((src_x > 1) || (src_y > 1))
+   {
+      src_x = (src_x + 1) >> 1;
+      src_y = (src_y + 1) >> 1;
+      num_levels++;
+   }
+   return num_levels;
+}
+
+template<typename Real, typename Storage>
+void Resampler_Pyramid<Real, Storage>::get_level_size(int src_x, int src_y, int level, int& level_x, int& level_y)
+{
+   level_x = src_x;
+   level_y = src_y;
+   for (int i = 0; i < level; i++)
+   {
+      level_x = (level_x + 1) >> 1;
+      level_y = (level_y + 1) >> 1;
+   }
+}
+
+// Sets up level, the previous levels are set up. Returns STATUS_OUT_OF_MEMORY or the failing Resampler's status.
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_Pyramid<Real, Storage>::init_level(
+   Job& job, int level,
+   Resampler_Base::Boundary_Op boundary_op,
+   Real sample_low, Real sample_high,
+   const char* Pfilter_name,
+   Real filter_scale)
+{
+   Level& l = job.Plevels[level];
+   const int tile_size = job.tile_size;
+
+   l.Pjob = &job;
+   l.level = level;
+   get_level_size(job.Psrc->width, job.Psrc->height, level, l.width, l.height);
+   l.num_cols = (l.width + tile_size - 1) / tile_size;
+   l.num_bands = (l.height + tile_size - 1) / tile_size;
+   l.pitch = (size_t)l.width * job.num_channels;
+
+   // Level 0's steps each write a band.
+   int max_step_bands = 1;
+
+   if (level)
+   {
+      const Level& prev = job.Plevels[level - 1];
+
+      l.Presamplers = (Level_Resampler**)calloc(l.num_cols, sizeof(Level_Resampler*));
+      l.Pstep_rows = (int*)malloc(prev.num_bands * sizeof(int));
+      if ((!l.Presamplers) || (!l.Pstep_rows))
+         return Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+      for (int col = 0; col < l.num_cols; col++)
+      {
+         Resampler_Base::Window window;
+         window.x = col * tile_size;
+         window.y = 0;
+         window.width = (window.x + tile_size <= l.width) ? tile_size : (l.width - window.x);
+         window.height = l.height;
+
+         Level_Resampler* Presampler = new Level_Resampler(prev.width, prev.height, l.width, l.height, job.num_channels,
+            boundary_op, sample_low, sample_high, Pfilter_name, NULL, NULL, filter_scale, filter_scale,
+            Level_Resampler::RR(0.0), Level_Resampler::RR(0.0), &window);
+         l.Presamplers[col] = Presampler;
+
+         if (Presampler->status() != Resampler_Base::STATUS_OKAY)
+            return Presampler->status();
+
+         // X-Y order, so each column only buffers scanlines of its own width (Y-X order buffers the previous level's).
+         if (!Presampler->set_delay_x_resample(false))
+            return (Presampler->status() != Resampler_Base::STATUS_OKAY) ? Presampler->status() : Resampler_Base::STATUS_OUT_OF_MEMORY;
+      }
+
+      // The columns share their Y contributor list. Scanlines are completed in order, each one once the previous
+      // level's band holding its last contributor has been filtered.
+      const typename Level_Resampler::Contrib_List* Pclist_y = l.Presamplers[0]->get_clist_y();
+
+      int y = 0, rows = 0;
+      for (int band = 0; band < prev.num_bands; band++)
+      {
+         const int src_end = prev.get_band_end(band);
+         for ( ; y < l.height; y++)
+         {
+            int last = 0;
+            for (int i = 0; i < Pclist_y[y].n; i++)
+               last = ((int)Pclist_y[y].p[i].pixel > last) ? (int)Pclist_y[y].p[i].pixel : last;
+
+            if (last >= src_end)
+               break;
+         }
+
+         l.Pstep_rows[band] = y;
+
+         if (y > rows)
+         {
+            const int step_bands = (y - 1) / tile_size - rows / tile_size + 1;
+            max_step_bands = (step_bands > max_step_bands) ? step_bands : max_step_bands;
+         }
+         rows = y;
+      }
+
+      resampler_assert(y == l.height);
+   }
+
+   // One more band than a step writes to, so the slots it needs don't wait for the band it's completing, and one
+   // more to write a band's tiles while the next level filters the band before it.
+   l.num_slots = (max_step_bands + 2 < l.num_bands) ? (max_step_bands + 2) : l.num_bands;
+
+   l.Pslots = (Real*)malloc((size_t)l.num_slots * tile_size * l.pitch * sizeof(Real));
+   if (!l.Pslots)
+      return Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+   return Resampler_Base::STATUS_OKAY;
+}
+
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_Pyramid<Real, Storage>::generate_pyramid(
+   const Resampler_Row_Source& src,
+   const Tile_Sink& dst,
+   int tile_size,
+   int num_levels,
+   Resampler_Base::Boundary_Op boundary_op,
+   Real sample_low, Real sample_high,
+   const char* Pfilter_name,
+   Resampler_Work_Pool* Ppool,
+   Real filter_scale)
+{
+   resampler_assert((src.width > 0) && (src.height > 0));
+   resampler_assert((src.num_channels > 0) && (src.num_channels <= RESAMPLER_MAX_CHANNELS));
+   resampler_assert(tile_size > 0);
+   resampler_assert(num_levels <= get_num_levels(src.width, src.height));
+
+   if (num_levels <= 0)
+      num_levels = get_num_levels(src.width, src.height);
+
+   Job job;
+   job.Psrc = &src;
+   job.Pdst = &dst;
+   job.tile_size = tile_size;
+   job.num_channels = src.num_channels;
+   job.num_levels = num_levels;
+   job.Ppool = Ppool;
+   job.failed = false;
+   job.status = Resampler_Base::STATUS_OKAY;
+
+   for (int i = 0; i < 256; i++)
+      job.byte_to_sample[i] = (Real)i / Level_Resampler::RR(255.0);
+
+   job.Plevels = (Level*)calloc(num_levels, sizeof(Level));
+   job.Psrc_row = (unsigned char*)malloc((size_t)src.width * src.num_channels);
+
+   Resampler_Base::Status status = Resampler_Base::STATUS_OKAY;
+
+   if ((!job.Plevels) || (!job.Psrc_row))
+      status = Resampler_Base::STATUS_OUT_OF_MEMORY;
+
+   // All the levels are set up front, they're all filtered at once.
+   for (int level = 0; (level < num_levels) && (status == Resampler_Base::STATUS_OKAY); level++)
+      status = init_level(job, level, boundary_op, sample_low, sample_high, Pfilter_name, filter_scale);
+
+   if (status == Resampler_Base::STATUS_OKAY)
+   {
+      Resampler_Work_Pool* Ptemp_pool = NULL;
+      if (!Ppool)
+         job.Ppool = Ptemp_pool = new Resampler_Work_Pool();
+
+      {
+         std::lock_guard<std::mutex> lock(job.mutex);
+         schedule(job);
+      }
+
+      job.Ppool->wait();
+
+      delete Ptemp_pool;
+
+      status = job.status;
+
+      for (int level = 0; (level < num_levels) && (status == Resampler_Base::STATUS_OKAY); level++)
+         resampler_assert(job.Plevels[level].next_emit == job.Plevels[level].num_bands);
+   }
+
+   if (job.Plevels)
+   {
+      for (int level = 0; level < num_levels; level++)
+      {
+         Level& l = job.Plevels[level];
+
+         if (l.Presamplers)
+         {
+            for (int col = 0; col < l.num_cols; col++)
+               delete l.Presamplers[col];
+            free(l.Presamplers);
+         }
+
+         free(l.Pstep_rows);
+         free(l.Pslots);
+      }
+      free(job.Plevels);
+   }
+
+   free(job.Psrc_row);
+
+   return status;
+}
+
+template class Resampler_Pyramid<float>;
+template class Resampler_Pyramid<double>;
+template class Resampler_Pyramid<float, Resample_Half>;
@@ -0,0 +1,89 @@
+// resampler_pyramid.h, Tiled multi-resolution pyramids (Deep Zoom, XYZ tiles) streamed out of a single pass over the source.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_PYRAMID_H__
+#define __RESAMPLER_PYRAMID_H__
+
+#include "resampler.h"
+#include "resampler_stream.h"
+
+class Resampler_Work_Pool;
+
+// Cuts an image and all its reductions into fixed size tiles, reading the source once, top to bottom. Each level is a
+// 2:1 reduction of the previous one (rounded up, to at least 1 pixel, like Deep Zoom's) filtered out of the previous
+// level's scanlines as they're completed, like Resampler_Mips does. Each tile column of a level has its own Resampler
+// with an output window (see Resampler_T's multichannel constructor), so the columns are filtered in parallel and each
+// one only filters the source columns it needs.
+// The levels only keep a few rows of tiles in memory: a row of tiles is written as soon as its scanlines are complete,
+// and dropped once written and filtered into the next level. The reading, filtering and tile writing of all the
+// levels run as tasks on a Resampler_Work_Pool, a level's next row of tiles starts as soon as the scanlines it depends on
+// are there. Explicitly instantiated in resampler_pyramid.cpp for the same types as Resampler_T.
+template<typename Real, typename Storage = Real>
+class Resampler_Pyramid
+{
+public:
+   typedef Resampler_T<Real, Storage> Level_Resampler;
+   typedef Real Sample;
+
+   // A tile of a level. The tiles of the last column and row are cut to the level's size.
+   struct Tile
+   {
+      int level;           // 0 is the full resolution level. Deep Zoom numbers it num_levels - 1.
+      int col, row;
+      int x, y;            // position of the tile's top left pixel in the level: col * tile_size, row * tile_size
+      int width, height;
+      const Sample* Psamples; // width * height pixels of num_channels interleaved samples
+      size_t pitch;        // Number of samples between the starts of consecutive scanlines
+   };
+
+   // Receives the tiles, in row order within each level (the levels are interleaved).
+   struct Tile_Sink
+   {
+      // Writes a tile, Psamples is only valid during the call. Called from the pool's threads, concurrently for
+      // different tiles. Returns false on write errors.
+      bool (*Pwrite_tile)(const Tile& tile, void* pUser);
+
+      void* pUser;
+   };
+
+   // Number of levels of a src_x * src_y image, the image itself and its reductions down to 1x1.
+   static int get_num_levels(int src_x, int src_y);
+
+   // Dimensions of level level (0 is the image itself).
+   static void get_level_size(int src_x, int src_y, int level, int& level_x, int& level_y);
+
+   // Reads src and writes the tile_size * tile_size tiles of its first num_levels levels to dst (0 writes all of them).
+   // The 8-bit source samples are scaled to [0, 1].
+   // Ppool - Pool to run on, or NULL to use a temporary pool with one thread per core
+   // The other parameters are the same as Resampler_Mips::generate_mips()'s.
+   // Returns STATUS_IO_ERROR if src can't be read or dst fails to write a tile: the other tiles which were in flight are
+   // still written, no new ones are.
+   static Resampler_Base::Status generate_pyramid(
+      const Resampler_Row_Source& src,
+      const Tile_Sink& dst,
+      int tile_size = 256,
+      int num_levels = 0,
+      Resampler_Base::Boundary_Op boundary_op = Resampler_Base::BOUNDARY_CLAMP,
+      Real sample_low = Level_Resampler::RR(0.0), Real sample_high = Level_Resampler::RR(0.0),
+      const char* Pfilter_name = RESAMPLER_DEFAULT_FILTER,
+      Resampler_Work_Pool* Ppool = NULL,
+      Real filter_scale = Level_Resampler::RR(1.0));
+
+private:
+   struct Level;
+   struct Job;
+
+   static Resampler_Base::Status init_level(
+      Job& job, int level,
+      Resampler_Base::Boundary_Op boundary_op,
+      Real sample_low, Real sample_high,
+      const char* Pfilter_name,
+      Real filter_scale);
+
+   static void schedule(Job& job);
+   static Resampler_Base::Status read_band(Job& job, Level& l);
+   static Resampler_Base::Status filter_band(Job& job, Level& l, int col);
+   static void run_step(void* pData, int col);
+   static void write_tile(void* pData, int col);
+};
+
+#endif // __RESAMPLER_PYRAMID_H__
@@ -0,0 +1,1076 @@
+// resampler_stream.cpp, Scanline sources and sinks for streaming images larger than memory through the Resampler.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#ifndef _MSC_VER
+// 64-bit fseeko()/ftello() offsets on 32-bit platforms too.
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <cassert>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "resampler_stream.h"
+#include "resampler_threads.h"
+
+#define resampler_assert assert
+
+// State of a file source or sink.
+struct Stream_File
+{
+   FILE* Pfile;
+   int width, height;
+   int num_channels;
+   int file_bytes_per_pixel;
+   int cur_y;
+
+   // Offset of the first scanline in the file, and whether the last scanline comes first (bottom up TGA).
+   unsigned long long data_ofs;
+   bool bottom_up;
+
+   // PNM samples to [0, 255], for maxvals below 255.
+   bool rescale;
+   unsigned char rescale_table[256];
+
+   // One scanline as stored in the file.
+   unsigned char* Prow;
+};
+
+static bool seek_file(FILE* Pfile, unsigned long long ofs, int origin)
+{
+#ifdef _MSC_VER
+   return !_fseeki64(Pfile, (__int64)ofs, origin);
+#else
+   return !fseeko(Pfile, (off_t)ofs, origin);
+#endif
+}
+
+static unsigned long long tell_file(FILE* Pfile)
+{
+#ifdef _MSC_VER
+   return (unsigned long long)_ftelli64(Pfile);
+#else
+   return (unsigned long long)ftello(Pfile);
+#endif
+}
+
+static Stream_File* open_stream_file(const char* Pfilename, const char* Pmode)
+{
+   Stream_File* Pf = (Stream_File*)calloc(1, sizeof(Stream_File));
+   if (!Pf)
+      return NULL;
+
+   Pf->Pfile = fopen(Pfilename, Pmode);
+   if (!Pf->Pfile)
+   {
+      free(Pf);
+      return NULL;
+   }
+
+   return Pf;
+}
+
+// Allocates the scanline buffer once the header has set the dimensions.
+static bool alloc_stream_row(Stream_File* Pf)
+{
+   Pf->Prow = (unsigned char*)malloc((size_t)Pf->width * Pf->file_bytes_per_pixel);
+   return Pf->Prow != NULL;
+}
+
+static void close_stream_file(void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+   if (Pf->Pfile)
+      fclose(Pf->Pfile);
+   free(Pf->Prow);
+   free(Pf);
+}
+
+static bool close_stream_sink_file(void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+
+   // A sink which didn't receive every scanline leaves a truncated file behind.
+   bool okay = (Pf->cur_y == Pf->height);
+   okay = (!ferror(Pf->Pfile)) && okay;
+   okay = (!fclose(Pf->Pfile)) && okay;
+   Pf->Pfile = NULL;
+
+   close_stream_file(Pf);
+   return okay;
+}
+
+static void set_source(Resampler_Row_Source& src, Stream_File* Pf, bool (*Pread_row)(unsigned char*, void*))
+{
+   src.width = Pf->width;
+   src.height = Pf->height;
+   src.num_channels = Pf->num_channels;
+   src.Pread_row = Pread_row;
+   src.Pclose = close_stream_file;
+   src.pUser = Pf;
+}
+
+static void set_sink(Resampler_Row_Sink& dst, Stream_File* Pf, bool (*Pwrite_row)(const unsigned char*, void*))
+{
+   dst.width = Pf->width;
+   dst.height = Pf->height;
+   dst.num_channels = Pf->num_channels;
+   dst.Pwrite_row = Pwrite_row;
+   dst.Pclose = close_stream_sink_file;
+   dst.pUser = Pf;
+}
+
+static void set_float_sink(Resampler_Row_Sink& dst, Stream_File* Pf, bool (*Pwrite_float_row)(const float*, void*))
+{
+   set_sink(dst, Pf, NULL);
+   dst.Pwrite_float_row = Pwrite_float_row;
+}
+
+static void clear_source(Resampler_Row_Source& src)
+{
+   memset(&src, 0, sizeof(src));
+}
+
+static void clear_sink(Resampler_Row_Sink& dst)
+{
+   memset(&dst, 0, sizeof(dst));
+}
+
+static bool read_tga_row(unsigned char* Pdst, void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+   if (Pf->cur_y >= Pf->height)
+      return false;
+
+   const size_t row_size = (size_t)Pf->width * Pf->file_bytes_per_pixel;
+
+   if (Pf->bottom_up)
+   {
+      if (!seek_file(Pf->Pfile, Pf->data_ofs + (unsigned long long)(Pf->height - 1 - Pf->cur_y) * row_size, SEEK_SET))
+         return false;
+   }
+
+   if (fread(Pf->Prow, 1, row_size, Pf->Pfile) != row_size)
+      return false;
+
+   const unsigned char* Psrc = Pf->Prow;
+   switch (Pf->file_bytes_per_pixel)
+   {
+      case 1:
+         memcpy(Pdst, Psrc, row_size);
+         break;
+      case 3:
+         for (int x = 0; x < Pf->width; x++, Psrc += 3, Pdst += 3)
+         {
+            Pdst[0] = Psrc[2];
+            Pdst[1] = Psrc[1];
+            Pdst[2] = Psrc[0];
+         }
+         break;
+      default:
+         for (int x = 0; x < Pf->width; x++, Psrc += 4, Pdst += 4)
+         {
+            Pdst[0] = Psrc[2];
+            Pdst[1] = Psrc[1];
+            Pdst[2] = Psrc[0];
+            Pdst[3] = Psrc[3];
+         }
+         break;
+   }
+
+   Pf->cur_y++;
+   return true;
+}
+
+bool resampler_open_tga_source(Resampler_Row_Source& src, const char* Pfilename)
+{
+   clear_source(src);
+
+   Stream_File* Pf = open_stream_file(Pfilename, "rb");
+   if (!Pf)
+      return false;
+
+   unsigned char h[18];
+   if (fread(h, 1, sizeof(h), Pf->Pfile) != sizeof(h))
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   const int id_size = h[0];
+   const int color_map_type = h[1];
+   const int image_type = h[2];
+   const int color_map_size = (h[5] | (h[6] << 8)) * ((h[7] + 7) >> 3);
+   const int bits_per_pixel = h[16];
+   const int descriptor = h[17];
+
+   Pf->width = h[12] | (h[13] << 8);
+   Pf->height = h[14] | (h[15] << 8);
+
+   // Uncompressed true color or grayscale, left to right (a color map may be present, but isn't used).
+   const bool true_color = (image_type == 2) && ((bits_per_pixel == 24) || (bits_per_pixel == 32));
+   const bool gray = (image_type == 3) && (bits_per_pixel == 8);
+   if ((color_map_type > 1) || ((!true_color) && (!gray)) || (descriptor & 0x10) || (!Pf->width) || (!Pf->height))
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   Pf->file_bytes_per_pixel = bits_per_pixel >> 3;
+   Pf->num_channels = Pf->file_bytes_per_pixel;
+   Pf->data_ofs = sizeof(h) + id_size + (color_map_type ? color_map_size : 0);
+   Pf->bottom_up = (descriptor & 0x20) == 0;
+
+   // TGA has no signature, so a file which is too short for its header's image isn't a TGA file.
+   const unsigned long long data_size = (unsigned long long)Pf->width * Pf->height * Pf->file_bytes_per_pixel;
+   if ((!seek_file(Pf->Pfile, 0, SEEK_END)) || (tell_file(Pf->Pfile) < Pf->data_ofs + data_size) ||
+       (!seek_file(Pf->Pfile, Pf->data_ofs, SEEK_SET)) || (!alloc_stream_row(Pf)))
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   set_source(src, Pf, read_tga_row);
+   return true;
+}
+
+// Reads a PNM header field, skipping whitespace and comments before it and consuming the single whitespace character after it.
+static bool read_pnm_int(FILE* Pfile, int& value)
+{
+   int c = fgetc(Pfile);
+   for ( ; ; )
+   {
+      if (c == '#')
+      {
+         while ((c != EOF) && (c != '\n') && (c != '\r'))
+            c = fgetc(Pfile);
+      }
+      else if ((c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f'))
+         c = fgetc(Pfile);
+      else
+         break;
+   }
+
+   if ((c < '0') || (c > '9'))
+      return false;
+
+   value = 0;
+   while ((c >= '0') && (c <= '9'))
+   {
+      if (value > (0x7FFFFFFF - 9) / 10)
+         return false;
+      value = value * 10 + (c - '0');
+      c = fgetc(Pfile);
+   }
+
+   return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\r') || (c == '\v') || (c == '\f');
+}
+
+static bool read_pnm_row(unsigned char* Pdst, void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+   if (Pf->cur_y >= Pf->height)
+      return false;
+
+   const size_t row_size = (size_t)Pf->width * Pf->file_bytes_per_pixel;
+   if (fread(Pdst, 1, row_size, Pf->Pfile) != row_size)
+      return false;
+
+   if (Pf->rescale)
+   {
+      for (size_t i = 0; i < row_size; i++)
+         Pdst[i] = Pf->rescale_table[Pdst[i]];
+   }
+
+   Pf->cur_y++;
+   return true;
+}
+
+bool resampler_open_pnm_source(Resampler_Row_Source& src, const char* Pfilename)
+{
+   clear_source(src);
+
+   Stream_File* Pf = open_stream_file(Pfilename, "rb");
+   if (!Pf)
+      return false;
+
+   unsigned char magic[2];
+   int maxval = 0;
+   if ((fread(magic, 1, 2, Pf->Pfile) != 2) || (magic[0] != 'P') || ((magic[1] != '5') && (magic[1] != '6')) ||
+       (!read_pnm_int(Pf->Pfile, Pf->width)) || (!read_pnm_int(Pf->Pfile, Pf->height)) || (!read_pnm_int(Pf->Pfile, maxval)) ||
+       (!Pf->width) || (!Pf->height) || (maxval < 1) || (maxval > 255))
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   Pf->num_channels = (magic[1] == '5') ? 1 : 3;
+   Pf->file_bytes_per_pixel = Pf->num_channels;
+
+   // The PNM scanlines are read straight into the caller's buffer, only the rescaling needs a table.
+   Pf->rescale = (maxval != 255);
+   for (int i = 0; i < 256; i++)
+      Pf->rescale_table[i] = (unsigned char)((i >= maxval) ? 255 : ((i * 255 + (maxval >> 1)) / maxval));
+
+   set_source(src, Pf, read_pnm_row);
+   return true;
+}
+
+bool resampler_open_file_source(Resampler_Row_Source& src, const char* Pfilename)
+{
+   // PNM files start with a signature, TGA files are recognized by their header.
+   return resampler_open_pnm_source(src, Pfilename) || resampler_open_tga_source(src, Pfilename);
+}
+
+void resampler_close_source(Resampler_Row_Source& src)
+{
+   if (src.Pclose)
+      src.Pclose(src.pUser);
+   clear_source(src);
+}
+
+static bool write_tga_row(const unsigned char* Psrc, void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+   if (Pf->cur_y >= Pf->height)
+      return false;
+
+   unsigned char* Pdst = Pf->Prow;
+   switch (Pf->num_channels)
+   {
+      case 1:
+         for (int x = 0; x < Pf->width; x++, Psrc++, Pdst += 3)
+            Pdst[0] = Pdst[1] = Pdst[2] = Psrc[0];
+         break;
+      case 2:
+         for (int x = 0; x < Pf->width; x++, Psrc += 2, Pdst += 4)
+         {
+            Pdst[0] = Pdst[1] = Pdst[2] = Psrc[0];
+            Pdst[3] = Psrc[1];
+         }
+         break;
+      case 3:
+         for (int x = 0; x < Pf->width; x++, Psrc += 3, Pdst += 3)
+         {
+            Pdst[0] = Psrc[2];
+            Pdst[1] = Psrc[1];
+            Pdst[2] = Psrc[0];
+         }
+         break;
+      default:
+         for (int x = 0; x < Pf->width; x++, Psrc += 4, Pdst += 4)
+         {
+            Pdst[0] = Psrc[2];
+            Pdst[1] = Psrc[1];
+            Pdst[2] = Psrc[0];
+            Pdst[3] = Psrc[3];
+         }
+         break;
+   }
+
+   const size_t row_size = (size_t)Pf->width * Pf->file_bytes_per_pixel;
+   if (fwrite(Pf->Prow, 1, row_size, Pf->Pfile) != row_size)
+      return false;
+
+   Pf->cur_y++;
+   return true;
+}
+
+bool resampler_open_tga_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels)
+{
+   clear_sink(dst);
+
+   if ((width < 1) || (width > 65535) || (height < 1) || (height > 65535) || (num_channels < 1) || (num_channels > 4))
+      return false;
+
+   Stream_File* Pf = open_stream_file(Pfilename, "wb");
+   if (!Pf)
+      return false;
+
+   const bool has_alpha = !(num_channels & 1);
+
+   Pf->width = width;
+   Pf->height = height;
+   Pf->num_channels = num_channels;
+   Pf->file_bytes_per_pixel = has_alpha ? 4 : 3;
+
+   // Top down (descriptor bit 5), so the scanlines can be written in the order they're produced.
+   unsigned char h[18];
+   memset(h, 0, sizeof(h));
+   h[2] = 2;
+   h[12] = (unsigned char)width;
+   h[13] = (unsigned char)(width >> 8);
+   h[14] = (unsigned char)height;
+   h[15] = (unsigned char)(height >> 8);
+   h[16] = (unsigned char)(Pf->file_bytes_per_pixel * 8);
+   h[17] = (unsigned char)(0x20 | (has_alpha ? 8 : 0));
+
+   if ((fwrite(h, 1, sizeof(h), Pf->Pfile) != sizeof(h)) || (!alloc_stream_row(Pf)))
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   set_sink(dst, Pf, write_tga_row);
+   return true;
+}
+
+static bool write_pnm_row(const unsigned char* Psrc, void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+   if (Pf->cur_y >= Pf->height)
+      return false;
+
+   const size_t row_size = (size_t)Pf->width * Pf->file_bytes_per_pixel;
+   if (fwrite(Psrc, 1, row_size, Pf->Pfile) != row_size)
+      return false;
+
+   Pf->cur_y++;
+   return true;
+}
+
+bool resampler_open_pnm_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels)
+{
+   clear_sink(dst);
+
+   if ((width < 1) || (height < 1) || ((num_channels != 1) && (num_channels != 3)))
+      return false;
+
+   Stream_File* Pf = open_stream_file(Pfilename, "wb");
+   if (!Pf)
+      return false;
+
+   Pf->width = width;
+   Pf->height = height;
+   Pf->num_channels = num_channels;
+   Pf->file_bytes_per_pixel = num_channels;
+
+   if (fprintf(Pf->Pfile, "P%c\n%i %i\n255\n", (num_channels == 1) ? '5' : '6', width, height) < 0)
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   set_sink(dst, Pf, write_pnm_row);
+   return true;
+}
+
+static bool write_raw_float_row(const float* Psrc, void* pUser)
+{
+   Stream_File* Pf = static_cast<Stream_File*>(pUser);
+   if (Pf->cur_y >= Pf->height)
+      return false;
+
+   const unsigned long long plane_size = (unsigned long long)Pf->width * Pf->height * sizeof(float);
+   const size_t row_size = (size_t)Pf->width * sizeof(float);
+
+   float* Pdst = (float*)Pf->Prow;
+   for (int c = 0; c < Pf->num_channels; c++)
+   {
+      for (int x = 0; x < Pf->width; x++)
+         Pdst[x] = Psrc[x * Pf->num_channels + c];
+
+      // Single channel images are written front to back, without seeking.
+      if ((Pf->num_channels > 1) && (!seek_file(Pf->Pfile, c * plane_size + (unsigned long long)Pf->cur_y * row_size, SEEK_SET)))
+         return false;
+
+      if (fwrite(Pdst, 1, row_size, Pf->Pfile) != row_size)
+         return false;
+   }
+
+   Pf->cur_y++;
+   return true;
+}
+
+bool resampler_open_raw_float_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels)
+{
+   clear_sink(dst);
+
+   if ((width < 1) || (height < 1) || (num_channels < 1))
+      return false;
+
+   Stream_File* Pf = open_stream_file(Pfilename, "wb");
+   if (!Pf)
+      return false;
+
+   Pf->width = width;
+   Pf->height = height;
+   Pf->num_channels = num_channels;
+
+   // The scanline buffer holds one channel of a scanline.
+   Pf->file_bytes_per_pixel = sizeof(float);
+
+   if (!alloc_stream_row(Pf))
+   {
+      close_stream_file(Pf);
+      return false;
+   }
+
+   set_float_sink(dst, Pf, write_raw_float_row);
+   return true;
+}
+
+// State of a memory sink.
+struct Memory_Sink
+{
+   unsigned char* Pdst;
+   size_t pitch;      // In bytes
+   size_t row_size;   // In bytes
+   int height;
+   int cur_y;
+};
+
+static bool write_memory_row(const void* Psrc, void* pUser)
+{
+   Memory_Sink* Pm = static_cast<Memory_Sink*>(pUser);
+   if (Pm->cur_y >= Pm->height)
+      return false;
+
+   memcpy(Pm->Pdst + Pm->cur_y * Pm->pitch, Psrc, Pm->row_size);
+
+   Pm->cur_y++;
+   return true;
+}
+
+static bool write_memory_u8_row(const unsigned char* Psrc, void* pUser)
+{
+   return write_memory_row(Psrc, pUser);
+}
+
+static bool write_memory_float_row(const float* Psrc, void* pUser)
+{
+   return write_memory_row(Psrc, pUser);
+}
+
+static bool close_memory_sink(void* pUser)
+{
+   Memory_Sink* Pm = static_cast<Memory_Sink*>(pUser);
+   const bool okay = (Pm->cur_y == Pm->height);
+   free(Pm);
+   return okay;
+}
+
+static bool open_memory_sink(Resampler_Row_Sink& dst, void* Pdst, size_t pitch, size_t row_size, int width, int height, int num_channels)
+{
+   clear_sink(dst);
+
+   if ((!Pdst) || (width < 1) || (height < 1) || (num_channels < 1) || (pitch < row_size))
+      return false;
+
+   Memory_Sink* Pm = (Memory_Sink*)malloc(sizeof(Memory_Sink));
+   if (!Pm)
+      return false;
+
+   Pm->Pdst = static_cast<unsigned char*>(Pdst);
+   Pm->pitch = pitch;
+   Pm->row_size = row_size;
+   Pm->height = height;
+   Pm->cur_y = 0;
+
+   dst.width = width;
+   dst.height = height;
+   dst.num_channels = num_channels;
+   dst.Pclose = close_memory_sink;
+   dst.pUser = Pm;
+   return true;
+}
+
+bool resampler_open_memory_sink(Resampler_Row_Sink& dst, unsigned char* Pdst, size_t pitch, int width, int height, int num_channels)
+{
+   if (!open_memory_sink(dst, Pdst, pitch, (size_t)width * num_channels, width, height, num_channels))
+      return false;
+
+   dst.Pwrite_row = write_memory_u8_row;
+   return true;
+}
+
+bool resampler_open_float_memory_sink(Resampler_Row_Sink& dst, float* Pdst, size_t pitch, int width, int height, int num_channels)
+{
+   if (!open_memory_sink(dst, Pdst, pitch * sizeof(float), (size_t)width * num_channels * sizeof(float), width, height, num_channels))
+      return false;
+
+   dst.Pwrite_float_row = write_memory_float_row;
+   return true;
+}
+
+// State of an async sink: a ring of queued scanlines, drained by the writer thread.
+struct Async_Sink
+{
+   Resampler_Row_Sink target;
+   size_t row_size;
+   int max_rows;
+   unsigned char* Prows;
+
+   // The oldest queued scanline and the number of them. Only the producer adds scanlines and only the writer thread
+   // removes them, so each of them copies its scanline without holding the mutex.
+   int first_row, num_rows;
+   bool done;
+   bool failed;
+
+   std::mutex mutex;
+   std::condition_variable queued_cond;
+   std::condition_variable written_cond;
+   std::thread thread;
+};
+
+static void async_sink_thread(Async_Sink* pAsync)
+{
+   std::unique_lock<std::mutex> lock(pAsync->mutex);
+
+   for ( ; ; )
+   {
+      while ((!pAsync->num_rows) && (!pAsync->done))
+         pAsync->queued_cond.wait(lock);
+
+      if (!pAsync->num_rows)
+         break;
+
+      const unsigned char* Prow = pAsync->Prows + pAsync->first_row * pAsync->row_size;
+      const bool failed = pAsync->failed;
+
+      lock.unlock();
+
+      // After an error the remaining scanlines are dropped, the producer learns about it on its next write.
+      bool okay = failed;
+      if (!failed)
+      {
+         const Resampler_Row_Sink& target = pAsync->target;
+         okay = target.Pwrite_float_row ? target.Pwrite_float_row((const float*)Prow, target.pUser) : target.Pwrite_row(Prow, target.pUser);
+      }
+
+      lock.lock();
+
+      pAsync->failed = pAsync->failed || (!okay);
+      pAsync->first_row = (pAsync->first_row + 1) % pAsync->max_rows;
+      pAsync->num_rows--;
+      pAsync->written_cond.notify_one();
+   }
+}
+
+static bool queue_async_row(const void* Psrc, void* pUser)
+{
+   Async_Sink* pAsync = static_cast<Async_Sink*>(pUser);
+
+   std::unique_lock<std::mutex> lock(pAsync->mutex);
+
+   while ((pAsync->num_rows == pAsync->max_rows) && (!pAsync->failed))
+      pAsync->written_cond.wait(lock);
+
+   if (pAsync->failed)
+      return false;
+
+   unsigned char* Prow = pAsync->Prows + ((pAsync->first_row + pAsync->num_rows) % pAsync->max_rows) * pAsync->row_size;
+
+   lock.unlock();
+   memcpy(Prow, Psrc, pAsync->row_size);
+   lock.lock();
+
+   pAsync->num_rows++;
+   pAsync->queued_cond.notify_one();
+   return true;
+}
+
+static bool queue_async_u8_row(const unsigned char* Psrc, void* pUser)
+{
+   return queue_async_row(Psrc, pUser);
+}
+
+static bool queue_async_float_row(const float* Psrc, void* pUser)
+{
+   return queue_async_row(Psrc, pUser);
+}
+
+static bool close_async_sink(void* pUser)
+{
+   Async_Sink* pAsync = static_cast<Async_Sink*>(pUser);
+
+   {
+      std::lock_guard<std::mutex> lock(pAsync->mutex);
+      pAsync->done = true;
+      pAsync->queued_cond.notify_one();
+   }
+
+   pAsync->thread.join();
+
+   bool okay = !pAsync->failed;
+   okay = resampler_close_sink(pAsync->target) && okay;
+
+   free(pAsync->Prows);
+   delete pAsync;
+   return okay;
+}
+
+bool resampler_open_async_sink(Resampler_Row_Sink& dst, Resampler_Row_Sink& target, int max_queued_rows)
+{
+   clear_sink(dst);
+
+   if (max_queued_rows < 1)
+      return false;
+
+   Async_Sink* pAsync = new Async_Sink;
+   pAsync->target = target;
+   pAsync->row_size = (size_t)target.width * target.num_channels * (target.Pwrite_float_row ? sizeof(float) : 1);
+   pAsync->max_rows = max_queued_rows;
+   pAsync->Prows = (unsigned char*)malloc(pAsync->row_size * max_queued_rows);
+   pAsync->first_row = 0;
+   pAsync->num_rows = 0;
+   pAsync->done = false;
+   pAsync->failed = false;
+
+   if (!pAsync->Prows)
+   {
+      delete pAsync;
+      return false;
+   }
+
+   pAsync->thread = std::thread(async_sink_thread, pAsync);
+
+   dst.width = target.width;
+   dst.height = target.height;
+   dst.num_channels = target.num_channels;
+   if (target.Pwrite_float_row)
+      dst.Pwrite_float_row = queue_async_float_row;
+   else
+      dst.Pwrite_row = queue_async_u8_row;
+   dst.Pclose = close_async_sink;
+   dst.pUser = pAsync;
+
+   clear_sink(target);
+   return true;
+}
+
+bool resampler_close_sink(Resampler_Row_Sink& dst)
+{
+   const bool okay = (!dst.Pclose) || (dst.Pclose(dst.pUser));
+   clear_sink(dst);
+   return okay;
+}
+
+// get_line()'s samples as floats, for float sinks.
+static inline const float* float_row(const float* Pline, float* Pdst, size_t n)
+{
+   (void)Pdst;
+   (void)n;
+   return Pline;
+}
+
+static inline const float* float_row(const double* Pline, float* Pdst, size_t n)
+{
+   for (size_t i = 0; i < n; i++)
+      Pdst[i] = (float)Pline[i];
+   return Pdst;
+}
+
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_T<Real, Storage>::stream(const Resampler_Row_Source& src, const Resampler_Row_Sink& dst)
+{
+   resampler_assert((src.width == m_resample_src_x) && (src.height == m_resample_src_y) && (src.num_channels >= m_num_channels));
+   resampler_assert((dst.width == m_resample_dst_x) && (dst.height == m_resample_dst_y) && (dst.num_channels == m_num_channels));
+
+   if (m_status != STATUS_OKAY)
+      return m_status;
+
+   restart();
+
+   unsigned char* Psrc_row = (unsigned char*)malloc((size_t)src.width * src.num_channels);
+   unsigned char* Pdst_row = (unsigned char*)malloc((size_t)m_resample_dst_x * m_num_channels * (dst.Pwrite_float_row ? sizeof(float) : 1));
+
+   Status status = ((Psrc_row) && (Pdst_row)) ? STATUS_OKAY : STATUS_OUT_OF_MEMORY;
+
+   for (int y = 0; (y < m_resample_src_y) && (status == STATUS_OKAY); y++)
+   {
+      if (!src.Pread_row(Psrc_row, src.pUser))
+      {
+         status = STATUS_IO_ERROR;
+         break;
+      }
+
+      if (!put_line(Psrc_row, src.num_channels))
+      {
+         status = (m_status != STATUS_OKAY) ? m_status : STATUS_OUT_OF_MEMORY;
+         break;
+      }
+
+      for ( ; ; )
+      {
+         bool okay;
+         if (dst.Pwrite_float_row)
+         {
+            const Sample* Pline = get_line();
+            if (!Pline)
+               break;
+            okay = dst.Pwrite_float_row(float_row(Pline, (float*)Pdst_row, (size_t)m_resample_dst_x * m_num_channels), dst.pUser);
+         }
+         else
+         {
+            if (!get_line_into(Pdst_row, m_num_channels))
+               break;
+            okay = dst.Pwrite_row(Pdst_row, dst.pUser);
+         }
+
+         if (!okay)
+         {
+            status = STATUS_IO_ERROR;
+            break;
+         }
+      }
+   }
+
+   resampler_assert((status != STATUS_OKAY) || (m_cur_dst_y == m_resample_dst_y));
+
+   free(Psrc_row);
+   free(Pdst_row);
+
+   return status;
+}
+
+// State shared by the stages of stream_pipelined().
+template<typename Real, typename Storage>
+struct Resampler_T<Real, Storage>::Pipeline
+{
+   Resampler_T* Presampler;
+   const Resampler_Row_Source* Psrc;
+   const Resampler_Row_Sink* Pdst;
+
+   // Source scanlines, X filtered scanlines (only of the source scanlines which contribute to the output) and
+   // destination scanlines.
+   Resampler_Row_Queue src_queue;
+   Resampler_Row_Queue x_queue;
+   Resampler_Row_Queue dst_queue;
+
+   // Status of each stage but the Y stage, written by its own thread only.
+   Status read_status, x_status, write_status;
+
+   void cancel()
+   {
+      src_queue.cancel();
+      x_queue.cancel();
+      dst_queue.cancel();
+   }
+};
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::pipeline_read_stage(Pipeline* Pp)
+{
+   const Resampler_Row_Source& src = *Pp->Psrc;
+
+   for (int y = 0; y < src.height; y++)
+   {
+      unsigned char* Prow = (unsigned char*)Pp->src_queue.get_write_row();
+      if (!Prow)
+         return;
+
+      if (!src.Pread_row(Prow, src.pUser))
+      {
+         Pp->read_status = STATUS_IO_ERROR;
+         Pp->cancel();
+         return;
+      }
+
+      Pp->src_queue.push();
+   }
+
+   Pp->src_queue.finish();
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::pipeline_x_stage(Pipeline* Pp)
+{
+   const Resampler_T& r = *Pp->Presampler;
+   const int src_num_channels = Pp->Psrc->num_channels;
+
+   Sample* Pdecoded = (Sample*)malloc((size_t)r.m_resample_src_x * r.m_num_channels * sizeof(Sample));
+   if (!Pdecoded)
+   {
+      Pp->x_status = STATUS_OUT_OF_MEMORY;
+      Pp->cancel();
+      return;
+   }
+
+   for (int y = 0; y < r.m_resample_src_y; y++)
+   {
+      const unsigned char* Psrc = (const unsigned char*)Pp->src_queue.get_read_row();
+      if (!Psrc)
+         break;
+
+      // The Y stage skips the scanlines which don't contribute on its own.
+      if (r.m_Psrc_y_count[y])
+      {
+         Sample* Pdst = (Sample*)Pp->x_queue.get_write_row();
+         if (!Pdst)
+            break;
+
+         // Only reads the tables set up by init(), like decode_line(), so it can run alongside the Y pass.
+         r.decode_line(Pdecoded, Psrc, src_num_channels);
+         Pp->Presampler->resample_x(Pdst, Pdecoded, r.m_num_channels);
+
+         Pp->x_queue.push();
+      }
+
+      Pp->src_queue.pop();
+   }
+
+   Pp->x_queue.finish();
+   free(Pdecoded);
+}
+
+template<typename Real, typename Storage>
+void Resampler_T<Real, Storage>::pipeline_write_stage(Pipeline* Pp)
+{
+   const Resampler_Row_Sink& dst = *Pp->Pdst;
+
+   for ( ; ; )
+   {
+      const void* Prow = Pp->dst_queue.get_read_row();
+      if (!Prow)
+         break;
+
+      const bool okay = dst.Pwrite_float_row ? dst.Pwrite_float_row((const float*)Prow, dst.pUser) : dst.Pwrite_row((const unsigned char*)Prow, dst.pUser);
+      if (!okay)
+      {
+         Pp->write_status = STATUS_IO_ERROR;
+         Pp->cancel();
+         break;
+      }
+
+      Pp->dst_queue.pop();
+   }
+}
+
+template<typename Real, typename Storage>
+Resampler_Base::Status Resampler_T<Real, Storage>::stream_pipelined(const Resampler_Row_Source& src, const Resampler_Row_Sink& dst, int queue_rows)
+{
+   resampler_assert((src.width == m_resample_src_x) && (src.height == m_resample_src_y) && (src.num_channels >= m_num_channels));
+   resampler_assert((dst.width == m_resample_dst_x) && (dst.height == m_resample_dst_y) && (dst.num_channels == m_num_channels));
+   resampler_assert(queue_rows >= 1);
+
+   if (m_status != STATUS_OKAY)
+      return m_status;
+
+   restart();
+
+   // The X stage hands finished X filtered scanlines to the Y stage.
+   const bool delay_x_resample = m_delay_x_resample;
+   if ((delay_x_resample) && (!set_delay_x_resample(false)))
+      return STATUS_OUT_OF_MEMORY;
+
+   if ((!m_Pdecode_table) && (!build_decode_table()))
+      return m_status;
+
+   const size_t dst_row_size = (size_t)m_resample_dst_x * m_num_channels * (dst.Pwrite_float_row ? sizeof(float) : 1);
+
+   Pipeline pipeline;
+   pipeline.Presampler = this;
+   pipeline.Psrc = &src;
+   pipeline.Pdst = &dst;
+   pipeline.read_status = STATUS_OKAY;
+   pipeline.x_status = STATUS_OKAY;
+   pipeline.write_status = STATUS_OKAY;
+
+   Status status = STATUS_OKAY;
+   if ((!pipeline.src_queue.init(queue_rows, (size_t)src.width * src.num_channels)) ||
+       (!pipeline.x_queue.init(queue_rows, (size_t)m_resample_dst_x * m_num_channels * sizeof(Sample))) ||
+       (!pipeline.dst_queue.init(queue_rows, dst_row_size)))
+      status = STATUS_OUT_OF_MEMORY;
+
+   if (status == STATUS_OKAY)
+   {
+      std::thread read_thread(pipeline_read_stage, &pipeline);
+      std::thread x_thread(pipeline_x_stage, &pipeline);
+      std::thread write_thread(pipeline_write_stage, &pipeline);
+
+      // Y stage.
+      for (int y = 0; (y < m_resample_src_y) && (status == STATUS_OKAY); y++)
+      {
+         if (!m_Psrc_y_count[y])
+         {
+            m_cur_src_y++;
+            continue;
+         }
+
+         const Sample* Pline = (const Sample*)pipeline.x_queue.get_read_row();
+         if (!Pline)
+            break;
+
+         if (!put_line_x_filtered(Pline))
+         {
+            status = (m_status != STATUS_OKAY) ? m_status : STATUS_OUT_OF_MEMORY;
+            break;
+         }
+
+         pipeline.x_queue.pop();
+
+         while (line_available())
+         {
+            void* Pdst_row = pipeline.dst_queue.get_write_row();
+            if (!Pdst_row)
+               break;
+
+            bool okay;
+            if (dst.Pwrite_float_row)
+            {
+               const Sample* Pdst_line = get_line();
+               okay = (Pdst_line != NULL);
+               if (okay)
+               {
+                  const float* Pfloats = float_row(Pdst_line, (float*)Pdst_row, (size_t)m_resample_dst_x * m_num_channels);
+                  if (Pfloats != Pdst_row)
+                     memcpy(Pdst_row, Pfloats, dst_row_size);
+               }
+            }
+            else
+               okay = get_line_into((unsigned char*)Pdst_row, m_num_channels);
+
+            if (!okay)
+            {
+               status = (m_status != STATUS_OKAY) ? m_status : STATUS_OUT_OF_MEMORY;
+               break;
+            }
+
+            pipeline.dst_queue.push();
+         }
+      }
+
+      if (status == STATUS_OKAY)
+         pipeline.dst_queue.finish();
+      else
+         pipeline.cancel();
+
+      read_thread.join();
+      x_thread.join();
+      write_thread.join();
+
+      // A stage which stopped early cancelled the queues, which stopped the others: report the first failure.
+      if (status == STATUS_OKAY)
+      {
+         if (pipeline.read_status != STATUS_OKAY)
+            status = pipeline.read_status;
+         else if (pipeline.x_status != STATUS_OKAY)
+            status = pipeline.x_status;
+         else if (pipeline.write_status != STATUS_OKAY)
+            status = pipeline.write_status;
+      }
+
+      resampler_assert((status != STATUS_OKAY) || (m_cur_dst_y == m_resample_dst_y));
+   }
+
+   // Switching the order back needs an empty scan buffer.
+   if (delay_x_resample)
+   {
+      restart();
+      if ((!set_delay_x_resample(true)) && (status == STATUS_OKAY))
+         status = STATUS_OUT_OF_MEMORY;
+   }
+
+   return status;
+}
+
+template Resampler_Base::Status Resampler_T<float>::stream(const Resampler_Row_Source&, const Resampler_Row_Sink&);
+template Resampler_Base::Status Resampler_T<double>::stream(const Resampler_Row_Source&, const Resampler_Row_Sink&);
+template Resampler_Base::Status Resampler_T<float, Resample_Half>::stream(const Resampler_Row_Source&, const Resampler_Row_Sink&);
+
+template Resampler_Base::Status Resampler_T<float>::stream_pipelined(const Resampler_Row_Source&, const Resampler_Row_Sink&, int);
+template Resampler_Base::Status Resampler_T<double>::stream_pipelined(const Resampler_Row_Source&, const Resampler_Row_Sink&, int);
+template Resampler_Base::Status Resampler_T<float, Resample_Half>::stream_pipelined(const Resampler_Row_Source&, const Resampler_Row_Sink&, int);
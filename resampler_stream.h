@@ -0,0 +1,87 @@
+// resampler_stream.h, Scanline sources and sinks for streaming images larger than memory through the Resampler.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_STREAM_H__
+#define __RESAMPLER_STREAM_H__
+
+#include "resampler.h"
+
+// Supplies the scanlines of an 8-bit image with num_channels interleaved samples per pixel, top to bottom.
+// See Resampler_T::stream().
+struct Resampler_Row_Source
+{
+   int width, height, num_channels;
+
+   // Reads the next scanline (width * num_channels samples) into Pdst. Returns false on read errors.
+   bool (*Pread_row)(unsigned char* Pdst, void* pUser);
+
+   // Releases pUser, called by resampler_close_source(). May be NULL.
+   void (*Pclose)(void* pUser);
+
+   void* pUser;
+};
+
+// Receives the scanlines of an 8-bit image with num_channels interleaved samples per pixel, top to bottom.
+struct Resampler_Row_Sink
+{
+   int width, height, num_channels;
+
+   // Writes the next scanline (width * num_channels samples). Returns false on write errors.
+   bool (*Pwrite_row)(const unsigned char* Psrc, void* pUser);
+
+   // Float sinks set this instead of Pwrite_row: Resampler_T::stream() then passes get_line()'s samples, converted to
+   // float but not quantized. NULL for 8-bit sinks.
+   bool (*Pwrite_float_row)(const float* Psrc, void* pUser);
+
+   // Flushes and releases pUser, called by resampler_close_sink(). Returns false if anything couldn't be written.
+   // May be NULL.
+   bool (*Pclose)(void* pUser);
+
+   void* pUser;
+};
+
+// File sources, which keep a single scanline of the file in memory:
+// TGA - Uncompressed true color (24/32 bpp) and grayscale (8 bpp) images. Bottom up images are read by seeking to
+//    each scanline, backwards from the end of the file.
+// PNM - Binary PGM and PPM (P5/P6) with a maxval of up to 255, rescaled to [0, 255].
+// Return false if the file can't be opened or isn't in a supported format, src is left closed.
+bool resampler_open_tga_source(Resampler_Row_Source& src, const char* Pfilename);
+bool resampler_open_pnm_source(Resampler_Row_Source& src, const char* Pfilename);
+
+// Opens Pfilename with whichever of the file sources supports it.
+bool resampler_open_file_source(Resampler_Row_Source& src, const char* Pfilename);
+
+void resampler_close_source(Resampler_Row_Source& src);
+
+// File sinks, which write each scanline as soon as they receive it:
+// TGA - Uncompressed and top down, laid out like stbi_write_tga()'s: 1 and 2 channel images are written as gray RGB,
+//    2 and 4 channel images with alpha. width and height must be <= 65535.
+// PNM - Binary PGM (1 channel) or PPM (3 channels).
+// Return false if the file can't be created or the image can't be stored in the format.
+bool resampler_open_tga_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels);
+bool resampler_open_pnm_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels);
+
+// PNG - 8-bit gray, gray + alpha, RGB or RGBA, written with a streaming deflate encoder tuned for speed rather than
+//    size: level 0 stores the scanlines unfiltered and uncompressed, levels 1 to 9 search up to 1 << (level - 1)
+//    earlier matches at each byte and code them with the fixed Huffman codes (so incompressible scanlines grow by up to
+//    1/8). Levels 1 to 5 filter every scanline with the Paeth filter, higher levels pick each scanline's filter with the
+//    usual minimum sum of absolute values test. Implemented in resampler_png.cpp.
+bool resampler_open_png_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels, int level = 1);
+
+// Raw float - Headerless native endian floats, planar: all the scanlines of channel 0, then of channel 1 and so on.
+//    Each scanline's samples are written to their planes right away, by seeking.
+bool resampler_open_raw_float_sink(Resampler_Row_Sink& dst, const char* Pfilename, int width, int height, int num_channels);
+
+// Memory sinks, which copy each scanline to Pdst + y * pitch (pitch in bytes for the 8-bit sink, floats otherwise).
+bool resampler_open_memory_sink(Resampler_Row_Sink& dst, unsigned char* Pdst, size_t pitch, int width, int height, int num_channels);
+bool resampler_open_float_memory_sink(Resampler_Row_Sink& dst, float* Pdst, size_t pitch, int width, int height, int num_channels);
+
+// Queues the scanlines written to dst, up to max_queued_rows of them, and writes them to target on a thread of its
+// own, so encoding or writing the finished scanlines overlaps with resampling the next ones. dst takes over target
+// (target is cleared): closing dst waits for the queue to drain, then closes target.
+// Write errors of target make the next write to dst fail.
+bool resampler_open_async_sink(Resampler_Row_Sink& dst, Resampler_Row_Sink& target, int max_queued_rows = 16);
+
+// Returns false if the sink failed to write anything, including on close.
+bool resampler_close_sink(Resampler_Row_Sink& dst);
+
+#endif // __RESAMPLER_STREAM_H__
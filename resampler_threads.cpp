@@ -0,0 +1,350 @@
+// resampler_threads.cpp, Thread pool and row queue used by the multithreaded resampler entry points.
+// See unlicense at the bottom of resampler.h, or at http://unlicense.org/
+#include <cstdlib>
+#include "resampler_threads.h"
+
+Resampler_Thread_Pool::Resampler_Thread_Pool(int num_threads) :
+   m_Pfunc(NULL),
+   m_pData(NULL),
+   m_num_tasks(0),
+   m_next_task(0),
+   m_num_busy(0),
+   m_batch(0),
+   m_exit(false)
+{
+   if (num_threads <= 0)
+      num_threads = (int)std::thread::hardware_concurrency();
+
+   for (int i = 1; i < num_threads; i++)
+      m_threads.push_back(std::thread(&Resampler_Thread_Pool::worker_thread, this));
+}
+
+Resampler_Thread_Pool::~Resampler_Thread_Pool()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_exit = true;
+   }
+   m_work_cond.notify_all();
+
+   for (size_t i = 0; i < m_threads.size(); i++)
+      m_threads[i].join();
+}
+
+void Resampler_Thread_Pool::execute_tasks()
+{
+   for ( ; ; )
+   {
+      const int task_index = m_next_task.fetch_add(1);
+      if (task_index >= m_num_tasks)
+         break;
+
+      m_Pfunc(task_index, m_pData);
+   }
+}
+
+void Resampler_Thread_Pool::worker_thread()
+{
+   unsigned int last_batch = 0;
+
+   for ( ; ; )
+   {
+      {
+         std::unique_lock<std::mutex> lock(m_mutex);
+         while ((!m_exit) && (m_batch == last_batch))
+            m_work_cond.wait(lock);
+
+         if (m_exit)
+            return;
+
+         last_batch = m_batch;
+         m_num_busy++;
+      }
+
+      execute_tasks();
+
+      {
+         std::lock_guard<std::mutex> lock(m_mutex);
+         if (--m_num_busy == 0)
+            m_done_cond.notify_all();
+      }
+   }
+}
+
+void Resampler_Thread_Pool::run(int num_tasks, Task_Func Pfunc, void* pData)
+{
+   if (num_tasks <= 0)
+      return;
+
+   // Serialize batches submitted from different threads.
+   std::lock_guard<std::mutex> run_lock(m_run_mutex);
+
+   if ((m_threads.empty()) || (num_tasks == 1))
+   {
+      for (int i = 0; i < num_tasks; i++)
+         Pfunc(i, pData);
+      return;
+   }
+
+   {
+      // Workers which woke up late for the previous batch may still be looking at its (exhausted) task counter.
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while (m_num_busy)
+         m_done_cond.wait(lock);
+
+      m_Pfunc = Pfunc;
+      m_pData = pData;
+      m_num_tasks = num_tasks;
+      m_next_task = 0;
+      m_batch++;
+   }
+   m_work_cond.notify_all();
+
+   execute_tasks();
+
+   // Wait for workers still executing tasks of this batch. Workers which wake up after the
+   // task counter ran out find nothing to do, so don't wait for them to start.
+   std::unique_lock<std::mutex> lock(m_mutex);
+   while (m_num_busy)
+      m_done_cond.wait(lock);
+}
+
+// The pool and deque of the calling thread, if it's running tasks.
+static thread_local const Resampler_Work_Pool* t_Pwork_pool;
+static thread_local int t_worker_index;
+
+Resampler_Work_Pool::Resampler_Work_Pool(int num_threads) :
+   m_num_queued(0),
+   m_num_pending(0),
+   m_exit(false)
+{
+   if (num_threads <= 0)
+      num_threads = (int)std::thread::hardware_concurrency();
+   if (num_threads <= 0)
+      num_threads = 1;
+
+   for (int i = 0; i < num_threads; i++)
+      m_workers.push_back(new Worker);
+
+   for (int i = 1; i < num_threads; i++)
+      m_threads.push_back(std::thread(&Resampler_Work_Pool::worker_thread, this, i));
+}
+
+Resampler_Work_Pool::~Resampler_Work_Pool()
+{
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_exit = true;
+   }
+   m_cond.notify_all();
+
+   for (size_t i = 0; i < m_threads.size(); i++)
+      m_threads[i].join();
+
+   for (size_t i = 0; i < m_workers.size(); i++)
+      delete m_workers[i];
+}
+
+int Resampler_Work_Pool::get_worker_index() const
+{
+   return (t_Pwork_pool == this) ? t_worker_index : 0;
+}
+
+void Resampler_Work_Pool::spawn(Task_Func Pfunc, void* pData, int index)
+{
+   Task task;
+   task.Pfunc = Pfunc;
+   task.pData = pData;
+   task.index = index;
+
+   Worker& worker = *m_workers[get_worker_index()];
+   {
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      worker.tasks.push_back(task);
+   }
+
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_num_queued++;
+      m_num_pending++;
+   }
+   m_cond.notify_one();
+}
+
+// Runs the newest task of the thread's own deque, or else steals the oldest task of another deque.
+// Returns false if all the deques are empty.
+bool Resampler_Work_Pool::run_task(int worker_index)
+{
+   const int num_workers = (int)m_workers.size();
+
+   Task task;
+   bool found = false;
+
+   for (int i = 0; (i < num_workers) && (!found); i++)
+   {
+      Worker& worker = *m_workers[(worker_index + i) % num_workers];
+
+      std::lock_guard<std::mutex> lock(worker.mutex);
+      if (worker.tasks.empty())
+         continue;
+
+      if (!i)
+      {
+         task = worker.tasks.back();
+         worker.tasks.pop_back();
+      }
+      else
+      {
+         task = worker.tasks.front();
+         worker.tasks.pop_front();
+      }
+      found = true;
+   }
+
+   if (!found)
+      return false;
+
+   m_num_queued--;
+
+   task.Pfunc(task.pData, task.index);
+
+   bool done;
+   {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      done = (--m_num_pending == 0);
+   }
+   if (done)
+      m_cond.notify_all();
+
+   return true;
+}
+
+void Resampler_Work_Pool::worker_thread(int worker_index)
+{
+   t_Pwork_pool = this;
+   t_worker_index = worker_index;
+
+   for ( ; ; )
+   {
+      if (run_task(worker_index))
+         continue;
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      while ((!m_exit) && (!m_num_queued))
+         m_cond.wait(lock);
+
+      if (m_exit)
+         return;
+   }
+}
+
+void Resampler_Work_Pool::wait()
+{
+   const Resampler_Work_Pool* Pprev_pool = t_Pwork_pool;
+   const int prev_worker_index = t_worker_index;
+
+   t_Pwork_pool = this;
+   t_worker_index = 0;
+
+   for ( ; ; )
+   {
+      if (run_task(0))
+         continue;
+
+      std::unique_lock<std::mutex> lock(m_mutex);
+      if (!m_num_pending)
+         break;
+
+      while ((m_num_pending) && (!m_num_queued))
+         m_cond.wait(lock);
+   }
+
+   t_Pwork_pool = Pprev_pool;
+   t_worker_index = prev_worker_index;
+}
+
+Resampler_Row_Queue::Resampler_Row_Queue() :
+   m_Prows(NULL),
+   m_row_size(0),
+   m_num_rows(0),
+   m_num_pushed(0),
+   m_num_popped(0),
+   m_finished(false),
+   m_cancelled(false)
+{
+}
+
+Resampler_Row_Queue::~Resampler_Row_Queue()
+{
+   free(m_Prows);
+}
+
+bool Resampler_Row_Queue::init(int num_rows, size_t row_size)
+{
+   free(m_Prows);
+
+   m_Prows = (unsigned char*)malloc((size_t)num_rows * row_size);
+   m_row_size = row_size;
+   m_num_rows = m_Prows ? num_rows : 0;
+   m_num_pushed = 0;
+   m_num_popped = 0;
+   m_finished = false;
+   m_cancelled = false;
+
+   return m_Prows != NULL;
+}
+
+void* Resampler_Row_Queue::get_write_row()
+{
+   const unsigned int num_pushed = m_num_pushed.load(std::memory_order_relaxed);
+
+   while (num_pushed - m_num_popped.load(std::memory_order_acquire) == m_num_rows)
+   {
+      if (is_cancelled())
+         return NULL;
+      std::this_thread::yield();
+   }
+
+   if (is_cancelled())
+      return NULL;
+
+   return m_Prows + (num_pushed % m_num_rows) * m_row_size;
+}
+
+void Resampler_Row_Queue::push()
+{
+   m_num_pushed.store(m_num_pushed.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Resampler_Row_Queue::finish()
+{
+   m_finished.store(true, std::memory_order_release);
+}
+
+const void* Resampler_Row_Queue::get_read_row()
+{
+   const unsigned int num_popped = m_num_popped.load(std::memory_order_relaxed);
+
+   while (m_num_pushed.load(std::memory_order_acquire) == num_popped)
+   {
+      // Rows pushed before finish() are visible once it is, check for them once more.
+      if ((is_cancelled()) || ((m_finished.load(std::memory_order_acquire)) && (m_num_pushed.load(std::memory_order_acquire) == num_popped)))
+         return NULL;
+      std::this_thread::yield();
+   }
+
+   if (is_cancelled())
+      return NULL;
+
+   return m_Prows + (num_popped % m_num_rows) * m_row_size;
+}
+
+void Resampler_Row_Queue::pop()
+{
+   m_num_popped.store(m_num_popped.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+void Resampler_Row_Queue::cancel()
+{
+   m_cancelled.store(true, std::memory_order_release);
+}
@@ -0,0 +1,159 @@
+// resampler_threads.h, Thread pool and row queue used by the multithreaded resampler entry points.
+// See unlicense.org text at the bottom of resampler.h
+#ifndef __RESAMPLER_THREADS_H__
+#define __RESAMPLER_THREADS_H__
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <vector>
+#include <deque>
+
+// A fixed set of worker threads which execute batches of independent tasks.
+// One pool can be shared by any number of resample_image() calls, but only one batch runs at a time.
+class Resampler_Thread_Pool
+{
+public:
+   typedef void (*Task_Func)(int task_index, void* pData);
+
+   // num_threads - Total number of threads working on each batch, including the thread calling run().
+   // 0 uses one thread per hardware thread.
+   explicit Resampler_Thread_Pool(int num_threads = 0);
+   ~Resampler_Thread_Pool();
+
+   int get_num_threads() const { return (int)m_threads.size() + 1; }
+
+   // Calls Pfunc(i, pData) for every i in [0, num_tasks), spread across the pool's threads and the calling thread.
+   // Returns once all tasks have completed.
+   void run(int num_tasks, Task_Func Pfunc, void* pData);
+
+private:
+   Resampler_Thread_Pool(const Resampler_Thread_Pool&);
+   Resampler_Thread_Pool& operator= (const Resampler_Thread_Pool&);
+
+   std::vector<std::thread> m_threads;
+
+   std::mutex m_run_mutex;
+
+   std::mutex m_mutex;
+   std::condition_variable m_work_cond;
+   std::condition_variable m_done_cond;
+
+   // The current batch.
+   Task_Func m_Pfunc;
+   void* m_pData;
+   int m_num_tasks;
+   std::atomic<int> m_next_task;
+   int m_num_busy;
+   unsigned int m_batch;
+   bool m_exit;
+
+   void worker_thread();
+   void execute_tasks();
+};
+
+// A fixed set of worker threads executing tasks which spawn more tasks as they run, so dependent work is queued as soon
+// as it's ready instead of in batches. Each thread queues the tasks it spawns in a deque of its own and runs the newest
+// one first (its data is likely still in the cache), threads which run out of tasks steal the oldest task of another
+// thread's deque. See Resampler_Pyramid. Only one thread at a time may call wait().
+class Resampler_Work_Pool
+{
+public:
+   typedef void (*Task_Func)(void* pData, int index);
+
+   // num_threads - Total number of threads running tasks, including the thread calling wait().
+   // 0 uses one thread per hardware thread.
+   explicit Resampler_Work_Pool(int num_threads = 0);
+   ~Resampler_Work_Pool();
+
+   int get_num_threads() const { return (int)m_workers.size(); }
+
+   // Queues a call to Pfunc(pData, index). Called by tasks, or by the thread calling wait() before it does.
+   void spawn(Task_Func Pfunc, void* pData, int index);
+
+   // Runs tasks on the calling thread too, until all the spawned tasks (and the tasks they spawn) have completed.
+   void wait();
+
+private:
+   Resampler_Work_Pool(const Resampler_Work_Pool&);
+   Resampler_Work_Pool& operator= (const Resampler_Work_Pool&);
+
+   struct Task
+   {
+      Task_Func Pfunc;
+      void* pData;
+      int index;
+   };
+
+   // The deque of a thread. Worker 0 is the thread calling wait().
+   struct Worker
+   {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+   };
+
+   std::vector<Worker*> m_workers;
+   std::vector<std::thread> m_threads;
+
+   std::mutex m_mutex;
+   std::condition_variable m_cond;
+
+   // Tasks in the deques, only raised with m_mutex held so idle threads can't miss new tasks.
+   std::atomic<int> m_num_queued;
+
+   // Tasks spawned but not completed, guarded by m_mutex.
+   int m_num_pending;
+   bool m_exit;
+
+   void worker_thread(int worker_index);
+   bool run_task(int worker_index);
+   int get_worker_index() const;
+};
+
+// A bounded, lock-free queue of fixed size rows between one producer thread and one consumer thread, see
+// Resampler_T::stream_pipelined(). Rows are written and read in place. A side which finds the queue full (or empty)
+// yields its time slice until the other side catches up, so each stage of a pipeline should have a core of its own.
+class Resampler_Row_Queue
+{
+public:
+   Resampler_Row_Queue();
+   ~Resampler_Row_Queue();
+
+   // Allocates num_rows rows of row_size bytes and empties the queue. Returns false on out of memory.
+   bool init(int num_rows, size_t row_size);
+
+   // Producer: returns the next free row, waiting for the consumer if the queue is full, then push() queues it.
+   // NULL once the queue is cancelled.
+   void* get_write_row();
+   void push();
+
+   // Producer: no more rows will be pushed.
+   void finish();
+
+   // Consumer: returns the oldest queued row, waiting for the producer if the queue is empty, then pop() frees it.
+   // NULL once the queue is finished and empty, or cancelled.
+   const void* get_read_row();
+   void pop();
+
+   // Either side: stops the other side from waiting any longer, on errors.
+   void cancel();
+   bool is_cancelled() const { return m_cancelled.load(std::memory_order_acquire); }
+
+private:
+   Resampler_Row_Queue(const Resampler_Row_Queue&);
+   Resampler_Row_Queue& operator= (const Resampler_Row_Queue&);
+
+   unsigned char* m_Prows;
+   size_t m_row_size;
+   unsigned int m_num_rows;
+
+   // Rows ever pushed and popped, only written by the producer and by the consumer respectively.
+   std::atomic<unsigned int> m_num_pushed;
+   std::atomic<unsigned int> m_num_popped;
+
+   std::atomic<bool> m_finished;
+   std::atomic<bool> m_cancelled;
+};
+
+#endif // __RESAMPLER_THREADS_H__
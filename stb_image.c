@@ -14,11 +14,13 @@
       writes BMP,TGA (define STBI_NO_WRITE to remove code)
       decoded from memory or through stdio FILE (define STBI_NO_STDIO to remove code)
       supports installable dequantizing-IDCT, YCbCr-to-RGB conversion (define STBI_SIMD)
+      JPEG decode-time downscaling (1/2, 1/4, 1/8) and row by row output (stbi_jpeg_load_rows)
 
    TODO:
       stbi_info_*
 
    history:
+      1.19   scaled IDCT; row callback JPEG decoding; stbi_jpeg_info
       1.18   fix a threading bug (local mutable static)
       1.17   support interlaced PNG
       1.16   major bugfix - convert_format converted one too many pixels
@@ -256,6 +258,27 @@ extern int      stbi_jpeg_info            (char const *filename,     int *x, int
 extern int      stbi_jpeg_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
 #endif
 
+// row by row JPEG decoding, optionally downscaled while decoding:
+//    every 8x8 block is inverse transformed straight to (8 >> scale_log2)^2 pixels, with scale_log2 0 to 3
+//    (full size, 1/2, 1/4 or 1/8 of the width and height, rounded up), which skips most of the IDCT,
+//    upsampling and color conversion work of big downscales. begin() gets the output size and the number of
+//    components of each row (req_comp, or the image's if 0) before the first row, then each row is passed to
+//    row() as soon as it's complete, top to bottom. Either callback returns 0 to abort the decode.
+//    Images coded as a single interleaved scan (the usual case) only keep two MCU rows of each component
+//    in memory. returns 1 on success, 0 on failure (see stbi_failure_reason)
+typedef struct
+{
+   int  (*begin)(void *user, int x, int y, int comp);
+   int  (*row)(void *user, stbi_uc const *row);
+   void  *user;
+} stbi_row_callbacks;
+
+extern int      stbi_jpeg_load_rows_from_memory(stbi_uc const *buffer, int len, int scale_log2, int req_comp, stbi_row_callbacks const *callbacks);
+#ifndef STBI_NO_STDIO
+extern int      stbi_jpeg_load_rows            (char const *filename,     int scale_log2, int req_comp, stbi_row_callbacks const *callbacks);
+extern int      stbi_jpeg_load_rows_from_file  (FILE *f,                  int scale_log2, int req_comp, stbi_row_callbacks const *callbacks);
+#endif
+
 // is it a png?
 extern int      stbi_png_test_memory      (stbi_uc const *buffer, int len);
 extern stbi_uc *stbi_png_load_from_memory (stbi_uc const *buffer, int len, int *x, int *y, int *comp, int req_comp);
@@ -873,6 +896,20 @@ typedef struct
    int    delta[17];   // old 'firstsymbol' - old 'firstcode'
 } huffman;
 
+typedef uint8 *(*resample_row_func)(uint8 *out, uint8 *in0, uint8 *in1,
+                                    int w, int hs);
+
+typedef struct
+{
+   resample_row_func resample;
+   uint8 *line0,*line1;
+   int hs,vs;   // expansion factor in each axis
+   int w_lores; // horizontal pixels pre-expansion
+   int h_lores; // vertical pixels pre-expansion
+   int ystep;   // how far through vertical expansion we are
+   int ypos;    // which pre-expansion row we're on
+} stbi_resample;
+
 typedef struct
 {
    #if STBI_SIMD
@@ -897,7 +934,7 @@ typedef struct
       int hd,ha;
       int dc_pred;
 
-      int x,y,w2,h2;
+      int x,y,w2,h2;   // h2 rows of w2 pixels are allocated: the whole component, or a ring of 2 MCU rows
       uint8 *data;
       void *raw_data;
       uint8 *linebuf;
@@ -910,6 +947,18 @@ typedef struct
 
    int scan_n, order[4];
    int restart_interval, todo;
+
+// decode-time downscaling: each 8x8 block becomes (8 >> scale_log2)^2 pixels of an out_x*out_y image
+   int scale_log2;
+   int out_x, out_y;
+
+// output: upsampling and color conversion state, and for row by row decoding the callbacks
+   int out_n, decode_n;
+   stbi_resample res_comp[4];
+   int rows_out;
+   stbi_row_callbacks const *rows;
+   int emit;        // rows are passed on while the scan is being decoded
+   uint8 *row_buf;
 } jpeg;
 
 static int build_huffman(huffman *h, int *count)
@@ -1260,6 +1309,88 @@ extern void stbi_install_idct(stbi_idct_8x8 func)
 }
 #endif
 
+// reduced IDCTs for decode-time downscaling: the N*N lowest frequencies of the block are inverse
+// transformed with an N point IDCT, which gives the block's pixels averaged down to N*N
+#define IDCT_4(s0,s1,s2,s3)                    \
+   int a0,a1,o0,o1;                            \
+   a0 = (s0+s2) * f2f(0.707106781f);           \
+   a1 = (s0-s2) * f2f(0.707106781f);           \
+   o0 = s1*f2f(0.923879533f) + s3*f2f(0.382683432f); \
+   o1 = s1*f2f(0.382683432f) - s3*f2f(0.923879533f);
+
+static void idct_block_4x4(uint8 *out, int out_stride, short data[64], uint8 *dq)
+{
+   int i,val[16],*v=val;
+   short *d = data;
+
+   for (i=0; i < 4; ++i,++d,++dq,++v) {
+      IDCT_4(d[0]*dq[0],d[8]*dq[8],d[16]*dq[16],d[24]*dq[24])
+      // scaled up by 1<<12; bring them back down, keeping 2 extra bits of precision
+      a0 += 512; a1 += 512;
+      v[ 0] = (a0+o0) >> 10;
+      v[12] = (a0-o0) >> 10;
+      v[ 4] = (a1+o1) >> 10;
+      v[ 8] = (a1-o1) >> 10;
+   }
+
+   for (i=0, v=val; i < 4; ++i,v+=4,out+=out_stride) {
+      IDCT_4(v[0],v[1],v[2],v[3])
+      // 1<<12 from the constants, 1<<2 from the first pass and the 1/4 of the 2D IDCT: 1<<16 total
+      a0 += 32768; a1 += 32768;
+      out[0] = clamp((a0+o0) >> 16);
+      out[3] = clamp((a0-o0) >> 16);
+      out[1] = clamp((a1+o1) >> 16);
+      out[2] = clamp((a1-o1) >> 16);
+   }
+}
+
+static void idct_block_2x2(uint8 *out, int out_stride, short data[64], uint8 *dq)
+{
+   int a0,a1,v[4];
+
+   a0 = (data[0]*dq[0] + data[8]*dq[8]) * f2f(0.707106781f) + 512;
+   a1 = (data[0]*dq[0] - data[8]*dq[8]) * f2f(0.707106781f) + 512;
+   v[0] = a0 >> 10;
+   v[2] = a1 >> 10;
+   a0 = (data[1]*dq[1] + data[9]*dq[9]) * f2f(0.707106781f) + 512;
+   a1 = (data[1]*dq[1] - data[9]*dq[9]) * f2f(0.707106781f) + 512;
+   v[1] = a0 >> 10;
+   v[3] = a1 >> 10;
+
+   out[0]            = clamp(((v[0]+v[1]) * f2f(0.707106781f) + 32768) >> 16);
+   out[1]            = clamp(((v[0]-v[1]) * f2f(0.707106781f) + 32768) >> 16);
+   out[out_stride]   = clamp(((v[2]+v[3]) * f2f(0.707106781f) + 32768) >> 16);
+   out[out_stride+1] = clamp(((v[2]-v[3]) * f2f(0.707106781f) + 32768) >> 16);
+}
+
+// the average of the block is its DC term / 8
+static void idct_block_1x1(uint8 *out, short data[64], uint8 *dq)
+{
+   out[0] = clamp((data[0]*dq[0] + 4) >> 3);
+}
+
+// inverse transform block (bx,by) of component n into its plane
+static void idct_jpeg_block(jpeg *z, int n, int bx, int by, short data[64])
+{
+   int bs = 8 >> z->scale_log2;
+   uint8 *out = z->img_comp[n].data + z->img_comp[n].w2 * ((by * bs) % z->img_comp[n].h2) + bx * bs;
+   switch (z->scale_log2) {
+      case 0:
+         #if STBI_SIMD
+         stbi_idct_installed(out, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
+         #else
+         idct_block(out, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
+         #endif
+         break;
+      case 1: idct_block_4x4(out, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]); break;
+      case 2: idct_block_2x2(out, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]); break;
+      default: idct_block_1x1(out, data, z->dequant[z->img_comp[n].tq]); break;
+   }
+}
+
+static int emit_jpeg_rows(jpeg *z, int end_y);
+static int jpeg_rows_ready(jpeg *z, int mcu_rows);
+
 #define MARKER_none  0xff
 // if there's a pending marker from the entropy stream, return that
 // otherwise, fetch from the stream and get a marker. if there's no
@@ -1312,11 +1443,7 @@ static int parse_entropy_coded_data(jpeg *z)
       for (j=0; j < h; ++j) {
          for (i=0; i < w; ++i) {
             if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
-            #if STBI_SIMD
-            stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
-            #else
-            idct_block(z->img_comp[n].data+z->img_comp[n].w2*j*8+i*8, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
-            #endif
+            idct_jpeg_block(z, n, i, j, data);
             // every data block is an MCU, so countdown the restart interval
             if (--z->todo <= 0) {
                if (z->code_bits < 24) grow_buffer_unsafe(z);
@@ -1326,6 +1453,12 @@ static int parse_entropy_coded_data(jpeg *z)
                reset(z);
             }
          }
+         // a single component image isn't upsampled, so every block row completes 8 >> scale_log2
+         // output rows (jpeg_rows_ready() counts MCU rows, which are v block rows here)
+         if (z->emit) {
+            int end_y = (j+1) * (8 >> z->scale_log2);
+            if (!emit_jpeg_rows(z, end_y < z->out_y ? end_y : z->out_y)) return 0;
+         }
       }
    } else { // interleaved!
       int i,j,k,x,y;
@@ -1339,14 +1472,10 @@ static int parse_entropy_coded_data(jpeg *z)
                // by the basic H and V specified for the component
                for (y=0; y < z->img_comp[n].v; ++y) {
                   for (x=0; x < z->img_comp[n].h; ++x) {
-                     int x2 = (i*z->img_comp[n].h + x)*8;
-                     int y2 = (j*z->img_comp[n].v + y)*8;
+                     int x2 = i*z->img_comp[n].h + x;
+                     int y2 = j*z->img_comp[n].v + y;
                      if (!decode_block(z, data, z->huff_dc+z->img_comp[n].hd, z->huff_ac+z->img_comp[n].ha, n)) return 0;
-                     #if STBI_SIMD
-                     stbi_idct_installed(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant2[z->img_comp[n].tq]);
-                     #else
-                     idct_block(z->img_comp[n].data+z->img_comp[n].w2*y2+x2, z->img_comp[n].w2, data, z->dequant[z->img_comp[n].tq]);
-                     #endif
+                     idct_jpeg_block(z, n, x2, y2, data);
                   }
                }
             }
@@ -1360,6 +1489,7 @@ static int parse_entropy_coded_data(jpeg *z)
                reset(z);
             }
          }
+         if (z->emit && !emit_jpeg_rows(z, jpeg_rows_ready(z, j+1))) return 0;
       }
    }
    return 1;
@@ -1459,6 +1589,33 @@ static int process_scan_header(jpeg *z)
    return 1;
 }
 
+// ring - only allocate 2 MCU rows of each component, for images decoded in a single interleaved scan
+static int alloc_jpeg_planes(jpeg *z, int ring)
+{
+   int i, bs = 8 >> z->scale_log2;
+   for (i=0; i < z->s.img_n; ++i) {
+      // to simplify generation, we'll allocate enough memory to decode
+      // the bogus oversized data from using interleaved MCUs and their
+      // big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
+      // discard the extra data until colorspace conversion
+      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * bs;
+      z->img_comp[i].h2 = (ring ? 2 : z->img_mcu_y) * z->img_comp[i].v * bs;
+      z->img_comp[i].raw_data = malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
+      if (z->img_comp[i].raw_data == NULL) {
+         for(--i; i >= 0; --i) {
+            free(z->img_comp[i].raw_data);
+            z->img_comp[i].data = NULL;
+         }
+         return e("outofmem", "Out of memory");
+      }
+      // align blocks for installable-idct using mmx/sse
+      z->img_comp[i].data = (uint8*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
+      z->img_comp[i].linebuf = NULL;
+   }
+
+   return 1;
+}
+
 static int process_frame_header(jpeg *z, int scan)
 {
    stbi *s = &z->s;
@@ -1509,26 +1666,14 @@ static int process_frame_header(jpeg *z, int scan)
       // number of effective pixels (e.g. for non-interleaved MCU)
       z->img_comp[i].x = (s->img_x * z->img_comp[i].h + h_max-1) / h_max;
       z->img_comp[i].y = (s->img_y * z->img_comp[i].v + v_max-1) / v_max;
-      // to simplify generation, we'll allocate enough memory to decode
-      // the bogus oversized data from using interleaved MCUs and their
-      // big blocks (e.g. a 16x16 iMCU on an image of width 33); we won't
-      // discard the extra data until colorspace conversion
-      z->img_comp[i].w2 = z->img_mcu_x * z->img_comp[i].h * 8;
-      z->img_comp[i].h2 = z->img_mcu_y * z->img_comp[i].v * 8;
-      z->img_comp[i].raw_data = malloc(z->img_comp[i].w2 * z->img_comp[i].h2+15);
-      if (z->img_comp[i].raw_data == NULL) {
-         for(--i; i >= 0; --i) {
-            free(z->img_comp[i].raw_data);
-            z->img_comp[i].data = NULL;
-         }
-         return e("outofmem", "Out of memory");
-      }
-      // align blocks for installable-idct using mmx/sse
-      z->img_comp[i].data = (uint8*) (((size_t) z->img_comp[i].raw_data + 15) & ~15);
-      z->img_comp[i].linebuf = NULL;
    }
 
-   return 1;
+   z->out_x = (s->img_x + (1 << z->scale_log2)-1) >> z->scale_log2;
+   z->out_y = (s->img_y + (1 << z->scale_log2)-1) >> z->scale_log2;
+
+   // row by row decoding allocates the planes once it knows how the scans are laid out
+   if (z->rows) return 1;
+   return alloc_jpeg_planes(z, 0);
 }
 
 // use comparisons since in some cases we handle more than one case (e.g. SOF)
@@ -1559,15 +1704,32 @@ static int decode_jpeg_header(jpeg *z, int scan)
    return 1;
 }
 
-static int decode_jpeg_image(jpeg *j)
+static int start_jpeg_output(jpeg *z, int req_comp);
+
+static int decode_jpeg_image(jpeg *j, int req_comp)
 {
    int m;
    j->restart_interval = 0;
    if (!decode_jpeg_header(j, SCAN_load)) return 0;
+   if (j->rows) {
+      j->out_n = req_comp ? req_comp : j->s.img_n;
+      j->row_buf = (uint8 *) malloc(j->out_n * j->out_x + 1);
+      if (!j->row_buf) return e("outofmem", "Out of memory");
+      if (!j->rows->begin(j->rows->user, j->out_x, j->out_y, j->out_n)) return e("aborted", "Decode aborted");
+   }
    m = get_marker(j);
    while (!EOI(m)) {
       if (SOS(m)) {
          if (!process_scan_header(j)) return 0;
+         if (j->rows && !j->img_comp[0].data) {
+            // a scan with every component can be passed on as it's decoded, the planes
+            // then only need to hold the MCU rows which haven't been output yet
+            int ring = j->scan_n == j->s.img_n;
+            if (!alloc_jpeg_planes(j, ring)) return 0;
+            if (!start_jpeg_output(j, req_comp)) return 0;
+            j->emit = ring;
+         } else if (j->emit)
+            return e("multiple scans", "JPEG format not supported: rows of multiple scans");
          if (!parse_entropy_coded_data(j)) return 0;
       } else {
          if (!process_marker(j, m)) return 0;
@@ -1579,9 +1741,6 @@ static int decode_jpeg_image(jpeg *j)
 
 // static jfif-centered resampling (across block boundaries)
 
-typedef uint8 *(*resample_row_func)(uint8 *out, uint8 *in0, uint8 *in1,
-                                    int w, int hs);
-
 #define div4(x) ((uint8) ((x) >> 2))
 
 static uint8 *resample_row_1(uint8 *out, uint8 *in_near, uint8 *in_far, int w, int hs)
@@ -1709,114 +1868,173 @@ static void cleanup_jpeg(jpeg *j)
    }
 }
 
-typedef struct
+// set up upsampling and color conversion, once the component planes are allocated
+static int start_jpeg_output(jpeg *z, int req_comp)
 {
-   resample_row_func resample;
-   uint8 *line0,*line1;
-   int hs,vs;   // expansion factor in each axis
-   int w_lores; // horizontal pixels pre-expansion
-   int ystep;   // how far through vertical expansion we are
-   int ypos;    // which pre-expansion row we're on
-} stbi_resample;
+   int k;
+
+   // determine actual number of components to generate
+   z->out_n = req_comp ? req_comp : z->s.img_n;
+
+   if (z->s.img_n == 3 && z->out_n < 3)
+      z->decode_n = 1;
+   else
+      z->decode_n = z->s.img_n;
+
+   for (k=0; k < z->decode_n; ++k) {
+      stbi_resample *r = &z->res_comp[k];
+
+      // allocate line buffer big enough for upsampling off the edges
+      // with upsample factor of 4
+      z->img_comp[k].linebuf = (uint8 *) malloc(z->out_x + 3);
+      if (!z->img_comp[k].linebuf) return e("outofmem", "Out of memory");
+
+      r->hs      = z->img_h_max / z->img_comp[k].h;
+      r->vs      = z->img_v_max / z->img_comp[k].v;
+      r->ystep   = r->vs >> 1;
+      r->w_lores = (z->out_x + r->hs-1) / r->hs;
+      r->h_lores = (z->img_comp[k].y + (1 << z->scale_log2)-1) >> z->scale_log2;
+      r->ypos    = 0;
+      r->line0   = r->line1 = z->img_comp[k].data;
+
+      if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
+      else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
+      else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
+      else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
+      else                               r->resample = resample_row_generic;
+   }
+
+   z->rows_out = 0;
+   return 1;
+}
+
+// resample and color-convert the next output row
+static void output_jpeg_row(jpeg *z, uint8 *out)
+{
+   int k, n = z->out_n;
+   uint i;
+   uint8 *coutput[4];
+
+   for (k=0; k < z->decode_n; ++k) {
+      stbi_resample *r = &z->res_comp[k];
+      int y_bot = r->ystep >= (r->vs >> 1);
+      coutput[k] = r->resample(z->img_comp[k].linebuf,
+                               y_bot ? r->line1 : r->line0,
+                               y_bot ? r->line0 : r->line1,
+                               r->w_lores, r->hs);
+      if (++r->ystep >= r->vs) {
+         r->ystep = 0;
+         r->line0 = r->line1;
+         if (++r->ypos < r->h_lores) {
+            r->line1 += z->img_comp[k].w2;
+            // the planes of row by row decoding are rings
+            if (r->line1 == z->img_comp[k].data + z->img_comp[k].w2 * z->img_comp[k].h2)
+               r->line1 = z->img_comp[k].data;
+         }
+      }
+   }
+   if (n >= 3) {
+      uint8 *y = coutput[0];
+      if (z->s.img_n == 3) {
+         #if STBI_SIMD
+         stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->out_x, n);
+         #else
+         YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->out_x, n);
+         #endif
+      } else
+         for (i=0; i < (uint) z->out_x; ++i) {
+            out[0] = out[1] = out[2] = y[i];
+            out[3] = 255; // not used if n==3
+            out += n;
+         }
+   } else {
+      uint8 *y = coutput[0];
+      if (n == 1)
+         for (i=0; i < (uint) z->out_x; ++i) out[i] = y[i];
+      else
+         for (i=0; i < (uint) z->out_x; ++i) *out++ = y[i], *out++ = 255;
+   }
+   ++z->rows_out;
+}
+
+// number of output rows which only depend on the first mcu_rows MCU rows: rows upsampled vertically
+// by 2 also read the next row of their component
+static int jpeg_rows_ready(jpeg *z, int mcu_rows)
+{
+   int k, end_y = z->out_y;
+   if (mcu_rows >= z->img_mcu_y) return end_y;
+   for (k=0; k < z->decode_n; ++k) {
+      int rows = mcu_rows * z->img_comp[k].v * (8 >> z->scale_log2);
+      int vs = z->res_comp[k].vs;
+      rows = (vs == 2) ? rows * 2 - 1 : rows * vs;
+      if (rows < end_y) end_y = rows;
+   }
+   return end_y;
+}
+
+// pass the rows up to end_y on to the row callback
+static int emit_jpeg_rows(jpeg *z, int end_y)
+{
+   while (z->rows_out < end_y) {
+      output_jpeg_row(z, z->row_buf);
+      if (!z->rows->row(z->rows->user, z->row_buf)) return e("aborted", "Decode aborted");
+   }
+   return 1;
+}
 
 static uint8 *load_jpeg_image(jpeg *z, int *out_x, int *out_y, int *comp, int req_comp)
 {
-   int n, decode_n;
+   int j;
+   uint8 *output;
+
    // validate req_comp
    if (req_comp < 0 || req_comp > 4) return epuc("bad req_comp", "Internal error");
    z->s.img_n = 0;
+   z->scale_log2 = 0;
+   z->rows = NULL;
+   z->emit = 0;
+   z->row_buf = NULL;
 
    // load a jpeg image from whichever source
-   if (!decode_jpeg_image(z)) { cleanup_jpeg(z); return NULL; }
+   if (!decode_jpeg_image(z, req_comp)) { cleanup_jpeg(z); return NULL; }
 
-   // determine actual number of components to generate
-   n = req_comp ? req_comp : z->s.img_n;
+   if (!start_jpeg_output(z, req_comp)) { cleanup_jpeg(z); return NULL; }
 
-   if (z->s.img_n == 3 && n < 3)
-      decode_n = 1;
-   else
-      decode_n = z->s.img_n;
+   // can't error after this so, this is safe
+   output = (uint8 *) malloc(z->out_n * z->out_x * z->out_y + 1);
+   if (!output) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
 
-   // resample and color-convert
-   {
-      int k;
-      uint i,j;
-      uint8 *output;
-      uint8 *coutput[4];
-
-      stbi_resample res_comp[4];
-
-      for (k=0; k < decode_n; ++k) {
-         stbi_resample *r = &res_comp[k];
-
-         // allocate line buffer big enough for upsampling off the edges
-         // with upsample factor of 4
-         z->img_comp[k].linebuf = (uint8 *) malloc(z->s.img_x + 3);
-         if (!z->img_comp[k].linebuf) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
-
-         r->hs      = z->img_h_max / z->img_comp[k].h;
-         r->vs      = z->img_v_max / z->img_comp[k].v;
-         r->ystep   = r->vs >> 1;
-         r->w_lores = (z->s.img_x + r->hs-1) / r->hs;
-         r->ypos    = 0;
-         r->line0   = r->line1 = z->img_comp[k].data;
-
-         if      (r->hs == 1 && r->vs == 1) r->resample = resample_row_1;
-         else if (r->hs == 1 && r->vs == 2) r->resample = resample_row_v_2;
-         else if (r->hs == 2 && r->vs == 1) r->resample = resample_row_h_2;
-         else if (r->hs == 2 && r->vs == 2) r->resample = resample_row_hv_2;
-         else                               r->resample = resample_row_generic;
-      }
+   // now go ahead and resample
+   for (j=0; j < z->out_y; ++j)
+      output_jpeg_row(z, output + z->out_n * z->out_x * j);
 
-      // can't error after this so, this is safe
-      output = (uint8 *) malloc(n * z->s.img_x * z->s.img_y + 1);
-      if (!output) { cleanup_jpeg(z); return epuc("outofmem", "Out of memory"); }
-
-      // now go ahead and resample
-      for (j=0; j < z->s.img_y; ++j) {
-         uint8 *out = output + n * z->s.img_x * j;
-         for (k=0; k < decode_n; ++k) {
-            stbi_resample *r = &res_comp[k];
-            int y_bot = r->ystep >= (r->vs >> 1);
-            coutput[k] = r->resample(z->img_comp[k].linebuf,
-                                     y_bot ? r->line1 : r->line0,
-                                     y_bot ? r->line0 : r->line1,
-                                     r->w_lores, r->hs);
-            if (++r->ystep >= r->vs) {
-               r->ystep = 0;
-               r->line0 = r->line1;
-               if (++r->ypos < z->img_comp[k].y)
-                  r->line1 += z->img_comp[k].w2;
-            }
-         }
-         if (n >= 3) {
-            uint8 *y = coutput[0];
-            if (z->s.img_n == 3) {
-               #if STBI_SIMD
-               stbi_YCbCr_installed(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #else
-               YCbCr_to_RGB_row(out, y, coutput[1], coutput[2], z->s.img_x, n);
-               #endif
-            } else
-               for (i=0; i < z->s.img_x; ++i) {
-                  out[0] = out[1] = out[2] = y[i];
-                  out[3] = 255; // not used if n==3
-                  out += n;
-               }
-         } else {
-            uint8 *y = coutput[0];
-            if (n == 1)
-               for (i=0; i < z->s.img_x; ++i) out[i] = y[i];
-            else
-               for (i=0; i < z->s.img_x; ++i) *out++ = y[i], *out++ = 255;
-         }
-      }
-      cleanup_jpeg(z);
-      *out_x = z->s.img_x;
-      *out_y = z->s.img_y;
-      if (comp) *comp  = z->s.img_n; // report original components, not output
-      return output;
-   }
+   cleanup_jpeg(z);
+   *out_x = z->out_x;
+   *out_y = z->out_y;
+   if (comp) *comp  = z->s.img_n; // report original components, not output
+   return output;
+}
+
+static int load_jpeg_rows(jpeg *z, int scale_log2, int req_comp, stbi_row_callbacks const *callbacks)
+{
+   int r;
+   if (req_comp < 0 || req_comp > 4) return e("bad req_comp", "Internal error");
+   if (scale_log2 < 0 || scale_log2 > 3) return e("bad scale", "Internal error");
+   z->s.img_n = 0;
+   z->scale_log2 = scale_log2;
+   z->rows = callbacks;
+   z->emit = 0;
+   z->row_buf = NULL;
+
+   r = decode_jpeg_image(z, req_comp);
+   if (r && !z->img_comp[0].data) r = e("no SOS", "Corrupt JPEG");
+   // whatever the scans left over, i.e. all the rows if the image wasn't output while decoding
+   if (r) r = emit_jpeg_rows(z, z->out_y);
+
+   cleanup_jpeg(z);
+   free(z->row_buf);
+   z->row_buf = NULL;
+   return r;
 }
 
 #ifndef STBI_NO_STDIO
@@ -1845,6 +2063,32 @@ unsigned char *stbi_jpeg_load_from_memory(stbi_uc const *buffer, int len, int *x
    return load_jpeg_image(&j, x,y,comp,req_comp);
 }
 
+#ifndef STBI_NO_STDIO
+int stbi_jpeg_load_rows_from_file(FILE *f, int scale_log2, int req_comp, stbi_row_callbacks const *callbacks)
+{
+   jpeg j;
+   start_file(&j.s, f);
+   return load_jpeg_rows(&j, scale_log2, req_comp, callbacks);
+}
+
+int stbi_jpeg_load_rows(char const *filename, int scale_log2, int req_comp, stbi_row_callbacks const *callbacks)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return e("can't fopen", "Unable to open file");
+   r = stbi_jpeg_load_rows_from_file(f, scale_log2, req_comp, callbacks);
+   fclose(f);
+   return r;
+}
+#endif
+
+int stbi_jpeg_load_rows_from_memory(stbi_uc const *buffer, int len, int scale_log2, int req_comp, stbi_row_callbacks const *callbacks)
+{
+   jpeg j;
+   start_mem(&j.s, buffer,len);
+   return load_jpeg_rows(&j, scale_log2, req_comp, callbacks);
+}
+
 #ifndef STBI_NO_STDIO
 int stbi_jpeg_test_file(FILE *f)
 {
@@ -1865,12 +2109,44 @@ int stbi_jpeg_test_memory(stbi_uc const *buffer, int len)
    return decode_jpeg_header(&j, SCAN_type);
 }
 
-// @TODO:
+static int jpeg_info(jpeg *j, int *x, int *y, int *comp)
+{
+   if (!decode_jpeg_header(j, SCAN_header)) return 0;
+   if (x) *x = j->s.img_x;
+   if (y) *y = j->s.img_y;
+   if (comp) *comp = j->s.img_n;
+   return 1;
+}
+
 #ifndef STBI_NO_STDIO
-extern int      stbi_jpeg_info            (char const *filename,           int *x, int *y, int *comp);
-extern int      stbi_jpeg_info_from_file  (FILE *f,                  int *x, int *y, int *comp);
+int stbi_jpeg_info_from_file(FILE *f, int *x, int *y, int *comp)
+{
+   int n,r;
+   jpeg j;
+   n = ftell(f);
+   start_file(&j.s, f);
+   r = jpeg_info(&j, x,y,comp);
+   fseek(f,n,SEEK_SET);
+   return r;
+}
+
+int stbi_jpeg_info(char const *filename, int *x, int *y, int *comp)
+{
+   int r;
+   FILE *f = fopen(filename, "rb");
+   if (!f) return 0;
+   r = stbi_jpeg_info_from_file(f, x,y,comp);
+   fclose(f);
+   return r;
+}
 #endif
-extern int      stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp);
+
+int stbi_jpeg_info_from_memory(stbi_uc const *buffer, int len, int *x, int *y, int *comp)
+{
+   jpeg j;
+   start_mem(&j.s, buffer,len);
+   return jpeg_info(&j, x,y,comp);
+}
 
 // public domain zlib decode    v0.2  Sean Barrett 2006-11-18
 //    simple implementation